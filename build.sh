@@ -14,13 +14,29 @@ mkdir -p $LIB_DIR
 
 gcc -g -Wall -O2 \
     -fPIC -shared \
-    -fopenmp \
+    -fopenmp -pthread \
     $INC_CMD \
     $SRC_DIR/datasets/mnist.c \
+    $SRC_DIR/datasets/idx_file.c \
+    $SRC_DIR/datasets/dataset.c \
+    $SRC_DIR/datasets/shard_dataset.c \
+    $SRC_DIR/datasets/data_cache.c \
+    $SRC_DIR/datasets/augment.c \
     $SRC_DIR/datasets/data_utils.c \
+    $SRC_DIR/data_loader.c \
     $SRC_DIR/network.c \
+    $SRC_DIR/network_plan.c \
+    $SRC_DIR/graph_opt.c \
+    $SRC_DIR/model.c \
+    $SRC_DIR/data_parallel.c \
+    $SRC_DIR/pipeline_trainer.c \
+    $SRC_DIR/hogwild_trainer.c \
+    $SRC_DIR/mp_trainer.c \
+    $SRC_DIR/shm_allreduce.c \
+    $SRC_DIR/param_server.c \
     $SRC_DIR/layer.c \
     $SRC_DIR/linear_layer.c \
+    $SRC_DIR/sharded_linear_layer.c \
     $SRC_DIR/sigmoid_layer.c \
     $SRC_DIR/relu_layer.c \
     $SRC_DIR/softmax_layer.c \
@@ -29,7 +45,12 @@ gcc -g -Wall -O2 \
     $SRC_DIR/opt_alg.c \
     $SRC_DIR/tensor.c \
     $SRC_DIR/gemm.c \
+    $SRC_DIR/thread_pool.c \
+    $SRC_DIR/affinity.c \
+    $SRC_DIR/memory.c \
+    $SRC_DIR/rng.c \
     $SRC_DIR/math_utils.c \
     $SRC_DIR/io_utils.c \
     $SRC_DIR/debug_macros.c \
+    -lrt \
     -o $LIB_DIR/libnn.so
\ No newline at end of file
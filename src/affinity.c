@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "debug_macros.h"
+#include "affinity.h"
+
+#define AFFINITY_MAX_NODES (64)
+#define AFFINITY_PATH_LEN (128)
+
+struct AffinityConfig
+{
+    enum AffinityMode mode;
+    int n_cpus; // 进程可用的CPU, 升序
+    int cpus[CPU_SETSIZE];
+    int n_list; // AFFINITY_LIST的CPU列表
+    int list[CPU_SETSIZE];
+    int n_nodes;
+    int n_node_cpus[AFFINITY_MAX_NODES]; // 各节点上进程可用的CPU
+    int *node_cpus[AFFINITY_MAX_NODES];
+};
+
+static struct AffinityConfig g_config;
+static pthread_mutex_t g_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief 解析"0,2,4-7"形式的CPU列表, 与/sys/devices/system/node/node*\/cpulist格式相同
+ */
+static int parseCpuList(int *cpus, int *n, int cap, const char *str)
+{
+    *n = 0;
+    const char *p = str;
+    while (*p != '\0' && *p != '\n') {
+        char *end = NULL;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0) {
+            return ERR_COD;
+        }
+        long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            if (end == p + 1 || hi < lo) {
+                return ERR_COD;
+            }
+            p = end;
+        }
+        long c;
+        for (c = lo; c <= hi; ++c) {
+            if (*n >= cap || c >= CPU_SETSIZE) {
+                return ERR_COD;
+            }
+            cpus[(*n)++] = (int)c;
+        }
+        if (*p == ',') {
+            ++p;
+        }
+        else if (*p != '\0' && *p != '\n') {
+            return ERR_COD;
+        }
+    }
+    return (*n > 0)? SUCCESS: ERR_COD;
+}
+
+static int applyAffinitySpec(const char *spec)
+{
+    if (strcmp(spec, "none") == 0) {
+        g_config.mode = AFFINITY_NONE;
+    }
+    else if (strcmp(spec, "compact") == 0) {
+        g_config.mode = AFFINITY_COMPACT;
+    }
+    else if (strcmp(spec, "scatter") == 0) {
+        g_config.mode = AFFINITY_SCATTER;
+    }
+    else {
+        static int list[CPU_SETSIZE]; // 解析失败时保留原有列表, 调用者持有g_mtx
+        int n = 0;
+        if (parseCpuList(list, &n, CPU_SETSIZE, spec) != SUCCESS) {
+            return ERR_COD;
+        }
+        memcpy(g_config.list, list, n * sizeof(int));
+        g_config.n_list = n;
+        g_config.mode = AFFINITY_LIST;
+    }
+    return SUCCESS;
+}
+
+// 读取各NUMA节点的CPU, 只保留进程可用的; 没有/sys节点信息时视为单节点
+static void initAffinityConfig()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        int c;
+        for (c = 0; c < CPU_SETSIZE; ++c) {
+            CPU_SET(c, &allowed);
+        }
+    }
+    int c;
+    for (c = 0; c < CPU_SETSIZE; ++c) {
+        if (CPU_ISSET(c, &allowed)) {
+            g_config.cpus[g_config.n_cpus++] = c;
+        }
+    }
+
+    int node;
+    static int buf[CPU_SETSIZE];
+    for (node = 0; node < AFFINITY_MAX_NODES; ++node) {
+        char path[AFFINITY_PATH_LEN];
+        snprintf(path, AFFINITY_PATH_LEN, "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+            break;
+        }
+        char line[4096] = {0};
+        int n = 0;
+        if (fgets(line, sizeof(line), fp) && parseCpuList(buf, &n, CPU_SETSIZE, line) == SUCCESS) {
+            int i, k = 0;
+            g_config.node_cpus[node] = calloc(n, sizeof(int));
+            for (i = 0; g_config.node_cpus[node] && i < n; ++i) {
+                if (CPU_ISSET(buf[i], &allowed)) {
+                    g_config.node_cpus[node][k++] = buf[i];
+                }
+            }
+            g_config.n_node_cpus[node] = k;
+        }
+        fclose(fp);
+    }
+    g_config.n_nodes = node;
+    if (g_config.n_nodes == 0) {
+        g_config.n_nodes = 1;
+        g_config.node_cpus[0] = g_config.cpus;
+        g_config.n_node_cpus[0] = g_config.n_cpus;
+    }
+
+    const char *env = getenv("NN_AFFINITY");
+    g_config.mode = AFFINITY_NONE;
+    if (env && applyAffinitySpec(env) != SUCCESS) {
+        ERR_MSG("NN_AFFINITY=%s is invalid, ignored.\n", env);
+    }
+}
+
+int setAffinity(const char *spec)
+{
+    CHK_NIL(spec);
+    pthread_once(&g_once, initAffinityConfig);
+
+    pthread_mutex_lock(&g_mtx);
+    int res = applyAffinitySpec(spec);
+    pthread_mutex_unlock(&g_mtx);
+    if (res != SUCCESS) {
+        ERR_MSG("affinity spec: %s not supported, error.\n", spec);
+    }
+    return res;
+}
+
+int getAffinityMode(enum AffinityMode *mode)
+{
+    CHK_NIL(mode);
+    pthread_once(&g_once, initAffinityConfig);
+
+    pthread_mutex_lock(&g_mtx);
+    *mode = g_config.mode;
+    pthread_mutex_unlock(&g_mtx);
+    return SUCCESS;
+}
+
+int getNumaNodeNumber(int *n_nodes)
+{
+    CHK_NIL(n_nodes);
+    pthread_once(&g_once, initAffinityConfig);
+
+    *n_nodes = g_config.n_nodes;
+    return SUCCESS;
+}
+
+// cpus平均分为n组, 第idx组加入set; CPU少于组数时多个组共用一个CPU
+static void addCpuGroup(cpu_set_t *set, const int *cpus, int n_cpus, int idx, int n)
+{
+    int per = n_cpus / n;
+    if (per < 1) {
+        per = 1;
+    }
+    int c;
+    for (c = 0; c < per; ++c) {
+        CPU_SET(cpus[(idx * per + c) % n_cpus], set);
+    }
+}
+
+int bindThreadToCpus(pthread_t tid, int idx, int n_threads)
+{
+    CHK_ERR((idx >= 0 && idx < n_threads)? 0: 1);
+    pthread_once(&g_once, initAffinityConfig);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    pthread_mutex_lock(&g_mtx);
+    switch (g_config.mode) {
+        case AFFINITY_LIST:
+        addCpuGroup(&set, g_config.list, g_config.n_list, idx, n_threads);
+        break;
+
+        case AFFINITY_SCATTER: {
+            // 第idx个线程分到idx % n_nodes号节点, 是该节点上的第idx / n_nodes个线程
+            int n_nodes = g_config.n_nodes;
+            int node = idx % n_nodes;
+            int n_on_node = n_threads / n_nodes + ((node < n_threads % n_nodes)? 1: 0);
+            if (g_config.n_node_cpus[node] > 0) {
+                addCpuGroup(&set, g_config.node_cpus[node], g_config.n_node_cpus[node], idx / n_nodes, n_on_node);
+                break;
+            }
+            addCpuGroup(&set, g_config.cpus, g_config.n_cpus, idx, n_threads); // 节点上没有可用CPU
+            break;
+        }
+
+        default: // AFFINITY_NONE, AFFINITY_COMPACT
+        addCpuGroup(&set, g_config.cpus, g_config.n_cpus, idx, n_threads);
+        break;
+    }
+    pthread_mutex_unlock(&g_mtx);
+
+    if (pthread_setaffinity_np(tid, sizeof(set), &set) != 0) {
+        ERR_MSG("thread %d/%d: pin cpu failed, continue without pinning.\n", idx, n_threads);
+    }
+    return SUCCESS;
+}
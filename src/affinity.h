@@ -0,0 +1,27 @@
+/**
+ * @brief 库内线程(线程池后台线程, 流水线段线程, 分片线程)的CPU绑定配置.
+ *        配置串: "none"(不绑定), "compact"(可用CPU按顺序平均分组, 第i个线程绑定第i组),
+ *        "scatter"(线程轮流分配到各NUMA节点, 节点内再平均分组), 或CPU列表如"0,2,4-7"(按列表顺序分组).
+ *        首次使用时从环境变量NN_AFFINITY读取, 未设置时为"none"; 单节点机器上scatter与compact相同.
+ */
+#pragma once
+
+#include <pthread.h>
+
+enum AffinityMode
+{
+    AFFINITY_NONE,
+    AFFINITY_COMPACT,
+    AFFINITY_SCATTER,
+    AFFINITY_LIST
+};
+
+int setAffinity(const char *spec);
+int getAffinityMode(enum AffinityMode *mode);
+int getNumaNodeNumber(int *n_nodes);
+
+/**
+ * @brief 把tid绑定到n_threads个库内线程中第idx个线程对应的CPU组;
+ *        配置为none时按compact绑定(调用者已明确要求绑定). 绑定失败只打印错误, 不影响运行
+ */
+int bindThreadToCpus(pthread_t tid, int idx, int n_threads);
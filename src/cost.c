@@ -33,6 +33,41 @@ char *getCostTypeStrFromEnum(enum CostType type)
     return "unknow_layer";
 }
 
+int createCostReplica(struct Cost **dst, const struct Cost *src)
+{
+    CHK_NIL(dst);
+    CHK_NIL(src);
+
+    switch (src->type)  {
+        case CE_COST_TYPE:
+        CHK_ERR(createCECost((struct CECost **)dst, src->name, src->n_input));
+        break;
+
+        default:
+        ERR_MSG("Unknow cost type: %s, error.\n", getCostTypeStrFromEnum(src->type));
+        return ERR_COD;
+    }
+    (*dst)->idx = src->idx;
+    return SUCCESS;
+}
+
+void destroyCost(struct Cost *cost)
+{
+    if (cost == NULL) {
+        return;
+    }
+
+    switch (cost->type)  {
+        case CE_COST_TYPE:
+        destroyCECost((struct CECost *)cost);
+        break;
+
+        default:
+        ERR_MSG("Unknow cost type: %s, error.\n", getCostTypeStrFromEnum(cost->type));
+        break;
+    }
+}
+
 int getCostInputNumber(int *n_in, const struct Cost *cost)
 {
     CHK_NIL(n_in);
@@ -24,6 +24,9 @@ struct Cost
     struct Tensor *delta;
 };
 
+int createCostReplica(struct Cost **dst, const struct Cost *src);
+void destroyCost(struct Cost *cost);
+
 int getCostInputNumber(int *n_in, const struct Cost *cost);
 int getCostValue(float *val, const struct Cost *cost);
 int getCostGroundTruthAttributes(int *n_features, enum DType *dtype, const struct Cost *cost);
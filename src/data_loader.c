@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "debug_macros.h"
+#include "memory.h"
+#include "thread_pool.h"
+#include "data_loader.h"
+
+#define ALIGN_UP(x) (((x) + DATA_LOADER_ALIGN - 1) / DATA_LOADER_ALIGN * DATA_LOADER_ALIGN)
+
+enum SlotState
+{
+    SLOT_FREE,
+    SLOT_FILLING,
+    SLOT_READY
+};
+
+struct LoaderSlot
+{
+    char *data;
+    char *label;
+    int n_samples;
+    enum SlotState state;
+};
+
+struct LoaderWorker
+{
+    pthread_t tid;
+    struct DataLoader *loader;
+};
+
+struct DataLoader
+{
+    DataLoaderFillFunc fill;
+    void *user_data;
+    int n_batches;
+    int n_slots;
+    int n_workers;
+    int n_started;
+
+    char *ring; // allocBlob分配的原始地址, 槽位从其中第一个对齐的地址开始
+    size_t ring_bytes;
+    struct LoaderSlot *slots;
+    struct LoaderWorker *workers;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cond_ready; // 有槽位生产完成
+    pthread_cond_t cond_free; // 有槽位被训练线程释放
+    long next_fill; // 下一个待生产的全局序号
+    long next_read; // 下一个待取出的全局序号
+    long n_released; // 序号小于n_released的槽位已释放, 序号s可以生产的条件是s < n_released + n_slots
+    int at_end; // 本epoch的结束标记已经返回
+    int stop;
+    int status;
+
+    long n_delivered;
+    long n_stalls;
+    double stall_time;
+};
+
+static void *runLoaderThread(void *arg)
+{
+    struct LoaderWorker *worker = arg;
+    struct DataLoader *loader = worker->loader;
+    setParallelForInline(1);
+
+    pthread_mutex_lock(&(loader->mtx));
+    while (1) {
+        while (!loader->stop && loader->next_fill >= loader->n_released + loader->n_slots) {
+            pthread_cond_wait(&(loader->cond_free), &(loader->mtx));
+        }
+        if (loader->stop) {
+            break;
+        }
+        long seq = loader->next_fill++;
+        struct LoaderSlot *slot = &(loader->slots[seq % loader->n_slots]);
+        slot->state = SLOT_FILLING;
+        pthread_mutex_unlock(&(loader->mtx));
+
+        int n_samples = 0;
+        int res = loader->fill(slot->data, slot->label, &n_samples,
+            (int)(seq / loader->n_batches), (int)(seq % loader->n_batches), loader->user_data);
+
+        pthread_mutex_lock(&(loader->mtx));
+        if (res != SUCCESS) {
+            ERR_MSG("data loader fill failed, epoch = %ld, batch = %ld, error.\n", seq / loader->n_batches, seq % loader->n_batches);
+            loader->status = ERR_COD;
+            loader->stop = 1;
+            pthread_cond_broadcast(&(loader->cond_free));
+        }
+        slot->n_samples = n_samples;
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&(loader->cond_ready));
+    }
+    pthread_mutex_unlock(&(loader->mtx));
+    return NULL;
+}
+
+static void stopLoaderThreads(struct DataLoader *loader)
+{
+    pthread_mutex_lock(&(loader->mtx));
+    loader->stop = 1;
+    pthread_cond_broadcast(&(loader->cond_free));
+    pthread_cond_broadcast(&(loader->cond_ready));
+    pthread_mutex_unlock(&(loader->mtx));
+
+    int i;
+    for (i = 0; i < loader->n_started; ++i) {
+        pthread_join(loader->workers[i].tid, NULL);
+    }
+    loader->n_started = 0;
+}
+
+void destroyDataLoader(struct DataLoader *loader)
+{
+    if (loader) {
+        stopLoaderThreads(loader);
+        pthread_mutex_destroy(&(loader->mtx));
+        pthread_cond_destroy(&(loader->cond_ready));
+        pthread_cond_destroy(&(loader->cond_free));
+        freeBlob(loader->ring, loader->ring_bytes);
+        free(loader->slots);
+        free(loader->workers);
+        free(loader);
+    }
+}
+
+int createDataLoader(struct DataLoader **loader, DataLoaderFillFunc fill, void *user_data, int n_batches,
+    size_t data_bytes, size_t label_bytes, int n_slots, int n_workers)
+{
+    CHK_NIL(loader);
+    CHK_NIL(fill);
+    CHK_ERR((n_batches > 0)? 0: 1);
+    CHK_ERR((data_bytes > 0)? 0: 1);
+    CHK_ERR((n_slots >= 2)? 0: 1);
+    CHK_ERR((n_workers > 0)? 0: 1);
+
+    struct DataLoader *l = calloc(1, sizeof(struct DataLoader));
+    CHK_NIL(l);
+    l->fill = fill;
+    l->user_data = user_data;
+    l->n_batches = n_batches;
+    l->n_slots = n_slots;
+    l->n_workers = n_workers;
+    pthread_mutex_init(&(l->mtx), NULL);
+    pthread_cond_init(&(l->cond_ready), NULL);
+    pthread_cond_init(&(l->cond_free), NULL);
+
+    // 所有槽位放在一块连续内存中, 大于MEM_LARGE_SIZE时由allocBlob按大页分配
+    size_t slot_bytes = ALIGN_UP(data_bytes) + ALIGN_UP(label_bytes);
+    l->ring_bytes = slot_bytes * n_slots + DATA_LOADER_ALIGN;
+    l->ring = allocBlob(l->ring_bytes);
+    if (l->ring == NULL) {
+        ERR_MSG("allocBlob failed, error.\n");
+        goto err_end;
+    }
+    l->slots = calloc(n_slots, sizeof(struct LoaderSlot));
+    l->workers = calloc(n_workers, sizeof(struct LoaderWorker));
+    if (l->slots == NULL || l->workers == NULL) {
+        ERR_MSG("calloc failed, error.\n");
+        goto err_end;
+    }
+    char *base = (char *)ALIGN_UP((uintptr_t)l->ring);
+    int i;
+    for (i = 0; i < n_slots; ++i) {
+        l->slots[i].data = base + slot_bytes * i;
+        l->slots[i].label = l->slots[i].data + ALIGN_UP(data_bytes);
+        l->slots[i].state = SLOT_FREE;
+    }
+
+    for (i = 0; i < n_workers; ++i) {
+        l->workers[i].loader = l;
+        if (pthread_create(&(l->workers[i].tid), NULL, runLoaderThread, &(l->workers[i])) != 0) {
+            ERR_MSG("pthread_create() failed, error.\n");
+            goto err_end;
+        }
+        ++(l->n_started);
+    }
+
+    *loader = l;
+    return SUCCESS;
+
+err_end:
+    destroyDataLoader(l);
+    return ERR_COD;
+}
+
+int getDataLoaderNextBatch(const void *(*data), const void *(*label), int *n_samples, struct DataLoader *loader)
+{
+    CHK_NIL(data);
+    CHK_NIL(label);
+    CHK_NIL(n_samples);
+    CHK_NIL(loader);
+
+    pthread_mutex_lock(&(loader->mtx));
+    // 释放上一次返回的槽位
+    if (loader->n_released < loader->next_read) {
+        loader->slots[loader->n_released % loader->n_slots].state = SLOT_FREE;
+        ++(loader->n_released);
+        pthread_cond_broadcast(&(loader->cond_free));
+    }
+
+    if (loader->next_read > 0 && loader->next_read % loader->n_batches == 0 && !loader->at_end) {
+        loader->at_end = 1;
+        pthread_mutex_unlock(&(loader->mtx));
+        *data = NULL;
+        *label = NULL;
+        *n_samples = 0;
+        return SUCCESS;
+    }
+
+    struct LoaderSlot *slot = &(loader->slots[loader->next_read % loader->n_slots]);
+    if (slot->state != SLOT_READY && loader->status == SUCCESS) {
+        struct timeval t0, t1, t2;
+        gettimeofday(&t0, NULL);
+        while (slot->state != SLOT_READY && loader->status == SUCCESS) {
+            pthread_cond_wait(&(loader->cond_ready), &(loader->mtx));
+        }
+        gettimeofday(&t1, NULL);
+        timersub(&t1, &t0, &t2);
+        ++(loader->n_stalls);
+        loader->stall_time += t2.tv_sec + t2.tv_usec / 1e6;
+    }
+    if (loader->status != SUCCESS) {
+        pthread_mutex_unlock(&(loader->mtx));
+        ERR_MSG("data loader stopped by a failed fill, error.\n");
+        return ERR_COD;
+    }
+
+    ++(loader->next_read);
+    loader->at_end = 0;
+    ++(loader->n_delivered);
+    *data = slot->data;
+    *label = slot->label;
+    *n_samples = slot->n_samples;
+    pthread_mutex_unlock(&(loader->mtx));
+    return SUCCESS;
+}
+
+int getDataLoaderStats(long *n_batches, long *n_stalls, double *stall_time, const struct DataLoader *loader)
+{
+    CHK_NIL(n_batches);
+    CHK_NIL(n_stalls);
+    CHK_NIL(stall_time);
+    CHK_NIL(loader);
+
+    pthread_mutex_lock((pthread_mutex_t *)&(loader->mtx));
+    *n_batches = loader->n_delivered;
+    *n_stalls = loader->n_stalls;
+    *stall_time = loader->stall_time;
+    pthread_mutex_unlock((pthread_mutex_t *)&(loader->mtx));
+    return SUCCESS;
+}
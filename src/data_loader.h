@@ -0,0 +1,37 @@
+/**
+ * @brief 后台预取的数据加载器: n_workers个生产者线程通过回调把batch写入一个有n_slots个槽位的环形缓冲区,
+ *        训练线程按序号顺序取出已经准备好的batch, 取batch与前向/反向计算重叠.
+ *        每个槽位包含data和label两块缓冲区, 起始地址按DATA_LOADER_ALIGN对齐.
+ *
+ *        batch按全局序号s依次生产, 对应第s / n_batches个epoch的第s % n_batches个batch, 生产者可以越过epoch边界提前生产.
+ *        每个epoch的n_batches个batch取完后, 下一次getDataLoaderNextBatch返回*data为NULL, 表示epoch结束(用法同getMnistNthBatch).
+ *        getDataLoaderNextBatch返回的缓冲区在下一次调用之前有效, 因此n_slots至少为2(双缓冲).
+ *
+ *        生产者线程中的parallelFor直接在本线程上执行, 预处理不占用训练使用的线程池.
+ *        训练线程等待batch的次数和时间计入统计, 等待时间占比高说明训练受限于数据输入.
+ */
+#pragma once
+
+#include <stddef.h>
+
+#define DATA_LOADER_ALIGN (64)
+
+/**
+ * @brief 生产batch的回调, 由多个生产者线程并发调用, 每次调用的(epoch, batch_idx)不同.
+ *        把第epoch轮的第batch_idx个batch写入data和label(容量为创建时指定的字节数), *n_samples返回样本数.
+ */
+typedef int (*DataLoaderFillFunc)(void *data, void *label, int *n_samples, int epoch, int batch_idx, void *user_data);
+
+struct DataLoader;
+
+int createDataLoader(struct DataLoader **loader, DataLoaderFillFunc fill, void *user_data, int n_batches,
+    size_t data_bytes, size_t label_bytes, int n_slots, int n_workers);
+void destroyDataLoader(struct DataLoader *loader);
+
+/**
+ * @brief 取下一个batch, 尚未准备好时阻塞等待. 回调出错时返回ERR_COD, 之后的调用都返回ERR_COD
+ */
+int getDataLoaderNextBatch(const void *(*data), const void *(*label), int *n_samples, struct DataLoader *loader);
+
+// 已取出的batch数, 其中需要等待的次数, 以及累计等待时间(秒)
+int getDataLoaderStats(long *n_batches, long *n_stalls, double *stall_time, const struct DataLoader *loader);
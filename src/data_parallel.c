@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug_macros.h"
+#include "tensor.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "network.h"
+#include "data_parallel.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "thread_pool.h"
+
+// 归约时每次处理的float个数(16KB), 保证两个操作数块同时驻留L1
+#define DP_REDUCE_BLOCK (4096)
+
+struct DataParallelTrainer
+{
+    int n_threads;
+    int n_layers;
+    int n_classes;
+    struct Layer **master_layers; // 不负责释放
+    struct Cost *master_cost; // 不负责释放
+
+    // 每个线程一份副本, 下标为线程号
+    struct Layer ***layers;
+    struct Cost **costs;
+    struct Network **nets;
+    struct Probe *probes;
+    int p_class_cap; // 副本探针p_class缓冲区可容纳的样本数
+
+    // 梯度按线性层顺序展开为若干段: w_grad, b_grad, w_grad, b_grad...
+    int n_segs;
+    int *seg_len;
+    int *seg_is_bias;
+    float ***segs; // segs[t][s]
+    float **master_segs;
+    long n_params;
+
+    struct ThreadPool *pool;
+    int stride; // 当前归约轮次的步长
+
+    // 当前step的参数, 由调用线程在提交任务前写入
+    const char *input;
+    const char *gt;
+    int n_features;
+    int n_gt_features;
+    const char *dtype_str;
+    const char *gt_dtype_str;
+    size_t in_row_bytes;
+    size_t gt_row_bytes;
+    int n_samples;
+    struct UpdateArgs args_rep;
+    struct Probe *probe;
+    int *starts;
+    int *counts;
+    float *ce;
+    int *status;
+};
+
+// dst[lo, hi) += src[lo, hi), 区间是所有梯度段展开后的下标
+static void addSegmentsRange(struct DataParallelTrainer *trainer, float **dst, float **src, long lo, long hi)
+{
+    long base = 0;
+    int s;
+    for (s = 0; s < trainer->n_segs && base < hi; ++s) {
+        long seg_lo = (lo > base)? lo - base: 0;
+        long seg_hi = (hi < base + trainer->seg_len[s])? hi - base: trainer->seg_len[s];
+        long i, j;
+        for (i = seg_lo; i < seg_hi; i += DP_REDUCE_BLOCK) {
+            long end = (i + DP_REDUCE_BLOCK < seg_hi)? i + DP_REDUCE_BLOCK: seg_hi;
+            float *d = dst[s];
+            const float *x = src[s];
+            for (j = i; j < end; ++j) {
+                d[j] += x[j];
+            }
+        }
+        base += trainer->seg_len[s];
+    }
+}
+
+// 主层梯度合并: w_grad累加(保留动量项, 与linearTensorWeightGradient一致), b_grad覆盖(与linearTensorBiasGradient一致)
+static void mergeSegmentsRange(struct DataParallelTrainer *trainer, float **master, float **src, long lo, long hi)
+{
+    long base = 0;
+    int s;
+    for (s = 0; s < trainer->n_segs && base < hi; ++s) {
+        long seg_lo = (lo > base)? lo - base: 0;
+        long seg_hi = (hi < base + trainer->seg_len[s])? hi - base: trainer->seg_len[s];
+        if (seg_lo < seg_hi) {
+            if (trainer->seg_is_bias[s]) {
+                memcpy(master[s] + seg_lo, src[s] + seg_lo, (seg_hi - seg_lo) * sizeof(float));
+            }
+            else {
+                long j;
+                for (j = seg_lo; j < seg_hi; ++j) {
+                    master[s][j] += src[s][j];
+                }
+            }
+        }
+        base += trainer->seg_len[s];
+    }
+}
+
+static void getChunk(long *lo, long *hi, long n, int k, int n_chunks)
+{
+    long size = (n + n_chunks - 1) / n_chunks;
+    *lo = size * k;
+    *hi = *lo + size;
+    if (*lo > n) *lo = n;
+    if (*hi > n) *hi = n;
+}
+
+static int runReplicaBatch(struct DataParallelTrainer *trainer, int t)
+{
+    int count = trainer->counts[t];
+    int s;
+    if (count == 0) { // 线程数多于样本数时, 空闲线程的梯度清零后参与归约
+        for (s = 0; s < trainer->n_segs; ++s) {
+            memset(trainer->segs[t][s], 0, trainer->seg_len[s] * sizeof(float));
+        }
+        trainer->ce[t] = 0.;
+        return SUCCESS;
+    }
+
+    // 副本的w_grad由gemm累加, 每个step开始时清零
+    for (s = 0; s < trainer->n_segs; ++s) {
+        if (!trainer->seg_is_bias[s]) {
+            memset(trainer->segs[t][s], 0, trainer->seg_len[s] * sizeof(float));
+        }
+    }
+
+    int start = trainer->starts[t];
+    struct Probe *probe = &(trainer->probes[t]);
+    CHK_ERR(forwardNetwork(trainer->nets[t], trainer->input + start * trainer->in_row_bytes, count,
+        trainer->n_features, trainer->dtype_str, &(trainer->args_rep), probe));
+    CHK_ERR(backwardNetwork(trainer->nets[t], trainer->gt + start * trainer->gt_row_bytes, count,
+        trainer->n_gt_features, trainer->gt_dtype_str, &(trainer->args_rep), probe));
+
+    // 代价函数按子batch样本数平均, 这里换算为按整个batch平均
+    float scale = (float)count / trainer->n_samples;
+    for (s = 0; s < trainer->n_segs; ++s) {
+        float *g = trainer->segs[t][s];
+        int i;
+        for (i = 0; i < trainer->seg_len[s]; ++i) {
+            g[i] *= scale;
+        }
+    }
+
+    trainer->ce[t] = probe->ce_cost;
+    if (trainer->probe->sw_p_class) {
+        memcpy(trainer->probe->p_class + (size_t)start * trainer->n_classes, probe->p_class, (size_t)count * trainer->n_classes * sizeof(float));
+    }
+    return SUCCESS;
+}
+
+// 以下三个阶段各由一次parallelFor完成, 区间下标为副本号, 阶段之间的同步由parallelFor返回保证
+static void runReplicaRange(void *arg, int lo, int hi)
+{
+    struct DataParallelTrainer *trainer = arg;
+    int t;
+    for (t = lo; t < hi; ++t) {
+        trainer->status[t] = runReplicaBatch(trainer, t);
+    }
+}
+
+// 树形归约的一轮: [base, base + 2 * stride)内的副本共同把副本base + stride加到副本base上, 每个副本负责一段连续区间
+static void reduceReplicaRange(void *arg, int lo, int hi)
+{
+    struct DataParallelTrainer *trainer = arg;
+    int n_threads = trainer->n_threads;
+    int stride = trainer->stride;
+    int t;
+    for (t = lo; t < hi; ++t) {
+        int base = t - t % (2 * stride);
+        if (base + stride < n_threads) {
+            int n_group = (base + 2 * stride < n_threads)? 2 * stride: n_threads - base;
+            long lo_p, hi_p;
+            getChunk(&lo_p, &hi_p, trainer->n_params, t - base, n_group);
+            addSegmentsRange(trainer, trainer->segs[base], trainer->segs[base + stride], lo_p, hi_p);
+        }
+    }
+}
+
+static void mergeReplicaRange(void *arg, int lo, int hi)
+{
+    struct DataParallelTrainer *trainer = arg;
+    int t;
+    for (t = lo; t < hi; ++t) {
+        long lo_p, hi_p;
+        getChunk(&lo_p, &hi_p, trainer->n_params, t, trainer->n_threads);
+        mergeSegmentsRange(trainer, trainer->master_segs, trainer->segs[0], lo_p, hi_p);
+    }
+}
+
+static int runDataParallelStep(struct DataParallelTrainer *trainer)
+{
+    int n_threads = trainer->n_threads;
+    long cost = trainer->n_params; // 每个副本的计算量与参数个数成正比
+
+    CHK_ERR(parallelFor(trainer->pool, 0, n_threads, cost * trainer->args_rep.batch_size, runReplicaRange, trainer));
+    for (trainer->stride = 1; trainer->stride < n_threads; trainer->stride *= 2) {
+        CHK_ERR(parallelFor(trainer->pool, 0, n_threads, cost / n_threads, reduceReplicaRange, trainer));
+    }
+    CHK_ERR(parallelFor(trainer->pool, 0, n_threads, cost / n_threads, mergeReplicaRange, trainer));
+    return SUCCESS;
+}
+
+static int initGradientSegments(struct DataParallelTrainer *trainer)
+{
+    int n_threads = trainer->n_threads;
+    int i, t;
+
+    int n_segs = 0;
+    for (i = 0; i < trainer->n_layers; ++i) {
+        if (trainer->master_layers[i]->type == LINEAR_LAYER_TYPE) {
+            n_segs += 2;
+        }
+    }
+    trainer->n_segs = n_segs;
+    CHK_NIL((trainer->seg_len = calloc(n_segs + 1, sizeof(int))));
+    CHK_NIL((trainer->seg_is_bias = calloc(n_segs + 1, sizeof(int))));
+    CHK_NIL((trainer->master_segs = calloc(n_segs + 1, sizeof(float *))));
+    CHK_NIL((trainer->segs = calloc(n_threads, sizeof(float **))));
+    for (t = 0; t < n_threads; ++t) {
+        CHK_NIL((trainer->segs[t] = calloc(n_segs + 1, sizeof(float *))));
+    }
+
+    int s = 0;
+    for (i = 0; i < trainer->n_layers; ++i) {
+        if (trainer->master_layers[i]->type != LINEAR_LAYER_TYPE) {
+            continue;
+        }
+        struct Tensor *w_grad = NULL;
+        struct Tensor *b_grad = NULL;
+        int row, col;
+        void *blob = NULL;
+
+        CHK_ERR(getLinearLayerGradientRef(&w_grad, &b_grad, (struct LinearLayer *)(trainer->master_layers[i])));
+        CHK_ERR(getTensorRowAndCol(&row, &col, w_grad));
+        trainer->seg_len[s] = row * col;
+        trainer->seg_len[s + 1] = row;
+        trainer->seg_is_bias[s + 1] = 1;
+        CHK_ERR(getTensorBlob(&blob, w_grad));
+        trainer->master_segs[s] = blob;
+        CHK_ERR(getTensorBlob(&blob, b_grad));
+        trainer->master_segs[s + 1] = blob;
+
+        for (t = 0; t < n_threads; ++t) {
+            CHK_ERR(getLinearLayerGradientRef(&w_grad, &b_grad, (struct LinearLayer *)(trainer->layers[t][i])));
+            CHK_ERR(getTensorBlob(&blob, w_grad));
+            trainer->segs[t][s] = blob;
+            CHK_ERR(getTensorBlob(&blob, b_grad));
+            trainer->segs[t][s + 1] = blob;
+        }
+        trainer->n_params += trainer->seg_len[s] + trainer->seg_len[s + 1];
+        s += 2;
+    }
+    return SUCCESS;
+}
+
+int createDataParallelTrainer(struct DataParallelTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost, int n_threads)
+{
+    CHK_NIL(trainer);
+    CHK_NIL(layers);
+    CHK_ERR((n_layers > 0)? 0: 1);
+    CHK_NIL(cost);
+    CHK_ERR((n_threads > 0)? 0: 1);
+
+    struct DataParallelTrainer *res = calloc(1, sizeof(struct DataParallelTrainer));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    res->n_threads = n_threads;
+    res->n_layers = n_layers;
+    res->master_layers = layers;
+    res->master_cost = cost;
+    CHK_ERR_GOTO(getCostInputNumber(&(res->n_classes), cost));
+
+    CHK_NIL_GOTO((res->layers = calloc(n_threads, sizeof(struct Layer **))));
+    CHK_NIL_GOTO((res->costs = calloc(n_threads, sizeof(struct Cost *))));
+    CHK_NIL_GOTO((res->nets = calloc(n_threads, sizeof(struct Network *))));
+    CHK_NIL_GOTO((res->probes = calloc(n_threads, sizeof(struct Probe))));
+    CHK_NIL_GOTO((res->starts = calloc(n_threads, sizeof(int))));
+    CHK_NIL_GOTO((res->counts = calloc(n_threads, sizeof(int))));
+    CHK_NIL_GOTO((res->ce = calloc(n_threads, sizeof(float))));
+    CHK_NIL_GOTO((res->status = calloc(n_threads, sizeof(int))));
+    CHK_ERR_GOTO(getDefaultThreadPool(&(res->pool)));
+
+    int t, i;
+    for (t = 0; t < n_threads; ++t) {
+        CHK_NIL_GOTO((res->layers[t] = calloc(n_layers, sizeof(struct Layer *))));
+        for (i = 0; i < n_layers; ++i) {
+            CHK_ERR_GOTO(createLayerReplica(&(res->layers[t][i]), layers[i]));
+        }
+        CHK_ERR_GOTO(createCostReplica(&(res->costs[t]), cost));
+        CHK_ERR_GOTO(createNetwork(&(res->nets[t]), res->layers[t], n_layers, res->costs[t]));
+        res->probes[t].sw_ce_cost = 1;
+    }
+    CHK_ERR_GOTO(initGradientSegments(res));
+
+    *trainer = res;
+    return SUCCESS;
+
+err_end:
+    destroyDataParallelTrainer(res);
+    return ERR_COD;
+}
+
+void destroyDataParallelTrainer(struct DataParallelTrainer *trainer)
+{
+    if (trainer == NULL) {
+        return;
+    }
+
+    int t, i;
+    for (t = 0; t < trainer->n_threads; ++t) {
+        if (trainer->nets) {
+            destroyNetwork(trainer->nets[t]);
+        }
+        if (trainer->costs) {
+            destroyCost(trainer->costs[t]);
+        }
+        if (trainer->layers && trainer->layers[t]) {
+            for (i = 0; i < trainer->n_layers; ++i) {
+                destroyLayer(trainer->layers[t][i]);
+            }
+            free(trainer->layers[t]);
+        }
+        if (trainer->probes) {
+            free(trainer->probes[t].p_class);
+        }
+        if (trainer->segs) {
+            free(trainer->segs[t]);
+        }
+    }
+    free(trainer->layers);
+    free(trainer->costs);
+    free(trainer->nets);
+    free(trainer->probes);
+    free(trainer->segs);
+    free(trainer->seg_len);
+    free(trainer->seg_is_bias);
+    free(trainer->master_segs);
+    free(trainer->starts);
+    free(trainer->counts);
+    free(trainer->ce);
+    free(trainer->status);
+    free(trainer);
+}
+
+int trainDataParallelBatch(struct DataParallelTrainer *trainer,
+    const void *input_data, int n_features, const char *dtype_str,
+    const void *gt_data, int n_gt_features, const char *gt_dtype_str,
+    int n_samples, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(trainer);
+    CHK_NIL(input_data);
+    CHK_NIL(gt_data);
+    CHK_NIL(dtype_str);
+    CHK_NIL(gt_dtype_str);
+    CHK_NIL(probe);
+    CHK_ERR(checkUpdateArgs(args));
+    CHK_ERR((n_samples > 0 && n_samples <= args->batch_size)? 0: 1);
+
+    int n_threads = trainer->n_threads;
+    int in_size, gt_size;
+    CHK_ERR(getTensorDtypeSize(&in_size, getTensorDtypeEnumFromStr(dtype_str)));
+    CHK_ERR(getTensorDtypeSize(&gt_size, getTensorDtypeEnumFromStr(gt_dtype_str)));
+
+    // 每个副本的缓冲区按ceil(batch_size / n_threads)分配
+    trainer->args_rep = *args;
+    trainer->args_rep.batch_size = (args->batch_size + n_threads - 1) / n_threads;
+    int t;
+    if (probe->sw_p_class && trainer->p_class_cap < trainer->args_rep.batch_size) {
+        for (t = 0; t < n_threads; ++t) {
+            free(trainer->probes[t].p_class);
+            CHK_NIL((trainer->probes[t].p_class = calloc((size_t)trainer->args_rep.batch_size * trainer->n_classes, sizeof(float))));
+        }
+        trainer->p_class_cap = trainer->args_rep.batch_size;
+    }
+    for (t = 0; t < n_threads; ++t) {
+        trainer->probes[t].sw_p_class = probe->sw_p_class;
+    }
+
+    int base = n_samples / n_threads;
+    int rem = n_samples % n_threads;
+    int start = 0;
+    for (t = 0; t < n_threads; ++t) {
+        trainer->starts[t] = start;
+        trainer->counts[t] = base + ((t < rem)? 1: 0);
+        start += trainer->counts[t];
+    }
+    trainer->input = input_data;
+    trainer->gt = gt_data;
+    trainer->n_features = n_features;
+    trainer->n_gt_features = n_gt_features;
+    trainer->dtype_str = dtype_str;
+    trainer->gt_dtype_str = gt_dtype_str;
+    trainer->in_row_bytes = (size_t)n_features * in_size;
+    trainer->gt_row_bytes = (size_t)n_gt_features * gt_size;
+    trainer->n_samples = n_samples;
+    trainer->probe = probe;
+
+    CHK_ERR(runDataParallelStep(trainer));
+
+    float ce = 0.;
+    for (t = 0; t < n_threads; ++t) {
+        CHK_ERR(trainer->status[t]);
+        ce += trainer->ce[t] * trainer->counts[t];
+    }
+    if (probe->sw_ce_cost) {
+        probe->ce_cost = ce / n_samples;
+    }
+
+    int i;
+    for (i = trainer->n_layers - 1; i >= 0; --i) {
+        CHK_ERR(updateLayer(trainer->master_layers[i], args, probe));
+    }
+    return SUCCESS;
+}
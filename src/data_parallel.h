@@ -0,0 +1,22 @@
+/**
+ * @brief 数据并行训练: 每个batch按样本切分为n_threads份, 每份由一个共享参数的副本网络计算,
+ *        副本拥有独立的输出/灵敏度缓冲区和梯度缓冲区; 反向传播结束后各副本梯度经树形归约合并到主层,
+ *        最后在主层上执行一次参数更新. 结果与单线程训练一致(仅浮点加法结合顺序不同).
+ *        副本计算和归约作为默认线程池(thread_pool.h)的任务执行, 副本内部的gemm等算子在同一个池中嵌套并行.
+ */
+#pragma once
+
+#include "layer.h"
+#include "cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+struct DataParallelTrainer;
+
+int createDataParallelTrainer(struct DataParallelTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost, int n_threads);
+void destroyDataParallelTrainer(struct DataParallelTrainer *trainer);
+
+int trainDataParallelBatch(struct DataParallelTrainer *trainer,
+    const void *input_data, int n_features, const char *dtype_str,
+    const void *gt_data, int n_gt_features, const char *gt_dtype_str,
+    int n_samples, const struct UpdateArgs *args, struct Probe *probe);
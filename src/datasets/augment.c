@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "debug_macros.h"
+#include "thread_pool.h"
+#include "rng.h"
+#include "augment.h"
+
+#define AUG_N_PARAMS (3) // 每个样本: 水平平移, 竖直平移, 旋转角度
+#define AUG_PI (3.14159265358979323846)
+#define AUG_MAX_SIGMA (16.f)
+
+struct Augmenter
+{
+    struct AugmentConfig cfg;
+    int is_uint8;
+    uint64_t seed;
+    int geometric; // 需要双线性插值(旋转或弹性形变)
+    int radius; // 高斯核半径
+    float *kernel; // 2 * radius + 1个权重, 和为1
+
+    DataLoaderFillFunc fill;
+    void *user_data;
+};
+
+struct AugmentArgs
+{
+    const struct Augmenter *aug;
+    char *data;
+    const float *params; // 每个样本AUG_N_PARAMS个
+    const float *fields; // 每个样本2 * height * width个[-1, 1)上的均匀随机数, 不使用弹性形变时为NULL
+    const float *noise; // 每个样本height * width个, 不加噪声时为NULL
+    int error;
+};
+
+static float getPixel(const float *src, int h, int w, int x, int y, float fill)
+{
+    return (x >= 0 && x < w && y >= 0 && y < h)? src[y * w + x]: fill;
+}
+
+static float sampleBilinear(const float *src, int h, int w, float sx, float sy, float fill)
+{
+    float fx = floorf(sx);
+    float fy = floorf(sy);
+    int x0 = (int)fx;
+    int y0 = (int)fy;
+    float ax = sx - fx;
+    float ay = sy - fy;
+    if (x0 >= 0 && x0 + 1 < w && y0 >= 0 && y0 + 1 < h) { // 内部不需要边界判断
+        const float *p = src + y0 * w + x0;
+        return (p[0] * (1.f - ax) + p[1] * ax) * (1.f - ay) + (p[w] * (1.f - ax) + p[w + 1] * ax) * ay;
+    }
+    float v00 = getPixel(src, h, w, x0, y0, fill);
+    float v01 = getPixel(src, h, w, x0 + 1, y0, fill);
+    float v10 = getPixel(src, h, w, x0, y0 + 1, fill);
+    float v11 = getPixel(src, h, w, x0 + 1, y0 + 1, fill);
+    return (v00 * (1.f - ax) + v01 * ax) * (1.f - ay) + (v10 * (1.f - ax) + v11 * ax) * ay;
+}
+
+// 可分离的高斯平滑, 边界外按0处理, 结果乘以scale
+static void smoothField(float *dst, float *tmp, const float *src, int h, int w, const float *kernel, int radius, float scale)
+{
+    int x, y, k;
+    for (y = 0; y < h; ++y) {
+        const float *row = src + y * w;
+        for (x = 0; x < w; ++x) {
+            float s = 0.f;
+            int k0 = (x - radius < 0)? radius - x: 0;
+            int k1 = (x + radius >= w)? radius + (w - 1 - x): 2 * radius;
+            for (k = k0; k <= k1; ++k) {
+                s += kernel[k] * row[x + k - radius];
+            }
+            tmp[y * w + x] = s;
+        }
+    }
+    for (y = 0; y < h; ++y) {
+        float *out = dst + y * w;
+        for (x = 0; x < w; ++x) {
+            out[x] = 0.f;
+        }
+        int k0 = (y - radius < 0)? radius - y: 0;
+        int k1 = (y + radius >= h)? radius + (h - 1 - y): 2 * radius;
+        for (k = k0; k <= k1; ++k) { // 按行累加, 内层沿x连续
+            const float *in = tmp + (y + k - radius) * w;
+            float c = kernel[k] * scale;
+            for (x = 0; x < w; ++x) {
+                out[x] += c * in[x];
+            }
+        }
+    }
+}
+
+static void augmentSample(const struct AugmentArgs *a, int s, float *src, float *out, float *ex, float *ey, float *tmp)
+{
+    const struct Augmenter *aug = a->aug;
+    const struct AugmentConfig *cfg = &(aug->cfg);
+    int h = cfg->height;
+    int w = cfg->width;
+    int n_pixels = h * w;
+    int i, x, y;
+
+    if (aug->is_uint8) {
+        const unsigned char *p = (const unsigned char *)a->data + (size_t)s * n_pixels;
+        for (i = 0; i < n_pixels; ++i) {
+            src[i] = p[i];
+        }
+    }
+    else {
+        memcpy(src, (float *)a->data + (size_t)s * n_pixels, n_pixels * sizeof(float));
+    }
+
+    const float *param = a->params + s * AUG_N_PARAMS;
+    int dx = (int)param[0];
+    int dy = (int)param[1];
+    if (aug->geometric) {
+        // 输出像素(x, y)取原图中的(sx, sy): 先反向平移, 再绕中心反向旋转, 最后加上位移场
+        if (a->fields) {
+            const float *field = a->fields + (size_t)s * 2 * n_pixels;
+            smoothField(ex, tmp, field, h, w, aug->kernel, aug->radius, cfg->elastic_alpha);
+            smoothField(ey, tmp, field + n_pixels, h, w, aug->kernel, aug->radius, cfg->elastic_alpha);
+        }
+        float c = cosf(param[2]);
+        float sn = sinf(param[2]);
+        float cx = 0.5f * (w - 1);
+        float cy = 0.5f * (h - 1);
+        for (y = 0; y < h; ++y) {
+            float py = y - cy - dy;
+            float bx = cx + sn * py;
+            float by = cy + c * py;
+            for (x = 0; x < w; ++x) {
+                float px = x - cx - dx;
+                float sx = bx + c * px;
+                float sy = by - sn * px;
+                if (a->fields) {
+                    sx += ex[y * w + x];
+                    sy += ey[y * w + x];
+                }
+                out[y * w + x] = sampleBilinear(src, h, w, sx, sy, cfg->fill);
+            }
+        }
+    }
+    else { // 只有整数平移, 按行复制
+        for (y = 0; y < h; ++y) {
+            float *row = out + y * w;
+            int sy = y - dy;
+            if (sy < 0 || sy >= h) {
+                for (x = 0; x < w; ++x) {
+                    row[x] = cfg->fill;
+                }
+                continue;
+            }
+            int x0 = (dx > 0)? dx: 0; // 输出行中来自原图的范围[x0, x1)
+            int x1 = (dx < 0)? w + dx: w;
+            for (x = 0; x < x0 && x < w; ++x) {
+                row[x] = cfg->fill;
+            }
+            if (x1 > x0) {
+                memcpy(row + x0, src + sy * w + x0 - dx, (x1 - x0) * sizeof(float));
+            }
+            for (x = (x1 > x0)? x1: x0; x < w; ++x) {
+                row[x] = cfg->fill;
+            }
+        }
+    }
+
+    if (a->noise) {
+        const float *z = a->noise + (size_t)s * n_pixels;
+        for (i = 0; i < n_pixels; ++i) {
+            out[i] += z[i];
+        }
+    }
+
+    if (aug->is_uint8) {
+        unsigned char *p = (unsigned char *)a->data + (size_t)s * n_pixels;
+        for (i = 0; i < n_pixels; ++i) {
+            float v = out[i];
+            v = (v < 0.f)? 0.f: ((v > 255.f)? 255.f: v);
+            p[i] = (unsigned char)(v + 0.5f);
+        }
+    }
+    else {
+        memcpy((float *)a->data + (size_t)s * n_pixels, out, n_pixels * sizeof(float));
+    }
+}
+
+static void augmentRange(void *arg, int lo, int hi)
+{
+    struct AugmentArgs *a = arg;
+    int n_pixels = a->aug->cfg.height * a->aug->cfg.width;
+    float *buf = malloc(5 * (size_t)n_pixels * sizeof(float));
+    if (buf == NULL) {
+        __atomic_store_n(&(a->error), 1, __ATOMIC_RELAXED);
+        return;
+    }
+    int s;
+    for (s = lo; s < hi; ++s) {
+        augmentSample(a, s, buf, buf + n_pixels, buf + 2 * n_pixels, buf + 3 * n_pixels, buf + 4 * n_pixels);
+    }
+    free(buf);
+}
+
+int createAugmenter(struct Augmenter **aug, const struct AugmentConfig *cfg, uint64_t seed)
+{
+    CHK_NIL(aug);
+    CHK_NIL(cfg);
+    CHK_NIL(cfg->dtype);
+    CHK_ERR((cfg->height > 0 && cfg->width > 0)? 0: 1);
+    CHK_ERR((cfg->max_shift >= 0 && cfg->max_rotation >= 0.f && cfg->elastic_alpha >= 0.f && cfg->noise_std >= 0.f)? 0: 1);
+    if (cfg->elastic_alpha > 0.f) {
+        CHK_ERR((cfg->elastic_sigma > 0.f && cfg->elastic_sigma <= AUG_MAX_SIGMA)? 0: 1);
+    }
+
+    int is_uint8;
+    if (strcasecmp(cfg->dtype, "uint8") == 0) {
+        is_uint8 = 1;
+    } else if (strcasecmp(cfg->dtype, "float32") == 0) {
+        is_uint8 = 0;
+    } else {
+        ERR_MSG("dtype: %s not supported for augmentation, error.\n", cfg->dtype);
+        return ERR_COD;
+    }
+
+    struct Augmenter *res = calloc(1, sizeof(struct Augmenter));
+    CHK_NIL(res);
+    res->cfg = *cfg;
+    res->is_uint8 = is_uint8;
+    res->seed = seed;
+    res->geometric = (cfg->max_rotation > 0.f || cfg->elastic_alpha > 0.f);
+    if (cfg->elastic_alpha > 0.f) {
+        res->radius = (int)ceilf(3.f * cfg->elastic_sigma);
+        res->kernel = malloc((2 * res->radius + 1) * sizeof(float));
+        if (res->kernel == NULL) {
+            ERR_MSG("malloc failed, error.\n");
+            free(res);
+            return ERR_COD;
+        }
+        double sum = 0.;
+        int k;
+        for (k = -res->radius; k <= res->radius; ++k) {
+            sum += exp(-0.5 * k * k / ((double)cfg->elastic_sigma * cfg->elastic_sigma));
+        }
+        for (k = -res->radius; k <= res->radius; ++k) {
+            res->kernel[k + res->radius] = (float)(exp(-0.5 * k * k / ((double)cfg->elastic_sigma * cfg->elastic_sigma)) / sum);
+        }
+    }
+    *aug = res;
+    return SUCCESS;
+}
+
+void destroyAugmenter(struct Augmenter *aug)
+{
+    if (aug) {
+        free(aug->kernel);
+        free(aug);
+    }
+}
+
+int augmentBatch(const struct Augmenter *aug, void *data, int n_samples, int epoch, int batch_idx)
+{
+    CHK_NIL(aug);
+    CHK_NIL(data);
+    CHK_ERR((n_samples > 0 && epoch >= 0 && batch_idx >= 0)? 0: 1);
+
+    const struct AugmentConfig *cfg = &(aug->cfg);
+    if (cfg->max_shift == 0 && !aug->geometric && cfg->noise_std == 0.f) {
+        return SUCCESS;
+    }
+    long n_pixels = (long)cfg->height * cfg->width;
+
+    struct AugmentArgs a;
+    memset(&a, 0, sizeof(struct AugmentArgs));
+    struct RandomStream *rs = NULL;
+    float *params = malloc((size_t)n_samples * AUG_N_PARAMS * sizeof(float));
+    float *fields = (cfg->elastic_alpha > 0.f)? malloc((size_t)n_samples * 2 * n_pixels * sizeof(float)): NULL;
+    float *noise = (cfg->noise_std > 0.f)? malloc((size_t)n_samples * n_pixels * sizeof(float)): NULL;
+    if (params == NULL || (cfg->elastic_alpha > 0.f && fields == NULL) || (cfg->noise_std > 0.f && noise == NULL)) {
+        ERR_MSG("malloc failed, error.\n");
+        goto err_end;
+    }
+
+    // 随机数按固定顺序从同一个流中取出: 样本参数, 位移场, 噪声
+    CHK_ERR_GOTO(createRandomStream(&rs, aug->seed, ((uint64_t)(epoch + 1) << 32) | (uint32_t)batch_idx));
+    CHK_ERR_GOTO(fillRandomUniform(rs, params, (long)n_samples * AUG_N_PARAMS, 0.f, 1.f));
+    int s;
+    for (s = 0; s < n_samples; ++s) {
+        float *p = params + s * AUG_N_PARAMS;
+        int n_shifts = 2 * cfg->max_shift + 1;
+        int dx = (int)(p[0] * n_shifts);
+        int dy = (int)(p[1] * n_shifts);
+        p[0] = (float)(((dx < n_shifts)? dx: n_shifts - 1) - cfg->max_shift);
+        p[1] = (float)(((dy < n_shifts)? dy: n_shifts - 1) - cfg->max_shift);
+        p[2] = (float)((2. * p[2] - 1.) * cfg->max_rotation * AUG_PI / 180.);
+    }
+    if (fields) {
+        CHK_ERR_GOTO(fillRandomUniform(rs, fields, (long)n_samples * 2 * n_pixels, -1.f, 1.f));
+    }
+    if (noise) {
+        CHK_ERR_GOTO(fillRandomNormal(rs, noise, (long)n_samples * n_pixels, 0.f, cfg->noise_std));
+    }
+
+    a.aug = aug;
+    a.data = data;
+    a.params = params;
+    a.fields = fields;
+    a.noise = noise;
+    long cost = n_pixels * (aug->geometric? 24: 4) + (fields? 8 * n_pixels * (2 * aug->radius + 1): 0);
+    CHK_ERR_GOTO(parallelFor(NULL, 0, n_samples, cost, augmentRange, &a));
+    if (a.error) {
+        ERR_MSG("malloc failed in augmentation worker, error.\n");
+        goto err_end;
+    }
+
+    destroyRandomStream(rs);
+    free(params);
+    free(fields);
+    free(noise);
+    return SUCCESS;
+
+err_end:
+    destroyRandomStream(rs);
+    free(params);
+    free(fields);
+    free(noise);
+    return ERR_COD;
+}
+
+int setAugmenterSource(struct Augmenter *aug, DataLoaderFillFunc fill, void *user_data)
+{
+    CHK_NIL(aug);
+    CHK_NIL(fill);
+
+    aug->fill = fill;
+    aug->user_data = user_data;
+    return SUCCESS;
+}
+
+int fillAugmentedBatch(void *data, void *label, int *n_samples, int epoch, int batch_idx, void *user_data)
+{
+    CHK_NIL(n_samples);
+    CHK_NIL(user_data);
+
+    const struct Augmenter *aug = user_data;
+    if (aug->fill == NULL) {
+        ERR_MSG("augmenter has no source, call setAugmenterSource first, error.\n");
+        return ERR_COD;
+    }
+    CHK_ERR(aug->fill(data, label, n_samples, epoch, batch_idx, aug->user_data));
+    if (*n_samples > 0) {
+        CHK_ERR(augmentBatch(aug, data, *n_samples, epoch, batch_idx));
+    }
+    return SUCCESS;
+}
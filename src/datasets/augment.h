@@ -0,0 +1,43 @@
+/**
+ * @brief 图片batch的在线数据增强: 随机平移, 小角度旋转, 弹性形变(Simard 2003)和加性高斯噪声, 单通道height x width.
+ *        平移, 旋转和弹性形变合成一个逆映射, 每个输出像素双线性插值一次; 只有整数平移时直接按行复制.
+ *        样本原地修改, 支持"uint8"(结果四舍五入并截断到[0, 255])和"float32".
+ *
+ *        随机数: 第epoch轮第batch_idx个batch使用流(seed, ((epoch + 1) << 32) | batch_idx), 不会与按(seed, epoch)打乱的流重叠,
+ *        结果只取决于(seed, epoch, batch_idx)和batch内容, 与线程数和调用线程无关.
+ *        batch内按样本并行; 作为DataLoader的回调(fillAugmentedBatch)时在生产者线程上执行, 与训练的计算重叠.
+ *        Augmenter创建后只读, 可以被多个生产者线程同时使用.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "data_loader.h"
+
+struct AugmentConfig
+{
+    const char *dtype; // "uint8"或"float32"
+    int height;
+    int width;
+    int max_shift; // 平移的像素数在[-max_shift, max_shift]中均匀取整数
+    float max_rotation; // 旋转角度(度)在[-max_rotation, max_rotation]中均匀取
+    float elastic_alpha; // 弹性形变的幅度(像素), 0时不使用
+    float elastic_sigma; // 随机位移场高斯平滑的标准差(像素)
+    float noise_std; // 加性高斯噪声的标准差, 与样本同一单位, 0时不加
+    float fill; // 移出图像范围的位置取的值(背景), 归一化后的float样本应为背景像素归一化后的值
+};
+
+struct Augmenter;
+
+int createAugmenter(struct Augmenter **aug, const struct AugmentConfig *cfg, uint64_t seed);
+void destroyAugmenter(struct Augmenter *aug);
+
+// 原地增强n_samples个连续存放的样本, 可以直接用于getMnistShuffledBatch/getMnistShuffledBatchUint8取出的batch
+int augmentBatch(const struct Augmenter *aug, void *data, int n_samples, int epoch, int batch_idx);
+
+/**
+ * @brief 设置原始batch的来源, 之后fillAugmentedBatch(user_data为aug)先调用fill生产batch再原地增强,
+ *        用于在数据集和DataLoader之间插入增强.
+ */
+int setAugmenterSource(struct Augmenter *aug, DataLoaderFillFunc fill, void *user_data);
+int fillAugmentedBatch(void *data, void *label, int *n_samples, int epoch, int batch_idx, void *user_data);
@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "debug_macros.h"
+#include "thread_pool.h"
+#include "data_cache.h"
+
+#define DATA_CACHE_MAGIC ("NNCACHE1")
+#define DATA_CACHE_MAGIC_SIZE (8)
+#define DATA_CACHE_PATH_SIZE (1024)
+#define HASH_BLOCK_BYTES (1 << 20)
+
+#define HASH_P1 (11400714785074694791ULL)
+#define HASH_P2 (14029467366897019727ULL)
+#define HASH_P3 (1609587929392839161ULL)
+
+struct DataCacheEntry
+{
+    char name[DATA_CACHE_NAME_SIZE];
+    uint64_t offset;
+    uint64_t n_bytes;
+};
+
+struct DataCacheHeader
+{
+    char magic[DATA_CACHE_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t n_entries;
+    uint64_t key;
+    uint64_t file_bytes;
+    struct DataCacheEntry entries[DATA_CACHE_MAX_ENTRIES];
+};
+
+_Static_assert(sizeof(struct DataCacheHeader) <= DATA_CACHE_ALIGN, "data cache header does not fit");
+
+struct DataCacheWriter
+{
+    char path[DATA_CACHE_PATH_SIZE];
+    char tmp_path[DATA_CACHE_PATH_SIZE + 32];
+    int fd;
+    uint64_t offset; // 下一项的起始偏移
+    struct DataCacheHeader header;
+    int status;
+};
+
+struct DataCache
+{
+    void *map;
+    size_t map_bytes;
+    const struct DataCacheHeader *header;
+};
+
+// ------------------------------------------------------------------ hash
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t hashRound(uint64_t acc, uint64_t w)
+{
+    acc += w * HASH_P2;
+    acc = rotl64(acc, 31);
+    return acc * HASH_P1;
+}
+
+// 4路独立累加, 每路每次8字节, 最后混合
+static uint64_t hashBlock(const unsigned char *p, size_t n, uint64_t seed)
+{
+    uint64_t v0 = seed + HASH_P1 + HASH_P2;
+    uint64_t v1 = seed + HASH_P2;
+    uint64_t v2 = seed;
+    uint64_t v3 = seed - HASH_P1;
+    uint64_t w[4];
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        memcpy(w, p + i, 32);
+        v0 = hashRound(v0, w[0]);
+        v1 = hashRound(v1, w[1]);
+        v2 = hashRound(v2, w[2]);
+        v3 = hashRound(v3, w[3]);
+    }
+    uint64_t h = rotl64(v0, 1) + rotl64(v1, 7) + rotl64(v2, 12) + rotl64(v3, 18) + n;
+    for (; i + 8 <= n; i += 8) {
+        memcpy(w, p + i, 8);
+        h ^= hashRound(0, w[0]);
+        h = rotl64(h, 27) * HASH_P1 + HASH_P3;
+    }
+    for (; i < n; ++i) {
+        h ^= p[i] * HASH_P3;
+        h = rotl64(h, 11) * HASH_P1;
+    }
+    h ^= h >> 33;
+    h *= HASH_P2;
+    h ^= h >> 29;
+    h *= HASH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+struct HashArgs
+{
+    const unsigned char *data;
+    size_t n_bytes;
+    uint64_t *block_hashes;
+};
+
+static void hashRange(void *arg, int lo, int hi)
+{
+    struct HashArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        size_t begin = (size_t)i * HASH_BLOCK_BYTES;
+        size_t n = (a->n_bytes - begin < HASH_BLOCK_BYTES)? a->n_bytes - begin: HASH_BLOCK_BYTES;
+        a->block_hashes[i] = hashBlock(a->data + begin, n, 0);
+    }
+}
+
+int getDataHash(uint64_t *hash, const void *data, size_t n_bytes, uint64_t seed)
+{
+    CHK_NIL(hash);
+    if (n_bytes > 0) {
+        CHK_NIL(data);
+    }
+
+    // 各块独立计算, 再对块哈希的序列计算一次, 结果与线程数无关
+    int n_blocks = (int)((n_bytes + HASH_BLOCK_BYTES - 1) / HASH_BLOCK_BYTES);
+    uint64_t *block_hashes = NULL;
+    if (n_blocks > 0) {
+        block_hashes = malloc(n_blocks * sizeof(uint64_t));
+        CHK_NIL(block_hashes);
+        struct HashArgs a = {data, n_bytes, block_hashes};
+        if (parallelFor(NULL, 0, n_blocks, HASH_BLOCK_BYTES / 8, hashRange, &a) != SUCCESS) {
+            ERR_MSG("parallelFor() failed, error.\n");
+            free(block_hashes);
+            return ERR_COD;
+        }
+    }
+    *hash = hashBlock((const unsigned char *)block_hashes, n_blocks * sizeof(uint64_t), seed ^ (uint64_t)n_bytes);
+    free(block_hashes);
+    return SUCCESS;
+}
+
+// ------------------------------------------------------------------ writer
+
+static int writeFull(int fd, const void *buf, size_t n, off_t offset)
+{
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t res = pwrite(fd, p, n, offset);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR_MSG("pwrite() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        p += res;
+        n -= res;
+        offset += res;
+    }
+    return SUCCESS;
+}
+
+int createDataCacheWriter(struct DataCacheWriter **w, const char *path, uint64_t key)
+{
+    CHK_NIL(w);
+    CHK_NIL(path);
+    CHK_ERR((strlen(path) < DATA_CACHE_PATH_SIZE)? 0: 1);
+
+    struct DataCacheWriter *res = calloc(1, sizeof(struct DataCacheWriter));
+    CHK_NIL(res);
+    snprintf(res->path, DATA_CACHE_PATH_SIZE, "%s", path);
+    snprintf(res->tmp_path, sizeof(res->tmp_path), "%s.tmp.%d", path, (int)getpid());
+    res->fd = open(res->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (res->fd == -1) {
+        ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", res->tmp_path, ERRNO_DETAIL(errno));
+        free(res);
+        return ERR_COD;
+    }
+    memcpy(res->header.magic, DATA_CACHE_MAGIC, DATA_CACHE_MAGIC_SIZE);
+    res->header.version = DATA_CACHE_VERSION;
+    res->header.key = key;
+    res->offset = DATA_CACHE_ALIGN;
+    res->status = SUCCESS;
+    *w = res;
+    return SUCCESS;
+}
+
+static int addDataCacheEntryImpl(struct DataCacheWriter *w, const char *name, const void *data, size_t n_bytes)
+{
+    struct DataCacheHeader *h = &(w->header);
+    CHK_ERR((strlen(name) < DATA_CACHE_NAME_SIZE)? 0: 1);
+    CHK_ERR((h->n_entries < DATA_CACHE_MAX_ENTRIES)? 0: 1);
+    uint32_t i;
+    for (i = 0; i < h->n_entries; ++i) {
+        if (strcmp(h->entries[i].name, name) == 0) {
+            ERR_MSG("duplicate data cache entry: %s, error.\n", name);
+            return ERR_COD;
+        }
+    }
+
+    CHK_ERR(writeFull(w->fd, data, n_bytes, w->offset));
+    struct DataCacheEntry *e = &(h->entries[h->n_entries++]);
+    snprintf(e->name, DATA_CACHE_NAME_SIZE, "%s", name);
+    e->offset = w->offset;
+    e->n_bytes = n_bytes;
+    w->offset = (w->offset + n_bytes + DATA_CACHE_ALIGN - 1) / DATA_CACHE_ALIGN * DATA_CACHE_ALIGN;
+    return SUCCESS;
+}
+
+int addDataCacheEntry(struct DataCacheWriter *w, const char *name, const void *data, size_t n_bytes)
+{
+    CHK_NIL(w);
+    CHK_NIL(name);
+    if (n_bytes > 0) {
+        CHK_NIL(data);
+    }
+    if (w->status != SUCCESS) {
+        return ERR_COD;
+    }
+    if (addDataCacheEntryImpl(w, name, data, n_bytes) != SUCCESS) {
+        w->status = ERR_COD;
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+void destroyDataCacheWriter(struct DataCacheWriter *w)
+{
+    if (w) {
+        if (w->fd != -1) {
+            close(w->fd);
+        }
+        unlink(w->tmp_path);
+        free(w);
+    }
+}
+
+int closeDataCacheWriter(struct DataCacheWriter *w)
+{
+    CHK_NIL(w);
+    if (w->status != SUCCESS) {
+        destroyDataCacheWriter(w);
+        return ERR_COD;
+    }
+
+    // 文件大小取到最后一项对齐后的末尾, 各项之间的空隙是空洞
+    w->header.file_bytes = w->offset;
+    if (ftruncate(w->fd, w->offset) == -1) {
+        ERR_MSG("ftruncate() failed, path: %s, err_detail: %s, error.\n", w->tmp_path, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    char header[DATA_CACHE_ALIGN];
+    memset(header, 0, DATA_CACHE_ALIGN);
+    memcpy(header, &(w->header), sizeof(struct DataCacheHeader));
+    CHK_ERR_GOTO(writeFull(w->fd, header, DATA_CACHE_ALIGN, 0));
+    int fd = w->fd;
+    w->fd = -1;
+    if (close(fd) == -1) {
+        ERR_MSG("close() failed, path: %s, err_detail: %s, error.\n", w->tmp_path, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    if (rename(w->tmp_path, w->path) == -1) {
+        ERR_MSG("rename() failed, path: %s, err_detail: %s, error.\n", w->path, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    free(w);
+    return SUCCESS;
+
+err_end:
+    destroyDataCacheWriter(w);
+    return ERR_COD;
+}
+
+// ------------------------------------------------------------------ reader
+
+// 检查文件头, 不符时返回ERR_COD(不打印错误, 由调用者视为未命中)
+static int checkDataCacheHeader(const struct DataCacheHeader *h, size_t map_bytes, uint64_t key)
+{
+    if (memcmp(h->magic, DATA_CACHE_MAGIC, DATA_CACHE_MAGIC_SIZE) != 0 || h->version != DATA_CACHE_VERSION
+        || h->key != key || h->file_bytes != map_bytes || h->n_entries > DATA_CACHE_MAX_ENTRIES) {
+        return ERR_COD;
+    }
+    uint32_t i;
+    for (i = 0; i < h->n_entries; ++i) {
+        const struct DataCacheEntry *e = &(h->entries[i]);
+        if (memchr(e->name, '\0', DATA_CACHE_NAME_SIZE) == NULL || e->offset < DATA_CACHE_ALIGN
+            || e->offset > map_bytes || e->n_bytes > map_bytes - e->offset) {
+            return ERR_COD;
+        }
+    }
+    return SUCCESS;
+}
+
+int openDataCache(struct DataCache **c, const char *path, uint64_t key)
+{
+    CHK_NIL(c);
+    CHK_NIL(path);
+
+    *c = NULL;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return SUCCESS;
+        }
+        ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ERR_MSG("fstat() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        close(fd);
+        return ERR_COD;
+    }
+    if (st.st_size < DATA_CACHE_ALIGN) {
+        ERR_MSG("data cache %s is truncated, ignored.\n", path);
+        close(fd);
+        return SUCCESS;
+    }
+
+    struct DataCache *res = calloc(1, sizeof(struct DataCache));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, error.\n");
+        close(fd);
+        return ERR_COD;
+    }
+    res->map_bytes = st.st_size;
+    res->map = mmap(NULL, res->map_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (res->map == MAP_FAILED) {
+        ERR_MSG("mmap() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        free(res);
+        return ERR_COD;
+    }
+    res->header = res->map;
+    if (checkDataCacheHeader(res->header, res->map_bytes, key) != SUCCESS) {
+        ERR_MSG("data cache %s is stale or corrupt, ignored.\n", path);
+        closeDataCache(res);
+        return SUCCESS;
+    }
+    madvise(res->map, res->map_bytes, MADV_WILLNEED); // 只是提示内核预读, 失败不影响正确性
+    *c = res;
+    return SUCCESS;
+}
+
+void closeDataCache(struct DataCache *c)
+{
+    if (c) {
+        munmap(c->map, c->map_bytes);
+        free(c);
+    }
+}
+
+int getDataCacheEntry(const void *(*data), size_t *n_bytes, const struct DataCache *c, const char *name)
+{
+    CHK_NIL(data);
+    CHK_NIL(n_bytes);
+    CHK_NIL(c);
+    CHK_NIL(name);
+
+    *data = NULL;
+    *n_bytes = 0;
+    uint32_t i;
+    for (i = 0; i < c->header->n_entries; ++i) {
+        const struct DataCacheEntry *e = &(c->header->entries[i]);
+        if (strcmp(e->name, name) == 0) {
+            *data = (const char *)c->map + e->offset;
+            *n_bytes = e->n_bytes;
+            break;
+        }
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,42 @@
+/**
+ * @brief 预处理结果的缓存文件: 把若干个命名的数组(归一化后的样本, 均值/方差, onehot类标等)连同一个64位key写入一个文件,
+ *        之后的运行直接mmap该文件取用, 不再重新计算. key由调用者根据源文件内容(getDataHash)和预处理方法计算,
+ *        源文件或预处理方法变化后key不同, 旧缓存自动失效.
+ *
+ *        格式: DATA_CACHE_ALIGN字节的文件头(魔数, DATA_CACHE_VERSION, key, 文件大小, 各项的名字/偏移/字节数),
+ *        之后是各项的数据, 起始偏移按DATA_CACHE_ALIGN对齐.
+ *        写入时先写到同目录下的临时文件, 完成后rename为目标文件, 多个进程同时建立缓存时读者不会看到写了一半的文件.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DATA_CACHE_VERSION (1)
+#define DATA_CACHE_ALIGN (4096)
+#define DATA_CACHE_MAX_ENTRIES (64)
+#define DATA_CACHE_NAME_SIZE (40)
+
+struct DataCacheWriter;
+struct DataCache;
+
+/**
+ * @brief 数据内容的64位哈希, 按块并行计算. seed用于串联多段数据: 把前一段的结果作为后一段的seed
+ */
+int getDataHash(uint64_t *hash, const void *data, size_t n_bytes, uint64_t seed);
+
+int createDataCacheWriter(struct DataCacheWriter **w, const char *path, uint64_t key);
+// 追加一项, 名字不超过DATA_CACHE_NAME_SIZE - 1个字符且不能重复
+int addDataCacheEntry(struct DataCacheWriter *w, const char *name, const void *data, size_t n_bytes);
+// 写入文件头并替换目标文件, 之后释放w; 之前的addDataCacheEntry出过错时删除临时文件并返回ERR_COD
+int closeDataCacheWriter(struct DataCacheWriter *w);
+// 放弃写入, 删除临时文件
+void destroyDataCacheWriter(struct DataCacheWriter *w);
+
+/**
+ * @brief 映射缓存文件. 文件不存在, 版本或key不符, 或文件头损坏时不算错误, *c为NULL, 调用者应重新计算并写入缓存.
+ */
+int openDataCache(struct DataCache **c, const char *path, uint64_t key);
+void closeDataCache(struct DataCache *c);
+// 按名字取一项, 在closeDataCache之前有效; 没有该项时*data为NULL
+int getDataCacheEntry(const void *(*data), size_t *n_bytes, const struct DataCache *c, const char *name);
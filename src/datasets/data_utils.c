@@ -3,12 +3,27 @@
 #include <string.h>
 #include <math.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "debug_macros.h"
+#include "thread_pool.h"
 #include "data_utils.h"
 
-static int getElemSize(unsigned int *size, const char *dtype)
+#define GATHER_PREFETCH_ROWS (4) // 提前预取的行数
+#define GATHER_PREFETCH_BYTES (128) // 只预取行首, 行内的顺序访问由硬件预取接上
+#define GATHER_STREAM_BYTES (8 << 20) // 超过时使用非临时写
+#define CACHE_LINE_SIZE (64)
+#define UINT8_CHUNK_ELEMS (1 << 20) // uint8统计和转换按块并行, 每块的直方图计数不超过uint32
+#define UINT8_N_VALUES (256)
+#define STATS_BLOCK_ELEMS (1 << 12) // 统计时每个小块的元素数, 转为double后留在L1/L2中
+#define STATS_CHUNK_ELEMS (1 << 20) // 统计按块并行, 每块的统计量单独保存后按顺序合并
+#define NORM_CHUNK_ELEMS (1 << 16)
+
+int getDataElemSize(unsigned int *size, const char *dtype)
 {
     CHK_NIL(size);
     CHK_NIL(dtype);
@@ -42,8 +57,8 @@ int transformOnehot(void **onehot, const char *dtype_onehot, void *orin, const c
 
     unsigned int dst_elem_size;
     unsigned int src_elem_size;
-    CHK_ERR(getElemSize(&dst_elem_size, dtype_onehot));
-    CHK_ERR(getElemSize(&src_elem_size, dtype_orin));
+    CHK_ERR(getDataElemSize(&dst_elem_size, dtype_onehot));
+    CHK_ERR(getDataElemSize(&src_elem_size, dtype_orin));
 
     void *res = calloc(n_samples * n_classes, dst_elem_size);
     if (res == NULL) {
@@ -94,164 +109,793 @@ int transformToFloat32FromUint8(float *dst, const unsigned char *src, int n_elem
     return SUCCESS;
 }
 
-static int getDataMeanFloat32(double *mean, const float *data, int n_elems)
+struct Uint8HistArgs
 {
-    CHK_NIL(mean);
+    const unsigned char *data;
+    long n_elems;
+    uint32_t (*hist)[UINT8_N_VALUES]; // 每块一个直方图
+};
+
+static void getUint8HistRange(void *arg, int lo, int hi)
+{
+    const struct Uint8HistArgs *a = arg;
+    int c;
+    for (c = lo; c < hi; ++c) {
+        long start = (long)c * UINT8_CHUNK_ELEMS;
+        long end = (start + UINT8_CHUNK_ELEMS < a->n_elems)? start + UINT8_CHUNK_ELEMS: a->n_elems;
+        uint32_t *h = a->hist[c];
+        memset(h, 0, UINT8_N_VALUES * sizeof(uint32_t));
+        long i;
+        for (i = start; i < end; ++i) {
+            ++h[a->data[i]];
+        }
+    }
+}
+
+// 按块并行统计取值直方图, 一遍读完数据; 数据来自mmap时各块的缺页也分散在各线程上
+static int getUint8Histogram(double *hist, const unsigned char *data, long n_elems)
+{
+    CHK_NIL(hist);
     CHK_NIL(data);
     CHK_ERR((n_elems > 0)? 0: 1);
 
-    double sum = 0.;
-    int i;
-    for (i = 0; i < n_elems; ++i) {
-        sum += data[i];
+    struct Uint8HistArgs a;
+    int n_chunks = (int)((n_elems + UINT8_CHUNK_ELEMS - 1) / UINT8_CHUNK_ELEMS);
+    a.data = data;
+    a.n_elems = n_elems;
+    a.hist = malloc((size_t)n_chunks * sizeof(*a.hist));
+    CHK_NIL(a.hist);
+    if (parallelFor(NULL, 0, n_chunks, UINT8_CHUNK_ELEMS, getUint8HistRange, &a) != SUCCESS) {
+        free(a.hist);
+        return ERR_COD;
+    }
+    int c, v;
+    for (v = 0; v < UINT8_N_VALUES; ++v) {
+        hist[v] = 0.;
+    }
+    for (c = 0; c < n_chunks; ++c) {
+        for (v = 0; v < UINT8_N_VALUES; ++v) {
+            hist[v] += a.hist[c][v];
+        }
     }
-    *mean = sum / n_elems;
+    free(a.hist);
     return SUCCESS;
 }
 
-static int getDataMeanFloat64(double *mean, const double *data, int n_elems)
+// 由直方图得到均值和中心化平方和
+static void getUint8HistMoments(double *mean, double *m2, const double *hist, long n_elems)
 {
-    ERR_MSG("notimplementederror, error.\n");
-    return ERR_COD;
+    double sum = 0.;
+    int v;
+    for (v = 0; v < UINT8_N_VALUES; ++v) {
+        sum += hist[v] * v;
+    }
+    double m = sum / n_elems;
+    double sum2 = 0.;
+    for (v = 0; v < UINT8_N_VALUES; ++v) {
+        sum2 += hist[v] * (v - m) * (v - m);
+    }
+    *mean = m;
+    *m2 = sum2;
 }
 
-static int getDataMeanInt32(double *mean, const int *data, int n_elems)
+enum StatsDType
 {
-    ERR_MSG("notimplementederror, error.\n");
-    return ERR_COD;
+    STATS_FLOAT32,
+    STATS_FLOAT64,
+    STATS_INT32,
+    STATS_INT64,
+    STATS_UINT8
+};
+
+struct DataStats
+{
+    int n_features;
+    long n_samples;
+    int has_shift;
+    double *shift; // 统计前从每个特征减去的常数(第一行的值), 避免均值远大于标准差时损失精度
+    double *mean; // 每个特征减去shift后的均值
+    double *m2; // 每个特征的中心化平方和
+};
+
+static int getStatsDType(enum StatsDType *code, const char *dtype)
+{
+    if (strcasecmp(dtype, "float32") == 0) {
+        *code = STATS_FLOAT32;
+    } else if (strcasecmp(dtype, "float64") == 0) {
+        *code = STATS_FLOAT64;
+    } else if (strcasecmp(dtype, "int32") == 0) {
+        *code = STATS_INT32;
+    } else if (strcasecmp(dtype, "int64") == 0) {
+        *code = STATS_INT64;
+    } else if (strcasecmp(dtype, "uint8") == 0) {
+        *code = STATS_UINT8;
+    } else {
+        ERR_MSG("dtype: %s not supported yet, error.\n", dtype);
+        return ERR_COD;
+    }
+    return SUCCESS;
 }
 
-static int getDataMeanInt64(double *mean, const long long *data, int n_elems)
+// Chan合并: (n_a, mean_a, m2_a)加上另一组(n_b, mean_b, m2_b)个样本的统计量
+static void mergeMoments(double *mean_a, double *m2_a, long n_a, const double *mean_b, const double *m2_b, long n_b, int n_features)
 {
-    ERR_MSG("notimplementederror, error.\n");
-    return ERR_COD;
+    if (n_b == 0) {
+        return;
+    }
+    if (n_a == 0) {
+        memcpy(mean_a, mean_b, n_features * sizeof(double));
+        memcpy(m2_a, m2_b, n_features * sizeof(double));
+        return;
+    }
+    double n = (double)n_a + (double)n_b;
+    double w = (double)n_b / n;
+    double c = (double)n_a * (double)n_b / n;
+    int f;
+    for (f = 0; f < n_features; ++f) {
+        double d = mean_b[f] - mean_a[f];
+        mean_a[f] += d * w;
+        m2_a[f] += m2_b[f] + d * d * c;
+    }
 }
 
-static int getDataMeanUint8(double *mean, const unsigned char *data, int n_elems)
+static void loadAsDouble(double *dst, const void *src, enum StatsDType dtype, long n)
 {
-    ERR_MSG("notimplementederror, error.\n");
-    return ERR_COD;
+    long i;
+    switch (dtype) {
+    case STATS_FLOAT32:
+        for (i = 0; i < n; ++i) {
+            dst[i] = ((const float *)src)[i];
+        }
+        break;
+    case STATS_FLOAT64:
+        memcpy(dst, src, n * sizeof(double));
+        break;
+    case STATS_INT32:
+        for (i = 0; i < n; ++i) {
+            dst[i] = ((const int *)src)[i];
+        }
+        break;
+    case STATS_INT64:
+        for (i = 0; i < n; ++i) {
+            dst[i] = (double)((const long long *)src)[i];
+        }
+        break;
+    case STATS_UINT8:
+        for (i = 0; i < n; ++i) {
+            dst[i] = ((const unsigned char *)src)[i];
+        }
+        break;
+    }
 }
 
-int getDataMean(double *mean, const void *data, const char *dtype, int n_elems)
+struct StatsArgs
 {
-    CHK_NIL(dtype);
+    const char *data;
+    enum StatsDType dtype;
+    size_t elem_size;
+    int n_features;
+    long n_samples;
+    long block_rows;
+    long chunk_rows;
+    const double *shift;
+    long *n; // 每块的样本数
+    double *mean; // 每块n_features个
+    double *m2;
+    int error;
+};
 
-    if (strcasecmp(dtype, "float32") == 0) {
-        CHK_ERR(getDataMeanFloat32(mean, data, n_elems));
-    } else if (strcasecmp(dtype, "float64") == 0) {
-        CHK_ERR(getDataMeanFloat64(mean, data, n_elems));
-    } else if (strcasecmp(dtype, "int32") == 0) {
-        CHK_ERR(getDataMeanInt32(mean, data, n_elems));
-    } else if (strcasecmp(dtype, "int64") == 0) {
-        CHK_ERR(getDataMeanInt64(mean, data, n_elems));
-    } else if (strcasecmp(dtype, "uint8") == 0) {
-        CHK_ERR(getDataMeanUint8(mean, data, n_elems));
-    } else {
-        ERR_MSG("dtype: %s not supported ye, error.\n", dtype);
+/**
+ * @brief 每个并行块按小块处理: 小块转为double后留在缓存中, 先求和得到小块均值, 再求中心化平方和,
+ *        然后按Chan的公式合并到并行块的统计量中. 内层循环沿特征方向连续, 可以向量化.
+ */
+static void getStatsRange(void *arg, int lo, int hi)
+{
+    struct StatsArgs *a = arg;
+    int n_features = a->n_features;
+    double *x = malloc((a->block_rows * n_features + 2 * n_features) * sizeof(double));
+    if (x == NULL) {
+        __atomic_store_n(&(a->error), 1, __ATOMIC_RELAXED);
+        return;
+    }
+    double *bmean = x + a->block_rows * n_features;
+    double *bm2 = bmean + n_features;
+
+    int c;
+    for (c = lo; c < hi; ++c) {
+        long r0 = (long)c * a->chunk_rows;
+        long r1 = (r0 + a->chunk_rows < a->n_samples)? r0 + a->chunk_rows: a->n_samples;
+        double *mean = a->mean + (size_t)c * n_features;
+        double *m2 = a->m2 + (size_t)c * n_features;
+        long n = 0;
+        long b;
+        for (b = r0; b < r1; b += a->block_rows) {
+            long nb = (b + a->block_rows < r1)? a->block_rows: r1 - b;
+            loadAsDouble(x, a->data + (size_t)b * n_features * a->elem_size, a->dtype, nb * n_features);
+            long r;
+            int f;
+            for (r = 0; r < nb; ++r) {
+                double *row = x + r * n_features;
+                for (f = 0; f < n_features; ++f) {
+                    row[f] -= a->shift[f];
+                }
+            }
+            for (f = 0; f < n_features; ++f) {
+                bmean[f] = 0.;
+                bm2[f] = 0.;
+            }
+            for (r = 0; r < nb; ++r) {
+                const double *row = x + r * n_features;
+                for (f = 0; f < n_features; ++f) {
+                    bmean[f] += row[f];
+                }
+            }
+            for (f = 0; f < n_features; ++f) {
+                bmean[f] /= nb;
+            }
+            for (r = 0; r < nb; ++r) {
+                const double *row = x + r * n_features;
+                for (f = 0; f < n_features; ++f) {
+                    double d = row[f] - bmean[f];
+                    bm2[f] += d * d;
+                }
+            }
+            mergeMoments(mean, m2, n, bmean, bm2, nb, n_features);
+            n += nb;
+        }
+        a->n[c] = n;
+    }
+    free(x);
+}
+
+int createDataStats(struct DataStats **stats, int n_features)
+{
+    CHK_NIL(stats);
+    CHK_ERR((n_features > 0)? 0: 1);
+
+    struct DataStats *res = calloc(1, sizeof(struct DataStats));
+    CHK_NIL(res);
+    res->n_features = n_features;
+    res->shift = calloc(n_features, sizeof(double));
+    res->mean = calloc(n_features, sizeof(double));
+    res->m2 = calloc(n_features, sizeof(double));
+    if (res->shift == NULL || res->mean == NULL || res->m2 == NULL) {
+        ERR_MSG("calloc failed, error.\n");
+        destroyDataStats(res);
+        return ERR_COD;
     }
+    *stats = res;
     return SUCCESS;
 }
 
-static int getDataStdFloat32(double *std, const float *data, int n_elems)
+void destroyDataStats(struct DataStats *stats)
 {
-    CHK_NIL(std);
+    if (stats) {
+        free(stats->shift);
+        free(stats->mean);
+        free(stats->m2);
+        free(stats);
+    }
+}
+
+int updateDataStats(struct DataStats *stats, const void *data, const char *dtype, long n_samples)
+{
+    CHK_NIL(stats);
     CHK_NIL(data);
-    CHK_ERR((n_elems > 0)? 0: 1);
+    CHK_NIL(dtype);
+    CHK_ERR((n_samples > 0)? 0: 1);
 
-    double mean = 0.;
-    CHK_ERR(getDataMeanFloat32(&mean, data, n_elems));
+    enum StatsDType code;
+    CHK_ERR(getStatsDType(&code, dtype));
+    int n_features = stats->n_features;
+    if (!stats->has_shift) { // uint8的取值范围小, 不需要平移, 整体统计的结果因此保持精确
+        if (code != STATS_UINT8) {
+            loadAsDouble(stats->shift, data, code, n_features);
+        }
+        stats->has_shift = 1;
+    }
 
-    double sum = 0.;
-    int i;
-    for (i = 0; i < n_elems; ++i) {
-        sum += pow((double)(data[i] - mean), 2.);
+    // uint8整体统计用直方图, 结果是精确的
+    if (code == STATS_UINT8 && n_features == 1) {
+        double hist[UINT8_N_VALUES];
+        double mean, m2;
+        CHK_ERR(getUint8Histogram(hist, data, n_samples));
+        getUint8HistMoments(&mean, &m2, hist, n_samples);
+        mean -= stats->shift[0];
+        mergeMoments(stats->mean, stats->m2, stats->n_samples, &mean, &m2, n_samples, 1);
+        stats->n_samples += n_samples;
+        return SUCCESS;
     }
-    *std = sqrt(sum / (n_elems - 1));
+
+    // 并行块的划分只由数据形状决定, 按块的顺序合并, 结果与线程数无关
+    struct StatsArgs a;
+    unsigned int elem_size;
+    CHK_ERR(getDataElemSize(&elem_size, dtype));
+    a.data = data;
+    a.dtype = code;
+    a.elem_size = elem_size;
+    a.n_features = n_features;
+    a.n_samples = n_samples;
+    a.shift = stats->shift;
+    a.block_rows = (n_features < STATS_BLOCK_ELEMS)? STATS_BLOCK_ELEMS / n_features: 1;
+    a.chunk_rows = a.block_rows * ((a.block_rows * n_features < STATS_CHUNK_ELEMS)? STATS_CHUNK_ELEMS / (a.block_rows * n_features): 1);
+    a.error = 0;
+    int n_chunks = (int)((n_samples + a.chunk_rows - 1) / a.chunk_rows);
+    a.n = malloc(n_chunks * sizeof(long));
+    a.mean = malloc((size_t)n_chunks * n_features * sizeof(double));
+    a.m2 = malloc((size_t)n_chunks * n_features * sizeof(double));
+    if (a.n == NULL || a.mean == NULL || a.m2 == NULL) {
+        ERR_MSG("malloc failed, error.\n");
+        goto err_end;
+    }
+    CHK_ERR_GOTO(parallelFor(NULL, 0, n_chunks, 3 * a.chunk_rows * n_features, getStatsRange, &a));
+    if (a.error) {
+        ERR_MSG("malloc failed in stats worker, error.\n");
+        goto err_end;
+    }
+    int c;
+    for (c = 0; c < n_chunks; ++c) {
+        mergeMoments(stats->mean, stats->m2, stats->n_samples, a.mean + (size_t)c * n_features, a.m2 + (size_t)c * n_features, a.n[c], n_features);
+        stats->n_samples += a.n[c];
+    }
+    free(a.n);
+    free(a.mean);
+    free(a.m2);
     return SUCCESS;
+
+err_end:
+    free(a.n);
+    free(a.mean);
+    free(a.m2);
+    return ERR_COD;
 }
 
-static int getDataStdFloat64(double *std, const double *data, int n_elems)
+int mergeDataStats(struct DataStats *dst, const struct DataStats *src)
 {
-    ERR_MSG("notimplementederror, error.\n");
-    return ERR_COD;
+    CHK_NIL(dst);
+    CHK_NIL(src);
+    CHK_ERR((dst->n_features == src->n_features)? 0: 1);
+    if (src->n_samples == 0) {
+        return SUCCESS;
+    }
+    if (!dst->has_shift) {
+        memcpy(dst->shift, src->shift, dst->n_features * sizeof(double));
+        dst->has_shift = 1;
+    }
+
+    // src的均值换算到dst的平移下
+    double *mean = malloc(dst->n_features * sizeof(double));
+    CHK_NIL(mean);
+    int f;
+    for (f = 0; f < dst->n_features; ++f) {
+        mean[f] = src->mean[f] + (src->shift[f] - dst->shift[f]);
+    }
+    mergeMoments(dst->mean, dst->m2, dst->n_samples, mean, src->m2, src->n_samples, dst->n_features);
+    dst->n_samples += src->n_samples;
+    free(mean);
+    return SUCCESS;
 }
 
-static int getDataStdInt32(double *std, const int *data, int n_elems)
+int getDataStatsMeanStd(double *mean, double *std, long *n_samples, const struct DataStats *stats)
 {
-    ERR_MSG("notimplementederror, error.\n");
-    return ERR_COD;
+    CHK_NIL(stats);
+
+    int f;
+    for (f = 0; f < stats->n_features; ++f) {
+        if (mean) {
+            mean[f] = stats->shift[f] + stats->mean[f];
+        }
+        if (std) {
+            std[f] = (stats->n_samples > 1)? sqrt(stats->m2[f] / (stats->n_samples - 1)): 0.;
+        }
+    }
+    if (n_samples) {
+        *n_samples = stats->n_samples;
+    }
+    return SUCCESS;
 }
 
-static int getDataStdInt64(double *std, const long long *data, int n_elems)
+int getDataMeanStd(double *mean, double *std, const void *data, const char *dtype, int n_elems)
 {
-    ERR_MSG("notimplementederror, error.\n");
+    CHK_NIL(mean);
+    CHK_NIL(std);
+
+    struct DataStats *stats = NULL;
+    CHK_ERR(createDataStats(&stats, 1));
+    CHK_ERR_GOTO(updateDataStats(stats, data, dtype, n_elems));
+    CHK_ERR_GOTO(getDataStatsMeanStd(mean, std, NULL, stats));
+    destroyDataStats(stats);
+    return SUCCESS;
+
+err_end:
+    destroyDataStats(stats);
     return ERR_COD;
 }
 
-static int getDataStdUint8(double *std, const unsigned char *data, int n_elems)
+int getDataMean(double *mean, const void *data, const char *dtype, int n_elems)
 {
-    ERR_MSG("notimplementederror, error.\n");
-    return ERR_COD;
+    double std;
+    return getDataMeanStd(mean, &std, data, dtype, n_elems);
 }
 
 int getDataStd(double *std, const void *data, const char *dtype, int n_elems)
 {
-    CHK_NIL(dtype);
+    double mean;
+    return getDataMeanStd(&mean, std, data, dtype, n_elems);
+}
 
+// x[i] = (x[i] - mean) / std, 在double中计算, SSE2路径与标量路径的结果逐位相同
+static void normalizeFloat32(float *x, long n, double mean, double std)
+{
+    long i = 0;
+#ifdef __SSE2__
+    __m128d m = _mm_set1_pd(mean);
+    __m128d s = _mm_set1_pd(std);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        __m128d lo = _mm_div_pd(_mm_sub_pd(_mm_cvtps_pd(v), m), s);
+        __m128d hi = _mm_div_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), m), s);
+        _mm_storeu_ps(x + i, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+    }
+#endif
+    for (; i < n; ++i) {
+        x[i] = (x[i] - mean) / std;
+    }
+}
+
+// 一行n_features个元素, 每个特征有自己的均值和标准差
+static void normalizeFloat32Row(float *x, int n_features, const double *mean, const double *std)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n_features; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        __m128d lo = _mm_div_pd(_mm_sub_pd(_mm_cvtps_pd(v), _mm_loadu_pd(mean + i)), _mm_loadu_pd(std + i));
+        __m128d hi = _mm_div_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), _mm_loadu_pd(mean + i + 2)), _mm_loadu_pd(std + i + 2));
+        _mm_storeu_ps(x + i, _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi)));
+    }
+#endif
+    for (; i < n_features; ++i) {
+        x[i] = (x[i] - mean[i]) / std[i];
+    }
+}
+
+static void normalizeFloat64(double *x, long n, double mean, double std)
+{
+    long i = 0;
+#ifdef __SSE2__
+    __m128d m = _mm_set1_pd(mean);
+    __m128d s = _mm_set1_pd(std);
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(x + i, _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(x + i), m), s));
+    }
+#endif
+    for (; i < n; ++i) {
+        x[i] = (x[i] - mean) / std;
+    }
+}
+
+static void normalizeFloat64Row(double *x, int n_features, const double *mean, const double *std)
+{
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 2 <= n_features; i += 2) {
+        _mm_storeu_pd(x + i, _mm_div_pd(_mm_sub_pd(_mm_loadu_pd(x + i), _mm_loadu_pd(mean + i)), _mm_loadu_pd(std + i)));
+    }
+#endif
+    for (; i < n_features; ++i) {
+        x[i] = (x[i] - mean[i]) / std[i];
+    }
+}
+
+struct NormArgs
+{
+    char *data;
+    int is_float64;
+    long n_elems; // 整体归一化时的元素数
+    double mean;
+    double std;
+    int n_features; // 按特征归一化时每行的特征数, 整体归一化时为0
+    long n_samples;
+    const double *means;
+    const double *stds;
+};
+
+static void getDataNormalizationRange(void *arg, int lo, int hi)
+{
+    const struct NormArgs *a = arg;
+    if (a->n_features == 0) {
+        long start = (long)lo * NORM_CHUNK_ELEMS;
+        long end = ((long)hi * NORM_CHUNK_ELEMS < a->n_elems)? (long)hi * NORM_CHUNK_ELEMS: a->n_elems;
+        if (a->is_float64) {
+            normalizeFloat64((double *)a->data + start, end - start, a->mean, a->std);
+        }
+        else {
+            normalizeFloat32((float *)a->data + start, end - start, a->mean, a->std);
+        }
+        return;
+    }
+    int r;
+    for (r = lo; r < hi; ++r) {
+        if (a->is_float64) {
+            normalizeFloat64Row((double *)a->data + (size_t)r * a->n_features, a->n_features, a->means, a->stds);
+        }
+        else {
+            normalizeFloat32Row((float *)a->data + (size_t)r * a->n_features, a->n_features, a->means, a->stds);
+        }
+    }
+}
+
+static int getFloatDType(int *is_float64, const char *dtype)
+{
     if (strcasecmp(dtype, "float32") == 0) {
-        CHK_ERR(getDataStdFloat32(std, data, n_elems));
+        *is_float64 = 0;
     } else if (strcasecmp(dtype, "float64") == 0) {
-        CHK_ERR(getDataStdFloat64(std, data, n_elems));
-    } else if (strcasecmp(dtype, "int32") == 0) {
-        CHK_ERR(getDataStdInt32(std, data, n_elems));
-    } else if (strcasecmp(dtype, "int64") == 0) {
-        CHK_ERR(getDataStdInt64(std, data, n_elems));
-    } else if (strcasecmp(dtype, "uint8") == 0) {
-        CHK_ERR(getDataStdUint8(std, data, n_elems));
+        *is_float64 = 1;
     } else {
-        ERR_MSG("dtype: %s not supported ye, error.\n", dtype);
+        ERR_MSG("dtype: %s not supported yet, error.\n", dtype);
+        return ERR_COD;
     }
     return SUCCESS;
 }
 
-static int getDataNormalizationFloat32(float *data, int n_elems, double mean, double std)
+/**
+ * @brief normalize mnist images, see main.py in https://github.com/Cerebras/ccc
+ */
+int getDataNormalization(void *data, const char *dtype, int n_elems, double mean, double std)
+{
+    CHK_NIL(data);
+    CHK_NIL(dtype);
+    CHK_ERR((n_elems > 0)? 0: 1);
+
+    struct NormArgs a;
+    memset(&a, 0, sizeof(struct NormArgs));
+    CHK_ERR(getFloatDType(&(a.is_float64), dtype));
+    a.data = data;
+    a.n_elems = n_elems;
+    a.mean = mean;
+    a.std = std; // 原则上数据集不可能std为0
+    int n_chunks = (int)((n_elems + NORM_CHUNK_ELEMS - 1) / NORM_CHUNK_ELEMS);
+    CHK_ERR(parallelFor(NULL, 0, n_chunks, NORM_CHUNK_ELEMS, getDataNormalizationRange, &a));
+    return SUCCESS;
+}
+
+int getDataNormalizationPerFeature(void *data, const char *dtype, long n_samples, int n_features, const double *mean, const double *std)
 {
     CHK_NIL(data);
+    CHK_NIL(dtype);
+    CHK_NIL(mean);
+    CHK_NIL(std);
+    CHK_ERR((n_samples > 0 && n_samples <= 0x7fffffffL)? 0: 1);
+    CHK_ERR((n_features > 0)? 0: 1);
+
+    struct NormArgs a;
+    memset(&a, 0, sizeof(struct NormArgs));
+    CHK_ERR(getFloatDType(&(a.is_float64), dtype));
+    double *stds = malloc(n_features * sizeof(double));
+    CHK_NIL(stds);
+    int f;
+    for (f = 0; f < n_features; ++f) {
+        stds[f] = (std[f] > 0.)? std[f]: 1.; // 常数特征(如图片边缘的像素)只减均值
+    }
+    a.data = data;
+    a.n_features = n_features;
+    a.n_samples = n_samples;
+    a.means = mean;
+    a.stds = stds;
+    int res = parallelFor(NULL, 0, (int)n_samples, n_features, getDataNormalizationRange, &a);
+    free(stds);
+    CHK_ERR(res);
+    return SUCCESS;
+}
+
+struct NormUint8Args
+{
+    float *dst;
+    const unsigned char *src;
+    long n_elems;
+    float lut[UINT8_N_VALUES];
+};
+
+static void transformToNormalizedFloat32FromUint8Range(void *arg, int lo, int hi)
+{
+    const struct NormUint8Args *a = arg;
+    long start = (long)lo * UINT8_CHUNK_ELEMS;
+    long end = ((long)hi * UINT8_CHUNK_ELEMS < a->n_elems)? (long)hi * UINT8_CHUNK_ELEMS: a->n_elems;
+    long i;
+    for (i = start; i < end; ++i) {
+        a->dst[i] = a->lut[a->src[i]];
+    }
+}
+
+int transformToNormalizedFloat32FromUint8(float *dst, const unsigned char *src, long n_elems, double mean, double std)
+{
+    CHK_NIL(dst);
+    CHK_NIL(src);
     CHK_ERR((n_elems > 0)? 0: 1);
+    CHK_ERR((std > 0)? 0: 1);
+
+    struct NormUint8Args a;
+    a.dst = dst;
+    a.src = src;
+    a.n_elems = n_elems;
+    int v;
+    for (v = 0; v < UINT8_N_VALUES; ++v) {
+        a.lut[v] = (v - mean) / std; // 与先转float再getDataNormalization的结果逐位相同
+    }
+    int n_chunks = (int)((n_elems + UINT8_CHUNK_ELEMS - 1) / UINT8_CHUNK_ELEMS);
+    CHK_ERR(parallelFor(NULL, 0, n_chunks, UINT8_CHUNK_ELEMS, transformToNormalizedFloat32FromUint8Range, &a));
+    return SUCCESS;
+}
 
-    //double mean, std;
-    //CHK_ERR(getDataMeanFloat32(&mean, data, n_elems));
-    //CHK_ERR(getDataStdFloat32(&std, data, n_elems));
-    //fprintf(stdout, "mean = %f\nstd = %f\n", mean, std); 
+struct GatherArgs
+{
+    char *dst;
+    const char *src;
+    const int *idx;
+    size_t row_bytes;
+    int stream;
+};
+
+#ifdef __SSE2__
+// 非临时写复制一行, dst按16字节对齐, row_bytes为16的倍数
+static void copyRowStream(char *dst, const char *src, size_t row_bytes)
+{
+    size_t k;
+    for (k = 0; k < row_bytes; k += 16) {
+        _mm_stream_si128((__m128i *)(dst + k), _mm_loadu_si128((const __m128i *)(src + k)));
+    }
+}
+#endif
 
+static void gatherRowsRange(void *arg, int lo, int hi)
+{
+    const struct GatherArgs *a = arg;
     int i;
-    for (i = 0; i < n_elems; ++i) {
-        data[i] = (data[i] - mean) / std; // 原则上数据集不可能std为0
+    for (i = lo; i < hi; ++i) {
+        if (i + GATHER_PREFETCH_ROWS < hi) {
+            const char *next = a->src + (size_t)a->idx[i + GATHER_PREFETCH_ROWS] * a->row_bytes;
+            size_t k;
+            for (k = 0; k < a->row_bytes && k < GATHER_PREFETCH_BYTES; k += CACHE_LINE_SIZE) {
+                __builtin_prefetch(next + k, 0, 0);
+            }
+        }
+        char *dst = a->dst + (size_t)i * a->row_bytes;
+        const char *src = a->src + (size_t)a->idx[i] * a->row_bytes;
+#ifdef __SSE2__
+        if (a->stream) {
+            copyRowStream(dst, src, a->row_bytes);
+            continue;
+        }
+#endif
+        memcpy(dst, src, a->row_bytes);
     }
+#ifdef __SSE2__
+    if (a->stream) {
+        _mm_sfence();
+    }
+#endif
+}
 
+int gatherRows(void *dst, const void *src, const int *idx, int n_rows, size_t row_bytes)
+{
+    CHK_NIL(dst);
+    CHK_NIL(src);
+    CHK_NIL(idx);
+    CHK_ERR((n_rows > 0)? 0: 1);
+    CHK_ERR((row_bytes > 0)? 0: 1);
+
+    struct GatherArgs a;
+    a.dst = dst;
+    a.src = src;
+    a.idx = idx;
+    a.row_bytes = row_bytes;
+    a.stream = (row_bytes * n_rows > GATHER_STREAM_BYTES && (uintptr_t)dst % 16 == 0 && row_bytes % 16 == 0)? 1: 0;
+    // 代价按每4字节一次浮点运算估计
+    CHK_ERR(parallelFor(NULL, 0, n_rows, (long)(row_bytes / 4 + 1), gatherRowsRange, &a));
     return SUCCESS;
 }
 
-static int getDataNormalizationFloat64(double *data, int n_elems, double mean, double std)
+struct CsrArgs
 {
-    ERR_MSG("notimplementederror, error.\n");
-    return ERR_COD;
+    const unsigned char *u8;
+    const float *f32;
+    int n_features;
+    float scale;
+    int *row_ptr;
+    int *col_idx;
+    float *val;
+};
+
+// row_ptr为NULL时只统计每行的非零元个数, 写入col_idx[i]; 否则按row_ptr填写下标和数值
+static void transformToCsrRange(void *arg, int lo, int hi)
+{
+    const struct CsrArgs *a = arg;
+    int i, j;
+    for (i = lo; i < hi; ++i) {
+        long base = (long)i * a->n_features;
+        int k = (a->row_ptr)? a->row_ptr[i]: 0;
+        for (j = 0; j < a->n_features; ++j) {
+            float v = (a->u8)? a->u8[base + j]: a->f32[base + j];
+            if (v == 0.f) {
+                continue;
+            }
+            if (a->row_ptr) {
+                a->col_idx[k] = j;
+                a->val[k] = v * a->scale;
+            }
+            ++k;
+        }
+        if (a->row_ptr == NULL) {
+            a->col_idx[i] = k;
+        }
+    }
 }
 
-/**
- * @brief normalize mnist images, see main.py in https://github.com/Cerebras/ccc
- */
-int getDataNormalization(void *data, const char *dtype, int n_elems, double mean, double std)
+int transformToCsr(int **row_ptr, int **col_idx, float **val, const void *data, const char *dtype, int n_samples, int n_features, float scale)
 {
+    CHK_NIL(row_ptr);
+    CHK_NIL(col_idx);
+    CHK_NIL(val);
+    CHK_NIL(data);
     CHK_NIL(dtype);
-
-    if (strcasecmp(dtype, "float32") == 0) {
-        CHK_ERR(getDataNormalizationFloat32(data, n_elems, mean, std));
-    } else if (strcasecmp(dtype, "float64") == 0) {
-        CHK_ERR(getDataNormalizationFloat64(data, n_elems, mean, std));
+    CHK_ERR((n_samples > 0 && n_features > 0)? 0: 1);
+
+    struct CsrArgs a;
+    memset(&a, 0, sizeof(struct CsrArgs));
+    if (strcasecmp(dtype, "uint8") == 0) {
+        a.u8 = data;
+    } else if (strcasecmp(dtype, "float32") == 0) {
+        a.f32 = data;
     } else {
-        ERR_MSG("dtype: %s not supported ye, error.\n", dtype);
+        ERR_MSG("dtype: %s not supported for CSR, error.\n", dtype);
+        return ERR_COD;
+    }
+    a.n_features = n_features;
+    a.scale = scale;
+
+    int *counts = malloc(n_samples * sizeof(int));
+    int *p = malloc(((size_t)n_samples + 1) * sizeof(int));
+    int *c = NULL;
+    float *v = NULL;
+    if (counts == NULL || p == NULL) {
+        ERR_MSG("malloc failed, error.\n");
+        goto err_end;
+    }
+
+    // 第一遍并行统计每行的非零元个数, 前缀和之后第二遍并行填写
+    a.col_idx = counts;
+    CHK_ERR_GOTO(parallelFor(NULL, 0, n_samples, n_features, transformToCsrRange, &a));
+    p[0] = 0;
+    int i;
+    for (i = 0; i < n_samples; ++i) {
+        if (counts[i] > INT32_MAX - p[i]) {
+            ERR_MSG("number of non-zeros exceeds int range, error.\n");
+            goto err_end;
+        }
+        p[i + 1] = p[i] + counts[i];
+    }
+    c = malloc(((size_t)p[n_samples] + 1) * sizeof(int)); // 全为0时也返回可释放的指针
+    v = malloc(((size_t)p[n_samples] + 1) * sizeof(float));
+    if (c == NULL || v == NULL) {
+        ERR_MSG("malloc failed, error.\n");
+        goto err_end;
     }
+    a.row_ptr = p;
+    a.col_idx = c;
+    a.val = v;
+    CHK_ERR_GOTO(parallelFor(NULL, 0, n_samples, 2 * n_features, transformToCsrRange, &a));
+
+    free(counts);
+    *row_ptr = p;
+    *col_idx = c;
+    *val = v;
     return SUCCESS;
+
+err_end:
+    free(counts);
+    free(p);
+    free(c);
+    free(v);
+    return ERR_COD;
 }
@@ -1,8 +1,59 @@
 #pragma once
 
+#include <stddef.h>
+
+// dtype字符串("float32", "float64", "int32", "int64", "uint8")对应的元素字节数
+int getDataElemSize(unsigned int *size, const char *dtype);
 int transformOnehot(void **onehot, const char *dtype_onehot, void *orin, const char *dtype_orin, int n_samples, int n_classes);
 int transformToFloat32FromUint8(float *dst, const unsigned char *src, int n_elems);
 
+/**
+ * @brief 整体的均值和样本标准差(除以n - 1), 各dtype都只读一遍数据, 按块并行, 见updateDataStats
+ */
 int getDataMean(double *mean, const void *data, const char *dtype, int n_elems);
 int getDataStd(double *std, const void *data, const char *dtype, int n_elems);
-int getDataNormalization(void *data, const char *dtype, int n_elems, double mean, double std);
\ No newline at end of file
+int getDataMeanStd(double *mean, double *std, const void *data, const char *dtype, int n_elems);
+/**
+ * @brief data[i] = (data[i] - mean) / std, 只支持float32和float64, 按块并行, 在double中计算并向量化
+ */
+int getDataNormalization(void *data, const char *dtype, int n_elems, double mean, double std);
+/**
+ * @brief 按特征归一化: data为n_samples行, 每行n_features个元素, 第f列使用mean[f]和std[f]. std[f]为0的特征只减均值
+ */
+int getDataNormalizationPerFeature(void *data, const char *dtype, long n_samples, int n_features, const double *mean, const double *std);
+
+/**
+ * @brief 均值和方差的累加器, 可以分多次输入数据(流式或分块读入的数据集), 统计n_features个特征各自的均值和方差;
+ *        n_features为1且每次输入n个元素时即为整体统计.
+ *        每次输入的数据按固定大小的块并行: 块内转为double后先求均值再求中心化平方和(数据留在缓存中, 只从内存读一遍),
+ *        块之间以及与已有的统计量之间按Chan的公式合并. 块的划分与线程数无关, 结果可以复现.
+ *        uint8的整体统计使用直方图, 结果是精确的.
+ */
+struct DataStats;
+
+int createDataStats(struct DataStats **stats, int n_features);
+void destroyDataStats(struct DataStats *stats);
+// 加入n_samples行数据, 每行n_features个dtype元素
+int updateDataStats(struct DataStats *stats, const void *data, const char *dtype, long n_samples);
+// 把src的统计量合并到dst中, 两者的特征数必须相同
+int mergeDataStats(struct DataStats *dst, const struct DataStats *src);
+// mean和std各n_features个元素, 可以为NULL; std为样本标准差, 不足2个样本时为0
+int getDataStatsMeanStd(double *mean, double *std, long *n_samples, const struct DataStats *stats);
+
+/**
+ * @brief dst[i] = (src[i] - mean) / std, 转换和归一化合为一遍, 按块并行, 每个元素查256项的表
+ */
+int transformToNormalizedFloat32FromUint8(float *dst, const unsigned char *src, long n_elems, double mean, double std);
+
+/**
+ * @brief 按下标把src中的行复制到连续的dst中: dst的第i行 = src的第idx[i]行, 每行row_bytes字节.
+ *        按行并行, 复制当前行时预取后面几行的行首; 总字节数超过GATHER_STREAM_BYTES且dst按16字节对齐时使用非临时写,
+ *        避免大batch把缓存中的权重挤出.
+ */
+int gatherRows(void *dst, const void *src, const int *idx, int n_rows, size_t row_bytes);
+
+/**
+ * @brief 把n_samples行稠密数据("uint8"或"float32")转换为CSR格式: 数值为非零元乘以scale, 同一行内下标递增.
+ *        row_ptr有n_samples + 1个元素, 三个数组由调用者free. 先并行统计每行的非零元个数, 再并行填写.
+ */
+int transformToCsr(int **row_ptr, int **col_idx, float **val, const void *data, const char *dtype, int n_samples, int n_features, float scale);
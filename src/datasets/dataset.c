@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "debug_macros.h"
+#include "data_utils.h"
+#include "idx_file.h"
+#include "dataset.h"
+
+// 原始二进制文件的映射
+struct RawMapping
+{
+    void *map;
+    size_t map_bytes;
+};
+
+struct Dataset
+{
+    enum DatasetType type;
+    int n_samples;
+    int n_dims;
+    int dims[DATASET_MAX_DIMS];
+    const char *dtype;
+    size_t sample_bytes;
+
+    const char *label_dtype; // 类标文件中的元素类型, 没有类标时为NULL
+    int label_size; // 类标文件中每个样本的元素数
+    size_t label_bytes; // 类标文件中每个样本的字节数
+    int n_classes;
+
+    const char *data;
+    const char *label;
+
+    // IDX_DATASET_TYPE
+    struct IdxFile *idx_data;
+    struct IdxFile *idx_label;
+    // RAW_DATASET_TYPE
+    struct RawMapping raw_data;
+    struct RawMapping raw_label;
+};
+
+// 统一dtype字符串的大小写, 返回静态字符串, Dataset中保存的dtype不依赖调用者的内存
+static const char *getCanonicalDType(const char *dtype)
+{
+    static const char *names[] = {"float32", "float64", "int32", "int64", "uint8"};
+    int i;
+    for (i = 0; dtype && i < (int)(sizeof(names) / sizeof(names[0])); ++i) {
+        if (strcasecmp(dtype, names[i]) == 0) {
+            return names[i];
+        }
+    }
+    return NULL;
+}
+
+static int mapRawFile(struct RawMapping *m, const char *(*data), size_t *n_bytes, const char *path, size_t offset)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ERR_MSG("fstat() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        close(fd);
+        return ERR_COD;
+    }
+    if ((size_t)st.st_size <= offset) {
+        ERR_MSG("file size %ld not larger than offset %lu, path: %s, error.\n", (long)st.st_size, (unsigned long)offset, path);
+        close(fd);
+        return ERR_COD;
+    }
+    m->map_bytes = st.st_size;
+    m->map = mmap(NULL, m->map_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m->map == MAP_FAILED) {
+        m->map = NULL;
+        ERR_MSG("mmap() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    madvise(m->map, m->map_bytes, MADV_WILLNEED);
+    *data = (const char *)m->map + offset;
+    *n_bytes = m->map_bytes - offset;
+    return SUCCESS;
+}
+
+static void unmapRawFile(struct RawMapping *m)
+{
+    if (m->map) {
+        munmap(m->map, m->map_bytes);
+        m->map = NULL;
+    }
+}
+
+// 类别序号类标: 检查每个样本一个元素, 类型为uint8或int32, 且都在[0, n_classes)内
+static int checkClassLabels(const struct Dataset *ds)
+{
+    if (ds->label_size != 1) {
+        ERR_MSG("class labels must have 1 element per sample, got %d, error.\n", ds->label_size);
+        return ERR_COD;
+    }
+    int i;
+    if (strcmp(ds->label_dtype, "uint8") == 0) {
+        const unsigned char *label = (const unsigned char *)ds->label;
+        for (i = 0; i < ds->n_samples; ++i) {
+            if (label[i] >= ds->n_classes) {
+                ERR_MSG("label[%d] = %d not in [0, %d), error.\n", i, label[i], ds->n_classes);
+                return ERR_COD;
+            }
+        }
+    }
+    else if (strcmp(ds->label_dtype, "int32") == 0) {
+        const int *label = (const int *)ds->label;
+        for (i = 0; i < ds->n_samples; ++i) {
+            if (label[i] < 0 || label[i] >= ds->n_classes) {
+                ERR_MSG("label[%d] = %d not in [0, %d), error.\n", i, label[i], ds->n_classes);
+                return ERR_COD;
+            }
+        }
+    }
+    else {
+        ERR_MSG("class labels of dtype %s not supported, error.\n", ds->label_dtype);
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+void destroyDataset(struct Dataset *ds)
+{
+    if (ds) {
+        switch (ds->type) {
+            case IDX_DATASET_TYPE:
+                closeIdxFile(ds->idx_data);
+                closeIdxFile(ds->idx_label);
+                break;
+            case RAW_DATASET_TYPE:
+                unmapRawFile(&(ds->raw_data));
+                unmapRawFile(&(ds->raw_label));
+                break;
+            default:
+                break;
+        }
+        free(ds);
+    }
+}
+
+int createIdxDataset(struct Dataset **ds, const char *data_path, const char *label_path, int n_classes)
+{
+    CHK_NIL(ds);
+    CHK_NIL(data_path);
+    CHK_ERR((n_classes >= 0)? 0: 1);
+
+    struct Dataset *res = calloc(1, sizeof(struct Dataset));
+    CHK_NIL(res);
+    res->type = IDX_DATASET_TYPE;
+    res->n_classes = n_classes;
+
+    enum IdxDType dtype;
+    int n_dims;
+    int dims[IDX_MAX_DIMS];
+    const void *data = NULL;
+    size_t n_bytes = 0;
+    CHK_ERR_GOTO(openIdxFile(&(res->idx_data), data_path));
+    CHK_ERR_GOTO(getIdxFileDType(&dtype, res->idx_data));
+    CHK_ERR_GOTO(getIdxFileShape(&n_dims, dims, res->idx_data));
+    CHK_ERR_GOTO(getIdxFileData(&data, &n_bytes, res->idx_data));
+    if (dtype != IDX_UINT8) {
+        ERR_MSG("IDX element type 0x%02x not implemented yet (uint8 only), path: %s, error.\n", dtype, data_path);
+        goto err_end;
+    }
+    res->dtype = "uint8";
+    res->n_samples = dims[0];
+    res->n_dims = n_dims - 1;
+    memcpy(res->dims, dims + 1, res->n_dims * sizeof(int));
+    res->sample_bytes = n_bytes / res->n_samples;
+    res->data = data;
+
+    if (label_path) {
+        CHK_ERR_GOTO(openIdxFile(&(res->idx_label), label_path));
+        CHK_ERR_GOTO(getIdxFileDType(&dtype, res->idx_label));
+        CHK_ERR_GOTO(getIdxFileShape(&n_dims, dims, res->idx_label));
+        CHK_ERR_GOTO(getIdxFileData(&data, &n_bytes, res->idx_label));
+        if (dtype != IDX_UINT8 || dims[0] != res->n_samples) {
+            ERR_MSG("IDX labels must be uint8 with %d samples, got type 0x%02x and %d samples, path: %s, error.\n",
+                res->n_samples, dtype, dims[0], label_path);
+            goto err_end;
+        }
+        res->label_dtype = "uint8";
+        res->label_bytes = n_bytes / res->n_samples;
+        res->label_size = (int)res->label_bytes;
+        res->label = data;
+        if (n_classes > 0) {
+            CHK_ERR_GOTO(checkClassLabels(res));
+        }
+    }
+
+    *ds = res;
+    return SUCCESS;
+
+err_end:
+    destroyDataset(res);
+    return ERR_COD;
+}
+
+int createRawDataset(struct Dataset **ds, const struct RawDatasetDesc *desc)
+{
+    CHK_NIL(ds);
+    CHK_NIL(desc);
+    CHK_NIL(desc->data_path);
+    CHK_ERR((desc->n_dims > 0 && desc->n_dims <= DATASET_MAX_DIMS)? 0: 1);
+    CHK_ERR((desc->n_classes >= 0)? 0: 1);
+
+    const char *dtype = getCanonicalDType(desc->dtype);
+    if (dtype == NULL) {
+        ERR_MSG("unknown dtype: %s, error.\n", desc->dtype? desc->dtype: "(null)");
+        return ERR_COD;
+    }
+    unsigned int elem_size;
+    CHK_ERR(getDataElemSize(&elem_size, dtype));
+    size_t sample_bytes = elem_size;
+    int i;
+    for (i = 0; i < desc->n_dims; ++i) {
+        CHK_ERR((desc->dims[i] > 0)? 0: 1);
+        sample_bytes *= desc->dims[i];
+    }
+
+    struct Dataset *res = calloc(1, sizeof(struct Dataset));
+    CHK_NIL(res);
+    res->type = RAW_DATASET_TYPE;
+    res->dtype = dtype;
+    res->n_dims = desc->n_dims;
+    memcpy(res->dims, desc->dims, desc->n_dims * sizeof(int));
+    res->sample_bytes = sample_bytes;
+    res->n_classes = desc->n_classes;
+
+    size_t n_bytes = 0;
+    CHK_ERR_GOTO(mapRawFile(&(res->raw_data), &(res->data), &n_bytes, desc->data_path, desc->data_offset));
+    if (n_bytes % sample_bytes != 0 || n_bytes / sample_bytes > 0x7fffffff) {
+        ERR_MSG("data size %lu is not a multiple of sample size %lu, path: %s, error.\n",
+            (unsigned long)n_bytes, (unsigned long)sample_bytes, desc->data_path);
+        goto err_end;
+    }
+    res->n_samples = n_bytes / sample_bytes;
+
+    if (desc->label_path) {
+        res->label_dtype = getCanonicalDType(desc->label_dtype);
+        if (res->label_dtype == NULL || desc->label_size <= 0) {
+            ERR_MSG("bad label dtype: %s or label size: %d, error.\n", desc->label_dtype? desc->label_dtype: "(null)", desc->label_size);
+            goto err_end;
+        }
+        CHK_ERR_GOTO(getDataElemSize(&elem_size, res->label_dtype));
+        res->label_size = desc->label_size;
+        res->label_bytes = (size_t)elem_size * desc->label_size;
+        CHK_ERR_GOTO(mapRawFile(&(res->raw_label), &(res->label), &n_bytes, desc->label_path, desc->label_offset));
+        if (n_bytes != res->label_bytes * res->n_samples) {
+            ERR_MSG("label size %lu does not match %d samples * %lu bytes, path: %s, error.\n",
+                (unsigned long)n_bytes, res->n_samples, (unsigned long)res->label_bytes, desc->label_path);
+            goto err_end;
+        }
+        if (res->n_classes > 0) {
+            CHK_ERR_GOTO(checkClassLabels(res));
+        }
+    }
+
+    *ds = res;
+    return SUCCESS;
+
+err_end:
+    destroyDataset(res);
+    return ERR_COD;
+}
+
+int getDatasetType(enum DatasetType *type, const struct Dataset *ds)
+{
+    CHK_NIL(type);
+    CHK_NIL(ds);
+
+    *type = ds->type;
+    return SUCCESS;
+}
+
+int getDatasetSampleNumber(int *n_samples, const struct Dataset *ds)
+{
+    CHK_NIL(n_samples);
+    CHK_NIL(ds);
+
+    *n_samples = ds->n_samples;
+    return SUCCESS;
+}
+
+int getDatasetShape(int *n_dims, int *dims, const struct Dataset *ds)
+{
+    CHK_NIL(n_dims);
+    CHK_NIL(dims);
+    CHK_NIL(ds);
+
+    *n_dims = ds->n_dims;
+    memcpy(dims, ds->dims, ds->n_dims * sizeof(int));
+    return SUCCESS;
+}
+
+int getDatasetFeatureNumber(int *n_features, const struct Dataset *ds)
+{
+    CHK_NIL(n_features);
+    CHK_NIL(ds);
+
+    int n = 1;
+    int i;
+    for (i = 0; i < ds->n_dims; ++i) {
+        n *= ds->dims[i];
+    }
+    *n_features = n;
+    return SUCCESS;
+}
+
+int getDatasetDType(const char *(*dtype), const struct Dataset *ds)
+{
+    CHK_NIL(dtype);
+    CHK_NIL(ds);
+
+    *dtype = ds->dtype;
+    return SUCCESS;
+}
+
+int getDatasetLabelShape(int *n_label_features, const char *(*label_dtype), int *n_classes, const struct Dataset *ds)
+{
+    CHK_NIL(n_label_features);
+    CHK_NIL(label_dtype);
+    CHK_NIL(n_classes);
+    CHK_NIL(ds);
+
+    if (ds->label == NULL) {
+        *n_label_features = 0;
+        *label_dtype = NULL;
+    }
+    else if (ds->n_classes > 0) {
+        *n_label_features = ds->n_classes;
+        *label_dtype = "uint8";
+    }
+    else {
+        *n_label_features = ds->label_size;
+        *label_dtype = ds->label_dtype;
+    }
+    *n_classes = ds->n_classes;
+    return SUCCESS;
+}
+
+int getDatasetDataConstRef(const void *(*data), size_t *n_bytes, const struct Dataset *ds)
+{
+    CHK_NIL(data);
+    CHK_NIL(n_bytes);
+    CHK_NIL(ds);
+
+    *data = ds->data;
+    *n_bytes = ds->sample_bytes * ds->n_samples;
+    return SUCCESS;
+}
+
+int getDatasetLabelConstRef(const void *(*label), size_t *n_bytes, const struct Dataset *ds)
+{
+    CHK_NIL(label);
+    CHK_NIL(n_bytes);
+    CHK_NIL(ds);
+
+    *label = ds->label;
+    *n_bytes = (ds->label == NULL)? 0: ds->label_bytes * ds->n_samples;
+    return SUCCESS;
+}
+
+// 类别序号展开为onehot, sample_idx[i]为第i个样本在数据集中的下标
+static void expandOnehot(unsigned char *onehot, const struct Dataset *ds, const int *sample_idx, int n)
+{
+    memset(onehot, 0, (size_t)n * ds->n_classes);
+    int i;
+    for (i = 0; i < n; ++i) {
+        int c = (strcmp(ds->label_dtype, "uint8") == 0)?
+            ((const unsigned char *)ds->label)[sample_idx[i]]: ((const int *)ds->label)[sample_idx[i]];
+        onehot[(size_t)i * ds->n_classes + c] = 1;
+    }
+}
+
+int getDatasetBatch(void *data, void *label, int *n_samples, const struct Dataset *ds,
+    const int *perm, int start, int n_use, int batch_size, int batch_idx)
+{
+    CHK_NIL(data);
+    CHK_NIL(n_samples);
+    CHK_NIL(ds);
+    CHK_ERR((batch_size > 0)? 0: 1);
+    CHK_ERR((batch_idx >= 0)? 0: 1);
+    CHK_ERR((n_use > 0)? 0: 1);
+    CHK_ERR((start >= 0 && start + n_use <= ds->n_samples)? 0: 1);
+    if (label) {
+        CHK_NIL(ds->label);
+    }
+
+    long first = (long)batch_idx * batch_size;
+    if (first >= n_use) { // 训练循环的一个epoch结束的标识
+        *n_samples = 0;
+        return SUCCESS;
+    }
+    int n = (first + batch_size > n_use)? n_use - first: batch_size;
+
+    // 本batch各样本在数据集中的下标
+    int *idx = malloc((size_t)n * sizeof(int));
+    CHK_NIL(idx);
+    int i;
+    for (i = 0; i < n; ++i) {
+        idx[i] = start + (perm? perm[first + i]: (int)first + i);
+    }
+    if (gatherRows(data, ds->data, idx, n, ds->sample_bytes) != SUCCESS) {
+        free(idx);
+        return ERR_COD;
+    }
+    if (label) {
+        if (ds->n_classes > 0) {
+            expandOnehot(label, ds, idx, n);
+        }
+        else if (gatherRows(label, ds->label, idx, n, ds->label_bytes) != SUCCESS) {
+            free(idx);
+            return ERR_COD;
+        }
+    }
+    free(idx);
+    *n_samples = n;
+    return SUCCESS;
+}
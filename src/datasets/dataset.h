@@ -0,0 +1,76 @@
+/**
+ * @brief 通用数据集: 样本数, 单个样本的形状和元素类型, 类标类型, 以及按batch(可按排列打乱)复制数据.
+ *        样本和类标都通过mmap只读映射, 不复制; 取batch时复制到调用者的连续缓冲区, 可以直接作为DataLoader的回调使用.
+ *
+ *        后端:
+ *        IDX_DATASET_TYPE: 一个IDX样本文件(第一维为样本数)和一个可选的IDX类标文件, 目前只支持uint8元素
+ *                          (MNIST, Fashion-MNIST, EMNIST等), 多字节类型需要字节序转换, 尚未实现.
+ *        RAW_DATASET_TYPE: 按本机字节序连续存放样本的二进制文件, 可以跳过offset字节的文件头,
+ *                          样本数由文件大小决定; 类标文件同样处理.
+ *
+ *        类标两种用法: n_classes > 0时类标是每个样本一个类别序号(uint8或int32), 打开时检查都小于n_classes,
+ *        取batch时展开为n_classes字节的uint8 onehot; n_classes为0时按原样复制每个样本的类标元素.
+ *        dtype使用与forwardNetwork相同的字符串("uint8", "float32", ...).
+ */
+#pragma once
+
+#include <stddef.h>
+
+#define DATASET_MAX_DIMS (8)
+
+enum DatasetType
+{
+    UNKNOW_DATASET_TYPE,
+    IDX_DATASET_TYPE,
+    RAW_DATASET_TYPE
+};
+
+// 原始二进制数据集的描述, label_path为NULL时没有类标
+struct RawDatasetDesc
+{
+    const char *data_path;
+    size_t data_offset; // 跳过的文件头字节数
+    const char *dtype;
+    int n_dims; // 单个样本的维数
+    int dims[DATASET_MAX_DIMS];
+
+    const char *label_path;
+    size_t label_offset;
+    const char *label_dtype;
+    int label_size; // 每个样本的类标元素数, n_classes > 0时必须为1
+    int n_classes;
+};
+
+struct Dataset;
+
+/**
+ * @param label_path 可以为NULL; n_classes > 0时类标文件必须是一维的, 长度等于样本数
+ */
+int createIdxDataset(struct Dataset **ds, const char *data_path, const char *label_path, int n_classes);
+int createRawDataset(struct Dataset **ds, const struct RawDatasetDesc *desc);
+void destroyDataset(struct Dataset *ds);
+
+int getDatasetType(enum DatasetType *type, const struct Dataset *ds);
+int getDatasetSampleNumber(int *n_samples, const struct Dataset *ds);
+// 单个样本的形状(不含样本维), dims至少DATASET_MAX_DIMS个元素
+int getDatasetShape(int *n_dims, int *dims, const struct Dataset *ds);
+// 单个样本的元素数, 即各维的乘积
+int getDatasetFeatureNumber(int *n_features, const struct Dataset *ds);
+int getDatasetDType(const char *(*dtype), const struct Dataset *ds);
+/**
+ * @brief 取batch时每个样本的类标元素数和类型: n_classes > 0时为(n_classes, "uint8"), 否则为类标文件中的元素数和类型.
+ *        没有类标时*n_label_features为0
+ */
+int getDatasetLabelShape(int *n_label_features, const char *(*label_dtype), int *n_classes, const struct Dataset *ds);
+
+// 全部样本/类标在映射中的起始地址和字节数, 在destroyDataset之前有效; 没有类标时*label为NULL
+int getDatasetDataConstRef(const void *(*data), size_t *n_bytes, const struct Dataset *ds);
+int getDatasetLabelConstRef(const void *(*label), size_t *n_bytes, const struct Dataset *ds);
+
+/**
+ * @brief 从样本[start, start + n_use)中取第batch_idx个batch, 复制到data和label(label可以为NULL).
+ *        perm为[0, n_use)的一个排列时按排列取样本, 为NULL时按顺序取.
+ *        data至少batch_size个样本, label至少batch_size * n_label_features个元素. *n_samples返回0表示当前epoch结束.
+ */
+int getDatasetBatch(void *data, void *label, int *n_samples, const struct Dataset *ds,
+    const int *perm, int start, int n_use, int batch_size, int batch_idx);
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "debug_macros.h"
+#include "idx_file.h"
+
+#define IDX_PATH_SIZE (1024)
+
+struct IdxFile
+{
+    char path[IDX_PATH_SIZE];
+    enum IdxDType dtype;
+    int n_dims;
+    int dims[IDX_MAX_DIMS];
+
+    void *map; // 整个文件的映射
+    size_t map_bytes;
+    const unsigned char *data; // 数据区, 跳过文件头
+    size_t data_bytes;
+};
+
+static int getIdxElemSize(size_t *size, int code)
+{
+    switch (code) {
+    case IDX_UINT8:
+    case IDX_INT8:
+        *size = 1;
+        break;
+    case IDX_INT16:
+        *size = 2;
+        break;
+    case IDX_INT32:
+    case IDX_FLOAT32:
+        *size = 4;
+        break;
+    case IDX_FLOAT64:
+        *size = 8;
+        break;
+    default:
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+// 校验文件头并填写dtype, n_dims, dims, data, data_bytes
+static int parseIdxHeader(struct IdxFile *f)
+{
+    const unsigned char *p = f->map;
+    if (f->map_bytes < 4 || p[0] != 0 || p[1] != 0) {
+        ERR_MSG("bad IDX magic, path: %s, error.\n", f->path);
+        return ERR_COD;
+    }
+    size_t elem_size;
+    if (getIdxElemSize(&elem_size, p[2]) != SUCCESS) {
+        ERR_MSG("unknown IDX element type 0x%02x, path: %s, error.\n", p[2], f->path);
+        return ERR_COD;
+    }
+    int n_dims = p[3];
+    if (n_dims < 1 || n_dims > IDX_MAX_DIMS) {
+        ERR_MSG("IDX dims %d not in [1, %d], path: %s, error.\n", n_dims, IDX_MAX_DIMS, f->path);
+        return ERR_COD;
+    }
+    size_t header_bytes = 4 + 4 * (size_t)n_dims;
+    if (f->map_bytes < header_bytes) {
+        ERR_MSG("IDX header truncated, path: %s, error.\n", f->path);
+        return ERR_COD;
+    }
+
+    size_t n_elems = 1;
+    int i;
+    for (i = 0; i < n_dims; ++i) {
+        const unsigned char *q = p + 4 + 4 * i;
+        uint32_t d = ((uint32_t)q[0] << 24) | ((uint32_t)q[1] << 16) | ((uint32_t)q[2] << 8) | (uint32_t)q[3];
+        if (d == 0 || d > 0x7fffffffU || n_elems > SIZE_MAX / d) {
+            ERR_MSG("bad IDX dim[%d] = %u, path: %s, error.\n", i, d, f->path);
+            return ERR_COD;
+        }
+        f->dims[i] = (int)d;
+        n_elems *= d;
+    }
+    if (n_elems > (SIZE_MAX - header_bytes) / elem_size || f->map_bytes != header_bytes + n_elems * elem_size) {
+        ERR_MSG("IDX file size %lu does not match header (%lu + %lu * %lu bytes), path: %s, error.\n",
+            (unsigned long)f->map_bytes, (unsigned long)header_bytes, (unsigned long)n_elems, (unsigned long)elem_size, f->path);
+        return ERR_COD;
+    }
+
+    f->dtype = p[2];
+    f->n_dims = n_dims;
+    f->data = p + header_bytes;
+    f->data_bytes = n_elems * elem_size;
+    return SUCCESS;
+}
+
+int openIdxFile(struct IdxFile **f, const char *path)
+{
+    CHK_NIL(f);
+    CHK_NIL(path);
+
+    struct IdxFile *res = calloc(1, sizeof(struct IdxFile));
+    CHK_NIL(res);
+    snprintf(res->path, IDX_PATH_SIZE, "%s", path);
+    res->map = MAP_FAILED;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ERR_MSG("fstat() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    if (st.st_size < 4) {
+        ERR_MSG("IDX file too small: %ld bytes, path: %s, error.\n", (long)st.st_size, path);
+        goto err_end;
+    }
+    res->map_bytes = st.st_size;
+    res->map = mmap(NULL, res->map_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (res->map == MAP_FAILED) {
+        ERR_MSG("mmap() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    close(fd); // 映射建立后不再需要fd
+    fd = -1;
+    madvise(res->map, res->map_bytes, MADV_WILLNEED); // 只是提示内核预读, 失败不影响正确性
+
+    CHK_ERR_GOTO(parseIdxHeader(res));
+    *f = res;
+    return SUCCESS;
+
+err_end:
+    if (fd != -1) {
+        close(fd);
+    }
+    closeIdxFile(res);
+    return ERR_COD;
+}
+
+void closeIdxFile(struct IdxFile *f)
+{
+    if (f) {
+        if (f->map != MAP_FAILED && f->map != NULL) {
+            munmap(f->map, f->map_bytes);
+        }
+        free(f);
+    }
+}
+
+int getIdxFileDType(enum IdxDType *dtype, const struct IdxFile *f)
+{
+    CHK_NIL(dtype);
+    CHK_NIL(f);
+
+    *dtype = f->dtype;
+    return SUCCESS;
+}
+
+int getIdxFileShape(int *n_dims, int *dims, const struct IdxFile *f)
+{
+    CHK_NIL(n_dims);
+    CHK_NIL(dims);
+    CHK_NIL(f);
+
+    *n_dims = f->n_dims;
+    memcpy(dims, f->dims, f->n_dims * sizeof(int));
+    return SUCCESS;
+}
+
+int getIdxFileData(const void *(*data), size_t *n_bytes, const struct IdxFile *f)
+{
+    CHK_NIL(data);
+    CHK_NIL(n_bytes);
+    CHK_NIL(f);
+
+    *data = f->data;
+    *n_bytes = f->data_bytes;
+    return SUCCESS;
+}
+
+int checkIdxFileShape(const struct IdxFile *f, enum IdxDType dtype, int n_dims, const int *dims)
+{
+    CHK_NIL(f);
+    CHK_NIL(dims);
+
+    int ok = (f->dtype == dtype && f->n_dims == n_dims)? 1: 0;
+    int i;
+    for (i = 0; ok && i < n_dims; ++i) {
+        ok = (f->dims[i] == dims[i])? 1: 0;
+    }
+    if (!ok) {
+        char shape[128];
+        int len = 0;
+        for (i = 0; i < f->n_dims && len < (int)sizeof(shape) - 12; ++i) {
+            len += snprintf(shape + len, sizeof(shape) - len, (i == 0)? "%d": " x %d", f->dims[i]);
+        }
+        ERR_MSG("unexpected IDX content: type 0x%02x, shape (%s), path: %s, error.\n", f->dtype, shape, f->path);
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
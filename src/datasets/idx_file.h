@@ -0,0 +1,39 @@
+/**
+ * @brief IDX格式文件(MNIST使用的格式)的只读映射, 见http://yann.lecun.com/exdb/mnist/
+ *        文件头: 2个0字节, 1字节元素类型, 1字节维数, 然后每维一个大端序uint32.
+ *        打开时校验文件头, 并检查文件大小恰好等于文件头加各维乘积个元素, 截断或多余的字节都视为错误.
+ *
+ *        数据区通过mmap直接暴露给调用者, 不复制; 多字节元素保持文件中的大端序.
+ *        打开时只建立映射并提示内核预读, 数据在首次访问时按页读入, 首次访问可以分给多个线程并行.
+ */
+#pragma once
+
+#include <stddef.h>
+
+#define IDX_MAX_DIMS (8)
+
+enum IdxDType
+{
+    IDX_UINT8 = 0x08,
+    IDX_INT8 = 0x09,
+    IDX_INT16 = 0x0B,
+    IDX_INT32 = 0x0C,
+    IDX_FLOAT32 = 0x0D,
+    IDX_FLOAT64 = 0x0E
+};
+
+struct IdxFile;
+
+int openIdxFile(struct IdxFile **f, const char *path);
+void closeIdxFile(struct IdxFile *f);
+
+int getIdxFileDType(enum IdxDType *dtype, const struct IdxFile *f);
+// dims至少有IDX_MAX_DIMS个元素
+int getIdxFileShape(int *n_dims, int *dims, const struct IdxFile *f);
+// 数据区的起始地址和字节数, 在closeIdxFile之前有效
+int getIdxFileData(const void *(*data), size_t *n_bytes, const struct IdxFile *f);
+
+/**
+ * @brief 检查元素类型和形状与期望一致, 不一致时打印文件路径和实际形状并返回ERR_COD
+ */
+int checkIdxFileShape(const struct IdxFile *f, enum IdxDType dtype, int n_dims, const int *dims);
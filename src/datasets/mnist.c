@@ -10,9 +10,10 @@
 #include "debug_macros.h"
 #include "data_utils.h"
 #include "io_utils.h"
+#include "memory.h"
+#include "dataset.h"
 #include "mnist.h"
 
-#define MNIST_IMG_OFFSET (16)
 #define MNIST_LABEL_OFFSET (8)
 
 // mnist original file names
@@ -23,8 +24,147 @@
 
 //#define NORM_CONST (255)
 
-// 用法：声明栈变量data, load(&data, src_dir)
-int loadMnistAll(struct MNIST *data, const char *src_dir)
+// loadMnistAll中results[i]的字节数, 即struct MNIST中各成员的字节数; 0表示由transformOnehot分配, 用free释放.
+// results[0..3]直接指向IDX文件的映射, 由destroyDataset释放
+static const size_t g_blob_sizes[10] = {
+    MNIST_SAMPLE_SIZE * MNIST_N_TRAIN, MNIST_N_TRAIN, MNIST_SAMPLE_SIZE * MNIST_N_TEST, MNIST_N_TEST,
+    50000 * MNIST_WIDTH * MNIST_HEIGHT * sizeof(float), 0,
+    10000 * MNIST_WIDTH * MNIST_HEIGHT * sizeof(float), 0,
+    MNIST_N_TEST * MNIST_WIDTH * MNIST_HEIGHT * sizeof(float), 0
+};
+
+// 缓存文件中results[4..9]各项的名字, 以及均值/方差(2个double)一项
+static const char *g_cache_names[10] = {
+    NULL, NULL, NULL, NULL,
+    "train_images_norm", "train_labels_onehot", "valid_images_norm", "valid_labels_onehot", "test_images_norm", "test_labels_onehot"
+};
+static const size_t g_onehot_sizes[10] = {
+    0, 0, 0, 0, 0, 50000 * MNIST_N_CLASSES, 0, 10000 * MNIST_N_CLASSES, 0, MNIST_N_TEST * MNIST_N_CLASSES
+};
+#define MNIST_CACHE_STATS_NAME ("mean_std")
+#define MNIST_CACHE_RECIPE (0x4d4e495354000001ULL) // 预处理方法(划分, 归一化, onehot)改变时修改, 使旧缓存失效
+
+static void freeMnistBlob(void *ptr, int idx)
+{
+    if (g_blob_sizes[idx] == 0) {
+        free(ptr);
+    }
+    else {
+        freeBlob(ptr, g_blob_sizes[idx]);
+    }
+}
+
+int createMnistDataset(struct Dataset **ds, const char *src_dir, const char *type)
+{
+    CHK_NIL(ds);
+    CHK_NIL(src_dir);
+    CHK_NIL(type);
+
+    const char *images_name = NULL;
+    const char *labels_name = NULL;
+    int n_expected = 0;
+    if (strcasecmp(type, "train") == 0) {
+        images_name = MNIST_TRAIN_IMAGES_NAME;
+        labels_name = MNIST_TRAIN_LABELS_NAME;
+        n_expected = MNIST_N_TRAIN;
+    } else if (strcasecmp(type, "test") == 0) {
+        images_name = MNIST_TEST_IMAGES_NAME;
+        labels_name = MNIST_TEST_LABELS_NAME;
+        n_expected = MNIST_N_TEST;
+    } else {
+        ERR_MSG("MNIST type: %s is not supported, error.\n", type);
+        return ERR_COD;
+    }
+
+    char images_path[1024];
+    char labels_path[1024];
+    snprintf(images_path, 1024, "%s/%s", src_dir, images_name);
+    snprintf(labels_path, 1024, "%s/%s", src_dir, labels_name);
+    struct Dataset *res = NULL;
+    CHK_ERR(createIdxDataset(&res, images_path, labels_path, MNIST_N_CLASSES)); // 类标的范围在其中检查
+
+    int n_samples, n_dims;
+    int dims[DATASET_MAX_DIMS];
+    CHK_ERR_GOTO(getDatasetSampleNumber(&n_samples, res));
+    CHK_ERR_GOTO(getDatasetShape(&n_dims, dims, res));
+    if (n_samples != n_expected || n_dims != 2 || dims[0] != MNIST_HEIGHT || dims[1] != MNIST_WIDTH) {
+        ERR_MSG("unexpected MNIST %s shape: %d samples, %d dims, path: %s, error.\n", type, n_samples, n_dims, images_path);
+        goto err_end;
+    }
+    *ds = res;
+    return SUCCESS;
+
+err_end:
+    destroyDataset(res);
+    return ERR_COD;
+}
+
+// 缓存的key: 4个源文件数据区内容的哈希, 串联在预处理方法的版本之后
+static int getMnistCacheKey(uint64_t *key, void *results[10])
+{
+    uint64_t h = MNIST_CACHE_RECIPE;
+    int i;
+    for (i = 0; i < 4; ++i) {
+        CHK_ERR(getDataHash(&h, results[i], g_blob_sizes[i], h));
+    }
+    *key = h;
+    return SUCCESS;
+}
+
+// 从缓存取results[4..9]和均值/方差, 缺少某一项或大小不符时返回ERR_COD(不打印错误), 视为未命中
+static int getMnistFromCache(void *results[10], double *mean, double *std, const struct DataCache *cache, int to_float)
+{
+    const void *p = NULL;
+    size_t n_bytes = 0;
+    double stats[2];
+    if (getDataCacheEntry(&p, &n_bytes, cache, MNIST_CACHE_STATS_NAME) != SUCCESS || p == NULL || n_bytes != sizeof(stats)) {
+        return ERR_COD;
+    }
+    memcpy(stats, p, sizeof(stats));
+
+    void *res[10] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+    int i;
+    for (i = 4; i < 10; ++i) {
+        int is_float = (g_onehot_sizes[i] == 0);
+        if (is_float && !to_float) {
+            continue;
+        }
+        size_t expected = is_float? g_blob_sizes[i]: g_onehot_sizes[i];
+        if (getDataCacheEntry(&p, &n_bytes, cache, g_cache_names[i]) != SUCCESS || p == NULL || n_bytes != expected) {
+            return ERR_COD;
+        }
+        res[i] = (void *)p;
+    }
+    for (i = 4; i < 10; ++i) {
+        results[i] = res[i];
+    }
+    *mean = stats[0];
+    *std = stats[1];
+    return SUCCESS;
+}
+
+static int writeMnistCache(const char *cache_path, uint64_t key, void *results[10], double mean, double std)
+{
+    struct DataCacheWriter *w = NULL;
+    double stats[2] = {mean, std};
+    CHK_ERR(createDataCacheWriter(&w, cache_path, key));
+    CHK_ERR_GOTO(addDataCacheEntry(w, MNIST_CACHE_STATS_NAME, stats, sizeof(stats)));
+    int i;
+    for (i = 4; i < 10; ++i) {
+        if (results[i] == NULL) { // loadMnistUint8时没有float数组
+            continue;
+        }
+        CHK_ERR_GOTO(addDataCacheEntry(w, g_cache_names[i], results[i], (g_onehot_sizes[i] == 0)? g_blob_sizes[i]: g_onehot_sizes[i]));
+    }
+    return closeDataCacheWriter(w);
+
+err_end:
+    destroyDataCacheWriter(w);
+    return ERR_COD;
+}
+
+// to_float为0时不生成float数组, 只在原始数据上统计均值和方差; cache_path不为NULL时先查缓存, 未命中时计算后写缓存
+static int loadMnistImpl(struct MNIST *data, const char *src_dir, int to_float, const char *cache_path)
 {
     CHK_NIL(data);
     CHK_NIL(src_dir);
@@ -32,74 +172,68 @@ int loadMnistAll(struct MNIST *data, const char *src_dir)
     struct timeval t0, t1, t2;
     CHK_ERR(gettimeofday(&t0, NULL));
 
-    int fd = -1;
     int i;
+    struct Dataset *sets[2] = {NULL, NULL};
     void *results[10] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
-    const char *names[4] = {MNIST_TRAIN_IMAGES_NAME, MNIST_TRAIN_LABELS_NAME, MNIST_TEST_IMAGES_NAME, MNIST_TEST_LABELS_NAME};
-    const unsigned int offsets[4] = {MNIST_IMG_OFFSET, MNIST_LABEL_OFFSET, MNIST_IMG_OFFSET, MNIST_LABEL_OFFSET};
-    const unsigned int sizes[4] = {MNIST_WIDTH * MNIST_HEIGHT * MNIST_N_TRAIN, MNIST_N_TRAIN, MNIST_WIDTH * MNIST_HEIGHT * MNIST_N_TEST, MNIST_N_TEST};
-
-    char path[1024];
-    for (i = 0; i < 4; ++i) {
-        snprintf(path, 1024, "%s/%s", src_dir, names[i]);
+    double mean = 0., std = 1.; // 训练集(前50000个)上的均值和方差
+    const char *types[2] = {"train", "test"};
+    struct DataCache *cache = NULL;
+    uint64_t key = 0;
+
+    // 只建立映射, 原始数据不复制
+    for (i = 0; i < 2; ++i) {
+        const void *images = NULL;
+        const void *labels = NULL;
+        size_t n_bytes;
+        CHK_ERR_GOTO(createMnistDataset(&(sets[i]), src_dir, types[i]));
+        CHK_ERR_GOTO(getDatasetDataConstRef(&images, &n_bytes, sets[i]));
+        CHK_ERR_GOTO(getDatasetLabelConstRef(&labels, &n_bytes, sets[i]));
+        results[2 * i] = (void *)images;
+        results[2 * i + 1] = (void *)labels;
+    }
 
-        int fd = open(path, O_RDONLY); // open file
-        if (fd == -1) {
-            ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
-            goto err_end;
+    if (cache_path) { // 哈希的一遍同时把源文件的缺页分散到各线程
+        CHK_ERR_GOTO(getMnistCacheKey(&key, results));
+        CHK_ERR_GOTO(openDataCache(&cache, cache_path, key));
+        if (cache && getMnistFromCache(results, &mean, &std, cache, to_float) != SUCCESS) {
+            closeDataCache(cache);
+            cache = NULL;
         }
-
-        results[i] = calloc(sizes[i], sizeof(unsigned char)); // alloc memory
-        if (results[i] == NULL) {
-            ERR_MSG("calloc() failed, %s, error.\n", ERRNO_DETAIL(errno));
-            goto err_end;
+        if (cache) {
+            CHK_ERR_GOTO(gettimeofday(&t1, NULL));
+            timersub(&t1, &t0, &t2);
+            fprintf(stdout, "MNIST data read from cache %s, time elapsed: %lu.%06lus\n", cache_path, t2.tv_sec, t2.tv_usec);
+            goto finish;
         }
+    }
 
-        if (lseek(fd, offsets[i], SEEK_SET) == -1) { // skip the data header
-            ERR_MSG("lseek() failed, %s, error.\n", ERRNO_DETAIL(errno));
+    // 并行统计直方图, 训练集图片的缺页也在这一遍中分散到各线程
+    int n_train_elems = 50000 * MNIST_HEIGHT * MNIST_WIDTH;
+    int n_valid_elems = 10000 * MNIST_HEIGHT * MNIST_WIDTH;
+    int n_test_elems = MNIST_N_TEST * MNIST_HEIGHT * MNIST_WIDTH;
+    CHK_ERR_GOTO(getDataMeanStd(&mean, &std, results[0], "uint8", n_train_elems));
+    fprintf(stdout, "mean = %f\nstd = %f\n", mean, std);
+
+    if (to_float) {
+        if ((results[4] = allocBlob(g_blob_sizes[4])) == NULL) {
+            ERR_MSG("allocBlob() failed, error.\n");
             goto err_end;
         }
-
-        if (read(fd, results[i], sizes[i] * sizeof(unsigned char)) == -1) {; // read bytes
-            ERR_MSG("calloc() failed, %s, error.\n", ERRNO_DETAIL(errno));
+        if ((results[6] = allocBlob(g_blob_sizes[6])) == NULL) {
+            ERR_MSG("allocBlob() failed, error.\n");
             goto err_end;
         }
-
-        if (close(fd) == -1) { // close file
-            ERR_MSG("close() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
+        if ((results[8] = allocBlob(g_blob_sizes[8])) == NULL) {
+            ERR_MSG("allocBlob() failed, error.\n");
             goto err_end;
         }
-    }
 
-    int n_train_elems = 50000 * MNIST_HEIGHT * MNIST_WIDTH;
-    int n_valid_elems = 10000 * MNIST_HEIGHT * MNIST_WIDTH;
-    if ((results[4] = calloc(n_train_elems, sizeof(float))) == NULL) {
-        ERR_MSG("calloc() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
-        goto err_end;
-    }
-    if ((results[6] = calloc(n_valid_elems, sizeof(float))) == NULL) {
-        ERR_MSG("calloc() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
-        goto err_end;
-    }
-    int n_test_elems = MNIST_N_TEST * MNIST_HEIGHT * MNIST_WIDTH; 
-    if ((results[8] = calloc(n_test_elems, sizeof(float))) == NULL) {
-        ERR_MSG("calloc() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
-        goto err_end;
+        // 转换和归一化合为一遍并行完成, 测试集也使用训练集的均值和方差
+        CHK_ERR_GOTO(transformToNormalizedFloat32FromUint8((float *)(results[4]), (unsigned char *)(results[0]), n_train_elems, mean, std));
+        CHK_ERR_GOTO(transformToNormalizedFloat32FromUint8((float *)(results[6]), (unsigned char *)(results[0]) + n_train_elems, n_valid_elems, mean, std));
+        CHK_ERR_GOTO(transformToNormalizedFloat32FromUint8((float *)(results[8]), (unsigned char *)(results[2]), n_test_elems, mean, std));
     }
 
-    CHK_ERR_GOTO(transformToFloat32FromUint8((float *)(results[4]), (unsigned char *)(results[0]), n_train_elems));
-
-    double mean, std; // 训练集(前50000个)上的均值和方差
-    CHK_ERR_GOTO(getDataMean(&mean, (float *)(results[4]), "float32", n_train_elems));
-    CHK_ERR_GOTO(getDataStd(&std, (float *)(results[4]), "float32", n_train_elems));
-    fprintf(stdout, "mean = %f\nstd = %f\n", mean, std); 
-
-    CHK_ERR_GOTO(getDataNormalization(results[4], "float32", n_train_elems, mean, std));
-    CHK_ERR_GOTO(transformToFloat32FromUint8((float *)(results[6]), (unsigned char *)(results[0]) + n_train_elems, n_valid_elems));
-    CHK_ERR_GOTO(getDataNormalization(results[6], "float32", n_valid_elems, mean, std));
-    CHK_ERR_GOTO(transformToFloat32FromUint8((float *)(results[8]), (unsigned char *)(results[2]), n_test_elems));
-    CHK_ERR_GOTO(getDataNormalization(results[8], "float32", n_test_elems, mean, std)); // 测试集也使用训练集的均值和方差
-
     CHK_ERR_GOTO(transformOnehot((void **)(&(results[5])), "uint8", results[1], "uint8", 50000, MNIST_N_CLASSES));
     CHK_ERR_GOTO(transformOnehot((void **)(&(results[7])), "uint8", (void *)((unsigned char *)(results[1]) + 50000), "uint8", 10000, MNIST_N_CLASSES));
     CHK_ERR_GOTO(transformOnehot((void **)(&(results[9])), "uint8", results[3], "uint8", MNIST_N_TEST, MNIST_N_CLASSES));
@@ -107,7 +241,11 @@ int loadMnistAll(struct MNIST *data, const char *src_dir)
     CHK_ERR_GOTO(gettimeofday(&t1, NULL));
     timersub(&t1, &t0, &t2);
     fprintf(stdout, "MNIST data read finish, time elapsed: %lu.%06lus\n", t2.tv_sec, t2.tv_usec);
+    if (cache_path && writeMnistCache(cache_path, key, results, mean, std) != SUCCESS) {
+        ERR_MSG("failed to write MNIST cache %s, continue without it.\n", cache_path);
+    }
 
+finish:
     memset(data, 0, sizeof(struct MNIST));
     data->train_images = results[0];
     data->train_labels = results[1];
@@ -119,33 +257,69 @@ int loadMnistAll(struct MNIST *data, const char *src_dir)
     data->valid_labels_onehot = results[7];
     data->test_images_norm = results[8];
     data->test_labels_onehot = results[9];
+    data->mean = mean;
+    data->std = std;
+    data->train_set = sets[0];
+    data->test_set = sets[1];
+    data->cache = cache;
 
     return SUCCESS;
 
 err_end:
-    for (i = 0; i < 10; ++i) {
-        free(results[i]);
+    if (cache) { // results[4..9]指向缓存
+        closeDataCache(cache);
     }
-    if (close(fd) == -1) {
-        if (errno != EBADF) {
-            ERR_MSG("close() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
-            return ERR_COD;
+    else {
+        for (i = 4; i < 10; ++i) {
+            freeMnistBlob(results[i], i);
         }
     }
+    for (i = 0; i < 2; ++i) {
+        destroyDataset(sets[i]);
+    }
     return ERR_COD;
 }
 
+// 解除原始数据的映射
+static void closeMnistFiles(struct MNIST *data)
+{
+    destroyDataset(data->train_set);
+    destroyDataset(data->test_set);
+    data->train_set = NULL;
+    data->test_set = NULL;
+    data->train_images = NULL;
+    data->train_labels = NULL;
+    data->test_images = NULL;
+    data->test_labels = NULL;
+}
+
+// 用法：声明栈变量data, load(&data, src_dir)
+int loadMnistAll(struct MNIST *data, const char *src_dir)
+{
+    return loadMnistImpl(data, src_dir, 1, NULL);
+}
+
+int loadMnistUint8(struct MNIST *data, const char *src_dir)
+{
+    return loadMnistImpl(data, src_dir, 0, NULL);
+}
+
+int loadMnistAllCached(struct MNIST *data, const char *src_dir, const char *cache_path)
+{
+    CHK_NIL(cache_path);
+    return loadMnistImpl(data, src_dir, 1, cache_path);
+}
+
+int loadMnistUint8Cached(struct MNIST *data, const char *src_dir, const char *cache_path)
+{
+    CHK_NIL(cache_path);
+    return loadMnistImpl(data, src_dir, 0, cache_path);
+}
+
 int loadMnist(struct MNIST *mnist, const char *src_dir)
 {
     CHK_ERR(loadMnistAll(mnist, src_dir));
-    free(mnist->train_images);
-    free(mnist->train_labels);
-    free(mnist->test_images);
-    free(mnist->test_labels);
-    mnist->train_images = NULL;
-    mnist->train_labels = NULL;
-    mnist->test_images = NULL;
-    mnist->test_labels = NULL;
+    closeMnistFiles(mnist);
 
     return 0;
 }
@@ -153,16 +327,25 @@ int loadMnist(struct MNIST *mnist, const char *src_dir)
 void freeMnist(struct MNIST *data)
 {
     if (data) {
-        free(data->train_images);
-        free(data->train_labels);
-        free(data->test_images);
-        free(data->test_labels);
-        free(data->train_images_norm);
-        free(data->train_labels_onehot);
-        free(data->valid_images_norm);
-        free(data->valid_labels_onehot);
-        free(data->test_images_norm);
-        free(data->test_labels_onehot);
+        closeMnistFiles(data);
+        if (data->cache) {
+            closeDataCache(data->cache);
+            data->cache = NULL;
+        }
+        else {
+            freeMnistBlob(data->train_images_norm, 4);
+            freeMnistBlob(data->train_labels_onehot, 5);
+            freeMnistBlob(data->valid_images_norm, 6);
+            freeMnistBlob(data->valid_labels_onehot, 7);
+            freeMnistBlob(data->test_images_norm, 8);
+            freeMnistBlob(data->test_labels_onehot, 9);
+        }
+        data->train_images_norm = NULL;
+        data->train_labels_onehot = NULL;
+        data->valid_images_norm = NULL;
+        data->valid_labels_onehot = NULL;
+        data->test_images_norm = NULL;
+        data->test_labels_onehot = NULL;
     }
 }
 
@@ -243,6 +426,88 @@ int getMnistNthBatch(const float *(*data_float), const unsigned char *(*label_on
     return SUCCESS;
 }
 
+int getMnistShuffledBatch(float *data, unsigned char *label_onehot, int *n_samples, const char *type, const struct MNIST *mnist, const int *perm, int n_use, int batch_size, int batch_idx)
+{
+    CHK_NIL(data);
+    CHK_NIL(label_onehot);
+    CHK_NIL(n_samples);
+    CHK_NIL(type);
+    CHK_NIL(mnist);
+    CHK_NIL(perm);
+    CHK_ERR((batch_size > 0)? 0: 1);
+    CHK_ERR((batch_idx >= 0)? 0: 1);
+    CHK_ERR((n_use > 0)? 0: 1);
+
+    const float *data_all = NULL;
+    const unsigned char *label_onehot_all = NULL;
+    if (strcasecmp(type, "train") == 0) {
+        CHK_ERR((n_use < MNIST_N_TRAIN)? 0: 1);
+        data_all = mnist->train_images_norm;
+        label_onehot_all = mnist->train_labels_onehot;
+    } else if (strcasecmp(type, "test") == 0) {
+        CHK_ERR((n_use < MNIST_N_TEST)? 0: 1);
+        data_all = mnist->test_images_norm;
+        label_onehot_all = mnist->test_labels_onehot;
+    } else {
+        ERR_MSG("MNIST type: %s is not supported, error.\n", type);
+        return ERR_COD;
+    }
+    CHK_NIL(data_all);
+    CHK_NIL(label_onehot_all);
+
+    int start = batch_idx * batch_size;
+    if (start >= n_use) { // 训练循环的一个epoch结束的标识
+        *n_samples = 0;
+        return SUCCESS;
+    }
+    int n = (start + batch_size > n_use)? n_use - start: batch_size;
+    CHK_ERR(gatherRows(data, data_all, perm + start, n, MNIST_SAMPLE_SIZE * sizeof(float)));
+    CHK_ERR(gatherRows(label_onehot, label_onehot_all, perm + start, n, MNIST_N_CLASSES));
+    *n_samples = n;
+    return SUCCESS;
+}
+
+int getMnistShuffledBatchUint8(unsigned char *data, unsigned char *label_onehot, int *n_samples, const char *type, const struct MNIST *mnist, const int *perm, int n_use, int batch_size, int batch_idx)
+{
+    CHK_NIL(data);
+    CHK_NIL(label_onehot);
+    CHK_NIL(n_samples);
+    CHK_NIL(type);
+    CHK_NIL(mnist);
+    CHK_NIL(perm);
+    CHK_ERR((batch_size > 0)? 0: 1);
+    CHK_ERR((batch_idx >= 0)? 0: 1);
+    CHK_ERR((n_use > 0)? 0: 1);
+
+    const unsigned char *data_all = NULL;
+    const unsigned char *label_onehot_all = NULL;
+    if (strcasecmp(type, "train") == 0) {
+        CHK_ERR((n_use < MNIST_N_TRAIN)? 0: 1);
+        data_all = mnist->train_images;
+        label_onehot_all = mnist->train_labels_onehot;
+    } else if (strcasecmp(type, "test") == 0) {
+        CHK_ERR((n_use < MNIST_N_TEST)? 0: 1);
+        data_all = mnist->test_images;
+        label_onehot_all = mnist->test_labels_onehot;
+    } else {
+        ERR_MSG("MNIST type: %s is not supported, error.\n", type);
+        return ERR_COD;
+    }
+    CHK_NIL(data_all);
+    CHK_NIL(label_onehot_all);
+
+    int start = batch_idx * batch_size;
+    if (start >= n_use) { // 训练循环的一个epoch结束的标识
+        *n_samples = 0;
+        return SUCCESS;
+    }
+    int n = (start + batch_size > n_use)? n_use - start: batch_size;
+    CHK_ERR(gatherRows(data, data_all, perm + start, n, MNIST_SAMPLE_SIZE));
+    CHK_ERR(gatherRows(label_onehot, label_onehot_all, perm + start, n, MNIST_N_CLASSES));
+    *n_samples = n;
+    return SUCCESS;
+}
+
 /**
  * @brief 取出指定序号的batch的训练数据
  *
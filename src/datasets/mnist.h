@@ -12,9 +12,15 @@
 #define MNIST_ELEM_SIZE (sizeof(unsigned char))
 #define MNIST_SAMPLE_SIZE (MNIST_WIDTH * MNIST_HEIGHT * MNIST_ELEM_SIZE)
 
+#include "dataset.h"
+#include "data_cache.h"
+
 struct MNIST
 {
-    // oringinal data
+    // oringinal data, 只读, 指向train_set和test_set中IDX文件的映射
+    struct Dataset *train_set;
+    struct Dataset *test_set;
+
     unsigned char *train_images;
     unsigned char *train_labels;
     unsigned char *test_images;
@@ -27,13 +33,46 @@ struct MNIST
     unsigned char *valid_labels_onehot;
     float *test_images_norm;
     unsigned char *test_labels_onehot;
+
+    // 训练集(前50000个)原始像素的均值和标准差, 用于setLinearLayerInputNormalization
+    double mean;
+    double std;
+
+    // 从缓存文件加载时transformed data和均值/方差都指向其映射, 由freeMnist关闭; 否则为NULL
+    struct DataCache *cache;
 };
 
+/**
+ * @brief MNIST作为通用数据集的一个实例: type为"train"或"test", 检查样本数和28 x 28的形状, 类标取batch时展开为10类onehot.
+ *        同样格式的Fashion-MNIST等数据集直接使用createIdxDataset.
+ */
+int createMnistDataset(struct Dataset **ds, const char *src_dir, const char *type);
+
 // 用法：声明栈变量data, load(&data, src_dir)
 int loadMnist(struct MNIST *data, const char *src_dir);
 int loadMnistAll(struct MNIST *data, const char *src_dir);
+/**
+ * @brief 只加载原始uint8图片和onehot类标, 不生成*_images_norm(为NULL), 数据集占用的内存约为loadMnistAll的1/5.
+ *        归一化交给第一层在计算时完成, 见setLinearLayerInputNormalization.
+ */
+int loadMnistUint8(struct MNIST *data, const char *src_dir);
+/**
+ * @brief 同loadMnistAll/loadMnistUint8, 但预处理结果(归一化的图片, onehot类标, 均值/方差)保存在缓存文件cache_path中.
+ *        缓存的key为4个源文件内容的哈希, 命中时直接映射缓存文件, 不再重新计算; 未命中(包括源文件改变)时计算后重写缓存.
+ *        写缓存失败只打印提示, 不影响加载结果.
+ */
+int loadMnistAllCached(struct MNIST *data, const char *src_dir, const char *cache_path);
+int loadMnistUint8Cached(struct MNIST *data, const char *src_dir, const char *cache_path);
 void freeMnist(struct MNIST *data);
 int getMnistNthBatch(const float *(*data_float), const unsigned char *(*label_onehot), int *n_samples, const char *type, const struct MNIST *mnist, int n_use, int batch_size, int batch_idx);
+/**
+ * @brief 按排列perm(n_use个样本下标的一个排列)取出第batch_idx个batch, 复制到调用者提供的连续缓冲区中.
+ *        data至少batch_size * MNIST_SAMPLE_SIZE个float, label_onehot至少batch_size * MNIST_N_CLASSES字节.
+ *        *n_samples返回0表示当前epoch结束.
+ */
+int getMnistShuffledBatch(float *data, unsigned char *label_onehot, int *n_samples, const char *type, const struct MNIST *mnist, const int *perm, int n_use, int batch_size, int batch_idx);
+// 同getMnistShuffledBatch, 但复制原始uint8图片, data至少batch_size * MNIST_SAMPLE_SIZE字节, 需要loadMnistUint8或loadMnistAll加载的数据
+int getMnistShuffledBatchUint8(unsigned char *data, unsigned char *label_onehot, int *n_samples, const char *type, const struct MNIST *mnist, const int *perm, int n_use, int batch_size, int batch_idx);
 int getMnistNthBatchOrin(const unsigned char *(*data), const unsigned char *(*label), int *n_samples, const char *type, const struct MNIST *mnist, int n_use, int batch_size, int batch_idx);
 
 int dumpMnistToNumpyTxt(const struct MNIST *data, const char *dst_dir, unsigned int start, unsigned int end);
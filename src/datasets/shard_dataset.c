@@ -0,0 +1,1168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define SHARD_HAVE_IO_URING
+#endif
+#endif
+
+#include "debug_macros.h"
+#include "memory.h"
+#include "rng.h"
+#include "shard_dataset.h"
+
+#define SHARD_MAGIC ("NNSHARD1")
+#define SHARD_INDEX_MAGIC ("NNSINDX1")
+#define SHARD_MAGIC_SIZE (8)
+#define SHARD_VERSION (1)
+#define SHARD_FLAG_CHECKSUM (1)
+#define SHARD_PATH_SIZE (1024)
+#define FLETCHER_MOD (0xffffffffULL)
+#define FLETCHER_BLOCK_WORDS (16384) // 每累加这么多个32位字取一次模, b不会溢出
+
+// 分片文件头, 位于文件开头, 其余部分补0到SHARD_HEADER_SIZE
+struct ShardHeader
+{
+    char magic[SHARD_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t n_records;
+    uint64_t data_bytes;
+    uint64_t label_bytes;
+    uint64_t checksum;
+};
+
+// 索引文件头, 之后是n_shards个uint64_t, 为各分片的记录数
+struct ShardIndexHeader
+{
+    char magic[SHARD_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t n_shards;
+    uint64_t data_bytes;
+    uint64_t label_bytes;
+};
+
+// Fletcher-64, 按32位小端字累加, 可以分多次输入任意长度
+struct Checksum
+{
+    uint64_t a;
+    uint64_t b;
+    int n_words; // 上次取模之后累加的字数
+    int n_carry;
+    unsigned char carry[4];
+};
+
+static void resetChecksum(struct Checksum *c)
+{
+    memset(c, 0, sizeof(struct Checksum));
+}
+
+static void updateChecksum(struct Checksum *c, const void *buf, size_t n)
+{
+    const unsigned char *p = buf;
+    uint64_t a = c->a;
+    uint64_t b = c->b;
+    int k = c->n_words;
+    uint32_t w;
+
+    while (c->n_carry > 0 && n > 0) {
+        c->carry[c->n_carry++] = *p++;
+        --n;
+        if (c->n_carry == 4) {
+            memcpy(&w, c->carry, 4);
+            a += w;
+            b += a;
+            ++k;
+            c->n_carry = 0;
+        }
+    }
+    size_t i;
+    size_t n_words = n / 4;
+    for (i = 0; i < n_words; ++i) {
+        memcpy(&w, p + 4 * i, 4);
+        a += w;
+        b += a;
+        if (++k >= FLETCHER_BLOCK_WORDS) {
+            a %= FLETCHER_MOD;
+            b %= FLETCHER_MOD;
+            k = 0;
+        }
+    }
+    for (i = n_words * 4; i < n; ++i) {
+        c->carry[c->n_carry++] = p[i];
+    }
+    c->a = a;
+    c->b = b;
+    c->n_words = k;
+}
+
+static uint64_t finishChecksum(struct Checksum *c)
+{
+    if (c->n_carry > 0) {
+        uint32_t w;
+        memset(c->carry + c->n_carry, 0, 4 - c->n_carry);
+        memcpy(&w, c->carry, 4);
+        c->a += w;
+        c->b += c->a;
+        c->n_carry = 0;
+    }
+    c->a %= FLETCHER_MOD;
+    c->b %= FLETCHER_MOD;
+    return (c->b << 32) | c->a;
+}
+
+static int writeFull(int fd, const void *buf, size_t n, off_t offset)
+{
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t res = pwrite(fd, p, n, offset);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR_MSG("pwrite() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        p += res;
+        n -= res;
+        offset += res;
+    }
+    return SUCCESS;
+}
+
+static int readFull(int fd, void *buf, size_t n, off_t offset)
+{
+    char *p = buf;
+    while (n > 0) {
+        ssize_t res = pread(fd, p, n, offset);
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR_MSG("pread() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        if (res == 0) {
+            ERR_MSG("pread() hit end of file, %lu bytes missing, error.\n", (unsigned long)n);
+            return ERR_COD;
+        }
+        p += res;
+        n -= res;
+        offset += res;
+    }
+    return SUCCESS;
+}
+
+// ------------------------------------------------------------------ writer
+
+struct ShardWriter
+{
+    char prefix[SHARD_PATH_SIZE];
+    size_t data_bytes;
+    size_t label_bytes;
+    size_t record_bytes;
+    long records_per_shard;
+    int checksum;
+
+    int fd; // 正在写的分片, 没有时为-1
+    off_t offset; // 下一次写入的位置
+    long cur_records;
+    struct Checksum sum;
+    int n_shards;
+    uint64_t *counts; // 已完成分片的记录数
+
+    char *buf; // 待写入的记录
+    size_t buf_len;
+    size_t buf_cap;
+};
+
+static int flushShardWriter(struct ShardWriter *w)
+{
+    if (w->buf_len == 0) {
+        return SUCCESS;
+    }
+    CHK_ERR(writeFull(w->fd, w->buf, w->buf_len, w->offset));
+    if (w->checksum) {
+        updateChecksum(&(w->sum), w->buf, w->buf_len);
+    }
+    w->offset += w->buf_len;
+    w->buf_len = 0;
+    return SUCCESS;
+}
+
+static int openNextShard(struct ShardWriter *w)
+{
+    char path[SHARD_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s-%05d.shard", w->prefix, w->n_shards);
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (w->fd == -1) {
+        ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    w->offset = SHARD_HEADER_SIZE;
+    w->cur_records = 0;
+    resetChecksum(&(w->sum));
+    return SUCCESS;
+}
+
+static int finishShard(struct ShardWriter *w)
+{
+    CHK_ERR(flushShardWriter(w));
+
+    char header[SHARD_HEADER_SIZE];
+    struct ShardHeader h;
+    memset(header, 0, SHARD_HEADER_SIZE);
+    memset(&h, 0, sizeof(struct ShardHeader));
+    memcpy(h.magic, SHARD_MAGIC, SHARD_MAGIC_SIZE);
+    h.version = SHARD_VERSION;
+    h.flags = w->checksum? SHARD_FLAG_CHECKSUM: 0;
+    h.n_records = w->cur_records;
+    h.data_bytes = w->data_bytes;
+    h.label_bytes = w->label_bytes;
+    h.checksum = w->checksum? finishChecksum(&(w->sum)): 0;
+    memcpy(header, &h, sizeof(struct ShardHeader));
+    CHK_ERR(writeFull(w->fd, header, SHARD_HEADER_SIZE, 0));
+    if (close(w->fd) == -1) {
+        ERR_MSG("close() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
+        w->fd = -1;
+        return ERR_COD;
+    }
+    w->fd = -1;
+
+    uint64_t *counts = realloc(w->counts, (w->n_shards + 1) * sizeof(uint64_t));
+    CHK_NIL(counts);
+    w->counts = counts;
+    w->counts[w->n_shards++] = w->cur_records;
+    return SUCCESS;
+}
+
+static int writeShardIndex(struct ShardWriter *w)
+{
+    char path[SHARD_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s.index", w->prefix);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1) {
+        ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    struct ShardIndexHeader h;
+    memset(&h, 0, sizeof(struct ShardIndexHeader));
+    memcpy(h.magic, SHARD_INDEX_MAGIC, SHARD_MAGIC_SIZE);
+    h.version = SHARD_VERSION;
+    h.n_shards = w->n_shards;
+    h.data_bytes = w->data_bytes;
+    h.label_bytes = w->label_bytes;
+    int res = writeFull(fd, &h, sizeof(struct ShardIndexHeader), 0);
+    if (res == SUCCESS) {
+        res = writeFull(fd, w->counts, w->n_shards * sizeof(uint64_t), sizeof(struct ShardIndexHeader));
+    }
+    if (close(fd) == -1) {
+        ERR_MSG("close() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    return res;
+}
+
+static void freeShardWriter(struct ShardWriter *w)
+{
+    if (w->fd != -1) {
+        close(w->fd);
+    }
+    free(w->counts);
+    free(w->buf);
+    free(w);
+}
+
+int createShardWriter(struct ShardWriter **w, const char *prefix, size_t data_bytes, size_t label_bytes, long records_per_shard, int checksum)
+{
+    CHK_NIL(w);
+    CHK_NIL(prefix);
+    CHK_ERR((data_bytes > 0)? 0: 1);
+    CHK_ERR((records_per_shard > 0)? 0: 1);
+    CHK_ERR((strlen(prefix) < SHARD_PATH_SIZE)? 0: 1);
+
+    struct ShardWriter *res = calloc(1, sizeof(struct ShardWriter));
+    CHK_NIL(res);
+    snprintf(res->prefix, SHARD_PATH_SIZE, "%s", prefix);
+    res->data_bytes = data_bytes;
+    res->label_bytes = label_bytes;
+    res->record_bytes = data_bytes + label_bytes;
+    res->records_per_shard = records_per_shard;
+    res->checksum = checksum? 1: 0;
+    res->fd = -1;
+    // 缓冲区至少放得下一条记录
+    res->buf_cap = (res->record_bytes > SHARD_CHUNK_BYTES)? res->record_bytes: SHARD_CHUNK_BYTES;
+    res->buf = malloc(res->buf_cap);
+    if (res->buf == NULL) {
+        ERR_MSG("malloc failed, error.\n");
+        freeShardWriter(res);
+        return ERR_COD;
+    }
+    *w = res;
+    return SUCCESS;
+}
+
+int writeShardRecords(struct ShardWriter *w, const void *data, const void *label, long n)
+{
+    CHK_NIL(w);
+    CHK_NIL(data);
+    CHK_ERR((n >= 0)? 0: 1);
+    if (w->label_bytes > 0) {
+        CHK_NIL(label);
+    }
+
+    long i;
+    for (i = 0; i < n; ++i) {
+        if (w->fd == -1) {
+            CHK_ERR(openNextShard(w));
+        }
+        if (w->buf_len + w->record_bytes > w->buf_cap) {
+            CHK_ERR(flushShardWriter(w));
+        }
+        memcpy(w->buf + w->buf_len, (const char *)data + i * w->data_bytes, w->data_bytes);
+        if (w->label_bytes > 0) {
+            memcpy(w->buf + w->buf_len + w->data_bytes, (const char *)label + i * w->label_bytes, w->label_bytes);
+        }
+        w->buf_len += w->record_bytes;
+        if (++(w->cur_records) == w->records_per_shard) {
+            CHK_ERR(finishShard(w));
+        }
+    }
+    return SUCCESS;
+}
+
+int closeShardWriter(struct ShardWriter *w)
+{
+    CHK_NIL(w);
+
+    int res = SUCCESS;
+    if (w->fd != -1) {
+        res = finishShard(w);
+    }
+    if (res == SUCCESS && w->n_shards == 0) {
+        ERR_MSG("no records written, error.\n");
+        res = ERR_COD;
+    }
+    if (res == SUCCESS) {
+        res = writeShardIndex(w);
+    }
+    freeShardWriter(w);
+    return res;
+}
+
+// ------------------------------------------------------------------ reader
+
+enum ChunkState
+{
+    CHUNK_FREE,
+    CHUNK_INFLIGHT,
+    CHUNK_DONE
+};
+
+// 一次读盘请求: 一个分片中连续的若干条记录
+struct ShardChunk
+{
+    char *buf;
+    int shard;
+    long first; // 分片内第一条记录的序号
+    int n_records;
+    size_t n_bytes;
+    size_t n_done;
+    enum ChunkState state;
+    int error;
+};
+
+struct ShardFile
+{
+    int fd;
+    long n_records;
+    int has_checksum;
+    uint64_t checksum;
+};
+
+#ifdef SHARD_HAVE_IO_URING
+struct Uring
+{
+    int fd;
+    void *sq_ptr;
+    size_t sq_bytes;
+    void *cq_ptr;
+    size_t cq_bytes;
+    struct io_uring_sqe *sqes;
+    size_t sqes_bytes;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+#endif
+
+struct ShardReader
+{
+    size_t data_bytes;
+    size_t label_bytes;
+    size_t record_bytes;
+    int n_shards;
+    struct ShardFile *shards;
+    long n_records;
+
+    int batch_size;
+    int window;
+    int readahead;
+    uint64_t seed;
+    enum ShardIoMode mode;
+    int chunk_records;
+
+    // 当前epoch
+    int epoch;
+    long batch_idx;
+    int *order; // 分片读取顺序
+    struct RandomStream *rs;
+    uint32_t *rand;
+    int submit_pos; // 下一个要提交的块在order[submit_pos]分片中, 从第submit_record条记录开始
+    long submit_record;
+    long n_submitted; // 块按提交序号seq放在chunks[seq % readahead]
+    long n_consumed;
+    int cur_rec; // 当前块中下一条要取的记录
+    int release_pending; // 当前块已取完, 下次取记录时释放
+    struct Checksum sum;
+
+    char *ring;
+    size_t ring_bytes;
+    struct ShardChunk *chunks;
+    char *win; // 打乱用的记录缓冲区
+    size_t win_bytes;
+    int win_len;
+    int stream_end;
+
+#ifdef SHARD_HAVE_IO_URING
+    struct Uring uring;
+    int n_inflight;
+#endif
+    pthread_t threads[SHARD_IO_THREADS];
+    int n_threads;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond_req;
+    pthread_cond_t cond_done;
+    struct ShardChunk **queue; // pread线程的请求队列, 容量readahead
+    long q_head;
+    long q_tail;
+    int stop;
+
+    long n_bytes;
+    long n_stalls;
+    double stall_time;
+    int status;
+};
+
+static off_t getChunkOffset(const struct ShardReader *r, const struct ShardChunk *c)
+{
+    return SHARD_HEADER_SIZE + (off_t)c->first * r->record_bytes;
+}
+
+#ifdef SHARD_HAVE_IO_URING
+static void closeUring(struct Uring *u)
+{
+    if (u->sqes) {
+        munmap(u->sqes, u->sqes_bytes);
+    }
+    if (u->cq_ptr && u->cq_ptr != u->sq_ptr) {
+        munmap(u->cq_ptr, u->cq_bytes);
+    }
+    if (u->sq_ptr) {
+        munmap(u->sq_ptr, u->sq_bytes);
+    }
+    if (u->fd >= 0) {
+        close(u->fd);
+    }
+    memset(u, 0, sizeof(struct Uring));
+    u->fd = -1;
+}
+
+static int setupUring(struct Uring *u, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(struct io_uring_params));
+    memset(u, 0, sizeof(struct Uring));
+    u->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0) {
+        u->fd = -1;
+        return ERR_COD;
+    }
+    // IORING_OP_READ需要5.6以上的内核, 与IORING_FEAT_RW_CUR_POS同时引入
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        closeUring(u);
+        return ERR_COD;
+    }
+
+    u->sq_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_bytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP)? 1: 0;
+    if (single) {
+        u->sq_bytes = (u->cq_bytes > u->sq_bytes)? u->cq_bytes: u->sq_bytes;
+        u->cq_bytes = u->sq_bytes;
+    }
+    u->sq_ptr = mmap(NULL, u->sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED) {
+        u->sq_ptr = NULL;
+        closeUring(u);
+        return ERR_COD;
+    }
+    u->cq_ptr = single? u->sq_ptr: mmap(NULL, u->cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    if (u->cq_ptr == MAP_FAILED) {
+        u->cq_ptr = NULL;
+        closeUring(u);
+        return ERR_COD;
+    }
+    u->sqes_bytes = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        closeUring(u);
+        return ERR_COD;
+    }
+    u->sq_tail = (unsigned *)((char *)u->sq_ptr + p.sq_off.tail);
+    u->sq_mask = (unsigned *)((char *)u->sq_ptr + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)((char *)u->sq_ptr + p.sq_off.array);
+    u->cq_head = (unsigned *)((char *)u->cq_ptr + p.cq_off.head);
+    u->cq_tail = (unsigned *)((char *)u->cq_ptr + p.cq_off.tail);
+    u->cq_mask = (unsigned *)((char *)u->cq_ptr + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)((char *)u->cq_ptr + p.cq_off.cqes);
+    return SUCCESS;
+}
+
+static int submitUringRead(struct ShardReader *r, struct ShardChunk *c)
+{
+    struct Uring *u = &(r->uring);
+    unsigned tail = *(u->sq_tail);
+    unsigned idx = tail & *(u->sq_mask);
+    struct io_uring_sqe *sqe = &(u->sqes[idx]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = r->shards[c->shard].fd;
+    sqe->addr = (uint64_t)(uintptr_t)(c->buf + c->n_done);
+    sqe->len = c->n_bytes - c->n_done;
+    sqe->off = getChunkOffset(r, c) + c->n_done;
+    sqe->user_data = (uint64_t)(uintptr_t)c;
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while (syscall(__NR_io_uring_enter, u->fd, 1, 0, 0, NULL, 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            ERR_MSG("io_uring_enter() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+    }
+    ++(r->n_inflight);
+    return SUCCESS;
+}
+
+// 处理已完成的请求, wait非0且没有完成的请求时阻塞等待至少一个
+static int reapUring(struct ShardReader *r, int wait)
+{
+    struct Uring *u = &(r->uring);
+    unsigned head = *(u->cq_head);
+    if (wait && head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+        while (syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+            if (errno != EINTR) {
+                ERR_MSG("io_uring_enter() failed, err_detail: %s, error.\n", ERRNO_DETAIL(errno));
+                return ERR_COD;
+            }
+        }
+    }
+    int res = SUCCESS;
+    while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &(u->cqes[head & *(u->cq_mask)]);
+        struct ShardChunk *c = (struct ShardChunk *)(uintptr_t)cqe->user_data;
+        int n = cqe->res;
+        ++head;
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        --(r->n_inflight);
+
+        if (n <= 0) {
+            ERR_MSG("io_uring read failed, shard %d, res = %d (%s), error.\n", c->shard, n, (n < 0)? ERRNO_DETAIL(-n): "end of file");
+            c->error = ERR_COD;
+            c->state = CHUNK_DONE;
+            res = ERR_COD;
+            continue;
+        }
+        c->n_done += n;
+        if (c->n_done < c->n_bytes) { // 读得不完整, 提交剩余部分
+            if (submitUringRead(r, c) != SUCCESS) {
+                c->error = ERR_COD;
+                c->state = CHUNK_DONE;
+                res = ERR_COD;
+            }
+            continue;
+        }
+        c->state = CHUNK_DONE;
+    }
+    return res;
+}
+#endif
+
+static void *runShardIoThread(void *arg)
+{
+    struct ShardReader *r = arg;
+    pthread_mutex_lock(&(r->mtx));
+    while (1) {
+        while (!r->stop && r->q_head == r->q_tail) {
+            pthread_cond_wait(&(r->cond_req), &(r->mtx));
+        }
+        if (r->stop) {
+            break;
+        }
+        struct ShardChunk *c = r->queue[r->q_head++ % r->readahead];
+        int fd = r->shards[c->shard].fd;
+        off_t offset = getChunkOffset(r, c);
+        pthread_mutex_unlock(&(r->mtx));
+
+        int res = readFull(fd, c->buf, c->n_bytes, offset);
+
+        pthread_mutex_lock(&(r->mtx));
+        c->n_done = c->n_bytes;
+        c->error = res;
+        c->state = CHUNK_DONE;
+        pthread_cond_broadcast(&(r->cond_done));
+    }
+    pthread_mutex_unlock(&(r->mtx));
+    return NULL;
+}
+
+// 提交本epoch的下一个块, 全部提交完时什么也不做
+static int submitNextChunk(struct ShardReader *r)
+{
+    if (r->submit_pos >= r->n_shards) {
+        return SUCCESS;
+    }
+    int s = r->order[r->submit_pos];
+    long left = r->shards[s].n_records - r->submit_record;
+    struct ShardChunk *c = &(r->chunks[r->n_submitted % r->readahead]);
+
+    if (r->mode == SHARD_IO_PREAD) {
+        pthread_mutex_lock(&(r->mtx));
+    }
+    c->shard = s;
+    c->first = r->submit_record;
+    c->n_records = (left < r->chunk_records)? (int)left: r->chunk_records;
+    c->n_bytes = (size_t)c->n_records * r->record_bytes;
+    c->n_done = 0;
+    c->error = SUCCESS;
+    c->state = CHUNK_INFLIGHT;
+    r->submit_record += c->n_records;
+    if (r->submit_record == r->shards[s].n_records) {
+        ++(r->submit_pos);
+        r->submit_record = 0;
+    }
+    ++(r->n_submitted);
+
+    if (r->mode == SHARD_IO_PREAD) {
+        r->queue[r->q_tail++ % r->readahead] = c;
+        pthread_cond_signal(&(r->cond_req));
+        pthread_mutex_unlock(&(r->mtx));
+        return SUCCESS;
+    }
+#ifdef SHARD_HAVE_IO_URING
+    CHK_ERR(submitUringRead(r, c));
+#endif
+    return SUCCESS;
+}
+
+static int waitChunk(struct ShardReader *r, struct ShardChunk *c)
+{
+    struct timeval t0, t1, t2;
+    int stalled = 0;
+    if (r->mode == SHARD_IO_PREAD) {
+        pthread_mutex_lock(&(r->mtx));
+        if (c->state != CHUNK_DONE) {
+            stalled = 1;
+            gettimeofday(&t0, NULL);
+            while (c->state != CHUNK_DONE) {
+                pthread_cond_wait(&(r->cond_done), &(r->mtx));
+            }
+        }
+        pthread_mutex_unlock(&(r->mtx));
+    }
+#ifdef SHARD_HAVE_IO_URING
+    else {
+        CHK_ERR(reapUring(r, 0));
+        if (c->state != CHUNK_DONE) {
+            stalled = 1;
+            gettimeofday(&t0, NULL);
+            while (c->state != CHUNK_DONE) {
+                CHK_ERR(reapUring(r, 1));
+            }
+        }
+    }
+#endif
+    if (stalled) {
+        gettimeofday(&t1, NULL);
+        timersub(&t1, &t0, &t2);
+        ++(r->n_stalls);
+        r->stall_time += t2.tv_sec + t2.tv_usec / 1e6;
+    }
+    if (c->error != SUCCESS) {
+        ERR_MSG("read of shard %d failed, error.\n", c->shard);
+        return ERR_COD;
+    }
+    r->n_bytes += c->n_bytes;
+    return SUCCESS;
+}
+
+// 块读完后按读入顺序计算所属分片的校验和, 读完整个分片时比较
+static int checkChunk(struct ShardReader *r, const struct ShardChunk *c)
+{
+    const struct ShardFile *f = &(r->shards[c->shard]);
+    if (!f->has_checksum) {
+        return SUCCESS;
+    }
+    if (c->first == 0) {
+        resetChecksum(&(r->sum));
+    }
+    updateChecksum(&(r->sum), c->buf, c->n_bytes);
+    if (c->first + c->n_records == f->n_records) {
+        uint64_t sum = finishChecksum(&(r->sum));
+        if (sum != f->checksum) {
+            ERR_MSG("checksum mismatch in shard %d: %016llx vs %016llx in header, error.\n",
+                c->shard, (unsigned long long)sum, (unsigned long long)f->checksum);
+            return ERR_COD;
+        }
+    }
+    return SUCCESS;
+}
+
+// 取数据流中的下一条记录, 指针在下一次调用前有效; 本epoch读完时*rec为NULL
+static int nextRecord(const char *(*rec), struct ShardReader *r)
+{
+    if (r->release_pending) {
+        r->release_pending = 0;
+        r->chunks[r->n_consumed % r->readahead].state = CHUNK_FREE;
+        ++(r->n_consumed);
+        r->cur_rec = 0;
+        CHK_ERR(submitNextChunk(r)); // 复用刚释放的块
+    }
+    if (r->n_consumed == r->n_submitted) {
+        *rec = NULL;
+        return SUCCESS;
+    }
+    struct ShardChunk *c = &(r->chunks[r->n_consumed % r->readahead]);
+    if (r->cur_rec == 0) {
+        CHK_ERR(waitChunk(r, c));
+        CHK_ERR(checkChunk(r, c));
+    }
+    *rec = c->buf + (size_t)r->cur_rec * r->record_bytes;
+    if (++(r->cur_rec) == c->n_records) {
+        r->release_pending = 1;
+    }
+    return SUCCESS;
+}
+
+// 开始第epoch轮: 确定分片顺序, 提交前readahead个块. 调用时没有未完成的读请求
+static int startEpoch(struct ShardReader *r, int epoch)
+{
+    r->epoch = epoch;
+    r->batch_idx = 0;
+    int i;
+    for (i = 0; i < r->n_shards; ++i) {
+        r->order[i] = i;
+    }
+    if (r->window > 1) {
+        destroyRandomStream(r->rs);
+        r->rs = NULL;
+        CHK_ERR(createRandomStream(&(r->rs), r->seed, epoch));
+        if (r->n_shards > 1) {
+            CHK_ERR(fillRandomPermutation(r->rs, r->order, r->n_shards));
+        }
+    }
+    r->submit_pos = 0;
+    r->submit_record = 0;
+    r->n_submitted = 0;
+    r->n_consumed = 0;
+    r->cur_rec = 0;
+    r->release_pending = 0;
+    r->win_len = 0;
+    r->stream_end = 0;
+    for (i = 0; i < r->readahead; ++i) {
+        CHK_ERR(submitNextChunk(r));
+    }
+    return SUCCESS;
+}
+
+static void copyRecord(void *data, void *label, int k, const char *rec, const struct ShardReader *r)
+{
+    memcpy((char *)data + (size_t)k * r->data_bytes, rec, r->data_bytes);
+    if (label && r->label_bytes > 0) {
+        memcpy((char *)label + (size_t)k * r->label_bytes, rec + r->data_bytes, r->label_bytes);
+    }
+}
+
+static int readShardBatchImpl(void *data, void *label, int *n_samples, struct ShardReader *r)
+{
+    const char *rec = NULL;
+    int k = 0;
+    if (r->window <= 1) {
+        for (k = 0; k < r->batch_size; ++k) {
+            CHK_ERR(nextRecord(&rec, r));
+            if (rec == NULL) {
+                break;
+            }
+            copyRecord(data, label, k, rec, r);
+        }
+    }
+    else {
+        CHK_ERR(fillRandomUint32(r->rs, r->rand, r->batch_size));
+        for (k = 0; k < r->batch_size; ++k) {
+            while (r->win_len < r->window && !r->stream_end) { // 首次填满缓冲区
+                CHK_ERR(nextRecord(&rec, r));
+                if (rec == NULL) {
+                    r->stream_end = 1;
+                    break;
+                }
+                memcpy(r->win + (size_t)(r->win_len++) * r->record_bytes, rec, r->record_bytes);
+            }
+            if (r->win_len == 0) {
+                break;
+            }
+            // 随机取出一条, 空位由数据流中的下一条补上, 数据流读完后由缓冲区的最后一条补上
+            int j = (int)(((uint64_t)r->rand[k] * (uint64_t)r->win_len) >> 32);
+            char *slot = r->win + (size_t)j * r->record_bytes;
+            copyRecord(data, label, k, slot, r);
+            rec = NULL;
+            if (!r->stream_end) {
+                CHK_ERR(nextRecord(&rec, r));
+            }
+            if (rec) {
+                memcpy(slot, rec, r->record_bytes);
+            }
+            else {
+                r->stream_end = 1;
+                --(r->win_len);
+                if (j != r->win_len) {
+                    memcpy(slot, r->win + (size_t)r->win_len * r->record_bytes, r->record_bytes);
+                }
+            }
+        }
+    }
+
+    *n_samples = k;
+    if (k == 0) { // epoch结束, 立即开始读下一轮, 读盘与调用者的epoch间隙重叠
+        CHK_ERR(startEpoch(r, r->epoch + 1));
+    }
+    else {
+        ++(r->batch_idx);
+    }
+    return SUCCESS;
+}
+
+int readShardBatch(void *data, void *label, int *n_samples, struct ShardReader *r)
+{
+    CHK_NIL(data);
+    CHK_NIL(n_samples);
+    CHK_NIL(r);
+    if (r->status != SUCCESS) {
+        ERR_MSG("shard reader stopped by a previous error, error.\n");
+        return ERR_COD;
+    }
+    if (readShardBatchImpl(data, label, n_samples, r) != SUCCESS) {
+        r->status = ERR_COD;
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int fillShardBatch(void *data, void *label, int *n_samples, int epoch, int batch_idx, void *user_data)
+{
+    CHK_NIL(user_data);
+
+    struct ShardReader *r = user_data;
+    if (epoch == r->epoch + 1 && batch_idx == 0) { // 取走上一轮的结束标记
+        int n = 0;
+        CHK_ERR(readShardBatch(data, label, &n, r));
+        CHK_ERR((n == 0)? 0: 1);
+    }
+    if (epoch != r->epoch || batch_idx != r->batch_idx) {
+        ERR_MSG("out of order request (epoch %d, batch %d), reader at (epoch %d, batch %ld), error.\n",
+            epoch, batch_idx, r->epoch, r->batch_idx);
+        return ERR_COD;
+    }
+    CHK_ERR(readShardBatch(data, label, n_samples, r));
+    CHK_ERR((*n_samples > 0)? 0: 1);
+    return SUCCESS;
+}
+
+static int openShardFiles(struct ShardReader *r, const char *prefix)
+{
+    char path[SHARD_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s.index", prefix);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    struct ShardIndexHeader h;
+    uint64_t *counts = NULL;
+    if (readFull(fd, &h, sizeof(struct ShardIndexHeader), 0) != SUCCESS
+        || memcmp(h.magic, SHARD_INDEX_MAGIC, SHARD_MAGIC_SIZE) != 0 || h.version != SHARD_VERSION
+        || h.n_shards == 0 || h.n_shards > 0x7fffffff || h.data_bytes == 0) {
+        ERR_MSG("bad shard index, path: %s, error.\n", path);
+        close(fd);
+        return ERR_COD;
+    }
+    counts = malloc(h.n_shards * sizeof(uint64_t));
+    if (counts == NULL || readFull(fd, counts, h.n_shards * sizeof(uint64_t), sizeof(struct ShardIndexHeader)) != SUCCESS) {
+        ERR_MSG("failed to read shard index, path: %s, error.\n", path);
+        free(counts);
+        close(fd);
+        return ERR_COD;
+    }
+    close(fd);
+
+    r->data_bytes = h.data_bytes;
+    r->label_bytes = h.label_bytes;
+    r->record_bytes = h.data_bytes + h.label_bytes;
+    r->shards = calloc(h.n_shards, sizeof(struct ShardFile));
+    if (r->shards == NULL) {
+        ERR_MSG("calloc failed, error.\n");
+        free(counts);
+        return ERR_COD;
+    }
+    int i;
+    for (i = 0; i < (int)h.n_shards; ++i) {
+        r->shards[i].fd = -1;
+    }
+    r->n_shards = h.n_shards;
+
+    for (i = 0; i < r->n_shards; ++i) {
+        struct ShardFile *f = &(r->shards[i]);
+        struct ShardHeader sh;
+        struct stat st;
+        snprintf(path, sizeof(path), "%s-%05d.shard", prefix, i);
+        f->fd = open(path, O_RDONLY);
+        if (f->fd == -1) {
+            ERR_MSG("open() failed, path: %s, err_detail: %s, error.\n", path, ERRNO_DETAIL(errno));
+            goto err_end;
+        }
+        if (readFull(f->fd, &sh, sizeof(struct ShardHeader), 0) != SUCCESS || fstat(f->fd, &st) == -1) {
+            ERR_MSG("failed to read shard header, path: %s, error.\n", path);
+            goto err_end;
+        }
+        if (memcmp(sh.magic, SHARD_MAGIC, SHARD_MAGIC_SIZE) != 0 || sh.version != SHARD_VERSION
+            || sh.data_bytes != r->data_bytes || sh.label_bytes != r->label_bytes
+            || sh.n_records != counts[i] || sh.n_records == 0 || sh.n_records > 0x7fffffff
+            || (uint64_t)st.st_size != SHARD_HEADER_SIZE + sh.n_records * r->record_bytes) {
+            ERR_MSG("shard header does not match index or file size, path: %s, error.\n", path);
+            goto err_end;
+        }
+        f->n_records = sh.n_records;
+        f->has_checksum = (sh.flags & SHARD_FLAG_CHECKSUM)? 1: 0;
+        f->checksum = sh.checksum;
+        r->n_records += f->n_records;
+        posix_fadvise(f->fd, SHARD_HEADER_SIZE, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    free(counts);
+    return SUCCESS;
+
+err_end:
+    free(counts);
+    return ERR_COD;
+}
+
+static int selectShardIoMode(struct ShardReader *r, enum ShardIoMode mode)
+{
+    if (mode == SHARD_IO_AUTO) {
+        const char *env = getenv("NN_SHARD_IO");
+        if (env && strcasecmp(env, "pread") == 0) {
+            mode = SHARD_IO_PREAD;
+        }
+        else if (env && strcasecmp(env, "uring") == 0) {
+            mode = SHARD_IO_URING;
+        }
+        else if (env && env[0] != '\0') {
+            ERR_MSG("unknown NN_SHARD_IO: %s, error.\n", env);
+            return ERR_COD;
+        }
+    }
+#ifdef SHARD_HAVE_IO_URING
+    if (mode != SHARD_IO_PREAD) {
+        if (setupUring(&(r->uring), r->readahead) == SUCCESS) {
+            r->mode = SHARD_IO_URING;
+            return SUCCESS;
+        }
+        if (mode == SHARD_IO_URING) {
+            ERR_MSG("io_uring not available, error.\n");
+            return ERR_COD;
+        }
+    }
+#else
+    if (mode == SHARD_IO_URING) {
+        ERR_MSG("io_uring not supported by this build, error.\n");
+        return ERR_COD;
+    }
+#endif
+    r->mode = SHARD_IO_PREAD;
+    return SUCCESS;
+}
+
+void destroyShardReader(struct ShardReader *r)
+{
+    if (r) {
+        pthread_mutex_lock(&(r->mtx));
+        r->stop = 1;
+        pthread_cond_broadcast(&(r->cond_req));
+        pthread_mutex_unlock(&(r->mtx));
+        int i;
+        for (i = 0; i < r->n_threads; ++i) {
+            pthread_join(r->threads[i], NULL);
+        }
+#ifdef SHARD_HAVE_IO_URING
+        // 等未完成的读请求结束后才能释放缓冲区
+        while (r->uring.fd >= 0 && r->n_inflight > 0) {
+            int n_inflight = r->n_inflight;
+            if (reapUring(r, 1) != SUCCESS && r->n_inflight == n_inflight) {
+                break;
+            }
+        }
+        if (r->uring.fd >= 0) {
+            closeUring(&(r->uring));
+        }
+#endif
+        pthread_mutex_destroy(&(r->mtx));
+        pthread_cond_destroy(&(r->cond_req));
+        pthread_cond_destroy(&(r->cond_done));
+        for (i = 0; r->shards && i < r->n_shards; ++i) {
+            if (r->shards[i].fd != -1) {
+                close(r->shards[i].fd);
+            }
+        }
+        free(r->shards);
+        freeBlob(r->ring, r->ring_bytes);
+        freeBlob(r->win, r->win_bytes);
+        free(r->chunks);
+        free(r->queue);
+        free(r->order);
+        free(r->rand);
+        destroyRandomStream(r->rs);
+        free(r);
+    }
+}
+
+int createShardReader(struct ShardReader **r, const char *prefix, int batch_size, int window, int readahead, uint64_t seed, enum ShardIoMode mode)
+{
+    CHK_NIL(r);
+    CHK_NIL(prefix);
+    CHK_ERR((batch_size > 0)? 0: 1);
+    CHK_ERR((window >= 0)? 0: 1);
+    CHK_ERR((readahead > 0)? 0: 1);
+
+    struct ShardReader *res = calloc(1, sizeof(struct ShardReader));
+    CHK_NIL(res);
+    res->batch_size = batch_size;
+    res->window = window;
+    res->readahead = readahead;
+    res->seed = seed;
+    pthread_mutex_init(&(res->mtx), NULL);
+    pthread_cond_init(&(res->cond_req), NULL);
+    pthread_cond_init(&(res->cond_done), NULL);
+#ifdef SHARD_HAVE_IO_URING
+    res->uring.fd = -1;
+#endif
+
+    CHK_ERR_GOTO(openShardFiles(res, prefix));
+    res->chunk_records = (res->record_bytes < SHARD_CHUNK_BYTES)? SHARD_CHUNK_BYTES / res->record_bytes: 1;
+    size_t chunk_bytes = (size_t)res->chunk_records * res->record_bytes;
+    res->ring_bytes = chunk_bytes * readahead;
+    res->ring = allocBlob(res->ring_bytes);
+    res->chunks = calloc(readahead, sizeof(struct ShardChunk));
+    res->queue = calloc(readahead, sizeof(struct ShardChunk *));
+    res->order = calloc(res->n_shards, sizeof(int));
+    res->rand = calloc(batch_size, sizeof(uint32_t));
+    if (res->ring == NULL || res->chunks == NULL || res->queue == NULL || res->order == NULL || res->rand == NULL) {
+        ERR_MSG("alloc failed, error.\n");
+        goto err_end;
+    }
+    int i;
+    for (i = 0; i < readahead; ++i) {
+        res->chunks[i].buf = res->ring + chunk_bytes * i;
+    }
+    if (window > 1) {
+        res->win_bytes = (size_t)window * res->record_bytes;
+        res->win = allocBlob(res->win_bytes);
+        if (res->win == NULL) {
+            ERR_MSG("allocBlob failed, error.\n");
+            goto err_end;
+        }
+    }
+
+    CHK_ERR_GOTO(selectShardIoMode(res, mode));
+    if (res->mode == SHARD_IO_PREAD) {
+        for (i = 0; i < SHARD_IO_THREADS; ++i) {
+            if (pthread_create(&(res->threads[i]), NULL, runShardIoThread, res) != 0) {
+                ERR_MSG("pthread_create() failed, error.\n");
+                goto err_end;
+            }
+            ++(res->n_threads);
+        }
+    }
+    CHK_ERR_GOTO(startEpoch(res, 0));
+
+    *r = res;
+    return SUCCESS;
+
+err_end:
+    destroyShardReader(res);
+    return ERR_COD;
+}
+
+int getShardReaderInfo(long *n_records, size_t *data_bytes, size_t *label_bytes, int *n_shards, const struct ShardReader *r)
+{
+    CHK_NIL(n_records);
+    CHK_NIL(data_bytes);
+    CHK_NIL(label_bytes);
+    CHK_NIL(n_shards);
+    CHK_NIL(r);
+
+    *n_records = r->n_records;
+    *data_bytes = r->data_bytes;
+    *label_bytes = r->label_bytes;
+    *n_shards = r->n_shards;
+    return SUCCESS;
+}
+
+int getShardReaderIoMode(enum ShardIoMode *mode, const struct ShardReader *r)
+{
+    CHK_NIL(mode);
+    CHK_NIL(r);
+
+    *mode = r->mode;
+    return SUCCESS;
+}
+
+int getShardReaderStats(long *n_bytes, long *n_stalls, double *stall_time, const struct ShardReader *r)
+{
+    CHK_NIL(n_bytes);
+    CHK_NIL(n_stalls);
+    CHK_NIL(stall_time);
+    CHK_NIL(r);
+
+    *n_bytes = r->n_bytes;
+    *n_stalls = r->n_stalls;
+    *stall_time = r->stall_time;
+    return SUCCESS;
+}
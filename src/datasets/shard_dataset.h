@@ -0,0 +1,63 @@
+/**
+ * @brief 分片的二进制数据集和流式读取, 用于比内存大得多的数据集.
+ *
+ *        格式: 索引文件<prefix>.index记录分片数, 每条记录的样本/类标字节数和各分片的记录数;
+ *        分片文件<prefix>-00000.shard, <prefix>-00001.shard, ... 各有一个SHARD_HEADER_SIZE字节的文件头
+ *        (记录数, 记录大小, 可选的校验和), 之后是定长记录, 每条记录为data_bytes字节样本加label_bytes字节类标.
+ *        校验和为分片数据区的Fletcher-64, 读取时随数据流逐块计算, 读完一个分片时比较.
+ *
+ *        读取: 数据区按块(不跨分片, 约SHARD_CHUNK_BYTES字节)顺序读入, 同时有readahead个块在读,
+ *        优先使用io_uring, 不可用时(或环境变量NN_SHARD_IO=pread)由SHARD_IO_THREADS个线程执行pread.
+ *        window > 1时每个epoch按(seed, epoch)打乱分片顺序, 并在window条记录的缓冲区内随机取出记录(有界打乱),
+ *        打乱程度受window限制, 但读盘始终是顺序的. 内存占用约为(readahead * SHARD_CHUNK_BYTES + window * 记录大小).
+ *        打开读取器时打开全部分片文件.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHARD_HEADER_SIZE (4096)
+#define SHARD_CHUNK_BYTES (1 << 20)
+#define SHARD_IO_THREADS (2)
+
+enum ShardIoMode
+{
+    SHARD_IO_AUTO, // 读取环境变量NN_SHARD_IO("uring"或"pread"), 未设置时优先io_uring
+    SHARD_IO_URING,
+    SHARD_IO_PREAD
+};
+
+struct ShardWriter;
+struct ShardReader;
+
+/**
+ * @param records_per_shard 每个分片的记录数, 最后一个分片可能不满
+ * @param checksum 非0时计算各分片的校验和
+ */
+int createShardWriter(struct ShardWriter **w, const char *prefix, size_t data_bytes, size_t label_bytes, long records_per_shard, int checksum);
+// 追加n条记录: 第i条记录由data + i * data_bytes和label + i * label_bytes组成, label_bytes为0时label可以为NULL
+int writeShardRecords(struct ShardWriter *w, const void *data, const void *label, long n);
+// 写完最后一个分片的文件头和索引文件后释放, 出错时也释放
+int closeShardWriter(struct ShardWriter *w);
+
+int createShardReader(struct ShardReader **r, const char *prefix, int batch_size, int window, int readahead, uint64_t seed, enum ShardIoMode mode);
+void destroyShardReader(struct ShardReader *r);
+
+int getShardReaderInfo(long *n_records, size_t *data_bytes, size_t *label_bytes, int *n_shards, const struct ShardReader *r);
+// 实际使用的读取方式(SHARD_IO_URING或SHARD_IO_PREAD)
+int getShardReaderIoMode(enum ShardIoMode *mode, const struct ShardReader *r);
+// 读入的字节数, 取记录时需要等待读盘的次数和累计等待时间(秒)
+int getShardReaderStats(long *n_bytes, long *n_stalls, double *stall_time, const struct ShardReader *r);
+
+/**
+ * @brief 取下一个batch, 样本写入data(batch_size * data_bytes), 类标写入label(batch_size * label_bytes, 可以为NULL).
+ *        *n_samples返回0表示当前epoch结束, 之后的调用开始下一个epoch. 校验和不符或读盘出错时返回ERR_COD.
+ */
+int readShardBatch(void *data, void *label, int *n_samples, struct ShardReader *r);
+
+/**
+ * @brief DataLoader的回调, user_data为ShardReader, 每个epoch ceil(n_records / batch_size)个batch.
+ *        读取器是顺序的, 因此DataLoader只能有1个生产者线程, 调用顺序不符时返回ERR_COD.
+ */
+int fillShardBatch(void *data, void *label, int *n_samples, int epoch, int batch_idx, void *user_data);
@@ -9,6 +9,7 @@
 #include <time.h>
 
 #include "gemm.h"
+#include "thread_pool.h"
 
 void gemm_bin(int M, int N, int K, float ALPHA, 
         char  *A, int lda, 
@@ -77,13 +78,75 @@ void time_random_matrix(int TA, int TB, int m, int k, int n)
  * @param  lda, ldb, ldc 分别表示A, B, C的元素循环间隔,
  * @param C              初始保存偏置量矩阵, 计算过程中会被计算结果覆盖, 最终用来保存计算结果
  */
+struct GemmArgs
+{
+    int TA, TB, N, K;
+    float ALPHA, BETA;
+    float *A, *B, *C;
+    int lda, ldb, ldc;
+};
+
+// 计算C的[lo, hi)行, 每个元素的累加顺序与整体计算相同
+static void gemm_rows(void *arg, int lo, int hi)
+{
+    struct GemmArgs *g = arg;
+    float *A = (g->TA)? g->A + lo: g->A + (size_t)lo * g->lda;
+    gemm_cpu(g->TA, g->TB, hi - lo, g->N, g->K, g->ALPHA, A, g->lda, g->B, g->ldb, g->BETA, g->C + (size_t)lo * g->ldc, g->ldc);
+}
+
+// C按行切分给默认线程池, 计算量小时在调用线程上直接执行
 void gemm(int TA, int TB, int M, int N, int K, float ALPHA, 
         float *A, int lda, 
         float *B, int ldb,
         float BETA,
         float *C, int ldc)
 {
-    gemm_cpu( TA,  TB,  M, N, K, ALPHA,A,lda, B, ldb,BETA,C,ldc);
+    struct GemmArgs g = {TA, TB, N, K, ALPHA, BETA, A, B, C, lda, ldb, ldc};
+    parallelFor(NULL, 0, M, 2L * N * K, gemm_rows, &g);
+}
+
+struct GemmU8Args
+{
+    int TB, N, K;
+    float ALPHA, BETA;
+    const unsigned char *A;
+    const float *scale, *shift;
+    float *A_f, *B, *C;
+    int lda, ldb, ldc;
+};
+
+// 转换A的[lo, hi)行后计算C的[lo, hi)行
+static void gemm_u8_rows(void *arg, int lo, int hi)
+{
+    struct GemmU8Args *g = arg;
+    int i, k;
+    for (i = lo; i < hi; ++i) {
+        const unsigned char *a = g->A + (size_t)i * g->lda;
+        float *a_f = g->A_f + (size_t)i * g->K;
+        if (g->scale) {
+            for (k = 0; k < g->K; ++k) {
+                a_f[k] = a[k] * g->scale[k] + g->shift[k];
+            }
+        }
+        else {
+            for (k = 0; k < g->K; ++k) {
+                a_f[k] = a[k];
+            }
+        }
+    }
+    gemm_cpu(0, g->TB, hi - lo, g->N, g->K, g->ALPHA, g->A_f + (size_t)lo * g->K, g->K, g->B, g->ldb, g->BETA, g->C + (size_t)lo * g->ldc, g->ldc);
+}
+
+void gemm_u8(int TB, int M, int N, int K, float ALPHA,
+        const unsigned char *A, int lda,
+        const float *scale, const float *shift,
+        float *A_f,
+        float *B, int ldb,
+        float BETA,
+        float *C, int ldc)
+{
+    struct GemmU8Args g = {TB, N, K, ALPHA, BETA, A, scale, shift, A_f, B, C, lda, ldb, ldc};
+    parallelFor(NULL, 0, M, 2L * N * K + K, gemm_u8_rows, &g);
 }
 
 // MatMul(A, B), A is (M, K), B is (K, N)
@@ -11,6 +11,19 @@ void gemm(int TA, int TB, int M, int N, int K, float ALPHA,
                     float BETA,
                     float *C, int ldc);
 
+/**
+ * @brief C = ALPHA * MatMul(norm(A), BB) + BETA * C, A是(M, K)的uint8矩阵, norm(A)[i][k] = A[i][k] * scale[k] + shift[k],
+ *        scale/shift为NULL时分别取1和0. C按行分块并行, 每块先把A的对应行转换到A_f(packing), 随即在缓存中完成该块的乘法;
+ *        A_f是(M, K)的float矩阵, 返回后保存norm(A), 可供反向传播计算权重梯度.
+ */
+void gemm_u8(int TB, int M, int N, int K, float ALPHA,
+        const unsigned char *A, int lda,
+        const float *scale, const float *shift,
+        float *A_f,
+        float *B, int ldb,
+        float BETA,
+        float *C, int ldc);
+
 void gemm_cpu(int TA, int TB, int M, int N, int K, float ALPHA, 
         float *A, int lda, 
         float *B, int ldb,
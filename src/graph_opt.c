@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug_macros.h"
+#include "gemm.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "graph_opt.h"
+
+static int isLinearLayer(const struct Layer *layer)
+{
+    return layer->type == LINEAR_LAYER_TYPE || layer->type == SHARDED_LINEAR_LAYER_TYPE;
+}
+
+/**
+ * @brief 从src[0]开始合并连续的线性层, 遇到非线性层或合并不再减少乘加次数时停止, 合并结果写入新创建的线性层
+ *        参数布局与packLayerParam一致: w为n_out * n_in, 之后是b
+ */
+static int mergeLinearLayers(struct Layer **dst, int *n_used, struct Layer **src, int n_src)
+{
+    int n_in, n_mid, n_mid_next, n_out;
+    float *next = NULL;
+    float *merged = NULL;
+    struct LinearLayer *layer = NULL;
+
+    CHK_ERR(getLayerShape(&n_in, &n_mid, src[0]));
+    float *cur = calloc((size_t)n_mid * n_in + n_mid, sizeof(float));
+    CHK_NIL(cur);
+    CHK_ERR_GOTO(packLayerParam(cur, src[0]));
+
+    int k;
+    for (k = 1; k < n_src && isLinearLayer(src[k]); ++k) {
+        CHK_ERR_GOTO(getLayerShape(&n_mid_next, &n_out, src[k]));
+        if (n_mid_next != n_mid) {
+            ERR_MSG("Layer %s output number %d does not match Layer %s input number %d, error.\n",
+                src[k - 1]->name, n_mid, src[k]->name, n_mid_next);
+            goto err_end;
+        }
+        if ((long)n_in * n_out >= (long)n_in * n_mid + (long)n_mid * n_out) {
+            break;
+        }
+        next = calloc((size_t)n_out * n_mid + n_out, sizeof(float));
+        merged = calloc((size_t)n_out * n_in + n_out, sizeof(float));
+        CHK_NIL_GOTO(next);
+        CHK_NIL_GOTO(merged);
+        CHK_ERR_GOTO(packLayerParam(next, src[k]));
+
+        // W = W2 * W1, b = W2 * b1 + b2
+        memcpy(merged + (size_t)n_out * n_in, next + (size_t)n_out * n_mid, n_out * sizeof(float));
+        gemm(0, 0, n_out, n_in, n_mid, 1., next, n_mid, cur, n_in, 0., merged, n_in);
+        gemm(0, 0, n_out, 1, n_mid, 1., next, n_mid, cur + (size_t)n_mid * n_in, 1, 1., merged + (size_t)n_out * n_in, 1);
+
+        free(cur);
+        free(next);
+        cur = merged;
+        next = NULL;
+        merged = NULL;
+        n_mid = n_out;
+    }
+
+    CHK_ERR_GOTO(createLinearLayer(&layer, src[0]->name, n_in, n_mid));
+    CHK_ERR_GOTO(unpackLinearLayerParam(layer, cur));
+    if (src[0]->type == LINEAR_LAYER_TYPE) { // 归一化作用在W1之前, 合并后仍作用在输入上
+        CHK_ERR_GOTO(copyLinearLayerInputNormalization(layer, (const struct LinearLayer *)src[0]));
+    }
+    ((struct Layer *)layer)->idx = src[0]->idx;
+    free(cur);
+
+    *dst = (struct Layer *)layer;
+    *n_used = k;
+    return SUCCESS;
+
+err_end:
+    destroyLinearLayer(layer);
+    free(merged);
+    free(next);
+    free(cur);
+    return ERR_COD;
+}
+
+int optimizeLayers(struct Layer **(*dst), int *n_dst, struct Layer **src, int n_src, const struct Cost *cost)
+{
+    CHK_NIL(dst);
+    CHK_NIL(n_dst);
+    CHK_NIL(src);
+    CHK_NIL(cost);
+    CHK_ERR((n_src > 0)? 0: 1);
+
+    // CECost自带softmax, 最后的softmax层是多余的
+    int n_keep = n_src;
+    if (cost->type == CE_COST_TYPE && n_src > 1 && src[n_src - 1]->type == SOFTMAX_LAYER_TYPE) {
+        n_keep = n_src - 1;
+    }
+
+    struct Layer **layers = calloc(n_src, sizeof(struct Layer *));
+    CHK_NIL(layers);
+
+    int i = 0;
+    int n = 0;
+    while (i < n_keep) {
+        if (isLinearLayer(src[i])) {
+            int n_used = 0;
+            CHK_ERR_GOTO(mergeLinearLayers(&(layers[n]), &n_used, src + i, n_keep - i));
+            i += n_used;
+        }
+        else {
+            CHK_ERR_GOTO(createLayerReplica(&(layers[n]), src[i]));
+            ++i;
+        }
+        ++n;
+    }
+
+    *dst = layers;
+    *n_dst = n;
+    return SUCCESS;
+
+err_end:
+    destroyOptimizedLayers(layers, n);
+    return ERR_COD;
+}
+
+void destroyOptimizedLayers(struct Layer **layers, int n_layers)
+{
+    if (layers == NULL) {
+        return;
+    }
+
+    int i;
+    for (i = 0; i < n_layers; ++i) {
+        destroyLayer(layers[i]);
+    }
+    free(layers);
+}
@@ -0,0 +1,17 @@
+/**
+ * @brief 推理用的图优化: 对线性的层序列做等价变换, 减少计算量和访存遍数.
+ *        1. 相邻且中间没有非线性的线性层合并为一个线性层: W = W2 * W1, b = W2 * b1 + b2,
+ *           只在合并后的乘加次数 n_in * n_out 小于 n_in * n_mid + n_mid * n_out 时合并(瓶颈结构不合并);
+ *           第一层的输入归一化(setLinearLayerInputNormalization)作用在W1之前, 合并后的层保留它;
+ *        2. CECost自带softmax, 紧挨在CECost之前的SoftmaxLayer被去掉, 此后代价函数的分类概率即原softmax层的输出.
+ *
+ *        结果是一组新创建的层, 与原层不共享参数, 可以直接传给createNetwork; 分片线性层转换为普通线性层.
+ *        新线性层通过createLinearLayer创建, 其初始化会推进默认随机数流(rng.h, 由setRandomSeed重置)的位置, 不使用rand().
+ */
+#pragma once
+
+#include "layer.h"
+#include "cost.h"
+
+int optimizeLayers(struct Layer **(*dst), int *n_dst, struct Layer **src, int n_src, const struct Cost *cost);
+void destroyOptimizedLayers(struct Layer **layers, int n_layers);
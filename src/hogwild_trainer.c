@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "debug_macros.h"
+#include "layer.h"
+#include "cost.h"
+#include "network.h"
+#include "hogwild_trainer.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "thread_pool.h"
+
+struct HogwildWorker
+{
+    int idx;
+    pthread_t tid;
+    struct HogwildTrainer *trainer;
+    struct Layer **layers;
+    struct Cost *cost;
+    struct Network *net;
+    struct UpdateArgs args;
+    long n_updates;
+    float ce_cost;
+    int status;
+};
+
+struct HogwildTrainer
+{
+    int n_threads;
+    int n_layers;
+    struct HogwildWorker *workers;
+
+    // 当前run的参数
+    HogwildBatchFunc get_batch;
+    void *user_data;
+    int n_features;
+    int n_gt_features;
+    const char *dtype_str;
+    const char *gt_dtype_str;
+    long next_iter; // 全局batch序号, 各线程原子递增
+    int stop; // 某个线程出错时通知其他线程退出
+
+    long n_updates;
+    double elapsed;
+    float ce_cost;
+};
+
+static int runHogwildWorker(struct HogwildWorker *worker)
+{
+    struct HogwildTrainer *trainer = worker->trainer;
+    struct Probe probe;
+    memset(&probe, 0, sizeof(struct Probe));
+    probe.sw_ce_cost = 1;
+
+    while (!__atomic_load_n(&(trainer->stop), __ATOMIC_RELAXED)) {
+        const void *input_data = NULL;
+        const void *gt_data = NULL;
+        int n_samples = 0;
+        long n_iter = __atomic_fetch_add(&(trainer->next_iter), 1, __ATOMIC_RELAXED);
+        CHK_ERR(trainer->get_batch(&input_data, &gt_data, &n_samples, n_iter, trainer->user_data));
+        if (input_data == NULL) {
+            break;
+        }
+        worker->args.cur_iter = (int)n_iter;
+        // 前向计算读取的w和b可能正被其他线程写入, Hogwild允许这种不一致
+        CHK_ERR(forwardNetwork(worker->net, input_data, n_samples, trainer->n_features, trainer->dtype_str, &(worker->args), &probe));
+        CHK_ERR(backwardNetwork(worker->net, gt_data, n_samples, trainer->n_gt_features, trainer->gt_dtype_str, &(worker->args), &probe));
+        CHK_ERR(updateNetwork(worker->net, &(worker->args), &probe));
+        worker->ce_cost = probe.ce_cost;
+        ++(worker->n_updates);
+    }
+    return SUCCESS;
+}
+
+static void *runHogwildThread(void *arg)
+{
+    struct HogwildWorker *worker = arg;
+    setParallelForInline(1); // 每个线程已经是一个并行单位, 线程内的算子不再分发给线程池, 避免n_threads倍的超订
+    worker->status = runHogwildWorker(worker);
+    if (worker->status != SUCCESS) {
+        __atomic_store_n(&(worker->trainer->stop), 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+int createHogwildTrainer(struct HogwildTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost, int n_threads)
+{
+    CHK_NIL(trainer);
+    CHK_NIL(layers);
+    CHK_ERR((n_layers > 0)? 0: 1);
+    CHK_NIL(cost);
+    CHK_ERR((n_threads > 0)? 0: 1);
+
+    struct HogwildTrainer *res = calloc(1, sizeof(struct HogwildTrainer));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    res->n_threads = n_threads;
+    res->n_layers = n_layers;
+    CHK_NIL_GOTO((res->workers = calloc(n_threads, sizeof(struct HogwildWorker))));
+
+    int t, i;
+    for (t = 0; t < n_threads; ++t) {
+        struct HogwildWorker *worker = &(res->workers[t]);
+        worker->idx = t;
+        worker->trainer = res;
+        CHK_NIL_GOTO((worker->layers = calloc(n_layers, sizeof(struct Layer *))));
+        for (i = 0; i < n_layers; ++i) {
+            CHK_ERR_GOTO(createLayerReplica(&(worker->layers[i]), layers[i]));
+            CHK_ERR_GOTO(setLayerHogwild(worker->layers[i], 1));
+        }
+        CHK_ERR_GOTO(createCostReplica(&(worker->cost), cost));
+        CHK_ERR_GOTO(createNetwork(&(worker->net), worker->layers, n_layers, worker->cost));
+    }
+
+    *trainer = res;
+    return SUCCESS;
+
+err_end:
+    destroyHogwildTrainer(res);
+    return ERR_COD;
+}
+
+void destroyHogwildTrainer(struct HogwildTrainer *trainer)
+{
+    if (trainer == NULL) {
+        return;
+    }
+    if (trainer->workers) {
+        int t, i;
+        for (t = 0; t < trainer->n_threads; ++t) {
+            struct HogwildWorker *worker = &(trainer->workers[t]);
+            destroyNetwork(worker->net);
+            destroyCost(worker->cost);
+            if (worker->layers) {
+                for (i = 0; i < trainer->n_layers; ++i) {
+                    destroyLayer(worker->layers[i]);
+                }
+            }
+            free(worker->layers);
+        }
+    }
+    free(trainer->workers);
+    free(trainer);
+}
+
+int runHogwildTrainer(struct HogwildTrainer *trainer, HogwildBatchFunc get_batch, void *user_data,
+    int n_features, const char *dtype_str, int n_gt_features, const char *gt_dtype_str,
+    const struct UpdateArgs *args)
+{
+    CHK_NIL(trainer);
+    CHK_NIL(get_batch);
+    CHK_NIL(dtype_str);
+    CHK_NIL(gt_dtype_str);
+    CHK_ERR(checkUpdateArgs(args));
+
+    trainer->get_batch = get_batch;
+    trainer->user_data = user_data;
+    trainer->n_features = n_features;
+    trainer->n_gt_features = n_gt_features;
+    trainer->dtype_str = dtype_str;
+    trainer->gt_dtype_str = gt_dtype_str;
+    trainer->next_iter = 0;
+    trainer->stop = 0;
+
+    struct timeval t0, t1, t2;
+    gettimeofday(&t0, NULL);
+    int n_started = 0;
+    int t;
+    for (t = 0; t < trainer->n_threads; ++t) {
+        struct HogwildWorker *worker = &(trainer->workers[t]);
+        worker->args = *args;
+        worker->n_updates = 0;
+        worker->ce_cost = 0.;
+        worker->status = SUCCESS;
+        if (pthread_create(&(worker->tid), NULL, runHogwildThread, worker) != 0) {
+            ERR_MSG("pthread_create() failed, error.\n");
+            __atomic_store_n(&(trainer->stop), 1, __ATOMIC_RELAXED);
+            break;
+        }
+        ++n_started;
+    }
+
+    int ret = (n_started == trainer->n_threads)? SUCCESS: ERR_COD;
+    trainer->n_updates = 0;
+    trainer->ce_cost = 0.;
+    int n_active = 0;
+    for (t = 0; t < n_started; ++t) {
+        struct HogwildWorker *worker = &(trainer->workers[t]);
+        pthread_join(worker->tid, NULL);
+        if (worker->status != SUCCESS) {
+            ret = ERR_COD;
+        }
+        trainer->n_updates += worker->n_updates;
+        if (worker->n_updates > 0) {
+            trainer->ce_cost += worker->ce_cost;
+            ++n_active;
+        }
+    }
+    if (n_active > 0) {
+        trainer->ce_cost /= n_active;
+    }
+    gettimeofday(&t1, NULL);
+    timersub(&t1, &t0, &t2);
+    trainer->elapsed = t2.tv_sec + t2.tv_usec / 1e6;
+    return ret;
+}
+
+int getHogwildTrainerStats(long *n_updates, double *elapsed, float *ce_cost, const struct HogwildTrainer *trainer)
+{
+    CHK_NIL(n_updates);
+    CHK_NIL(elapsed);
+    CHK_NIL(ce_cost);
+    CHK_NIL(trainer);
+
+    *n_updates = trainer->n_updates;
+    *elapsed = trainer->elapsed;
+    *ce_cost = trainer->ce_cost;
+    return SUCCESS;
+}
@@ -0,0 +1,28 @@
+/**
+ * @brief Hogwild异步训练: n_threads个线程各自取batch、前向、反向, 然后不加锁直接更新共享的w和b.
+ *        每个线程持有共享参数的副本层(独立的梯度和动量), 线程之间的写冲突不做同步, 丢失的更新视为梯度噪声.
+ *        参数读写使用relaxed原子操作, 见addTensorHogwild. 结果不可复现, 与线程调度有关.
+ */
+#pragma once
+
+#include "layer.h"
+#include "cost.h"
+#include "opt_alg.h"
+
+/**
+ * @brief 取batch的回调, 由多个线程并发调用. n_iter是全局递增的batch序号, 可直接传给getMnistNthBatch.
+ *        *input_data返回NULL表示数据取完, 该线程结束.
+ */
+typedef int (*HogwildBatchFunc)(const void *(*input_data), const void *(*gt_data), int *n_samples, long n_iter, void *user_data);
+
+struct HogwildTrainer;
+
+int createHogwildTrainer(struct HogwildTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost, int n_threads);
+void destroyHogwildTrainer(struct HogwildTrainer *trainer);
+
+int runHogwildTrainer(struct HogwildTrainer *trainer, HogwildBatchFunc get_batch, void *user_data,
+    int n_features, const char *dtype_str, int n_gt_features, const char *gt_dtype_str,
+    const struct UpdateArgs *args);
+
+// 最近一次runHogwildTrainer的统计: 总更新次数, 耗时(秒), 各线程最后一个batch的代价均值
+int getHogwildTrainerStats(long *n_updates, double *elapsed, float *ce_cost, const struct HogwildTrainer *trainer);
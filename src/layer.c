@@ -2,6 +2,7 @@
 #include "tensor.h"
 #include "layer.h"
 #include "linear_layer.h"
+#include "sharded_linear_layer.h"
 #include "sigmoid_layer.h"
 #include "relu_layer.h"
 #include "softmax_layer.h"
@@ -36,12 +37,85 @@ char *getLayerTypeStrFromEnum(enum LayerType type)
         case SOFTMAX_LAYER_TYPE:
         return "softmax_layer";
 
+        case SHARDED_LINEAR_LAYER_TYPE:
+        return "sharded_linear_layer";
+
         default:
         break;
     }
     return "unknow_layer";
 }
 
+/**
+ * @brief 创建与src同类型的副本层, 带参数的层与src共享参数, 只拥有独立的梯度和输入输出关联
+ */
+int createLayerReplica(struct Layer **dst, const struct Layer *src)
+{
+    CHK_NIL(dst);
+    CHK_NIL(src);
+
+    switch (src->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(createLinearLayerReplica((struct LinearLayer **)dst, (const struct LinearLayer *)src));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE: // 分片层的参数已分布在多个线程上, 不再复制
+        ERR_MSG("Layer Type: %s does not support replica, error.\n", getLayerTypeStrFromEnum(src->type));
+        return ERR_COD;
+
+        case SIGMOID_LAYER_TYPE:
+        CHK_ERR(createSigmoidLayer((struct SigmoidLayer **)dst, src->name));
+        break;
+
+        case RELU_LAYER_TYPE:
+        CHK_ERR(createReluLayer((struct ReluLayer **)dst, src->name));
+        break;
+
+        case SOFTMAX_LAYER_TYPE:
+        CHK_ERR(createSoftmaxLayer((struct SoftmaxLayer **)dst, src->name));
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(src->type));
+        return ERR_COD;
+    }
+    (*dst)->idx = src->idx;
+    return SUCCESS;
+}
+
+void destroyLayer(struct Layer *layer)
+{
+    if (layer == NULL) {
+        return;
+    }
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        destroyLinearLayer((struct LinearLayer *)layer);
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE:
+        destroyShardedLinearLayer((struct ShardedLinearLayer *)layer);
+        break;
+
+        case SIGMOID_LAYER_TYPE:
+        destroySigmoidLayer((struct SigmoidLayer *)layer);
+        break;
+
+        case RELU_LAYER_TYPE:
+        destroyReluLayer((struct ReluLayer *)layer);
+        break;
+
+        case SOFTMAX_LAYER_TYPE:
+        destroySoftmaxLayer((struct SoftmaxLayer *)layer);
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        break;
+    }
+}
+
 int forwardLayer(struct Layer *layer, const struct UpdateArgs *args, struct Probe *probe)
 {
     CHK_NIL(layer);
@@ -51,6 +125,10 @@ int forwardLayer(struct Layer *layer, const struct UpdateArgs *args, struct Prob
         CHK_ERR(forwardLinearLayer((struct LinearLayer *)layer, args, probe));
         break;
 
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(forwardShardedLinearLayer((struct ShardedLinearLayer *)layer, args, probe));
+        break;
+
         case SIGMOID_LAYER_TYPE:
         CHK_ERR(forwardSigmoidLayer((struct SigmoidLayer *)layer, args, probe));
         break;
@@ -79,6 +157,10 @@ int backwardLayer(struct Layer *layer, const struct UpdateArgs *args, struct Pro
         CHK_ERR(backwardLinearLayer((struct LinearLayer *)layer, args, probe));
         break;
 
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(backwardShardedLinearLayer((struct ShardedLinearLayer *)layer, args, probe));
+        break;
+
         case SIGMOID_LAYER_TYPE:
         CHK_ERR(backwardSigmoidLayer((struct SigmoidLayer *)layer, args, probe));
         break;
@@ -107,6 +189,10 @@ int updateLayer(struct Layer *layer, const struct UpdateArgs *args, struct Probe
         CHK_ERR(updateLinearLayer((struct LinearLayer *)layer, args, probe));
         break;
 
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(updateShardedLinearLayer((struct ShardedLinearLayer *)layer, args, probe));
+        break;
+
         case SIGMOID_LAYER_TYPE: // sigmoid_layer无需参数更新，直接略过
         break;
 
@@ -134,6 +220,10 @@ int getLayerShape(int *n_in, int *n_out, const struct Layer *layer)
         CHK_ERR(getLinearLayerShape(n_in, n_out, (const struct LinearLayer *)layer));
         break;
 
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(getShardedLinearLayerShape(n_in, n_out, (const struct ShardedLinearLayer *)layer));
+        break;
+
         case SIGMOID_LAYER_TYPE:
         CHK_ERR(getSigmoidLayerShape(n_in, n_out, (const struct SigmoidLayer *)layer));
         break;
@@ -163,6 +253,10 @@ int getLayerInputNumber(int *n_in, const struct Layer *layer)
         CHK_ERR(getLinearLayerInputNumber(n_in, (const struct LinearLayer *)layer));
         break;
 
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(getShardedLinearLayerInputNumber(n_in, (const struct ShardedLinearLayer *)layer));
+        break;
+
         case SIGMOID_LAYER_TYPE:
         CHK_ERR(getSigmoidLayerInputNumber(n_in, (const struct SigmoidLayer *)layer));
         break;
@@ -192,6 +286,10 @@ int getLayerOutputNumber(int *n_out, const struct Layer *layer)
         CHK_ERR(getLinearLayerOutputNumber(n_out, (struct LinearLayer *)layer));
         break;
 
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(getShardedLinearLayerOutputNumber(n_out, (struct ShardedLinearLayer *)layer));
+        break;
+
         case SIGMOID_LAYER_TYPE:
         CHK_ERR(getSigmoidLayerOutputNumber(n_out, (struct SigmoidLayer *)layer));
         break;
@@ -225,6 +323,7 @@ int setLayerNeuronNumber(struct Layer *layer, int n_neurons)
 
     switch (layer->type) {
         case LINEAR_LAYER_TYPE: // 线性层不需要依赖前一层的神经元设置自己的神经元个数
+        case SHARDED_LINEAR_LAYER_TYPE:
         break;
 
         case SIGMOID_LAYER_TYPE:
@@ -246,6 +345,213 @@ int setLayerNeuronNumber(struct Layer *layer, int n_neurons)
     return SUCCESS;
 }
 
+int setLayerHogwild(struct Layer *layer, int on)
+{
+    CHK_NIL(layer);
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(setLinearLayerHogwild((struct LinearLayer *)layer, on));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE: // 分片层的参数只由各分片线程更新
+        ERR_MSG("Layer Type: %s does not support hogwild, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+
+        case SIGMOID_LAYER_TYPE: // 没有参数的层不需要设置
+        case RELU_LAYER_TYPE:
+        case SOFTMAX_LAYER_TYPE:
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+// 开启后反向传播时b_grad累加到已有值上, 关闭时覆盖(默认)
+int setLayerGradientAccumulation(struct Layer *layer, int on)
+{
+    CHK_NIL(layer);
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(setLinearLayerGradientAccumulation((struct LinearLayer *)layer, on));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(setShardedLinearLayerGradientAccumulation((struct ShardedLinearLayer *)layer, on));
+        break;
+
+        case SIGMOID_LAYER_TYPE: // 没有参数的层不需要设置
+        case RELU_LAYER_TYPE:
+        case SOFTMAX_LAYER_TYPE:
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int getLayerParamNumber(int *n, const struct Layer *layer)
+{
+    CHK_NIL(n);
+    CHK_NIL(layer);
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(getLinearLayerParamNumber(n, (const struct LinearLayer *)layer));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(getShardedLinearLayerParamNumber(n, (const struct ShardedLinearLayer *)layer));
+        break;
+
+        case SIGMOID_LAYER_TYPE: // 没有参数的层
+        case RELU_LAYER_TYPE:
+        case SOFTMAX_LAYER_TYPE:
+        *n = 0;
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int packLayerParam(float *dst, const struct Layer *layer)
+{
+    CHK_NIL(dst);
+    CHK_NIL(layer);
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(packLinearLayerParam(dst, (const struct LinearLayer *)layer));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(packShardedLinearLayerParam(dst, (const struct ShardedLinearLayer *)layer));
+        break;
+
+        case SIGMOID_LAYER_TYPE: // 没有参数的层
+        case RELU_LAYER_TYPE:
+        case SOFTMAX_LAYER_TYPE:
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int unpackLayerParam(struct Layer *layer, const float *src)
+{
+    CHK_NIL(layer);
+    CHK_NIL(src);
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(unpackLinearLayerParam((struct LinearLayer *)layer, src));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(unpackShardedLinearLayerParam((struct ShardedLinearLayer *)layer, src));
+        break;
+
+        case SIGMOID_LAYER_TYPE: // 没有参数的层
+        case RELU_LAYER_TYPE:
+        case SOFTMAX_LAYER_TYPE:
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int packLayerGradient(float *dst, const struct Layer *layer)
+{
+    CHK_NIL(dst);
+    CHK_NIL(layer);
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(packLinearLayerGradient(dst, (const struct LinearLayer *)layer));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(packShardedLinearLayerGradient(dst, (const struct ShardedLinearLayer *)layer));
+        break;
+
+        case SIGMOID_LAYER_TYPE: // 没有参数的层
+        case RELU_LAYER_TYPE:
+        case SOFTMAX_LAYER_TYPE:
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int clearLayerGradient(struct Layer *layer)
+{
+    CHK_NIL(layer);
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(clearLinearLayerGradient((struct LinearLayer *)layer));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(clearShardedLinearLayerGradient((struct ShardedLinearLayer *)layer));
+        break;
+
+        case SIGMOID_LAYER_TYPE: // 没有参数的层
+        case RELU_LAYER_TYPE:
+        case SOFTMAX_LAYER_TYPE:
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int mergeLayerGradient(struct Layer *layer, const float *src)
+{
+    CHK_NIL(layer);
+    CHK_NIL(src);
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(mergeLinearLayerGradient((struct LinearLayer *)layer, src));
+        break;
+
+        case SHARDED_LINEAR_LAYER_TYPE:
+        CHK_ERR(mergeShardedLinearLayerGradient((struct ShardedLinearLayer *)layer, src));
+        break;
+
+        case SIGMOID_LAYER_TYPE: // 没有参数的层
+        case RELU_LAYER_TYPE:
+        case SOFTMAX_LAYER_TYPE:
+        break;
+
+        default:
+        ERR_MSG("Unkonw Layer Type found: %s, error.\n", getLayerTypeStrFromEnum(layer->type));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
 int setLayerName(struct Layer *layer, const char *name)
 {
     CHK_NIL(layer);
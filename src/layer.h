@@ -11,7 +11,8 @@ enum LayerType
     LINEAR_LAYER_TYPE,
     SIGMOID_LAYER_TYPE,
     RELU_LAYER_TYPE,
-    SOFTMAX_LAYER_TYPE
+    SOFTMAX_LAYER_TYPE,
+    SHARDED_LINEAR_LAYER_TYPE
 };
 
 struct Layer
@@ -27,6 +28,9 @@ struct Layer
     struct Tensor *delta_out;
 };
 
+int createLayerReplica(struct Layer **dst, const struct Layer *src);
+void destroyLayer(struct Layer *layer);
+
 int forwardLayer(struct Layer *layer, const struct UpdateArgs *args, struct Probe *probe);
 int backwardLayer(struct Layer *layer, const struct UpdateArgs *args, struct Probe *probe);
 int updateLayer(struct Layer *layer, const struct UpdateArgs *args, struct Probe *probe);
@@ -35,8 +39,18 @@ int getLayerInputNumber(int *n_in, const struct Layer *layer);
 int getLayerOutputNumber(int *n_out, const struct Layer *layer);
 int getLayerShape(int *n_in, int *n_out, const struct Layer *layer);
 int getLayerName(const char *(*name), const struct Layer *layer);
+int getLayerParamNumber(int *n, const struct Layer *layer);
+
+// 参数和梯度与连续float数组之间的拷贝, 用于跨进程传输; 没有参数的层不读写数组
+int packLayerParam(float *dst, const struct Layer *layer);
+int unpackLayerParam(struct Layer *layer, const float *src);
+int packLayerGradient(float *dst, const struct Layer *layer);
+int clearLayerGradient(struct Layer *layer);
+int mergeLayerGradient(struct Layer *layer, const float *src);
 
 int setLayerNeuronNumber(struct Layer *layer, int n_neurons);
+int setLayerHogwild(struct Layer *layer, int on);
+int setLayerGradientAccumulation(struct Layer *layer, int on);
 int setLayerName(struct Layer *layer, const char *name);
 int setLayerIndex(struct Layer *layer, int idx);
 int setLayerInput(struct Layer *layer, const struct Tensor *input);
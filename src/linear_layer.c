@@ -20,7 +20,19 @@ struct LinearLayer
     struct Tensor *w; // n_inputs * n_outputs，布局与yolov2保持一致
     struct Tensor *b;
     struct Tensor *w_grad; // n_inputs * n_outputs，布局与yolov2保持一致
-    struct Tensor *b_grad;;
+    struct Tensor *b_grad;
+
+    int is_replica; // 副本与主层共享w和b, 只拥有自己的梯度缓冲区
+    int hogwild; // 参数更新时不加锁直接写共享的w和b
+    int acc_grad; // b_grad累加而不是覆盖, 用于micro-batch梯度累积(w_grad总是累加)
+
+    // 输入为UINT8时的归一化: x * in_scale + in_shift, 各n_in个; 转换结果保存在input_f中供反向传播使用
+    float *in_scale;
+    float *in_shift;
+    struct Tensor *input_f;
+    // input_f由哪个输入张量的哪份数据转换而来; 反向传播时的输入不是它(流水线的micro-batch交错)则重新转换
+    const struct Tensor *input_f_src;
+    const void *input_f_blob;
 };
 
 int createLinearLayer(struct LinearLayer **l, const char *name, int n_in, int n_out)
@@ -67,13 +79,65 @@ err_end:
     return ERR_COD;
 }
 
+/**
+ * @brief 创建共享master参数w和b的副本层, 用于多线程训练时每个线程独立计算梯度
+ */
+int createLinearLayerReplica(struct LinearLayer **l, const struct LinearLayer *master)
+{
+    CHK_NIL(l);
+    CHK_NIL(master);
+
+    int n_in, n_out;
+    CHK_ERR(getLinearLayerShape(&n_in, &n_out, master));
+
+    struct LinearLayer *layer = calloc(1, sizeof(struct LinearLayer));
+    if (layer == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    ((struct Layer *)layer)->type = LINEAR_LAYER_TYPE;
+    snprintf(((struct Layer *)layer)->name, NN_LAYER_NAME_LEN, "%s", ((const struct Layer *)master)->name);
+    layer->is_replica = 1;
+    layer->w = master->w;
+    layer->b = master->b;
+
+    CHK_ERR_GOTO(createTensorParam(&(layer->w_grad), FLOAT32, n_out, n_in));
+    CHK_ERR_GOTO(createTensorParam(&(layer->b_grad), FLOAT32, 1, n_out));
+    if (master->in_scale) {
+        layer->in_scale = malloc(n_in * sizeof(float));
+        layer->in_shift = malloc(n_in * sizeof(float));
+        if (layer->in_scale == NULL || layer->in_shift == NULL) {
+            ERR_MSG("malloc failed, error.\n");
+            goto err_end;
+        }
+        memcpy(layer->in_scale, master->in_scale, n_in * sizeof(float));
+        memcpy(layer->in_shift, master->in_shift, n_in * sizeof(float));
+    }
+
+    *l = layer;
+    return SUCCESS;
+
+err_end:
+    free(layer->in_scale);
+    free(layer->in_shift);
+    destroyTensor(layer->b_grad);
+    destroyTensor(layer->w_grad);
+    free(layer);
+    return ERR_COD;
+}
+
 void destroyLinearLayer(struct LinearLayer *layer)
 {
     if (layer) {
+        destroyTensor(layer->input_f);
+        free(layer->in_scale);
+        free(layer->in_shift);
         destroyTensor(layer->b_grad);
         destroyTensor(layer->w_grad);
-        destroyTensor(layer->b);
-        destroyTensor(layer->w);
+        if (!layer->is_replica) {
+            destroyTensor(layer->b);
+            destroyTensor(layer->w);
+        }
     }
     free(layer);
 }
@@ -102,6 +166,192 @@ int getLinearLayerOutputNumber(int *n_out, const struct LinearLayer *layer)
     return SUCCESS;
 }
 
+int getLinearLayerParamRef(struct Tensor **w, struct Tensor **b, const struct LinearLayer *layer)
+{
+    CHK_NIL(w);
+    CHK_NIL(b);
+    CHK_NIL(layer);
+
+    *w = layer->w;
+    *b = layer->b;
+    return SUCCESS;
+}
+
+int getLinearLayerGradientRef(struct Tensor **w_grad, struct Tensor **b_grad, const struct LinearLayer *layer)
+{
+    CHK_NIL(w_grad);
+    CHK_NIL(b_grad);
+    CHK_NIL(layer);
+
+    *w_grad = layer->w_grad;
+    *b_grad = layer->b_grad;
+    return SUCCESS;
+}
+
+// 开启后updateLinearLayer以Hogwild方式无锁更新w和b, 用于多个副本层并发写同一份参数
+int setLinearLayerHogwild(struct LinearLayer *layer, int on)
+{
+    CHK_NIL(layer);
+    layer->hogwild = on;
+    return SUCCESS;
+}
+
+int setLinearLayerGradientAccumulation(struct LinearLayer *layer, int on)
+{
+    CHK_NIL(layer);
+    layer->acc_grad = on;
+    return SUCCESS;
+}
+
+int setLinearLayerInputNormalization(struct LinearLayer *layer, const float *mean, const float *std, int n)
+{
+    CHK_NIL(layer);
+    CHK_NIL(mean);
+    CHK_NIL(std);
+
+    int n_in;
+    CHK_ERR(getLinearLayerInputNumber(&n_in, layer));
+    CHK_ERR((n == 1 || n == n_in)? 0: 1);
+    if (layer->in_scale == NULL) {
+        layer->in_scale = malloc(n_in * sizeof(float));
+        layer->in_shift = malloc(n_in * sizeof(float));
+        if (layer->in_scale == NULL || layer->in_shift == NULL) {
+            ERR_MSG("malloc failed, error.\n");
+            free(layer->in_scale);
+            free(layer->in_shift);
+            layer->in_scale = NULL;
+            layer->in_shift = NULL;
+            return ERR_COD;
+        }
+    }
+    int i;
+    for (i = 0; i < n_in; ++i) {
+        int k = (n == 1)? 0: i;
+        CHK_ERR((std[k] > 0)? 0: 1);
+        layer->in_scale[i] = 1.f / std[k];
+        layer->in_shift[i] = -mean[k] / std[k];
+    }
+    return SUCCESS;
+}
+
+int copyLinearLayerInputNormalization(struct LinearLayer *dst, const struct LinearLayer *src)
+{
+    CHK_NIL(dst);
+    CHK_NIL(src);
+
+    int n_in, n_in_src;
+    CHK_ERR(getLinearLayerInputNumber(&n_in, dst));
+    CHK_ERR(getLinearLayerInputNumber(&n_in_src, src));
+    CHK_ERR((n_in == n_in_src)? 0: 1);
+    if (src->in_scale == NULL) {
+        free(dst->in_scale);
+        free(dst->in_shift);
+        dst->in_scale = NULL;
+        dst->in_shift = NULL;
+        return SUCCESS;
+    }
+    if (dst->in_scale == NULL) {
+        dst->in_scale = malloc(n_in * sizeof(float));
+        dst->in_shift = malloc(n_in * sizeof(float));
+        if (dst->in_scale == NULL || dst->in_shift == NULL) {
+            ERR_MSG("malloc failed, error.\n");
+            free(dst->in_scale);
+            free(dst->in_shift);
+            dst->in_scale = NULL;
+            dst->in_shift = NULL;
+            return ERR_COD;
+        }
+    }
+    memcpy(dst->in_scale, src->in_scale, n_in * sizeof(float));
+    memcpy(dst->in_shift, src->in_shift, n_in * sizeof(float));
+    return SUCCESS;
+}
+
+int getLinearLayerParamNumber(int *n, const struct LinearLayer *layer)
+{
+    CHK_NIL(n);
+    CHK_NIL(layer);
+
+    int n_in, n_out;
+    CHK_ERR(getLinearLayerShape(&n_in, &n_out, layer));
+    *n = n_out * n_in + n_out;
+    return SUCCESS;
+}
+
+// 以下pack/unpack按w, b的顺序连续存放, 共getLinearLayerParamNumber个float
+int packLinearLayerParam(float *dst, const struct LinearLayer *layer)
+{
+    CHK_NIL(dst);
+    CHK_NIL(layer);
+
+    int n_in, n_out;
+    CHK_ERR(getLinearLayerShape(&n_in, &n_out, layer));
+    CHK_ERR(getTensorBlobByCopy(dst, FLOAT32, layer->w));
+    CHK_ERR(getTensorBlobByCopy(dst + n_out * n_in, FLOAT32, layer->b));
+    return SUCCESS;
+}
+
+int unpackLinearLayerParam(struct LinearLayer *layer, const float *src)
+{
+    CHK_NIL(layer);
+    CHK_NIL(src);
+
+    int n_in, n_out;
+    float *w, *b;
+    CHK_ERR(getLinearLayerShape(&n_in, &n_out, layer));
+    CHK_ERR(getTensorBlob((void **)&w, layer->w));
+    CHK_ERR(getTensorBlob((void **)&b, layer->b));
+    memcpy(w, src, n_out * n_in * sizeof(float));
+    memcpy(b, src + n_out * n_in, n_out * sizeof(float));
+    return SUCCESS;
+}
+
+int packLinearLayerGradient(float *dst, const struct LinearLayer *layer)
+{
+    CHK_NIL(dst);
+    CHK_NIL(layer);
+
+    int n_in, n_out;
+    CHK_ERR(getLinearLayerShape(&n_in, &n_out, layer));
+    CHK_ERR(getTensorBlobByCopy(dst, FLOAT32, layer->w_grad));
+    CHK_ERR(getTensorBlobByCopy(dst + n_out * n_in, FLOAT32, layer->b_grad));
+    return SUCCESS;
+}
+
+// w_grad由gemm累加, 在只需要本次梯度(例如发送给参数服务器)时, 反向传播前清零
+int clearLinearLayerGradient(struct LinearLayer *layer)
+{
+    CHK_NIL(layer);
+
+    int n_in, n_out;
+    float *w_grad, *b_grad;
+    CHK_ERR(getLinearLayerShape(&n_in, &n_out, layer));
+    CHK_ERR(getTensorBlob((void **)&w_grad, layer->w_grad));
+    CHK_ERR(getTensorBlob((void **)&b_grad, layer->b_grad));
+    memset(w_grad, 0, n_out * n_in * sizeof(float));
+    memset(b_grad, 0, n_out * sizeof(float));
+    return SUCCESS;
+}
+
+// 合并外部计算的梯度, 语义与反向传播一致: w_grad累加(保留动量项), b_grad覆盖
+int mergeLinearLayerGradient(struct LinearLayer *layer, const float *src)
+{
+    CHK_NIL(layer);
+    CHK_NIL(src);
+
+    int n_in, n_out;
+    float *w_grad, *b_grad;
+    CHK_ERR(getLinearLayerShape(&n_in, &n_out, layer));
+    CHK_ERR(getTensorBlob((void **)&w_grad, layer->w_grad));
+    CHK_ERR(getTensorBlob((void **)&b_grad, layer->b_grad));
+    int i;
+    for (i = 0; i < n_out * n_in; ++i) {
+        w_grad[i] += src[i];
+    }
+    memcpy(b_grad, src + n_out * n_in, n_out * sizeof(float));
+    return SUCCESS;
+}
+
 int loadtxtLinearLayerWeight(struct LinearLayer *layer, const char *pth)
 {
     CHK_NIL(layer);
@@ -120,6 +370,23 @@ int loadtxtLinearLayerBias(struct LinearLayer *layer, const char *pth)
 }
 
 
+// UINT8输入时按输入张量的batch大小准备转换结果的缓冲区
+static int prepareLinearLayerInputF(struct LinearLayer *layer, const struct Tensor *input)
+{
+    int b, n, b_f, n_f;
+    CHK_ERR(getTensorBatchAndFeatures(&b, &n, input));
+    if (layer->input_f) {
+        CHK_ERR(getTensorBatchAndFeatures(&b_f, &n_f, layer->input_f));
+        if (b_f == b && n_f == n) {
+            return SUCCESS;
+        }
+        destroyTensor(layer->input_f);
+        layer->input_f = NULL;
+    }
+    CHK_ERR(createTensorData(&(layer->input_f), FLOAT32, b, n));
+    return SUCCESS;
+}
+
 /**
  * @brief 正向传播, 计算当前层非线性变换后输出output, 相当于full_connected_layer的隐藏层神经元的值
  */
@@ -127,7 +394,23 @@ int forwardLinearLayer(struct LinearLayer *layer, const struct UpdateArgs *args,
 {
     CHK_NIL(layer);
 
-    CHK_ERR(linearTensorForward(((struct Layer *)layer)->output, ((struct Layer *)layer)->input, layer->w, layer->b));
+    struct Tensor *input = ((struct Layer *)layer)->input;
+    enum DType dtype;
+    enum TensorLayout layout;
+    CHK_ERR(getTensorDType(&dtype, input));
+    CHK_ERR(getTensorLayout(&layout, input));
+    if (layout == CSR_TENSOR_LAYOUT) { // 稀疏输入不做归一化, 否则零元素也会变成非零
+        CHK_ERR(linearTensorForwardCsr(((struct Layer *)layer)->output, input, layer->w, layer->b));
+    }
+    else if (dtype == UINT8) {
+        CHK_ERR(prepareLinearLayerInputF(layer, input));
+        CHK_ERR(linearTensorForwardU8(((struct Layer *)layer)->output, layer->input_f, input, layer->w, layer->b, layer->in_scale, layer->in_shift));
+        layer->input_f_src = input;
+        CHK_ERR(getTensorBlobConstRef(&(layer->input_f_blob), input));
+    }
+    else {
+        CHK_ERR(linearTensorForward(((struct Layer *)layer)->output, input, layer->w, layer->b));
+    }
 
     if (probe->dump_output) {
         CHK_ERR(savetxtTensorData(((struct Layer *)layer)->output, probe->dst_dir, "out", ((struct Layer *)layer)->name, args->cur_epoch, args->cur_iter));
@@ -160,12 +443,38 @@ int backwardLinearLayer(struct LinearLayer *layer, const struct UpdateArgs *args
 
     // update gradient
     //CHK_ERR(linearTensorWeightGradient(layer->w_grad, ((struct Layer *)layer)->delta_in, 1, ((struct Layer *)layer)->input, 0, NULL)); // update weight gradient
-    CHK_ERR(linearTensorWeightGradient(layer->w_grad, ((struct Layer *)layer)->delta_in, ((struct Layer *)layer)->input)); // update weight gradient
+    enum DType dtype;
+    enum TensorLayout layout;
+    CHK_ERR(getTensorDType(&dtype, ((struct Layer *)layer)->input));
+    CHK_ERR(getTensorLayout(&layout, ((struct Layer *)layer)->input));
+    if (layout == CSR_TENSOR_LAYOUT) {
+        CHK_ERR(linearTensorWeightGradientCsr(layer->w_grad, ((struct Layer *)layer)->delta_in, ((struct Layer *)layer)->input));
+    }
+    else {
+        const struct Tensor *input = ((struct Layer *)layer)->input;
+        if (dtype == UINT8) { // 使用正向传播时的转换结果, 它来自别的输入时按当前输入重新转换
+            const void *blob = NULL;
+            CHK_ERR(getTensorBlobConstRef(&blob, input));
+            if (layer->input_f_src != input || layer->input_f_blob != blob) {
+                CHK_ERR(prepareLinearLayerInputF(layer, input));
+                CHK_ERR(normalizeTensorU8(layer->input_f, input, layer->in_scale, layer->in_shift));
+                layer->input_f_src = input;
+                layer->input_f_blob = blob;
+            }
+            input = layer->input_f;
+        }
+        CHK_ERR(linearTensorWeightGradient(layer->w_grad, ((struct Layer *)layer)->delta_in, input)); // update weight gradient
+    }
     //CHK_ERR(savetxtTensorData(((struct Layer *)layer)->delta_in, probe->dst_dir, "delta_in", ((struct Layer *)layer)->name, args->cur_epoch, args->cur_iter));
     if (probe->dump_gw) {
         CHK_ERR(savetxtTensorParam(layer->w_grad, probe->dst_dir, "gW", ((struct Layer *)layer)->name, args->cur_epoch, args->cur_iter));
     }
-    CHK_ERR(linearTensorBiasGradient(layer->b_grad, ((struct Layer *)layer)->delta_in)); // update bias gradient
+    if (layer->acc_grad) {
+        CHK_ERR(linearTensorBiasGradientAcc(layer->b_grad, ((struct Layer *)layer)->delta_in));
+    }
+    else {
+        CHK_ERR(linearTensorBiasGradient(layer->b_grad, ((struct Layer *)layer)->delta_in)); // update bias gradient
+    }
     if (probe->dump_gb) {
         CHK_ERR(savetxtTensorParam(layer->b_grad, probe->dst_dir, "gb", ((struct Layer *)layer)->name, args->cur_epoch, args->cur_iter));
     }
@@ -197,12 +506,22 @@ int updateLinearLayer(struct LinearLayer *layer, const struct UpdateArgs *args,
 */
     // 注意：这里的lr应该是已经除以了batch_size后的lr
     //CHK_ERR(addTensor(layer->w, layer->w_grad, 1. * (args->lr) / (args->batch_size), args->momentum));
-    CHK_ERR(addTensor(layer->w, layer->w_grad, 1. * (args->lr), args->momentum));
+    if (layer->hogwild) {
+        CHK_ERR(addTensorHogwild(layer->w, layer->w_grad, 1. * (args->lr), args->momentum));
+    }
+    else {
+        CHK_ERR(addTensor(layer->w, layer->w_grad, 1. * (args->lr), args->momentum));
+    }
     if (probe->dump_w) {
         CHK_ERR(savetxtTensorParam(layer->w, probe->dst_dir, "W", ((struct Layer *)layer)->name, args->cur_epoch, args->cur_iter));
     }
     //CHK_ERR(addTensor(layer->b, layer->b_grad, 1. * (args->lr) / (args->batch_size), args->momentum));
-    CHK_ERR(addTensor(layer->b, layer->b_grad, 1. * (args->lr), args->momentum));
+    if (layer->hogwild) {
+        CHK_ERR(addTensorHogwild(layer->b, layer->b_grad, 1. * (args->lr), args->momentum));
+    }
+    else {
+        CHK_ERR(addTensor(layer->b, layer->b_grad, 1. * (args->lr), args->momentum));
+    }
     if (probe->dump_b) {
         CHK_ERR(savetxtTensorParam(layer->b, probe->dst_dir, "b", ((struct Layer *)layer)->name, args->cur_epoch, args->cur_iter));
     }
@@ -20,11 +20,30 @@ struct LinearLayer
 */
 
 int createLinearLayer(struct LinearLayer **l, const char *name, int n_in, int n_out);
+int createLinearLayerReplica(struct LinearLayer **l, const struct LinearLayer *master);
 void destroyLinearLayer(struct LinearLayer *layer);
 
 int getLinearLayerShape(int *n_in, int *n_out, const struct LinearLayer *layer);
 int getLinearLayerInputNumber(int *n_in, const struct LinearLayer *layer);
 int getLinearLayerOutputNumber(int *n_out, const struct LinearLayer *layer);
+int getLinearLayerParamRef(struct Tensor **w, struct Tensor **b, const struct LinearLayer *layer);
+int getLinearLayerGradientRef(struct Tensor **w_grad, struct Tensor **b_grad, const struct LinearLayer *layer);
+int setLinearLayerHogwild(struct LinearLayer *layer, int on);
+int setLinearLayerGradientAccumulation(struct LinearLayer *layer, int on);
+/**
+ * @brief 输入为UINT8张量时在gemm分块内做(x - mean) / std, 数据集可以保持uint8, 不必预先转换为float.
+ *        n为1时所有特征使用同一组mean/std, 否则n必须等于n_in(逐特征统计). 副本层复制创建时主层的设置.
+ *        未设置时UINT8输入只做类型转换.
+ */
+int setLinearLayerInputNormalization(struct LinearLayer *layer, const float *mean, const float *std, int n);
+// 把src的输入归一化设置原样复制给dst(src未设置时清除dst的设置), 两层的n_in必须相同, 用于由src派生出的新层
+int copyLinearLayerInputNormalization(struct LinearLayer *dst, const struct LinearLayer *src);
+int getLinearLayerParamNumber(int *n, const struct LinearLayer *layer);
+int packLinearLayerParam(float *dst, const struct LinearLayer *layer);
+int unpackLinearLayerParam(struct LinearLayer *layer, const float *src);
+int packLinearLayerGradient(float *dst, const struct LinearLayer *layer);
+int clearLinearLayerGradient(struct LinearLayer *layer);
+int mergeLinearLayerGradient(struct LinearLayer *layer, const float *src);
 int loadtxtLinearLayerWeight(struct LinearLayer *layer, const char *pth);
 int loadtxtLinearLayerBias(struct LinearLayer *layer, const char *pth);
 
@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "debug_macros.h"
+#include "affinity.h"
+#include "thread_pool.h"
+#include "memory.h"
+
+// 与<numaif.h>一致, 直接调用系统调用, 不依赖libnuma
+#ifndef MPOL_BIND
+#define MPOL_BIND (2)
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE (3)
+#endif
+#define MEM_MAX_NODES (64)
+
+// 大块分配的登记, 用于释放时取回映射长度和统计大页
+struct BlobRegion
+{
+    char *ptr;
+    size_t len;
+    int hugetlb;
+    struct BlobRegion *next;
+};
+
+static enum MemPolicy g_policy = MEM_POLICY_DEFAULT;
+static int g_node = 0;
+static enum HugePageMode g_huge = HUGE_PAGE_THP;
+static pthread_mutex_t g_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+
+static struct BlobRegion *g_regions = NULL;
+static pthread_mutex_t g_region_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static int applyMemoryPolicySpec(const char *spec)
+{
+    if (strcmp(spec, "default") == 0) {
+        g_policy = MEM_POLICY_DEFAULT;
+    }
+    else if (strcmp(spec, "interleave") == 0) {
+        g_policy = MEM_POLICY_INTERLEAVE;
+    }
+    else if (strncmp(spec, "bind:", 5) == 0) {
+        char *end = NULL;
+        long node = strtol(spec + 5, &end, 10);
+        if (end == spec + 5 || *end != '\0' || node < 0 || node >= MEM_MAX_NODES) {
+            return ERR_COD;
+        }
+        g_policy = MEM_POLICY_BIND;
+        g_node = (int)node;
+    }
+    else {
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+static int applyHugePageSpec(const char *spec)
+{
+    if (strcmp(spec, "none") == 0) {
+        g_huge = HUGE_PAGE_NONE;
+    }
+    else if (strcmp(spec, "thp") == 0) {
+        g_huge = HUGE_PAGE_THP;
+    }
+    else if (strcmp(spec, "hugetlb") == 0) {
+        g_huge = HUGE_PAGE_HUGETLB;
+    }
+    else {
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+static void initMemoryPolicy()
+{
+    const char *env = getenv("NN_MEMPOLICY");
+    if (env && applyMemoryPolicySpec(env) != SUCCESS) {
+        ERR_MSG("NN_MEMPOLICY=%s is invalid, ignored.\n", env);
+    }
+    env = getenv("NN_HUGEPAGE");
+    if (env && applyHugePageSpec(env) != SUCCESS) {
+        ERR_MSG("NN_HUGEPAGE=%s is invalid, ignored.\n", env);
+    }
+}
+
+int setMemoryPolicy(const char *spec)
+{
+    CHK_NIL(spec);
+    pthread_once(&g_once, initMemoryPolicy);
+
+    pthread_mutex_lock(&g_mtx);
+    int res = applyMemoryPolicySpec(spec);
+    pthread_mutex_unlock(&g_mtx);
+    if (res != SUCCESS) {
+        ERR_MSG("memory policy: %s not supported, error.\n", spec);
+    }
+    return res;
+}
+
+int getMemoryPolicy(enum MemPolicy *policy, int *node)
+{
+    CHK_NIL(policy);
+    CHK_NIL(node);
+    pthread_once(&g_once, initMemoryPolicy);
+
+    pthread_mutex_lock(&g_mtx);
+    *policy = g_policy;
+    *node = g_node;
+    pthread_mutex_unlock(&g_mtx);
+    return SUCCESS;
+}
+
+int setHugePageMode(const char *spec)
+{
+    CHK_NIL(spec);
+    pthread_once(&g_once, initMemoryPolicy);
+
+    pthread_mutex_lock(&g_mtx);
+    int res = applyHugePageSpec(spec);
+    pthread_mutex_unlock(&g_mtx);
+    if (res != SUCCESS) {
+        ERR_MSG("huge page mode: %s not supported, error.\n", spec);
+    }
+    return res;
+}
+
+int getHugePageMode(enum HugePageMode *mode)
+{
+    CHK_NIL(mode);
+    pthread_once(&g_once, initMemoryPolicy);
+
+    pthread_mutex_lock(&g_mtx);
+    *mode = g_huge;
+    pthread_mutex_unlock(&g_mtx);
+    return SUCCESS;
+}
+
+// 多节点时按策略设置mbind, 失败只影响物理页的位置, 不影响正确性
+static void bindBlob(void *ptr, size_t size)
+{
+    enum MemPolicy policy;
+    int node, n_nodes;
+    if (getMemoryPolicy(&policy, &node) != SUCCESS || policy == MEM_POLICY_DEFAULT) {
+        return;
+    }
+    if (getNumaNodeNumber(&n_nodes) != SUCCESS || n_nodes <= 1) {
+        return;
+    }
+    unsigned long mask = 0;
+    int mode;
+    if (policy == MEM_POLICY_INTERLEAVE) {
+        int i;
+        for (i = 0; i < n_nodes && i < MEM_MAX_NODES; ++i) {
+            mask |= 1UL << i;
+        }
+        mode = MPOL_INTERLEAVE;
+    }
+    else {
+        if (node >= n_nodes) {
+            return;
+        }
+        mask = 1UL << node;
+        mode = MPOL_BIND;
+    }
+    if (syscall(SYS_mbind, ptr, size, mode, &mask, (unsigned long)MEM_MAX_NODES + 1, 0) != 0) {
+        ERR_MSG("mbind failed, detail: %s, continue with default policy.\n", ERRNO_DETAIL(errno));
+    }
+}
+
+struct TouchArgs
+{
+    char *base;
+    size_t page;
+    size_t size;
+};
+
+static void touchPages(void *arg, int lo, int hi)
+{
+    struct TouchArgs *a = arg;
+    size_t begin = (size_t)lo * a->page;
+    size_t end = (size_t)hi * a->page;
+    if (end > a->size) {
+        end = a->size;
+    }
+    memset(a->base + begin, 0, end - begin);
+}
+
+// 多映射一个大页再裁掉首尾, 得到按MEM_HUGE_PAGE_SIZE对齐的len字节
+static void *mapAligned(size_t len)
+{
+    char *raw = mmap(NULL, len + MEM_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    size_t head = (MEM_HUGE_PAGE_SIZE - (size_t)((uintptr_t)raw % MEM_HUGE_PAGE_SIZE)) % MEM_HUGE_PAGE_SIZE;
+    if (head > 0) {
+        munmap(raw, head);
+    }
+    munmap(raw + head + len, MEM_HUGE_PAGE_SIZE - head);
+    return raw + head;
+}
+
+// 按大页模式映射len字节, 返回NULL表示失败; hugetlb池不足时退回THP
+static void *mapBlob(size_t *len, int *hugetlb, size_t size)
+{
+    enum HugePageMode mode = HUGE_PAGE_THP;
+    getHugePageMode(&mode);
+
+    void *ptr = NULL;
+    *hugetlb = 0;
+    if (mode == HUGE_PAGE_NONE) {
+        *len = size;
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (ptr == MAP_FAILED)? NULL: ptr;
+    }
+
+    *len = (size + MEM_HUGE_PAGE_SIZE - 1) / MEM_HUGE_PAGE_SIZE * MEM_HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+    if (mode == HUGE_PAGE_HUGETLB) {
+        ptr = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            *hugetlb = 1;
+            return ptr;
+        }
+    }
+#endif
+    ptr = mapAligned(*len);
+#ifdef MADV_HUGEPAGE
+    if (ptr != NULL) {
+        madvise(ptr, *len, MADV_HUGEPAGE); // 内核不支持THP时失败, 仍可使用普通页
+    }
+#endif
+    return ptr;
+}
+
+void *allocBlob(size_t size)
+{
+    if (size < MEM_LARGE_SIZE) {
+        return calloc(1, size);
+    }
+
+    struct BlobRegion *region = calloc(1, sizeof(struct BlobRegion));
+    if (region == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return NULL;
+    }
+    void *ptr = mapBlob(&(region->len), &(region->hugetlb), size);
+    if (ptr == NULL) {
+        ERR_MSG("mmap failed, detail: %s\n", ERRNO_DETAIL(errno));
+        free(region);
+        return NULL;
+    }
+    bindBlob(ptr, region->len);
+
+    // 使用大页时按大页划分首次写入, 一个大页只由一个线程缺页
+    struct TouchArgs args = {ptr, (size_t)sysconf(_SC_PAGESIZE), size};
+    if (region->len != size) {
+        args.page = MEM_HUGE_PAGE_SIZE;
+    }
+    int n_pages = (int)((size + args.page - 1) / args.page);
+    parallelFor(NULL, 0, n_pages, (long)args.page, touchPages, &args);
+
+    region->ptr = ptr;
+    pthread_mutex_lock(&g_region_mtx);
+    region->next = g_regions;
+    g_regions = region;
+    pthread_mutex_unlock(&g_region_mtx);
+    return ptr;
+}
+
+void freeBlob(void *ptr, size_t size)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    if (size < MEM_LARGE_SIZE) {
+        free(ptr);
+        return;
+    }
+
+    struct BlobRegion *region = NULL;
+    pthread_mutex_lock(&g_region_mtx);
+    struct BlobRegion **p = &g_regions;
+    while (*p != NULL && (*p)->ptr != ptr) {
+        p = &((*p)->next);
+    }
+    if (*p != NULL) {
+        region = *p;
+        *p = region->next;
+    }
+    pthread_mutex_unlock(&g_region_mtx);
+
+    if (region == NULL) {
+        ERR_MSG("blob %p not allocated by allocBlob, error.\n", ptr);
+        return;
+    }
+    munmap(ptr, region->len);
+    free(region);
+}
+
+// 映射[start, end)与登记的非hugetlb区域重叠的字节数, 调用者持有g_region_mtx
+static size_t getRegionOverlap(unsigned long start, unsigned long end)
+{
+    size_t overlap = 0;
+    const struct BlobRegion *r;
+    for (r = g_regions; r != NULL; r = r->next) {
+        unsigned long lo = (unsigned long)r->ptr;
+        unsigned long hi = lo + r->len;
+        if (r->hugetlb || hi <= start || lo >= end) {
+            continue;
+        }
+        overlap += ((hi < end)? hi: end) - ((lo > start)? lo: start);
+    }
+    return overlap;
+}
+
+int getHugePageBytes(size_t *huge_bytes, size_t *total_bytes)
+{
+    CHK_NIL(huge_bytes);
+    CHK_NIL(total_bytes);
+
+    size_t huge = 0;
+    size_t total = 0;
+    pthread_mutex_lock(&g_region_mtx);
+    const struct BlobRegion *r;
+    for (r = g_regions; r != NULL; r = r->next) {
+        total += r->len;
+        if (r->hugetlb) {
+            huge += r->len;
+        }
+    }
+
+    // 相邻区域可能被内核合并为一个映射, 按映射统计重叠部分, 大页字节数不超过重叠字节数
+    FILE *fp = fopen("/proc/self/smaps", "r");
+    if (fp != NULL) {
+        char line[512];
+        size_t overlap = 0;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            unsigned long start, end, kb;
+            if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+                overlap = getRegionOverlap(start, end);
+            }
+            else if (overlap > 0 && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+                huge += (kb * 1024 < overlap)? kb * 1024: overlap;
+            }
+        }
+        fclose(fp);
+    }
+    pthread_mutex_unlock(&g_region_mtx);
+
+    *huge_bytes = huge;
+    *total_bytes = total;
+    return SUCCESS;
+}
@@ -0,0 +1,48 @@
+/**
+ * @brief Tensor和数据集缓冲区的分配.
+ *        不小于MEM_LARGE_SIZE的分配使用匿名mmap, 按NUMA策略设置mbind后由默认线程池并行首次写入(清零),
+ *        物理页落在之后按同样的区间划分使用它的线程所在节点上; 小块分配仍使用calloc.
+ *        调用过setParallelForInline(1)的线程(如绑核的分片线程)分配的内存只由它自己首次写入.
+ *
+ *        NUMA策略: "default"(首次写入线程所在节点), "interleave"(所有节点轮流), "bind:<node>"(固定节点),
+ *        首次使用时从环境变量NN_MEMPOLICY读取; 单节点机器上或mbind不可用时策略不生效, 不报错.
+ *
+ *        大页: 大块分配的长度向上取整到MEM_HUGE_PAGE_SIZE并按其对齐(尾部最多多占不到一个大页).
+ *        "thp"(默认)对区域设置madvise(MADV_HUGEPAGE), 由内核透明大页决定是否使用;
+ *        "hugetlb"使用MAP_HUGETLB从预留的大页池分配, 池不足时自动退回"thp"; "none"使用普通页.
+ *        首次使用时从环境变量NN_HUGEPAGE读取. getHugePageBytes返回当前大块分配中实际使用大页的字节数.
+ */
+#pragma once
+
+#include <stddef.h>
+
+#define MEM_LARGE_SIZE (1 << 20)
+#define MEM_HUGE_PAGE_SIZE (2 << 20)
+
+enum MemPolicy
+{
+    MEM_POLICY_DEFAULT,
+    MEM_POLICY_INTERLEAVE,
+    MEM_POLICY_BIND
+};
+
+enum HugePageMode
+{
+    HUGE_PAGE_NONE,
+    HUGE_PAGE_THP,
+    HUGE_PAGE_HUGETLB
+};
+
+int setMemoryPolicy(const char *spec);
+int getMemoryPolicy(enum MemPolicy *policy, int *node);
+int setHugePageMode(const char *spec);
+int getHugePageMode(enum HugePageMode *mode);
+
+/**
+ * @brief 统计allocBlob大块分配的字节数, 以及其中实际由大页支撑的字节数(THP按/proc/self/smaps的AnonHugePages统计)
+ */
+int getHugePageBytes(size_t *huge_bytes, size_t *total_bytes);
+
+// 分配size字节并清零, 失败返回NULL; 释放时必须传入相同的size
+void *allocBlob(size_t size);
+void freeBlob(void *ptr, size_t size);
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+
+#include "debug_macros.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "sigmoid_layer.h"
+#include "relu_layer.h"
+#include "softmax_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "rng.h"
+#include "model.h"
+#include "const.h"
+
+struct Model
+{
+    int n_layers;
+    struct Layer *layers[NN_MODEL_MAX_LAYERS]; // Model负责释放
+    struct Cost *cost; // Model负责释放
+};
+
+// 权重文件路径相对于spec文件所在目录
+static int joinModelPath(char *dst, const char *spec_dir, const char *name)
+{
+    int len = 0;
+    if (name[0] == '/') {
+        len = snprintf(dst, NN_PATH_LEN, "%s", name);
+    }
+    else {
+        len = snprintf(dst, NN_PATH_LEN, "%s/%s", spec_dir, name);
+    }
+    if (len >= NN_PATH_LEN) {
+        ERR_MSG("path too long: %s/%s, error.\n", spec_dir, name);
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+static int parseModelLine(struct Model *model, char *line, const char *spec_dir, int line_no)
+{
+    char kind[32] = {0};
+    char name[NN_LAYER_NAME_LEN] = {0};
+    char w_name[NN_PATH_LEN] = {0};
+    char b_name[NN_PATH_LEN] = {0};
+    char pth[NN_PATH_LEN];
+    int n_in = 0;
+    int n_out = 0;
+
+    char *pos = strchr(line, '#');
+    if (pos) {
+        *pos = '\0';
+    }
+    int n_tokens = sscanf(line, "%31s %31s", kind, name);
+    if (n_tokens <= 0) { // 空行
+        return SUCCESS;
+    }
+    if (model->cost) {
+        ERR_MSG("line %d: cost must be the last entry of model spec, error.\n", line_no);
+        return ERR_COD;
+    }
+    if (model->n_layers == NN_MODEL_MAX_LAYERS) {
+        ERR_MSG("line %d: too many layers, max = %d, error.\n", line_no, NN_MODEL_MAX_LAYERS);
+        return ERR_COD;
+    }
+
+    if (strcasecmp(kind, "seed") == 0) {
+        unsigned int seed = 0;
+        if (sscanf(line, "%*s %u", &seed) != 1) {
+            ERR_MSG("line %d: usage: seed <n>, error.\n", line_no);
+            return ERR_COD;
+        }
+        CHK_ERR(setRandomSeed(seed));
+    }
+    else if (strcasecmp(kind, "linear") == 0) {
+        n_tokens = sscanf(line, "%*s %*s %d %d %511s %511s", &n_in, &n_out, w_name, b_name);
+        if (n_tokens != 2 && n_tokens != 4) {
+            ERR_MSG("line %d: usage: linear <name> <n_in> <n_out> [W.txt b.txt], error.\n", line_no);
+            return ERR_COD;
+        }
+        struct LinearLayer *layer = NULL;
+        CHK_ERR(createLinearLayer(&layer, name, n_in, n_out));
+        model->layers[model->n_layers++] = (struct Layer *)layer;
+        if (n_tokens == 4) {
+            CHK_ERR(joinModelPath(pth, spec_dir, w_name));
+            CHK_ERR(loadtxtLinearLayerWeight(layer, pth));
+            CHK_ERR(joinModelPath(pth, spec_dir, b_name));
+            CHK_ERR(loadtxtLinearLayerBias(layer, pth));
+        }
+    }
+    else if (strcasecmp(kind, "sigmoid") == 0) {
+        struct SigmoidLayer *layer = NULL;
+        CHK_ERR(createSigmoidLayer(&layer, name));
+        model->layers[model->n_layers++] = (struct Layer *)layer;
+    }
+    else if (strcasecmp(kind, "relu") == 0) {
+        struct ReluLayer *layer = NULL;
+        CHK_ERR(createReluLayer(&layer, name));
+        model->layers[model->n_layers++] = (struct Layer *)layer;
+    }
+    else if (strcasecmp(kind, "softmax") == 0) {
+        struct SoftmaxLayer *layer = NULL;
+        CHK_ERR(createSoftmaxLayer(&layer, name));
+        model->layers[model->n_layers++] = (struct Layer *)layer;
+    }
+    else if (strcasecmp(kind, "ce") == 0) {
+        int n_classes = 0;
+        if (sscanf(line, "%*s %*s %d", &n_classes) != 1) {
+            ERR_MSG("line %d: usage: ce <name> <n_classes>, error.\n", line_no);
+            return ERR_COD;
+        }
+        struct CECost *cost = NULL;
+        CHK_ERR(createCECost(&cost, name, n_classes));
+        model->cost = (struct Cost *)cost;
+    }
+    else {
+        ERR_MSG("line %d: unknow model entry: %s, error.\n", line_no, kind);
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int loadModel(struct Model **model, const char *spec_pth)
+{
+    CHK_NIL(model);
+    CHK_NIL(spec_pth);
+
+    char spec_dir[NN_PATH_LEN];
+    snprintf(spec_dir, NN_PATH_LEN, "%s", spec_pth);
+    dirname(spec_dir);
+
+    FILE *fp = fopen(spec_pth, "r");
+    if (fp == NULL) {
+        ERR_MSG("fopen() failed, pth: %s, detail: %s, error.\n", spec_pth, ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+
+    struct Model *res = calloc(1, sizeof(struct Model));
+    CHK_NIL_GOTO(res);
+
+    char line[1024];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        ++line_no;
+        CHK_ERR_GOTO(parseModelLine(res, line, spec_dir, line_no));
+    }
+    if (res->n_layers == 0 || res->cost == NULL) {
+        ERR_MSG("model spec: %s needs at least one layer and a cost, error.\n", spec_pth);
+        goto err_end;
+    }
+
+    // 根据前一层神经元个数设置激活层神经元个数, 并检查相邻层是否匹配, 与createNetwork一致
+    int i;
+    for (i = 1; i < res->n_layers; ++i) {
+        int n_out = 0;
+        CHK_ERR_GOTO(getLayerOutputNumber(&n_out, res->layers[i - 1]));
+        CHK_ERR_GOTO(setLayerNeuronNumber(res->layers[i], n_out));
+    }
+    int n_out = 0;
+    int n_classes = 0;
+    CHK_ERR_GOTO(getLayerOutputNumber(&n_out, res->layers[res->n_layers - 1]));
+    CHK_ERR_GOTO(getCostInputNumber(&n_classes, res->cost));
+    if (n_out != n_classes) {
+        ERR_MSG("last layer n_out = %d, cost n_input = %d, size not match, error.\n", n_out, n_classes);
+        goto err_end;
+    }
+
+    fclose(fp);
+    *model = res;
+    return SUCCESS;
+
+err_end:
+    fclose(fp);
+    destroyModel(res);
+    return ERR_COD;
+}
+
+void destroyModel(struct Model *model)
+{
+    if (model) {
+        int i;
+        for (i = 0; i < model->n_layers; ++i) {
+            destroyLayer(model->layers[i]);
+        }
+        destroyCost(model->cost);
+    }
+    free(model);
+}
+
+int getModelLayers(struct Layer **(*layers), int *n_layers, const struct Model *model)
+{
+    CHK_NIL(layers);
+    CHK_NIL(n_layers);
+    CHK_NIL(model);
+
+    *layers = (struct Layer **)(model->layers);
+    *n_layers = model->n_layers;
+    return SUCCESS;
+}
+
+int getModelCost(struct Cost **cost, const struct Model *model)
+{
+    CHK_NIL(cost);
+    CHK_NIL(model);
+
+    *cost = model->cost;
+    return SUCCESS;
+}
+
+int getModelShape(int *n_in, int *n_out, const struct Model *model)
+{
+    CHK_NIL(n_in);
+    CHK_NIL(n_out);
+    CHK_NIL(model);
+
+    CHK_ERR(getLayerInputNumber(n_in, model->layers[0]));
+    CHK_ERR(getLayerOutputNumber(n_out, model->layers[model->n_layers - 1]));
+    return SUCCESS;
+}
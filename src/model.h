@@ -0,0 +1,26 @@
+/**
+ * @brief 模型描述文件(model spec)读取, 用于在训练程序之外(例如推理服务)重建网络
+ *
+ *        文件为纯文本, 每行描述一层, '#'开头为注释, 层按出现顺序连接:
+ *            seed    1234                           # 可选, 随机初始化权重前调用setRandomSeed(seed)
+ *            linear  LIN_L0 784 625 [W.txt b.txt]   # 权重文件为numpy.savetxt格式, 路径相对于spec文件所在目录
+ *            sigmoid SIG_L0
+ *            relu    RELU_L0
+ *            softmax SM_L0
+ *            ce      CE_L1 10                       # 代价层, 必须位于最后一行
+ */
+#pragma once
+
+#include "layer.h"
+#include "cost.h"
+
+#define NN_MODEL_MAX_LAYERS (64)
+
+struct Model;
+
+int loadModel(struct Model **model, const char *spec_pth);
+void destroyModel(struct Model *model);
+
+int getModelLayers(struct Layer **(*layers), int *n_layers, const struct Model *model);
+int getModelCost(struct Cost **cost, const struct Model *model);
+int getModelShape(int *n_in, int *n_out, const struct Model *model);
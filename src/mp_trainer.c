@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug_macros.h"
+#include "tensor.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "network.h"
+#include "shm_allreduce.h"
+#include "mp_trainer.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+struct MultiProcessTrainer
+{
+    int rank;
+    int world_size;
+    struct ShmAllreduce *ar;
+    struct Network *net;
+
+    // 梯度按线性层顺序展开为若干段: w_grad, b_grad, w_grad, b_grad...
+    int n_segs;
+    int *seg_len;
+    int *seg_is_bias;
+    float **segs;
+    float *residual; // w_grad中保存的动量项, 只有本rank的新梯度参与all-reduce
+    long n_params;
+};
+
+static int initGradientSegments(struct MultiProcessTrainer *trainer, struct Layer **layers, int n_layers)
+{
+    int i;
+    int n_segs = 0;
+    for (i = 0; i < n_layers; ++i) {
+        if (layers[i]->type == LINEAR_LAYER_TYPE) {
+            n_segs += 2;
+        }
+    }
+    trainer->n_segs = n_segs;
+    CHK_NIL((trainer->seg_len = calloc(n_segs + 1, sizeof(int))));
+    CHK_NIL((trainer->seg_is_bias = calloc(n_segs + 1, sizeof(int))));
+    CHK_NIL((trainer->segs = calloc(n_segs + 1, sizeof(float *))));
+
+    int s = 0;
+    for (i = 0; i < n_layers; ++i) {
+        if (layers[i]->type != LINEAR_LAYER_TYPE) {
+            continue;
+        }
+        struct Tensor *w_grad = NULL;
+        struct Tensor *b_grad = NULL;
+        void *blob = NULL;
+        int row, col;
+        CHK_ERR(getLinearLayerGradientRef(&w_grad, &b_grad, (struct LinearLayer *)layers[i]));
+        CHK_ERR(getTensorRowAndCol(&row, &col, w_grad));
+        trainer->seg_len[s] = row * col;
+        trainer->seg_len[s + 1] = row;
+        trainer->seg_is_bias[s + 1] = 1;
+        CHK_ERR(getTensorBlob(&blob, w_grad));
+        trainer->segs[s] = blob;
+        CHK_ERR(getTensorBlob(&blob, b_grad));
+        trainer->segs[s + 1] = blob;
+        trainer->n_params += trainer->seg_len[s] + trainer->seg_len[s + 1];
+        s += 2;
+    }
+    CHK_NIL((trainer->residual = calloc(trainer->n_params + 1, sizeof(float))));
+    return SUCCESS;
+}
+
+int createMultiProcessTrainer(struct MultiProcessTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost,
+    const char *shm_name, int rank, int world_size)
+{
+    CHK_NIL(trainer);
+    CHK_NIL(layers);
+    CHK_NIL(cost);
+    CHK_NIL(shm_name);
+
+    struct MultiProcessTrainer *res = calloc(1, sizeof(struct MultiProcessTrainer));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    res->rank = rank;
+    res->world_size = world_size;
+    CHK_ERR_GOTO(createNetwork(&(res->net), layers, n_layers, cost));
+    CHK_ERR_GOTO(initGradientSegments(res, layers, n_layers));
+    // 多出的一个元素用于汇总代价值
+    CHK_ERR_GOTO(createShmAllreduce(&(res->ar), shm_name, rank, world_size, res->n_params + 1));
+
+    *trainer = res;
+    return SUCCESS;
+
+err_end:
+    destroyMultiProcessTrainer(res);
+    return ERR_COD;
+}
+
+int createMultiProcessTrainerFromEnv(struct MultiProcessTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost)
+{
+    const char *name = getenv("NN_SHM_NAME");
+    const char *rank = getenv("NN_RANK");
+    const char *world_size = getenv("NN_WORLD_SIZE");
+    if (name == NULL || rank == NULL || world_size == NULL) {
+        ERR_MSG("NN_SHM_NAME, NN_RANK or NN_WORLD_SIZE not set, run with nn_launch, error.\n");
+        return ERR_COD;
+    }
+    CHK_ERR(createMultiProcessTrainer(trainer, layers, n_layers, cost, name, atoi(rank), atoi(world_size)));
+    return SUCCESS;
+}
+
+void destroyMultiProcessTrainer(struct MultiProcessTrainer *trainer)
+{
+    if (trainer) {
+        destroyShmAllreduce(trainer->ar);
+        destroyNetwork(trainer->net);
+        free(trainer->seg_len);
+        free(trainer->seg_is_bias);
+        free(trainer->segs);
+        free(trainer->residual);
+    }
+    free(trainer);
+}
+
+int getMultiProcessTrainerRank(int *rank, int *world_size, const struct MultiProcessTrainer *trainer)
+{
+    CHK_NIL(rank);
+    CHK_NIL(world_size);
+    CHK_NIL(trainer);
+
+    *rank = trainer->rank;
+    *world_size = trainer->world_size;
+    return SUCCESS;
+}
+
+int trainMultiProcessBatch(struct MultiProcessTrainer *trainer,
+    const void *input_data, int n_features, const char *dtype_str,
+    const void *gt_data, int n_gt_features, const char *gt_dtype_str,
+    int n_samples, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(trainer);
+    CHK_NIL(input_data);
+    CHK_NIL(gt_data);
+    CHK_NIL(dtype_str);
+    CHK_NIL(gt_dtype_str);
+    CHK_NIL(probe);
+    CHK_ERR(checkUpdateArgs(args));
+    CHK_ERR((n_samples > 0 && n_samples <= args->batch_size)? 0: 1);
+
+    int in_size, gt_size;
+    CHK_ERR(getTensorDtypeSize(&in_size, getTensorDtypeEnumFromStr(dtype_str)));
+    CHK_ERR(getTensorDtypeSize(&gt_size, getTensorDtypeEnumFromStr(gt_dtype_str)));
+
+    // 与数据并行训练相同的切分方式, 前rem个rank多分一个样本
+    int world_size = trainer->world_size;
+    int rank = trainer->rank;
+    int base = n_samples / world_size;
+    int rem = n_samples % world_size;
+    int count = base + ((rank < rem)? 1: 0);
+    int start = base * rank + ((rank < rem)? rank: rem);
+    struct UpdateArgs args_rank = *args;
+    args_rank.batch_size = (args->batch_size + world_size - 1) / world_size;
+
+    // 取出动量项, w_grad清零后只累加本次的梯度
+    float *residual = trainer->residual;
+    int s;
+    for (s = 0; s < trainer->n_segs; ++s) {
+        if (!trainer->seg_is_bias[s]) {
+            memcpy(residual, trainer->segs[s], trainer->seg_len[s] * sizeof(float));
+            memset(trainer->segs[s], 0, trainer->seg_len[s] * sizeof(float));
+        }
+        residual += trainer->seg_len[s];
+    }
+
+    float *buf = NULL;
+    CHK_ERR(getShmAllreduceSendBuffer(&buf, trainer->ar));
+    long k = 0;
+    if (count > 0) {
+        CHK_ERR(forwardNetwork(trainer->net, (const char *)input_data + (size_t)start * n_features * in_size,
+            count, n_features, dtype_str, &args_rank, probe));
+        CHK_ERR(backwardNetwork(trainer->net, (const char *)gt_data + (size_t)start * n_gt_features * gt_size,
+            count, n_gt_features, gt_dtype_str, &args_rank, probe));
+
+        // 代价函数按本rank样本数平均, 这里换算为按整个batch平均
+        float scale = (float)count / n_samples;
+        for (s = 0; s < trainer->n_segs; ++s) {
+            const float *g = trainer->segs[s];
+            int i;
+            for (i = 0; i < trainer->seg_len[s]; ++i) {
+                buf[k++] = g[i] * scale;
+            }
+        }
+        buf[k] = probe->ce_cost * scale;
+    }
+    else {
+        memset(buf, 0, (trainer->n_params + 1) * sizeof(float));
+    }
+
+    CHK_ERR(runShmAllreduce(buf, trainer->n_params + 1, trainer->ar));
+
+    // w_grad = 动量项 + 梯度和, b_grad = 梯度和, 与单进程训练的语义一致
+    k = 0;
+    residual = trainer->residual;
+    for (s = 0; s < trainer->n_segs; ++s) {
+        float *g = trainer->segs[s];
+        int i;
+        if (trainer->seg_is_bias[s]) {
+            memcpy(g, buf + k, trainer->seg_len[s] * sizeof(float));
+        }
+        else {
+            for (i = 0; i < trainer->seg_len[s]; ++i) {
+                g[i] = residual[i] + buf[k + i];
+            }
+        }
+        k += trainer->seg_len[s];
+        residual += trainer->seg_len[s];
+    }
+    if (probe->sw_ce_cost) {
+        probe->ce_cost = buf[k];
+    }
+
+    CHK_ERR(updateNetwork(trainer->net, args, probe));
+    return SUCCESS;
+}
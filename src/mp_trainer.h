@@ -0,0 +1,29 @@
+/**
+ * @brief 多进程同步数据并行训练: 每个进程持有完整的网络, batch按样本切分给各rank,
+ *        梯度经共享内存all-reduce(见shm_allreduce.h)求和后各rank执行相同的参数更新, 各进程参数始终一致.
+ *        进程由tools/nn_launch启动, 通过环境变量NN_SHM_NAME, NN_RANK, NN_WORLD_SIZE获取通信参数.
+ */
+#pragma once
+
+#include "layer.h"
+#include "cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+struct MultiProcessTrainer;
+
+int createMultiProcessTrainer(struct MultiProcessTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost,
+    const char *shm_name, int rank, int world_size);
+int createMultiProcessTrainerFromEnv(struct MultiProcessTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost);
+void destroyMultiProcessTrainer(struct MultiProcessTrainer *trainer);
+
+int getMultiProcessTrainerRank(int *rank, int *world_size, const struct MultiProcessTrainer *trainer);
+
+/**
+ * @brief 所有rank传入相同的完整batch, 每个rank只计算属于自己的样本.
+ *        probe->ce_cost为整个batch的代价, probe->p_class只包含本rank的样本.
+ */
+int trainMultiProcessBatch(struct MultiProcessTrainer *trainer,
+    const void *input_data, int n_features, const char *dtype_str,
+    const void *gt_data, int n_gt_features, const char *gt_dtype_str,
+    int n_samples, const struct UpdateArgs *args, struct Probe *probe);
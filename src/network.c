@@ -4,6 +4,7 @@
 #include<sys/time.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "debug_macros.h"
 #include "layer.h"
@@ -13,6 +14,24 @@
 #include "opt_alg.h"
 #include "probe.h"
 
+/**
+ * @brief backwardUpdateNetwork的参数更新线程: 主线程每完成一层反向传播就把n_ready加1,
+ *        更新线程从最后一层开始依次更新已完成反向传播的层
+ */
+struct UpdateWorker
+{
+    pthread_t tid;
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    int started;
+    int quit;
+    int n_ready; // 已完成反向传播的层数, 从最后一层算起
+    int n_done; // 已完成参数更新的层数
+    int err;
+    const struct UpdateArgs *args;
+    struct Probe *probe;
+};
+
 struct Network {
     int n_layers;
     struct Layer **layers; // Network不负责释放这部分内存
@@ -21,6 +40,7 @@ struct Network {
     struct Tensor **deltas;
     struct Tensor *input; // 输入数据缓存
     struct Tensor *gt; // 样本真值缓存
+    struct UpdateWorker worker;
 };
 
 int createNetwork(struct Network **network, struct Layer **layers, int n_layers, struct Cost *cost)
@@ -181,7 +201,9 @@ static int reallocNetworkCache(struct Network *net, const struct UpdateArgs *arg
     }
 
     if (need_realloc) {
+#ifdef _DEBUG
         fprintf(stdout, "Network need to be reallocate for some reason...\n");
+#endif
         freeNetworkCache(net);
         CHK_ERR(allocNetworkCache(net, args));
     }
@@ -189,9 +211,24 @@ static int reallocNetworkCache(struct Network *net, const struct UpdateArgs *arg
     return SUCCESS;
 }
 
+static void stopUpdateWorker(struct UpdateWorker *w)
+{
+    if (w->started) {
+        pthread_mutex_lock(&(w->mtx));
+        w->quit = 1;
+        pthread_cond_broadcast(&(w->cond));
+        pthread_mutex_unlock(&(w->mtx));
+        pthread_join(w->tid, NULL);
+        pthread_cond_destroy(&(w->cond));
+        pthread_mutex_destroy(&(w->mtx));
+        w->started = 0;
+    }
+}
+
 void destroyNetwork(struct Network *net)
 {
     if (net) {
+        stopUpdateWorker(&(net->worker));
         int i;
         if (net->outputs) {
             for (i = 0; i < net->n_layers; ++i) {
@@ -236,6 +273,19 @@ static int checkNetworkInput(struct Network *net, const struct Tensor *input)
 }
 */
 
+int getNetworkLayers(struct Layer **(*layers), int *n_layers, struct Cost *(*cost), const struct Network *net)
+{
+    CHK_NIL(layers);
+    CHK_NIL(n_layers);
+    CHK_NIL(cost);
+    CHK_NIL(net);
+
+    *layers = net->layers;
+    *n_layers = net->n_layers;
+    *cost = net->cost;
+    return SUCCESS;
+}
+
 int getNetworkClassProbabilityConstRef(const float *(*p), const struct Network *net)
 {
     CHK_NIL(p);
@@ -244,6 +294,31 @@ int getNetworkClassProbabilityConstRef(const float *(*p), const struct Network *
     return SUCCESS;
 }
  
+// 输入已绑定到net->input后, 依次执行各层和代价层的正向传播
+static int forwardNetworkLayers(struct Network *net, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_ERR(setLayerInput(net->layers[0], net->input));
+    int i = 0;
+    for (i = 0; i < net->n_layers; ++i) {
+#ifdef _DEBUG
+        fprintf(stdout, "forward layer %d...\n", i);
+#endif
+        CHK_ERR(forwardLayer(net->layers[i], args, probe));
+    }
+    CHK_ERR(forwardCost(net->cost, args, probe));
+    return SUCCESS;
+}
+
+// 输入张量引用用户数据, 只释放张量本身; 稠密与CSR输入切换时重新创建
+static void releaseNetworkInput(struct Network *net, enum TensorLayout layout_needed)
+{
+    enum TensorLayout layout;
+    if (net->input && getTensorLayout(&layout, net->input) == SUCCESS && layout != layout_needed) {
+        free(net->input);
+        net->input = NULL;
+    }
+}
+
 int forwardNetwork(struct Network *net, const void *input_data, int n_samples, int n_features, const char *dtype_str, const struct UpdateArgs *args, struct Probe *probe)
 {
     CHK_NIL(net);
@@ -263,6 +338,7 @@ int forwardNetwork(struct Network *net, const void *input_data, int n_samples, i
 
     // 输入数据绑定Tensor对象
     enum DType dtype = getTensorDtypeEnumFromStr(dtype_str);
+    releaseNetworkInput(net, DENSE_TENSOR_LAYOUT);
     if (net->input) {
         void *blob_old = NULL; // 约定了输入的数据由用户负责保管句柄，因此不需要把旧训练数据的句柄返还给用户
         CHK_ERR(setTensorSamplesByReplace(&blob_old, net->input, (void *)input_data, n_samples, n_features, dtype));
@@ -274,15 +350,34 @@ int forwardNetwork(struct Network *net, const void *input_data, int n_samples, i
         CHK_ERR(createTensorDataWithBlobRef(&(net->input), (void *)input_data, dtype, args->batch_size, n_features, n_samples));
     }
 
-    CHK_ERR(setLayerInput(net->layers[0], net->input));
-    int i = 0;
-    for (i = 0; i < net->n_layers; ++i) {
-        fprintf(stdout, "forward layer %d...\n", i);
-        CHK_ERR(forwardLayer(net->layers[i], args, probe));
+    CHK_ERR(forwardNetworkLayers(net, args, probe));
+    return 0;
+}
+
+int forwardNetworkCsr(struct Network *net, const int *row_ptr, const int *col_idx, const float *val, int n_samples, int n_features,
+    const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(net);
+    CHK_NIL(row_ptr);
+    CHK_ERR((n_samples > 0)? 0: 1);
+    CHK_ERR((n_features > 0)? 0: 1);
+    CHK_ERR(checkUpdateArgs(args));
+    CHK_NIL(net->layers);
+    CHK_ERR((n_samples <= args->batch_size)? 0: 1);
+
+    CHK_ERR(reallocNetworkCache(net, args));
+
+    // 与forwardNetwork相同, CSR数组由用户负责保管
+    releaseNetworkInput(net, CSR_TENSOR_LAYOUT);
+    if (net->input) {
+        CHK_ERR(setTensorCsrSamplesByReplace(net->input, row_ptr, col_idx, val, n_samples, n_features));
+    }
+    else {
+        CHK_ERR(createTensorDataCsrWithRef(&(net->input), row_ptr, col_idx, val, args->batch_size, n_features, n_samples));
     }
-    CHK_ERR(forwardCost(net->cost, args, probe));
 
-    return 0;
+    CHK_ERR(forwardNetworkLayers(net, args, probe));
+    return SUCCESS;
 }
 
 int backwardNetwork(struct Network *net, const void *gt_data, int n_samples, int n_features, const char *dtype_str, const struct UpdateArgs *args, struct Probe *probe)
@@ -314,12 +409,145 @@ int backwardNetwork(struct Network *net, const void *gt_data, int n_samples, int
     CHK_ERR(backwardCost(net->cost, net->gt, args, probe));
     int i = 0;
     for (i = net->n_layers - 1; i >=0; --i) {
+#ifdef _DEBUG
         fprintf(stdout, "backward layer %d...\n", i);
+#endif
         CHK_ERR(backwardLayer(net->layers[i], args, probe));
     }
     return 0;
 }
 
+static void *runUpdateWorker(void *arg)
+{
+    struct Network *net = arg;
+    struct UpdateWorker *w = &(net->worker);
+
+    pthread_mutex_lock(&(w->mtx));
+    while (1) {
+        while (!w->quit && w->n_done >= w->n_ready) {
+            pthread_cond_wait(&(w->cond), &(w->mtx));
+        }
+        if (w->quit) {
+            break;
+        }
+        int i = net->n_layers - 1 - w->n_done;
+        const struct UpdateArgs *args = w->args;
+        struct Probe *probe = w->probe;
+        pthread_mutex_unlock(&(w->mtx));
+
+        int res = updateLayer(net->layers[i], args, probe);
+
+        pthread_mutex_lock(&(w->mtx));
+        if (res != SUCCESS) {
+            w->err = 1;
+        }
+        ++(w->n_done);
+        pthread_cond_broadcast(&(w->cond));
+    }
+    pthread_mutex_unlock(&(w->mtx));
+    return NULL;
+}
+
+static int startUpdateWorker(struct Network *net)
+{
+    struct UpdateWorker *w = &(net->worker);
+    if (w->started) {
+        return SUCCESS;
+    }
+    CHK_ERR(pthread_mutex_init(&(w->mtx), NULL));
+    CHK_ERR_GOTO(pthread_cond_init(&(w->cond), NULL));
+    w->quit = 0;
+    w->n_ready = 0;
+    w->n_done = 0;
+    if (pthread_create(&(w->tid), NULL, runUpdateWorker, net) != 0) {
+        ERR_MSG("pthread_create failed, error.\n");
+        pthread_cond_destroy(&(w->cond));
+        goto err_end;
+    }
+    w->started = 1;
+    return SUCCESS;
+
+err_end:
+    pthread_mutex_destroy(&(w->mtx));
+    return ERR_COD;
+}
+
+// 通知更新线程又有一层完成了反向传播
+static void postUpdateWorker(struct UpdateWorker *w)
+{
+    pthread_mutex_lock(&(w->mtx));
+    ++(w->n_ready);
+    pthread_cond_broadcast(&(w->cond));
+    pthread_mutex_unlock(&(w->mtx));
+}
+
+// 等待已提交的层全部更新完, 返回更新过程中是否出错
+static int waitUpdateWorker(struct UpdateWorker *w)
+{
+    pthread_mutex_lock(&(w->mtx));
+    while (w->n_done < w->n_ready) {
+        pthread_cond_wait(&(w->cond), &(w->mtx));
+    }
+    int err = w->err;
+    pthread_mutex_unlock(&(w->mtx));
+    return err;
+}
+
+/**
+ * @brief 反向传播与参数更新重叠, 结果与backwardNetwork + updateNetwork相同.
+ *        第i层的backwardLayer返回后其梯度已经确定, 且更低层的反向传播不再读取它的参数,
+ *        因此交给更新线程立即更新, 主线程继续计算第i-1层; 返回前等待所有层更新完毕.
+ *        probe的dump_w/dump_b在更新线程上执行.
+ */
+int backwardUpdateNetwork(struct Network *net, const void *gt_data, int n_samples, int n_features, const char *dtype_str, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(net);
+    CHK_NIL(gt_data);
+    CHK_ERR((n_samples > 0)? 0: 1);
+    CHK_ERR((n_features > 0)? 0: 1);
+    CHK_ERR(checkUpdateArgs(args));
+    CHK_NIL(net->layers);
+    CHK_NIL(probe);
+    CHK_ERR((n_samples <= args->batch_size)? 0: 1);
+
+    // gt绑定Tensor对象
+    enum DType dtype = getTensorDtypeEnumFromStr(dtype_str);
+    if (net->gt) {
+        void *blob_old = NULL;
+        CHK_ERR(setTensorSamplesByReplace(&blob_old, net->gt, (void *)gt_data, n_samples, n_features, dtype));
+    }
+    else {
+        int n_gt;
+        enum DType dtype_needed;
+        CHK_ERR(getCostGroundTruthAttributes(&n_gt, &dtype_needed,net->cost));
+        CHK_ERR((dtype == dtype_needed)? 0: 1);
+        CHK_ERR(createTensorDataWithBlobRef(&(net->gt), (void *)gt_data, dtype, args->batch_size, n_features, n_samples));
+    }
+    CHK_ERR(startUpdateWorker(net));
+
+    struct UpdateWorker *w = &(net->worker);
+    pthread_mutex_lock(&(w->mtx));
+    w->n_ready = 0;
+    w->n_done = 0;
+    w->err = 0;
+    w->args = args;
+    w->probe = probe;
+    pthread_mutex_unlock(&(w->mtx));
+
+    CHK_ERR(backwardCost(net->cost, net->gt, args, probe));
+    int i;
+    for (i = net->n_layers - 1; i >= 0; --i) {
+        CHK_ERR_GOTO(backwardLayer(net->layers[i], args, probe));
+        postUpdateWorker(w);
+    }
+    CHK_ERR(waitUpdateWorker(w));
+    return SUCCESS;
+
+err_end:
+    waitUpdateWorker(w); // 更新线程仍在使用args和probe
+    return ERR_COD;
+}
+
 int updateNetwork(struct Network *net, const struct UpdateArgs *args, struct Probe *probe)
 {
     CHK_NIL(net);
@@ -10,7 +10,15 @@ struct Network;
 
 int createNetwork(struct Network **network, struct Layer **layers, int n_layers, struct Cost *cost);
 void destroyNetwork(struct Network *net);
+int getNetworkLayers(struct Layer **(*layers), int *n_layers, struct Cost *(*cost), const struct Network *net);
 int getNetworkClassProbabilityConstRef(const float *(*p), const struct Network *net);
 int forwardNetwork(struct Network *net, const void *input_data, int n_samples, int n_features, const char *dtype_str, const struct UpdateArgs *args, struct Probe *probe);
+/**
+ * @brief 输入为CSR格式的稀疏样本(FLOAT32), 第一层必须是LinearLayer, 其计算量只与非零元个数有关.
+ *        第i个样本的非零元为val[row_ptr[i]..row_ptr[i + 1]), 特征下标为col_idx中的对应位置, row_ptr[0]不必为0.
+ */
+int forwardNetworkCsr(struct Network *net, const int *row_ptr, const int *col_idx, const float *val, int n_samples, int n_features,
+    const struct UpdateArgs *args, struct Probe *probe);
 int backwardNetwork(struct Network *net, const void *gt_data, int n_samples, int n_features, const char *dtype_str, const struct UpdateArgs *args, struct Probe *probe);
+int backwardUpdateNetwork(struct Network *net, const void *gt_data, int n_samples, int n_features, const char *dtype_str, const struct UpdateArgs *args, struct Probe *probe);
 int updateNetwork(struct Network *net, const struct UpdateArgs *args, struct Probe *probe);
\ No newline at end of file
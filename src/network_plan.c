@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "debug_macros.h"
+#include "tensor.h"
+#include "activations.h"
+#include "gemm.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "network.h"
+#include "network_plan.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+// 融合的线性层+激活按行分块, 每块的输出在激活时仍在缓存中
+#define PLAN_ROW_BLOCK (32)
+// 取不到L2大小时使用的默认值
+#define PLAN_DEFAULT_L2_SIZE (256 * 1024)
+
+struct PlanStep;
+typedef void (*PlanKernel)(const struct PlanStep *step, int n);
+
+struct PlanStep
+{
+    PlanKernel forward;
+    PlanKernel backward; // NULL表示不支持训练
+    const float *x;
+    float *y;
+    float *dx; // 灵敏度输出, 第一步为NULL
+    float *dy; // 灵敏度输入
+    float *w; // 以下只用于线性层, 指向层自己的缓冲区
+    float *b;
+    float *w_grad;
+    float *b_grad;
+    int n_in;
+    int n_out;
+};
+
+struct NetworkPlan
+{
+    int batch_size;
+    int tile_size; // 每次从头到尾穿过所有层的样本数, 等于batch_size时不分块
+    int n_features;
+    int n_classes;
+    int n_steps;
+    int n_alloc; // steps数组的长度, 即层数
+    struct PlanStep *steps;
+    int trainable;
+    float *p; // 代价函数的分类概率
+};
+
+// ---------------- 正向传播 ----------------
+
+static void fillBias(float *y, const float *b, int n, int n_out)
+{
+    int i;
+    for (i = 0; i < n; ++i) {
+        memcpy(y + (size_t)i * n_out, b, n_out * sizeof(float));
+    }
+}
+
+static void forwardLinear(const struct PlanStep *step, int n)
+{
+    fillBias(step->y, step->b, n, step->n_out);
+    gemm(0, 1, n, step->n_out, step->n_in, 1.,
+        (float *)step->x, step->n_in,
+        step->w, step->n_in,
+        1.,
+        step->y, step->n_out);
+}
+
+static void forwardLinearSigmoid(const struct PlanStep *step, int n)
+{
+    int r, i;
+    for (r = 0; r < n; r += PLAN_ROW_BLOCK) {
+        int rows = (n - r < PLAN_ROW_BLOCK)? n - r: PLAN_ROW_BLOCK;
+        float *y = step->y + (size_t)r * step->n_out;
+        fillBias(y, step->b, rows, step->n_out);
+        gemm(0, 1, rows, step->n_out, step->n_in, 1.,
+            (float *)step->x + (size_t)r * step->n_in, step->n_in,
+            step->w, step->n_in,
+            1.,
+            y, step->n_out);
+        for (i = 0; i < rows * step->n_out; ++i) {
+            y[i] = logistic_activate(y[i]);
+        }
+    }
+}
+
+static void forwardLinearRelu(const struct PlanStep *step, int n)
+{
+    int r, i;
+    for (r = 0; r < n; r += PLAN_ROW_BLOCK) {
+        int rows = (n - r < PLAN_ROW_BLOCK)? n - r: PLAN_ROW_BLOCK;
+        float *y = step->y + (size_t)r * step->n_out;
+        fillBias(y, step->b, rows, step->n_out);
+        gemm(0, 1, rows, step->n_out, step->n_in, 1.,
+            (float *)step->x + (size_t)r * step->n_in, step->n_in,
+            step->w, step->n_in,
+            1.,
+            y, step->n_out);
+        for (i = 0; i < rows * step->n_out; ++i) {
+            y[i] = relu_activate(y[i]);
+        }
+    }
+}
+
+static void forwardSigmoid(const struct PlanStep *step, int n)
+{
+    int i;
+    for (i = 0; i < n * step->n_out; ++i) {
+        step->y[i] = logistic_activate(step->x[i]);
+    }
+}
+
+static void forwardRelu(const struct PlanStep *step, int n)
+{
+    int i;
+    for (i = 0; i < n * step->n_out; ++i) {
+        step->y[i] = relu_activate(step->x[i]);
+    }
+}
+
+static void softmaxRows(float *y, const float *x, int n, int k)
+{
+    int i, j;
+    for (i = 0; i < n; ++i) {
+        const float *in = x + (size_t)i * k;
+        float *out = y + (size_t)i * k;
+        float largest = -FLT_MAX;
+        for (j = 0; j < k; ++j) {
+            if (in[j] > largest) {
+                largest = in[j];
+            }
+        }
+        float sum = 0;
+        for (j = 0; j < k; ++j) {
+            float e = exp(in[j] - largest);
+            sum += e;
+            out[j] = e;
+        }
+        for (j = 0; j < k; ++j) {
+            out[j] /= sum;
+        }
+    }
+}
+
+static void forwardSoftmax(const struct PlanStep *step, int n)
+{
+    softmaxRows(step->y, step->x, n, step->n_out);
+}
+
+// ---------------- 反向传播 ----------------
+
+static void backwardLinear(const struct PlanStep *step, int n)
+{
+    if (step->dx) { // 反向传播到达第一层时不需要计算灵敏度
+        gemm(0, 0, n, step->n_in, step->n_out, 1.,
+            step->dy, step->n_out,
+            step->w, step->n_in,
+            0.,
+            step->dx, step->n_in);
+    }
+    gemm(1, 0, step->n_out, step->n_in, n, 1.,
+        step->dy, step->n_out,
+        (float *)step->x, step->n_in,
+        1.,
+        step->w_grad, step->n_in);
+
+    int i, j; // b_grad在整个batch开始前清零, 各分块累加
+    for (i = 0; i < n; ++i) {
+        const float *d = step->dy + (size_t)i * step->n_out;
+        for (j = 0; j < step->n_out; ++j) {
+            step->b_grad[j] += d[j];
+        }
+    }
+}
+
+// 融合步骤的灵敏度先原地乘以激活函数导数, 再按线性层反向传播
+static void backwardLinearSigmoid(const struct PlanStep *step, int n)
+{
+    int i;
+    for (i = 0; i < n * step->n_out; ++i) {
+        step->dy[i] *= logistic_gradient(step->y[i]);
+    }
+    backwardLinear(step, n);
+}
+
+static void backwardLinearRelu(const struct PlanStep *step, int n)
+{
+    int i;
+    for (i = 0; i < n * step->n_out; ++i) {
+        step->dy[i] *= relu_gradient(step->y[i]);
+    }
+    backwardLinear(step, n);
+}
+
+static void backwardSigmoid(const struct PlanStep *step, int n)
+{
+    if (step->dx == NULL) { // 激活层是第一层
+        return;
+    }
+    int i;
+    for (i = 0; i < n * step->n_out; ++i) {
+        step->dx[i] = logistic_gradient(step->y[i]) * step->dy[i];
+    }
+}
+
+static void backwardRelu(const struct PlanStep *step, int n)
+{
+    if (step->dx == NULL) { // 激活层是第一层
+        return;
+    }
+    int i;
+    for (i = 0; i < n * step->n_out; ++i) {
+        step->dx[i] = relu_gradient(step->x[i]) * step->dy[i];
+    }
+}
+
+// 与addTensor相同的更新, 合并为一次遍历
+static void updateParam(float *x, float *y, int n, float lr, float momentum)
+{
+    int i;
+    for (i = 0; i < n; ++i) {
+        y[i] *= lr;
+        x[i] += y[i];
+        y[i] *= momentum;
+    }
+}
+
+// ---------------- 编译 ----------------
+
+static int getLinearBlobs(struct PlanStep *step, const struct Layer *layer)
+{
+    struct Tensor *w, *b, *w_grad, *b_grad;
+    CHK_ERR(getLinearLayerParamRef(&w, &b, (const struct LinearLayer *)layer));
+    CHK_ERR(getLinearLayerGradientRef(&w_grad, &b_grad, (const struct LinearLayer *)layer));
+    CHK_ERR(getTensorBlob((void **)&(step->w), w));
+    CHK_ERR(getTensorBlob((void **)&(step->b), b));
+    CHK_ERR(getTensorBlob((void **)&(step->w_grad), w_grad));
+    CHK_ERR(getTensorBlob((void **)&(step->b_grad), b_grad));
+    return SUCCESS;
+}
+
+// 把layers[*i]开始的一层或两层(线性层+激活层)翻译为一步, *i前进相应层数
+static int compileStep(struct PlanStep *step, struct Layer **layers, int n_layers, int *i)
+{
+    const struct Layer *layer = layers[*i];
+    enum LayerType next = (*i + 1 < n_layers)? layers[*i + 1]->type: UNKNOW_LAYER_TYPE;
+    CHK_ERR(getLayerShape(&(step->n_in), &(step->n_out), layer));
+
+    switch (layer->type) {
+        case LINEAR_LAYER_TYPE:
+        CHK_ERR(getLinearBlobs(step, layer));
+        if (next == SIGMOID_LAYER_TYPE) {
+            step->forward = forwardLinearSigmoid;
+            step->backward = backwardLinearSigmoid;
+            *i += 2;
+        }
+        else if (next == RELU_LAYER_TYPE) {
+            step->forward = forwardLinearRelu;
+            step->backward = backwardLinearRelu;
+            *i += 2;
+        }
+        else {
+            step->forward = forwardLinear;
+            step->backward = backwardLinear;
+            *i += 1;
+        }
+        break;
+
+        case SIGMOID_LAYER_TYPE:
+        step->forward = forwardSigmoid;
+        step->backward = backwardSigmoid;
+        *i += 1;
+        break;
+
+        case RELU_LAYER_TYPE:
+        step->forward = forwardRelu;
+        step->backward = backwardRelu;
+        *i += 1;
+        break;
+
+        case SOFTMAX_LAYER_TYPE: // 与backwardSoftmaxLayer一致, 不支持训练
+        step->forward = forwardSoftmax;
+        step->backward = NULL;
+        *i += 1;
+        break;
+
+        default:
+        ERR_MSG("Layer %s: type not supported by compiled plan, error.\n", layer->name);
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int compileNetwork(struct NetworkPlan **plan, const struct Network *net, int batch_size,
+    const char *dtype_str, const char *gt_dtype_str)
+{
+    CHK_NIL(plan);
+    CHK_NIL(net);
+    CHK_ERR((batch_size > 0)? 0: 1);
+    CHK_NIL(dtype_str);
+    CHK_NIL(gt_dtype_str);
+
+    struct Layer **layers = NULL;
+    struct Cost *cost = NULL;
+    int n_layers = 0;
+    CHK_ERR(getNetworkLayers(&layers, &n_layers, &cost, net));
+    if (getTensorDtypeEnumFromStr(dtype_str) != FLOAT32) {
+        ERR_MSG("input dtype: %s not supported by compiled plan, error.\n", dtype_str);
+        return ERR_COD;
+    }
+    if (cost->type != CE_COST_TYPE) {
+        ERR_MSG("only CECost is supported by compiled plan, error.\n");
+        return ERR_COD;
+    }
+    int n_gt;
+    enum DType gt_dtype;
+    CHK_ERR(getCostGroundTruthAttributes(&n_gt, &gt_dtype, cost));
+    CHK_ERR((getTensorDtypeEnumFromStr(gt_dtype_str) == gt_dtype)? 0: 1);
+
+    struct NetworkPlan *res = calloc(1, sizeof(struct NetworkPlan));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    res->batch_size = batch_size;
+    res->tile_size = batch_size;
+    res->trainable = 1;
+    CHK_ERR_GOTO(getLayerInputNumber(&(res->n_features), layers[0]));
+    CHK_ERR_GOTO(getCostInputNumber(&(res->n_classes), cost));
+    CHK_NIL_GOTO((res->steps = calloc(n_layers, sizeof(struct PlanStep))));
+    res->n_alloc = n_layers;
+
+    int i = 0;
+    while (i < n_layers) {
+        struct PlanStep *step = &(res->steps[res->n_steps]);
+        CHK_ERR_GOTO(compileStep(step, layers, n_layers, &i));
+        // 融合步骤的输出个数是激活层的输出个数, 与线性层相同
+        CHK_NIL_GOTO((step->y = calloc((size_t)batch_size * step->n_out, sizeof(float))));
+        CHK_NIL_GOTO((step->dy = calloc((size_t)batch_size * step->n_out, sizeof(float))));
+        if (res->n_steps > 0) {
+            struct PlanStep *prev = &(res->steps[res->n_steps - 1]);
+            CHK_ERR_GOTO((prev->n_out == step->n_in)? 0: 1);
+            step->x = prev->y;
+            step->dx = prev->dy;
+        }
+        if (step->backward == NULL) {
+            res->trainable = 0;
+        }
+        ++(res->n_steps);
+    }
+    CHK_ERR_GOTO((res->steps[res->n_steps - 1].n_out == res->n_classes)? 0: 1);
+    CHK_NIL_GOTO((res->p = calloc((size_t)batch_size * res->n_classes, sizeof(float))));
+
+    *plan = res;
+    return SUCCESS;
+
+err_end:
+    destroyNetworkPlan(res);
+    return ERR_COD;
+}
+
+void destroyNetworkPlan(struct NetworkPlan *plan)
+{
+    if (plan) {
+        int i;
+        if (plan->steps) {
+            for (i = 0; i < plan->n_alloc; ++i) { // 编译失败时最后一步的缓冲区可能已分配
+                free(plan->steps[i].y);
+                free(plan->steps[i].dy);
+            }
+        }
+        free(plan->steps);
+        free(plan->p);
+    }
+    free(plan);
+}
+
+/**
+ * @brief 分块大小: 一个分块在所有层上的输入输出和灵敏度之和占L2的一半, 另一半留给流过的权重,
+ *        取PLAN_ROW_BLOCK的整数倍以便融合步骤整块计算
+ */
+static int chooseTileSize(const struct NetworkPlan *plan)
+{
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l2 <= 0) {
+        l2 = PLAN_DEFAULT_L2_SIZE;
+    }
+    size_t row_bytes = (size_t)(plan->n_features + plan->n_classes) * sizeof(float);
+    int i;
+    for (i = 0; i < plan->n_steps; ++i) {
+        row_bytes += 2 * (size_t)plan->steps[i].n_out * sizeof(float);
+    }
+    int tile = (int)((size_t)l2 / 2 / row_bytes);
+    tile = (tile / PLAN_ROW_BLOCK) * PLAN_ROW_BLOCK;
+    if (tile < PLAN_ROW_BLOCK) {
+        tile = PLAN_ROW_BLOCK;
+    }
+    return (tile < plan->batch_size)? tile: plan->batch_size;
+}
+
+int setNetworkPlanTileSize(struct NetworkPlan *plan, int tile_size)
+{
+    CHK_NIL(plan);
+    CHK_ERR((tile_size >= 0)? 0: 1);
+
+    if (tile_size == 0) {
+        plan->tile_size = chooseTileSize(plan);
+    }
+    else {
+        plan->tile_size = (tile_size < plan->batch_size)? tile_size: plan->batch_size;
+    }
+    return SUCCESS;
+}
+
+int getNetworkPlanTileSize(int *tile_size, const struct NetworkPlan *plan)
+{
+    CHK_NIL(tile_size);
+    CHK_NIL(plan);
+
+    *tile_size = plan->tile_size;
+    return SUCCESS;
+}
+
+// ---------------- 运行 ----------------
+
+// 一个分块穿过所有层, 中间结果只占各缓冲区的前n行; 分类概率写入p的对应行
+static void forwardTile(struct NetworkPlan *plan, const float *input, float *p, int n)
+{
+    int i;
+    plan->steps[0].x = input;
+    for (i = 0; i < plan->n_steps; ++i) {
+        plan->steps[i].forward(&(plan->steps[i]), n);
+    }
+    softmaxRows(p, plan->steps[plan->n_steps - 1].y, n, plan->n_classes); // CECost正向传播
+}
+
+int forwardNetworkPlan(struct NetworkPlan *plan, const void *input_data, int n_samples, struct Probe *probe)
+{
+    CHK_NIL(plan);
+    CHK_NIL(input_data);
+    CHK_NIL(probe);
+    CHK_ERR((n_samples > 0 && n_samples <= plan->batch_size)? 0: 1);
+
+    const float *input = input_data;
+    int r;
+    for (r = 0; r < n_samples; r += plan->tile_size) {
+        int rows = (n_samples - r < plan->tile_size)? n_samples - r: plan->tile_size;
+        forwardTile(plan, input + (size_t)r * plan->n_features, plan->p + (size_t)r * plan->n_classes, rows);
+    }
+    if (probe->sw_p_class) {
+        memcpy(probe->p_class, plan->p, (size_t)n_samples * plan->n_classes * sizeof(float));
+    }
+    return SUCCESS;
+}
+
+int trainNetworkPlan(struct NetworkPlan *plan, const void *input_data, const void *gt_data, int n_samples,
+    const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(plan);
+    CHK_NIL(input_data);
+    CHK_NIL(gt_data);
+    CHK_NIL(args);
+    CHK_NIL(probe);
+    CHK_ERR((n_samples > 0 && n_samples <= plan->batch_size)? 0: 1);
+    CHK_ERR((plan->trainable)? 0: 1);
+
+    int n = n_samples;
+    int k = plan->n_classes;
+    int i, j, r;
+    for (i = 0; i < plan->n_steps; ++i) {
+        if (plan->steps[i].b_grad) {
+            memset(plan->steps[i].b_grad, 0, plan->steps[i].n_out * sizeof(float));
+        }
+    }
+
+    // 每个分块正向传播后立即反向传播, 梯度在分块间累加
+    const float *input = input_data;
+    float *delta = plan->steps[plan->n_steps - 1].dy;
+    float sum_log_p = 0.;
+    for (r = 0; r < n; r += plan->tile_size) {
+        int rows = (n - r < plan->tile_size)? n - r: plan->tile_size;
+        const unsigned char *gt = (const unsigned char *)gt_data + (size_t)r * k;
+        float *p = plan->p + (size_t)r * k;
+        forwardTile(plan, input + (size_t)r * plan->n_features, p, rows);
+
+        // CECost反向传播: 与addTensor2和probTensor相同, 除以整个batch的样本数
+        for (i = 0; i < rows * k; ++i) {
+            delta[i] = (gt[i] - p[i]) / (float)n;
+        }
+        for (i = 0; i < rows; ++i) {
+            for (j = 0; j < k; ++j) {
+                if (gt[i * k + j] != 0) {
+                    sum_log_p += log(p[i * k + j]);
+                    break;
+                }
+            }
+        }
+
+        for (i = plan->n_steps - 1; i >= 0; --i) {
+            plan->steps[i].backward(&(plan->steps[i]), rows);
+        }
+    }
+    if (probe->sw_p_class) {
+        memcpy(probe->p_class, plan->p, (size_t)n * k * sizeof(float));
+    }
+    if (probe->sw_ce_cost) {
+        probe->ce_cost = sum_log_p / n;
+    }
+
+    // 注意：这里的lr应该是已经除以了batch_size后的lr
+    for (i = 0; i < plan->n_steps; ++i) {
+        struct PlanStep *step = &(plan->steps[i]);
+        if (step->w) {
+            updateParam(step->w, step->w_grad, step->n_out * step->n_in, args->lr, args->momentum);
+            updateParam(step->b, step->b_grad, step->n_out, args->lr, args->momentum);
+        }
+    }
+    return SUCCESS;
+}
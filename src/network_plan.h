@@ -0,0 +1,39 @@
+/**
+ * @brief 编译后的网络执行计划.
+ *        compileNetwork一次性检查各层形状和数据类型, 把层序列翻译为函数指针数组, 并预先分配所有输入输出/灵敏度缓冲区;
+ *        线性层与其后的sigmoid/relu激活层融合为一步(按行分块计算gemm后立即激活, 省去一个中间缓冲区和一次遍历).
+ *        运行时不再经过layer.c的switch分发和tensor.c的逐函数检查, 只检查样本数.
+ *
+ *        支持的层: LinearLayer, SigmoidLayer, ReluLayer, SoftmaxLayer(只用于推理); 代价函数: CECost.
+ *        参数和梯度直接使用各层自己的缓冲区, 训练结果与forwardNetwork/backwardNetwork/updateNetwork一致.
+ *        计划不处理Probe的dump_*开关, 需要导出中间结果时使用Network.
+ *
+ *        分块执行: batch按行切成若干分块, 每个分块依次穿过所有层(训练时紧接着反向穿过所有层)后再处理下一块,
+ *        中间结果只占缓冲区的前tile_size行, 可以留在L2中, 反复读取的只有权重和梯度.
+ *        默认不分块(tile_size == batch_size).
+ */
+#pragma once
+
+#include "network.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+struct NetworkPlan;
+
+int compileNetwork(struct NetworkPlan **plan, const struct Network *net, int batch_size,
+    const char *dtype_str, const char *gt_dtype_str);
+void destroyNetworkPlan(struct NetworkPlan *plan);
+
+/**
+ * @brief 设置分块的样本数, 0表示根据L2大小和各层宽度自动选择, 大于batch_size时等同于不分块
+ */
+int setNetworkPlanTileSize(struct NetworkPlan *plan, int tile_size);
+int getNetworkPlanTileSize(int *tile_size, const struct NetworkPlan *plan);
+
+int forwardNetworkPlan(struct NetworkPlan *plan, const void *input_data, int n_samples, struct Probe *probe);
+
+/**
+ * @brief 正向传播, 反向传播和参数更新, 相当于forwardNetwork + backwardNetwork + updateNetwork
+ */
+int trainNetworkPlan(struct NetworkPlan *plan, const void *input_data, const void *gt_data, int n_samples,
+    const struct UpdateArgs *args, struct Probe *probe);
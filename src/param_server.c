@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "debug_macros.h"
+#include "layer.h"
+#include "cost.h"
+#include "network.h"
+#include "param_server.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+#define NN_PS_MAGIC (0x4e4e5053) // "NNPS"
+
+enum ParamServerOp
+{
+    PS_OP_HELLO = 1, // 校验参数个数, 返回max_staleness
+    PS_OP_PULL = 2, // 返回当前版本号和全部参数
+    PS_OP_PUSH = 3, // 发送基于version计算的梯度, 返回状态和最新版本号
+    PS_OP_BYE = 4
+};
+
+enum ParamServerStatus
+{
+    PS_STATUS_OK = 0,
+    PS_STATUS_STALE = 1,
+    PS_STATUS_BAD_REQUEST = 2
+};
+
+struct ParamServerHeader
+{
+    uint32_t magic;
+    uint16_t op;
+    uint16_t status;
+    uint32_t n_floats; // 消息头之后的float个数
+    uint32_t arg; // HELLO回复中为max_staleness
+    uint64_t version;
+};
+
+struct ParamServer
+{
+    char sock_pth[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int listen_fd;
+    struct Layer **layers; // 不负责释放
+    int n_layers;
+    int n_params;
+    float *buf;
+    int max_staleness;
+    long version;
+    long n_applied;
+    long n_rejected;
+};
+
+struct ParamServerWorker
+{
+    int fd;
+    struct Network *net;
+    struct Layer **layers; // 不负责释放
+    int n_layers;
+    int n_params;
+    float *buf;
+    int max_staleness;
+    int has_param; // 是否pull过参数
+    long version; // 本地参数的版本号
+    long server_version; // 最近一次得知的服务端版本号
+    long n_pushes;
+    long n_pulls;
+    long n_rejected;
+};
+
+static int readFull(int fd, void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        ssize_t ret = recv(fd, (char *)buf + done, n - done, 0);
+        if (ret <= 0) {
+            if (ret == -1 && errno == EINTR) {
+                continue;
+            }
+            return ERR_COD; // 对端关闭也视为失败, 由调用者决定是否报错
+        }
+        done += ret;
+    }
+    return SUCCESS;
+}
+
+static int writeFull(int fd, const void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        ssize_t ret = send(fd, (const char *)buf + done, n - done, MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR_MSG("send() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        done += ret;
+    }
+    return SUCCESS;
+}
+
+static int sendMessage(int fd, int op, int status, uint32_t arg, long version, const float *data, int n_floats)
+{
+    struct ParamServerHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = NN_PS_MAGIC;
+    h.op = op;
+    h.status = status;
+    h.n_floats = n_floats;
+    h.arg = arg;
+    h.version = version;
+    CHK_ERR(writeFull(fd, &h, sizeof(h)));
+    if (data && n_floats > 0) { // data为NULL时只发送消息头, 例如HELLO中n_floats只用于校验
+        CHK_ERR(writeFull(fd, data, (size_t)n_floats * sizeof(float)));
+    }
+    return SUCCESS;
+}
+
+static int getLayersParamNumber(int *n_params, struct Layer **layers, int n_layers)
+{
+    int i, n;
+    *n_params = 0;
+    for (i = 0; i < n_layers; ++i) {
+        CHK_ERR(getLayerParamNumber(&n, layers[i]));
+        *n_params += n;
+    }
+    return SUCCESS;
+}
+
+int createParamServer(struct ParamServer **ps, struct Layer **layers, int n_layers, const char *sock_pth, int max_staleness)
+{
+    CHK_NIL(ps);
+    CHK_NIL(layers);
+    CHK_NIL(sock_pth);
+    CHK_ERR((n_layers > 0)? 0: 1);
+    CHK_ERR((max_staleness >= 0)? 0: 1);
+
+    struct ParamServer *res = calloc(1, sizeof(struct ParamServer));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    res->listen_fd = -1;
+    res->layers = layers;
+    res->n_layers = n_layers;
+    res->max_staleness = max_staleness;
+    CHK_ERR_GOTO(getLayersParamNumber(&(res->n_params), layers, n_layers));
+    CHK_NIL_GOTO((res->buf = calloc(res->n_params + 1, sizeof(float))));
+
+    if (strlen(sock_pth) >= sizeof(res->sock_pth)) {
+        ERR_MSG("socket path too long: %s, error.\n", sock_pth);
+        goto err_end;
+    }
+    snprintf(res->sock_pth, sizeof(res->sock_pth), "%s", sock_pth);
+    res->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (res->listen_fd == -1) {
+        ERR_MSG("socket() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_pth);
+    unlink(sock_pth);
+    if (bind(res->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(res->listen_fd, NN_PS_MAX_CONNS) == -1) {
+        ERR_MSG("bind()/listen() failed, path: %s, detail: %s, error.\n", sock_pth, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+
+    *ps = res;
+    return SUCCESS;
+
+err_end:
+    destroyParamServer(res);
+    return ERR_COD;
+}
+
+void destroyParamServer(struct ParamServer *ps)
+{
+    if (ps) {
+        if (ps->listen_fd != -1) {
+            close(ps->listen_fd);
+            unlink(ps->sock_pth);
+        }
+        free(ps->buf);
+    }
+    free(ps);
+}
+
+static int applyGradient(struct ParamServer *ps, const struct UpdateArgs *args)
+{
+    struct Probe probe;
+    memset(&probe, 0, sizeof(struct Probe));
+    struct UpdateArgs args_ps = *args;
+    args_ps.cur_iter = (int)ps->version;
+
+    int i, n;
+    const float *src = ps->buf;
+    for (i = 0; i < ps->n_layers; ++i) {
+        CHK_ERR(mergeLayerGradient(ps->layers[i], src));
+        CHK_ERR(getLayerParamNumber(&n, ps->layers[i]));
+        src += n;
+    }
+    for (i = ps->n_layers - 1; i >= 0; --i) {
+        CHK_ERR(updateLayer(ps->layers[i], &args_ps, &probe));
+    }
+    ++(ps->version);
+    ++(ps->n_applied);
+    return SUCCESS;
+}
+
+static int packParam(float *dst, struct Layer **layers, int n_layers)
+{
+    int i, n;
+    for (i = 0; i < n_layers; ++i) {
+        CHK_ERR(packLayerParam(dst, layers[i]));
+        CHK_ERR(getLayerParamNumber(&n, layers[i]));
+        dst += n;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief 处理一个请求, 返回ERR_COD表示连接应关闭(对端断开、BYE或协议错误)
+ */
+static int handleRequest(struct ParamServer *ps, int fd, const struct UpdateArgs *args)
+{
+    struct ParamServerHeader h;
+    if (readFull(fd, &h, sizeof(h)) != SUCCESS) {
+        return ERR_COD;
+    }
+    if (h.magic != NN_PS_MAGIC) {
+        ERR_MSG("bad magic: 0x%x, error.\n", h.magic);
+        return ERR_COD;
+    }
+
+    switch (h.op) {
+        case PS_OP_HELLO:
+        if ((int)h.n_floats != ps->n_params) {
+            ERR_MSG("worker n_params = %u, server n_params = %d, not match, error.\n", h.n_floats, ps->n_params);
+            sendMessage(fd, PS_OP_HELLO, PS_STATUS_BAD_REQUEST, 0, ps->version, NULL, 0);
+            return ERR_COD;
+        }
+        CHK_ERR(sendMessage(fd, PS_OP_HELLO, PS_STATUS_OK, ps->max_staleness, ps->version, NULL, 0));
+        break;
+
+        case PS_OP_PULL:
+        CHK_ERR(packParam(ps->buf, ps->layers, ps->n_layers));
+        CHK_ERR(sendMessage(fd, PS_OP_PULL, PS_STATUS_OK, 0, ps->version, ps->buf, ps->n_params));
+        break;
+
+        case PS_OP_PUSH:
+        if ((int)h.n_floats != ps->n_params) {
+            ERR_MSG("push n_floats = %u, server n_params = %d, not match, error.\n", h.n_floats, ps->n_params);
+            return ERR_COD;
+        }
+        CHK_ERR(readFull(fd, ps->buf, (size_t)ps->n_params * sizeof(float)));
+        if (ps->version - (long)h.version > ps->max_staleness) {
+            ++(ps->n_rejected);
+            CHK_ERR(sendMessage(fd, PS_OP_PUSH, PS_STATUS_STALE, 0, ps->version, NULL, 0));
+        }
+        else {
+            CHK_ERR(applyGradient(ps, args));
+            CHK_ERR(sendMessage(fd, PS_OP_PUSH, PS_STATUS_OK, 0, ps->version, NULL, 0));
+        }
+        break;
+
+        case PS_OP_BYE:
+        return ERR_COD;
+
+        default:
+        ERR_MSG("unknow op: %u, error.\n", h.op);
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+int runParamServer(struct ParamServer *ps, const struct UpdateArgs *args, int n_workers)
+{
+    CHK_NIL(ps);
+    CHK_ERR(checkUpdateArgs(args));
+    CHK_ERR((n_workers > 0 && n_workers < NN_PS_MAX_CONNS)? 0: 1);
+
+    struct pollfd fds[NN_PS_MAX_CONNS];
+    int n_fds = 1;
+    int n_accepted = 0;
+    fds[0].fd = ps->listen_fd;
+    fds[0].events = POLLIN;
+
+    // 所有训练进程连接过且都已断开时结束
+    while (n_accepted < n_workers || n_fds > 1) {
+        fds[0].events = (n_accepted < n_workers)? POLLIN: 0;
+        if (poll(fds, n_fds, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR_MSG("poll() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        int i;
+        for (i = n_fds - 1; i >= 1; --i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            if (handleRequest(ps, fds[i].fd, args) != SUCCESS) {
+                close(fds[i].fd);
+                fds[i] = fds[--n_fds];
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(ps->listen_fd, NULL, NULL);
+            if (fd == -1) {
+                ERR_MSG("accept() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+                return ERR_COD;
+            }
+            fds[n_fds].fd = fd;
+            fds[n_fds].events = POLLIN;
+            fds[n_fds].revents = 0;
+            ++n_fds;
+            ++n_accepted;
+        }
+    }
+    return SUCCESS;
+}
+
+int getParamServerStats(long *version, long *n_applied, long *n_rejected, const struct ParamServer *ps)
+{
+    CHK_NIL(version);
+    CHK_NIL(n_applied);
+    CHK_NIL(n_rejected);
+    CHK_NIL(ps);
+
+    *version = ps->version;
+    *n_applied = ps->n_applied;
+    *n_rejected = ps->n_rejected;
+    return SUCCESS;
+}
+
+int createParamServerWorker(struct ParamServerWorker **worker, struct Layer **layers, int n_layers, struct Cost *cost, const char *sock_pth)
+{
+    CHK_NIL(worker);
+    CHK_NIL(layers);
+    CHK_NIL(cost);
+    CHK_NIL(sock_pth);
+
+    struct ParamServerWorker *res = calloc(1, sizeof(struct ParamServerWorker));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    res->fd = -1;
+    res->layers = layers;
+    res->n_layers = n_layers;
+    CHK_ERR_GOTO(createNetwork(&(res->net), layers, n_layers, cost));
+    CHK_ERR_GOTO(getLayersParamNumber(&(res->n_params), layers, n_layers));
+    CHK_NIL_GOTO((res->buf = calloc(res->n_params + 1, sizeof(float))));
+
+    res->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (res->fd == -1) {
+        ERR_MSG("socket() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_pth);
+    if (connect(res->fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        ERR_MSG("connect() failed, path: %s, detail: %s, error.\n", sock_pth, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+
+    struct ParamServerHeader h;
+    CHK_ERR_GOTO(sendMessage(res->fd, PS_OP_HELLO, PS_STATUS_OK, 0, 0, NULL, res->n_params));
+    CHK_ERR_GOTO(readFull(res->fd, &h, sizeof(h)));
+    if (h.magic != NN_PS_MAGIC || h.status != PS_STATUS_OK) {
+        ERR_MSG("param server rejected hello, status = %u, error.\n", h.status);
+        goto err_end;
+    }
+    res->max_staleness = h.arg;
+    res->server_version = h.version;
+
+    *worker = res;
+    return SUCCESS;
+
+err_end:
+    destroyParamServerWorker(res);
+    return ERR_COD;
+}
+
+void destroyParamServerWorker(struct ParamServerWorker *worker)
+{
+    if (worker) {
+        if (worker->fd != -1) {
+            sendMessage(worker->fd, PS_OP_BYE, PS_STATUS_OK, 0, 0, NULL, 0);
+            close(worker->fd);
+        }
+        destroyNetwork(worker->net);
+        free(worker->buf);
+    }
+    free(worker);
+}
+
+static int pullParam(struct ParamServerWorker *worker)
+{
+    struct ParamServerHeader h;
+    CHK_ERR(sendMessage(worker->fd, PS_OP_PULL, PS_STATUS_OK, 0, 0, NULL, 0));
+    CHK_ERR(readFull(worker->fd, &h, sizeof(h)));
+    CHK_ERR((h.magic == NN_PS_MAGIC && h.status == PS_STATUS_OK && (int)h.n_floats == worker->n_params)? 0: 1);
+    CHK_ERR(readFull(worker->fd, worker->buf, (size_t)worker->n_params * sizeof(float)));
+
+    int i, n;
+    const float *src = worker->buf;
+    for (i = 0; i < worker->n_layers; ++i) {
+        CHK_ERR(unpackLayerParam(worker->layers[i], src));
+        CHK_ERR(getLayerParamNumber(&n, worker->layers[i]));
+        src += n;
+    }
+    worker->version = h.version;
+    worker->server_version = h.version;
+    worker->has_param = 1;
+    ++(worker->n_pulls);
+    return SUCCESS;
+}
+
+int trainParamServerBatch(struct ParamServerWorker *worker,
+    const void *input_data, int n_features, const char *dtype_str,
+    const void *gt_data, int n_gt_features, const char *gt_dtype_str,
+    int n_samples, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(worker);
+    CHK_NIL(probe);
+
+    if (!worker->has_param || worker->server_version - worker->version >= worker->max_staleness) {
+        CHK_ERR(pullParam(worker));
+    }
+
+    // 动量由服务端维护, 训练进程每次只发送本batch的梯度
+    int i, n;
+    for (i = 0; i < worker->n_layers; ++i) {
+        CHK_ERR(clearLayerGradient(worker->layers[i]));
+    }
+    CHK_ERR(forwardNetwork(worker->net, input_data, n_samples, n_features, dtype_str, args, probe));
+    CHK_ERR(backwardNetwork(worker->net, gt_data, n_samples, n_gt_features, gt_dtype_str, args, probe));
+
+    float *dst = worker->buf;
+    for (i = 0; i < worker->n_layers; ++i) {
+        CHK_ERR(packLayerGradient(dst, worker->layers[i]));
+        CHK_ERR(getLayerParamNumber(&n, worker->layers[i]));
+        dst += n;
+    }
+    struct ParamServerHeader h;
+    CHK_ERR(sendMessage(worker->fd, PS_OP_PUSH, PS_STATUS_OK, 0, worker->version, worker->buf, worker->n_params));
+    CHK_ERR(readFull(worker->fd, &h, sizeof(h)));
+    CHK_ERR((h.magic == NN_PS_MAGIC && h.op == PS_OP_PUSH)? 0: 1);
+    ++(worker->n_pushes);
+    worker->server_version = h.version;
+    if (h.status == PS_STATUS_STALE) { // 梯度被丢弃, 立即同步参数
+        ++(worker->n_rejected);
+        CHK_ERR(pullParam(worker));
+    }
+    else {
+        CHK_ERR((h.status == PS_STATUS_OK)? 0: 1);
+    }
+    return SUCCESS;
+}
+
+int getParamServerWorkerStats(long *n_pushes, long *n_pulls, long *n_rejected, const struct ParamServerWorker *worker)
+{
+    CHK_NIL(n_pushes);
+    CHK_NIL(n_pulls);
+    CHK_NIL(n_rejected);
+    CHK_NIL(worker);
+
+    *n_pushes = worker->n_pushes;
+    *n_pulls = worker->n_pulls;
+    *n_rejected = worker->n_rejected;
+    return SUCCESS;
+}
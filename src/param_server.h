@@ -0,0 +1,40 @@
+/**
+ * @brief 基于Unix domain socket的异步参数服务器训练.
+ *        服务端进程持有主参数, 串行地把收到的梯度合并进主层并调用updateLayer更新(与单机训练同一更新路径);
+ *        训练进程各自取batch, 计算梯度后push给服务端, 按需pull最新参数, 快慢不同的训练进程互不等待.
+ *
+ *        有界延迟(bounded staleness): 服务端每应用一次梯度版本号加1. 梯度基于的参数版本落后超过max_staleness时,
+ *        服务端拒绝该梯度, 训练进程随即pull. 训练进程已知落后max_staleness个版本时, 在下一次计算前主动pull.
+ *
+ *        传输格式: 固定24字节的消息头(见param_server.c)后跟float32数组, 参数/梯度按层顺序, 每层按w, b顺序连续存放.
+ *        只用于同一主机, 不做字节序转换.
+ */
+#pragma once
+
+#include "layer.h"
+#include "cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+#define NN_PS_MAX_CONNS (64)
+
+struct ParamServer;
+struct ParamServerWorker;
+
+int createParamServer(struct ParamServer **ps, struct Layer **layers, int n_layers, const char *sock_pth, int max_staleness);
+void destroyParamServer(struct ParamServer *ps);
+
+/**
+ * @brief 处理请求直到n_workers个训练进程都已连接并断开
+ */
+int runParamServer(struct ParamServer *ps, const struct UpdateArgs *args, int n_workers);
+int getParamServerStats(long *version, long *n_applied, long *n_rejected, const struct ParamServer *ps);
+
+int createParamServerWorker(struct ParamServerWorker **worker, struct Layer **layers, int n_layers, struct Cost *cost, const char *sock_pth);
+void destroyParamServerWorker(struct ParamServerWorker *worker);
+
+int trainParamServerBatch(struct ParamServerWorker *worker,
+    const void *input_data, int n_features, const char *dtype_str,
+    const void *gt_data, int n_gt_features, const char *gt_dtype_str,
+    int n_samples, const struct UpdateArgs *args, struct Probe *probe);
+int getParamServerWorkerStats(long *n_pushes, long *n_pulls, long *n_rejected, const struct ParamServerWorker *worker);
@@ -0,0 +1,576 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "debug_macros.h"
+#include "tensor.h"
+#include "layer.h"
+#include "cost.h"
+#include "pipeline_trainer.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "affinity.h"
+#include "thread_pool.h"
+
+struct PipelineStage
+{
+    int idx;
+    int first; // 负责的层下标区间[first, last]
+    int last;
+    pthread_t tid;
+    struct PipelineTrainer *trainer;
+};
+
+struct PipelineTrainer
+{
+    int n_layers;
+    int n_classes;
+    struct Layer **layers; // 不负责释放
+    struct Cost *cost; // 不负责释放
+    int n_stages;
+    int n_micro_batches;
+    struct PipelineStage *stages;
+    int n_started;
+    int launched; // 所有段线程都已创建, 之前段线程在mtx/cond上等待, 不进入屏障
+    int stop;
+    int barrier_inited;
+    pthread_barrier_t barrier; // 所有段线程和调用线程, 标记一个step的开始和结束
+
+    // 每个micro-batch一组缓冲区, 下标为[micro-batch][层号]
+    int cap; // 每个micro-batch缓冲区可容纳的样本数
+    struct Tensor ***outputs;
+    struct Tensor ***deltas;
+    struct Tensor **inputs; // 引用用户输入数据
+    struct Tensor **gts; // 引用用户真值数据
+    struct Probe probe_last; // 最后一段计算代价时使用
+    int p_class_cap;
+
+    // 段间同步: fwd_done[s]/bwd_done[s]为第s段已完成正向/反向传播的micro-batch数
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    int *fwd_done;
+    int *bwd_done;
+    int failed;
+
+    // 当前step的参数, 由调用线程在开始屏障前写入
+    const char *input;
+    const char *gt;
+    int n_features;
+    int n_gt_features;
+    enum DType dtype;
+    enum DType gt_dtype;
+    size_t in_row_bytes;
+    size_t gt_row_bytes;
+    int n_samples;
+    int n_micro; // 本step实际的micro-batch数, 样本数少于n_micro_batches时减少
+    int *starts;
+    int *counts;
+    const struct UpdateArgs *args;
+    struct Probe *probe;
+    double ce; // 各micro-batch代价值按样本数加权求和, 只由最后一段访问
+    int *status;
+};
+
+// 层的计算量估计, 线性层为乘加次数, 其余层为神经元个数
+static int getLayerCost(long *cost, const struct Layer *layer)
+{
+    int n_in, n_out;
+    CHK_ERR(getLayerShape(&n_in, &n_out, layer));
+    *cost = (layer->type == LINEAR_LAYER_TYPE || layer->type == SHARDED_LINEAR_LAYER_TYPE)? (long)n_in * n_out: n_out;
+    return SUCCESS;
+}
+
+// 把n_layers层切分为n_stages段连续的层, 使计算量最大的段尽量小(动态规划)
+static int partitionLayers(struct PipelineTrainer *trainer)
+{
+    int n = trainer->n_layers;
+    int k = trainer->n_stages;
+    int ret = ERR_COD;
+    long *prefix = calloc(n + 1, sizeof(long));
+    long *best = calloc((size_t)(k + 1) * (n + 1), sizeof(long)); // best[j][i]: 前i层分为j段时最大段的计算量
+    int *cut = calloc((size_t)(k + 1) * (n + 1), sizeof(int));
+    CHK_NIL_GOTO(prefix);
+    CHK_NIL_GOTO(best);
+    CHK_NIL_GOTO(cut);
+
+    int i, j, p;
+    for (i = 0; i < n; ++i) {
+        long c = 0;
+        CHK_ERR_GOTO(getLayerCost(&c, trainer->layers[i]));
+        prefix[i + 1] = prefix[i] + c;
+    }
+    for (i = 1; i <= n; ++i) {
+        best[1 * (n + 1) + i] = prefix[i];
+    }
+    for (j = 2; j <= k; ++j) {
+        for (i = j; i <= n; ++i) {
+            long res = -1;
+            for (p = j - 1; p < i; ++p) { // 最后一段为[p, i)
+                long prev = best[(j - 1) * (n + 1) + p];
+                long cur = prefix[i] - prefix[p];
+                long m = (prev > cur)? prev: cur;
+                if (res < 0 || m < res) {
+                    res = m;
+                    cut[j * (n + 1) + i] = p;
+                }
+            }
+            best[j * (n + 1) + i] = res;
+        }
+    }
+
+    int end = n;
+    for (j = k; j >= 1; --j) {
+        int begin = (j == 1)? 0: cut[j * (n + 1) + end];
+        trainer->stages[j - 1].first = begin;
+        trainer->stages[j - 1].last = end - 1;
+        end = begin;
+    }
+    ret = SUCCESS;
+
+err_end:
+    free(prefix);
+    free(best);
+    free(cut);
+    return ret;
+}
+
+static void freeMicroBatchCache(struct PipelineTrainer *trainer)
+{
+    int m, i;
+    for (m = 0; m < trainer->n_micro_batches; ++m) {
+        if (trainer->outputs && trainer->outputs[m]) {
+            for (i = 0; i < trainer->n_layers; ++i) {
+                destroyTensor(trainer->outputs[m][i]);
+            }
+            free(trainer->outputs[m]);
+            trainer->outputs[m] = NULL;
+        }
+        if (trainer->deltas && trainer->deltas[m]) {
+            for (i = 0; i < trainer->n_layers; ++i) {
+                destroyTensor(trainer->deltas[m][i]);
+            }
+            free(trainer->deltas[m]);
+            trainer->deltas[m] = NULL;
+        }
+        // 输入和真值Tensor只引用用户数据, 只释放Tensor对象本身
+        if (trainer->inputs) {
+            free(trainer->inputs[m]);
+            trainer->inputs[m] = NULL;
+        }
+        if (trainer->gts) {
+            free(trainer->gts[m]);
+            trainer->gts[m] = NULL;
+        }
+    }
+    trainer->cap = 0;
+}
+
+static int allocMicroBatchCache(struct PipelineTrainer *trainer, int cap)
+{
+    int m, i;
+    for (m = 0; m < trainer->n_micro_batches; ++m) {
+        CHK_NIL((trainer->outputs[m] = calloc(trainer->n_layers, sizeof(struct Tensor *))));
+        CHK_NIL((trainer->deltas[m] = calloc(trainer->n_layers, sizeof(struct Tensor *))));
+        for (i = 0; i < trainer->n_layers; ++i) {
+            int n_out = 0;
+            CHK_ERR(getLayerOutputNumber(&n_out, trainer->layers[i]));
+            CHK_ERR(createTensorData(&(trainer->outputs[m][i]), FLOAT32, cap, n_out));
+            CHK_ERR(createTensorData(&(trainer->deltas[m][i]), FLOAT32, cap, n_out));
+        }
+    }
+    trainer->cap = cap;
+    return SUCCESS;
+}
+
+// 等待counter[s] > m, 其他段失败时返回错误
+static int waitStage(struct PipelineTrainer *trainer, const int *counter, int s, int m)
+{
+    int failed;
+    pthread_mutex_lock(&(trainer->mtx));
+    while (!trainer->failed && counter[s] <= m) {
+        pthread_cond_wait(&(trainer->cond), &(trainer->mtx));
+    }
+    failed = trainer->failed;
+    pthread_mutex_unlock(&(trainer->mtx));
+    return failed? ERR_COD: SUCCESS;
+}
+
+static void signalStage(struct PipelineTrainer *trainer, int *counter, int s)
+{
+    pthread_mutex_lock(&(trainer->mtx));
+    ++counter[s];
+    pthread_cond_broadcast(&(trainer->cond));
+    pthread_mutex_unlock(&(trainer->mtx));
+}
+
+// 最后一段在正向传播后立即计算代价和初始灵敏度
+static int runCost(struct PipelineTrainer *trainer, int m)
+{
+    int last = trainer->n_layers - 1;
+    int start = trainer->starts[m];
+    int count = trainer->counts[m];
+    struct Probe *probe = &(trainer->probe_last);
+
+    if (trainer->gts[m]) {
+        void *blob_old = NULL;
+        CHK_ERR(setTensorSamplesByReplace(&blob_old, trainer->gts[m], (void *)(trainer->gt + start * trainer->gt_row_bytes),
+            count, trainer->n_gt_features, trainer->gt_dtype));
+    }
+    else {
+        CHK_ERR(createTensorDataWithBlobRef(&(trainer->gts[m]), (void *)(trainer->gt + start * trainer->gt_row_bytes),
+            trainer->gt_dtype, trainer->cap, trainer->n_gt_features, count));
+    }
+
+    CHK_ERR(setCostInput(trainer->cost, trainer->outputs[m][last]));
+    CHK_ERR(setCostDelta(trainer->cost, trainer->deltas[m][last]));
+    CHK_ERR(forwardCost(trainer->cost, trainer->args, probe));
+    CHK_ERR(backwardCost(trainer->cost, trainer->gts[m], trainer->args, probe));
+
+    // 代价函数按micro-batch样本数平均, 这里换算为按整个batch平均, 之后各层梯度直接累加
+    CHK_ERR(scaleTensor(trainer->deltas[m][last], (float)count / trainer->n_samples));
+
+    trainer->ce += (double)probe->ce_cost * count;
+    if (trainer->probe->sw_p_class) {
+        memcpy(trainer->probe->p_class + (size_t)start * trainer->n_classes, probe->p_class, (size_t)count * trainer->n_classes * sizeof(float));
+    }
+    return SUCCESS;
+}
+
+static int forwardStage(struct PipelineTrainer *trainer, struct PipelineStage *stage, int m)
+{
+    if (stage->idx > 0) {
+        CHK_ERR(waitStage(trainer, trainer->fwd_done, stage->idx - 1, m));
+    }
+    else {
+        int start = trainer->starts[m];
+        if (trainer->inputs[m]) {
+            void *blob_old = NULL;
+            CHK_ERR(setTensorSamplesByReplace(&blob_old, trainer->inputs[m], (void *)(trainer->input + start * trainer->in_row_bytes),
+                trainer->counts[m], trainer->n_features, trainer->dtype));
+        }
+        else {
+            CHK_ERR(createTensorDataWithBlobRef(&(trainer->inputs[m]), (void *)(trainer->input + start * trainer->in_row_bytes),
+                trainer->dtype, trainer->cap, trainer->n_features, trainer->counts[m]));
+        }
+    }
+
+    int i;
+    for (i = stage->first; i <= stage->last; ++i) {
+        struct Layer *layer = trainer->layers[i];
+        CHK_ERR(setLayerInput(layer, (i == 0)? trainer->inputs[m]: trainer->outputs[m][i - 1]));
+        CHK_ERR(setLayerOutput(layer, trainer->outputs[m][i]));
+        CHK_ERR(forwardLayer(layer, trainer->args, &(trainer->probe_last)));
+    }
+    if (stage->idx == trainer->n_stages - 1) {
+        CHK_ERR(runCost(trainer, m));
+    }
+    signalStage(trainer, trainer->fwd_done, stage->idx);
+    return SUCCESS;
+}
+
+static int backwardStage(struct PipelineTrainer *trainer, struct PipelineStage *stage, int m)
+{
+    if (stage->idx < trainer->n_stages - 1) {
+        CHK_ERR(waitStage(trainer, trainer->bwd_done, stage->idx + 1, m));
+    }
+
+    int i;
+    for (i = stage->last; i >= stage->first; --i) {
+        struct Layer *layer = trainer->layers[i];
+        CHK_ERR(setLayerInput(layer, (i == 0)? trainer->inputs[m]: trainer->outputs[m][i - 1]));
+        CHK_ERR(setLayerOutput(layer, trainer->outputs[m][i]));
+        CHK_ERR(setLayerInputDelta(layer, trainer->deltas[m][i]));
+        if (i > 0) {
+            CHK_ERR(setLayerOutputDelta(layer, trainer->deltas[m][i - 1]));
+        }
+        CHK_ERR(setLayerGradientAccumulation(layer, (m > 0)? 1: 0)); // 第一个micro-batch覆盖偏置梯度, 之后累加
+        CHK_ERR(backwardLayer(layer, trainer->args, &(trainer->probe_last)));
+    }
+    signalStage(trainer, trainer->bwd_done, stage->idx);
+    return SUCCESS;
+}
+
+// 1F1B调度: 预热n_stages - 1 - s次正向传播, 然后交替正向和反向, 最后排空反向
+static int runStage(struct PipelineTrainer *trainer, struct PipelineStage *stage)
+{
+    int n_micro = trainer->n_micro;
+    int n_warmup = trainer->n_stages - 1 - stage->idx;
+    if (n_warmup > n_micro) {
+        n_warmup = n_micro;
+    }
+
+    int n_fwd = 0;
+    int n_bwd = 0;
+    int ret = SUCCESS;
+    while (n_fwd < n_warmup && ret == SUCCESS) {
+        ret = forwardStage(trainer, stage, n_fwd++);
+    }
+    while (n_fwd < n_micro && ret == SUCCESS) {
+        ret = forwardStage(trainer, stage, n_fwd++);
+        if (ret == SUCCESS) {
+            ret = backwardStage(trainer, stage, n_bwd++);
+        }
+    }
+    while (n_bwd < n_micro && ret == SUCCESS) {
+        ret = backwardStage(trainer, stage, n_bwd++);
+    }
+
+    int i;
+    for (i = stage->first; i <= stage->last; ++i) {
+        setLayerGradientAccumulation(trainer->layers[i], 0); // 恢复默认, 不影响在同一组层上的其他训练方式
+    }
+    if (ret != SUCCESS) { // 唤醒等待本段的其他段
+        pthread_mutex_lock(&(trainer->mtx));
+        trainer->failed = 1;
+        pthread_cond_broadcast(&(trainer->cond));
+        pthread_mutex_unlock(&(trainer->mtx));
+    }
+    return ret;
+}
+
+static void *runStageThread(void *arg)
+{
+    struct PipelineStage *stage = arg;
+    struct PipelineTrainer *trainer = stage->trainer;
+
+    setParallelForInline(1); // 每段已经独占一个线程, 段内算子不再分发给线程池
+
+    // 等到所有段线程都创建成功; 创建失败时stop置位, 已启动的线程直接退出
+    pthread_mutex_lock(&(trainer->mtx));
+    while (!trainer->launched && !trainer->stop) {
+        pthread_cond_wait(&(trainer->cond), &(trainer->mtx));
+    }
+    int quit = trainer->stop;
+    pthread_mutex_unlock(&(trainer->mtx));
+    if (quit) {
+        return NULL;
+    }
+
+    while (1) {
+        pthread_barrier_wait(&(trainer->barrier));
+        if (trainer->stop) {
+            break;
+        }
+        trainer->status[stage->idx] = runStage(trainer, stage);
+        pthread_barrier_wait(&(trainer->barrier));
+    }
+    return NULL;
+}
+
+int createPipelineTrainer(struct PipelineTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost,
+    int n_stages, int n_micro_batches, int pin)
+{
+    CHK_NIL(trainer);
+    CHK_NIL(layers);
+    CHK_ERR((n_layers > 0)? 0: 1);
+    CHK_NIL(cost);
+    CHK_ERR((n_stages > 0 && n_stages <= n_layers)? 0: 1);
+    CHK_ERR((n_micro_batches > 0)? 0: 1);
+
+    struct PipelineTrainer *res = calloc(1, sizeof(struct PipelineTrainer));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    res->n_layers = n_layers;
+    res->layers = layers;
+    res->cost = cost;
+    res->n_stages = n_stages;
+    res->n_micro_batches = n_micro_batches;
+    res->probe_last.sw_ce_cost = 1;
+    pthread_mutex_init(&(res->mtx), NULL);
+    pthread_cond_init(&(res->cond), NULL);
+    CHK_ERR_GOTO(getCostInputNumber(&(res->n_classes), cost));
+
+    // 与createNetwork相同: 根据前一层神经元个数设置激活层神经元个数, 并检查相邻层是否匹配
+    int i;
+    for (i = 1; i < n_layers; ++i) {
+        int n_bottom = 0;
+        int n_top = 0;
+        CHK_ERR_GOTO(getLayerOutputNumber(&n_bottom, layers[i - 1]));
+        CHK_ERR_GOTO(setLayerNeuronNumber(layers[i], n_bottom));
+        CHK_ERR_GOTO(getLayerInputNumber(&n_top, layers[i]));
+        if (n_bottom != n_top) {
+            ERR_MSG("layer[%d] n_out = %d, layer[%d] n_input = %d, size not match, error.\n", i - 1, n_bottom, i, n_top);
+            goto err_end;
+        }
+    }
+
+    CHK_NIL_GOTO((res->stages = calloc(n_stages, sizeof(struct PipelineStage))));
+    CHK_NIL_GOTO((res->fwd_done = calloc(n_stages, sizeof(int))));
+    CHK_NIL_GOTO((res->bwd_done = calloc(n_stages, sizeof(int))));
+    CHK_NIL_GOTO((res->status = calloc(n_stages, sizeof(int))));
+    CHK_NIL_GOTO((res->outputs = calloc(n_micro_batches, sizeof(struct Tensor **))));
+    CHK_NIL_GOTO((res->deltas = calloc(n_micro_batches, sizeof(struct Tensor **))));
+    CHK_NIL_GOTO((res->inputs = calloc(n_micro_batches, sizeof(struct Tensor *))));
+    CHK_NIL_GOTO((res->gts = calloc(n_micro_batches, sizeof(struct Tensor *))));
+    CHK_NIL_GOTO((res->starts = calloc(n_micro_batches, sizeof(int))));
+    CHK_NIL_GOTO((res->counts = calloc(n_micro_batches, sizeof(int))));
+    CHK_ERR_GOTO(partitionLayers(res));
+
+    // 所有段都在独立线程上运行, 调用线程只负责分发和参数更新, 绑核不影响调用线程
+    CHK_ERR_GOTO(pthread_barrier_init(&(res->barrier), NULL, n_stages + 1));
+    res->barrier_inited = 1;
+    int s;
+    for (s = 0; s < n_stages; ++s) {
+        res->stages[s].idx = s;
+        res->stages[s].trainer = res;
+        CHK_ERR_GOTO(pthread_create(&(res->stages[s].tid), NULL, runStageThread, &(res->stages[s])));
+        ++(res->n_started);
+        if (pin) {
+            bindThreadToCpus(res->stages[s].tid, s, n_stages);
+        }
+    }
+    pthread_mutex_lock(&(res->mtx));
+    res->launched = 1;
+    pthread_cond_broadcast(&(res->cond));
+    pthread_mutex_unlock(&(res->mtx));
+
+    *trainer = res;
+    return SUCCESS;
+
+err_end:
+    if (!res->launched && res->n_started > 0) { // 屏障无法凑齐, 通知已启动的线程退出并等待
+        pthread_mutex_lock(&(res->mtx));
+        res->stop = 1;
+        pthread_cond_broadcast(&(res->cond));
+        pthread_mutex_unlock(&(res->mtx));
+        for (s = 0; s < res->n_started; ++s) {
+            pthread_join(res->stages[s].tid, NULL);
+        }
+        res->n_started = 0;
+    }
+    destroyPipelineTrainer(res);
+    return ERR_COD;
+}
+
+void destroyPipelineTrainer(struct PipelineTrainer *trainer)
+{
+    if (trainer == NULL) {
+        return;
+    }
+
+    int s;
+    if (trainer->n_started > 0) {
+        trainer->stop = 1;
+        pthread_barrier_wait(&(trainer->barrier));
+        for (s = 0; s < trainer->n_started; ++s) {
+            pthread_join(trainer->stages[s].tid, NULL);
+        }
+    }
+    if (trainer->barrier_inited) {
+        pthread_barrier_destroy(&(trainer->barrier));
+    }
+    freeMicroBatchCache(trainer);
+    pthread_mutex_destroy(&(trainer->mtx));
+    pthread_cond_destroy(&(trainer->cond));
+
+    free(trainer->probe_last.p_class);
+    free(trainer->outputs);
+    free(trainer->deltas);
+    free(trainer->inputs);
+    free(trainer->gts);
+    free(trainer->starts);
+    free(trainer->counts);
+    free(trainer->fwd_done);
+    free(trainer->bwd_done);
+    free(trainer->status);
+    free(trainer->stages);
+    free(trainer);
+}
+
+int getPipelineTrainerStage(int *first, int *last, int stage, const struct PipelineTrainer *trainer)
+{
+    CHK_NIL(first);
+    CHK_NIL(last);
+    CHK_NIL(trainer);
+    CHK_ERR((stage >= 0 && stage < trainer->n_stages)? 0: 1);
+
+    *first = trainer->stages[stage].first;
+    *last = trainer->stages[stage].last;
+    return SUCCESS;
+}
+
+int trainPipelineBatch(struct PipelineTrainer *trainer,
+    const void *input_data, int n_features, const char *dtype_str,
+    const void *gt_data, int n_gt_features, const char *gt_dtype_str,
+    int n_samples, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(trainer);
+    CHK_NIL(input_data);
+    CHK_NIL(gt_data);
+    CHK_NIL(dtype_str);
+    CHK_NIL(gt_dtype_str);
+    CHK_NIL(probe);
+    CHK_ERR(checkUpdateArgs(args));
+    CHK_ERR((n_samples > 0 && n_samples <= args->batch_size)? 0: 1);
+
+    enum DType dtype = getTensorDtypeEnumFromStr(dtype_str);
+    enum DType gt_dtype = getTensorDtypeEnumFromStr(gt_dtype_str);
+    int n_gt_needed;
+    enum DType gt_dtype_needed;
+    CHK_ERR(getCostGroundTruthAttributes(&n_gt_needed, &gt_dtype_needed, trainer->cost));
+    CHK_ERR((gt_dtype == gt_dtype_needed && n_gt_features == n_gt_needed)? 0: 1);
+    int in_size, gt_size;
+    CHK_ERR(getTensorDtypeSize(&in_size, dtype));
+    CHK_ERR(getTensorDtypeSize(&gt_size, gt_dtype));
+
+    // 每个micro-batch的缓冲区按ceil(batch_size / n_micro_batches)分配
+    int cap = (args->batch_size + trainer->n_micro_batches - 1) / trainer->n_micro_batches;
+    if (trainer->cap < cap) {
+        freeMicroBatchCache(trainer);
+        CHK_ERR(allocMicroBatchCache(trainer, cap));
+    }
+    if (probe->sw_p_class && trainer->p_class_cap < trainer->cap) {
+        free(trainer->probe_last.p_class);
+        CHK_NIL((trainer->probe_last.p_class = calloc((size_t)trainer->cap * trainer->n_classes, sizeof(float))));
+        trainer->p_class_cap = trainer->cap;
+    }
+    trainer->probe_last.sw_p_class = probe->sw_p_class;
+
+    int n_micro = (n_samples < trainer->n_micro_batches)? n_samples: trainer->n_micro_batches;
+    int base = n_samples / n_micro;
+    int rem = n_samples % n_micro;
+    int start = 0;
+    int m, s;
+    for (m = 0; m < n_micro; ++m) {
+        trainer->starts[m] = start;
+        trainer->counts[m] = base + ((m < rem)? 1: 0);
+        start += trainer->counts[m];
+    }
+    for (s = 0; s < trainer->n_stages; ++s) {
+        trainer->fwd_done[s] = 0;
+        trainer->bwd_done[s] = 0;
+    }
+    trainer->failed = 0;
+    trainer->n_micro = n_micro;
+    trainer->input = input_data;
+    trainer->gt = gt_data;
+    trainer->n_features = n_features;
+    trainer->n_gt_features = n_gt_features;
+    trainer->dtype = dtype;
+    trainer->gt_dtype = gt_dtype;
+    trainer->in_row_bytes = (size_t)n_features * in_size;
+    trainer->gt_row_bytes = (size_t)n_gt_features * gt_size;
+    trainer->n_samples = n_samples;
+    trainer->args = args;
+    trainer->probe = probe;
+    trainer->ce = 0.;
+
+    pthread_barrier_wait(&(trainer->barrier)); // 开始
+    pthread_barrier_wait(&(trainer->barrier)); // 所有段完成
+    for (s = 0; s < trainer->n_stages; ++s) {
+        CHK_ERR(trainer->status[s]);
+    }
+    if (probe->sw_ce_cost) {
+        probe->ce_cost = trainer->ce / n_samples;
+    }
+
+    int i;
+    for (i = trainer->n_layers - 1; i >= 0; --i) {
+        CHK_ERR(updateLayer(trainer->layers[i], args, probe));
+    }
+    return SUCCESS;
+}
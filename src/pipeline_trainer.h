@@ -0,0 +1,32 @@
+/**
+ * @brief 流水线并行训练: 网络按层切分为n_stages段连续的层(按计算量均衡), 每段由一个常驻线程负责,
+ *        每个batch切分为n_micro_batches个micro-batch, 按1F1B调度在各段之间流动:
+ *        第s段先做n_stages - 1 - s次正向传播预热, 之后交替执行一次正向和一次反向, 最后排空剩余的反向.
+ *        各micro-batch的梯度在层内累加, 全部micro-batch完成后在调用线程上执行一次参数更新,
+ *        结果与单线程训练一致(仅浮点加法结合顺序不同).
+ *
+ *        各段直接在用户传入的层上运行(每层只由所属段的线程访问), 每个micro-batch有独立的输出/灵敏度缓冲区.
+ *        pin非0时第s段线程按affinity.h的配置绑定到第s组CPU(未配置时为compact).
+ */
+#pragma once
+
+#include "layer.h"
+#include "cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+struct PipelineTrainer;
+
+int createPipelineTrainer(struct PipelineTrainer **trainer, struct Layer **layers, int n_layers, struct Cost *cost,
+    int n_stages, int n_micro_batches, int pin);
+void destroyPipelineTrainer(struct PipelineTrainer *trainer);
+
+int trainPipelineBatch(struct PipelineTrainer *trainer,
+    const void *input_data, int n_features, const char *dtype_str,
+    const void *gt_data, int n_gt_features, const char *gt_dtype_str,
+    int n_samples, const struct UpdateArgs *args, struct Probe *probe);
+
+/**
+ * @brief 第stage段负责的层下标区间[first, last]
+ */
+int getPipelineTrainerStage(int *first, int *last, int stage, const struct PipelineTrainer *trainer);
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "debug_macros.h"
+#include "thread_pool.h"
+#include "rng.h"
+
+// Philox4x32-10的常数, 见Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC'11
+#define PHILOX_M0 (0xD2511F53U)
+#define PHILOX_M1 (0xCD9E8D57U)
+#define PHILOX_W0 (0x9E3779B9U)
+#define PHILOX_W1 (0xBB67AE85U)
+#define PHILOX_ROUNDS (10)
+
+// 一组同时计算的计数器个数, 各轮运算按组内下标写成独立的循环, 便于编译器向量化
+#define RNG_LANES (8)
+#define RNG_GROUP_SIZE (4 * RNG_LANES)
+// 每组的代价: 10轮, 每轮2次64位乘法和若干异或
+#define RNG_COST_GROUP (RNG_LANES * PHILOX_ROUNDS * 8)
+
+#define RNG_INV_2_24 (1.0f / 16777216.0f)
+#define RNG_TWO_PI (6.28318530717958647692f)
+
+struct RandomStream
+{
+    uint64_t seed;
+    uint64_t stream_id;
+    uint64_t offset; // 已用掉的计数器(每个4个32位随机数)个数
+};
+
+static struct RandomStream g_default_stream = {0, 0, 0};
+
+enum RandomKind
+{
+    RANDOM_UINT32,
+    RANDOM_UNIFORM,
+    RANDOM_NORMAL,
+    RANDOM_BERNOULLI
+};
+
+struct FillArgs
+{
+    uint32_t key[2];
+    uint32_t stream[2];
+    uint64_t base; // 本次fill的第一个计数器
+    long n;
+    void *dst;
+    enum RandomKind kind;
+    float a;
+    float b;
+};
+
+// 计数器(base + l, stream_id)在key下的输出, out[j][l]是第base + l个计数器的第j个32位数
+static void philoxGroup(uint32_t out[4][RNG_LANES], const struct FillArgs *args, uint64_t base)
+{
+    uint32_t c0[RNG_LANES], c1[RNG_LANES], c2[RNG_LANES], c3[RNG_LANES];
+    int l, r;
+    for (l = 0; l < RNG_LANES; ++l) {
+        uint64_t ctr = base + l;
+        c0[l] = (uint32_t)ctr;
+        c1[l] = (uint32_t)(ctr >> 32);
+        c2[l] = args->stream[0];
+        c3[l] = args->stream[1];
+    }
+
+    uint32_t k0 = args->key[0];
+    uint32_t k1 = args->key[1];
+    for (r = 0; r < PHILOX_ROUNDS; ++r) {
+        for (l = 0; l < RNG_LANES; ++l) {
+            uint64_t p0 = (uint64_t)PHILOX_M0 * c0[l];
+            uint64_t p1 = (uint64_t)PHILOX_M1 * c2[l];
+            uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+            uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+            c1[l] = (uint32_t)p1;
+            c3[l] = (uint32_t)p0;
+            c0[l] = n0;
+            c2[l] = n2;
+        }
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    for (l = 0; l < RNG_LANES; ++l) {
+        out[0][l] = c0[l];
+        out[1][l] = c1[l];
+        out[2][l] = c2[l];
+        out[3][l] = c3[l];
+    }
+}
+
+// 把一组随机数按种类转换后写到dst[start, start + RNG_GROUP_SIZE)中不超过n的部分
+static void storeGroup(const struct FillArgs *args, uint32_t out[4][RNG_LANES], long start)
+{
+    int l, j;
+    for (l = 0; l < RNG_LANES; ++l) {
+        for (j = 0; j < 4; j += 2) {
+            long i = start + 4 * l + j;
+            if (i >= args->n) {
+                return;
+            }
+            uint32_t x0 = out[j][l];
+            uint32_t x1 = out[j + 1][l];
+            float v0, v1;
+            switch (args->kind) {
+            case RANDOM_UINT32:
+                ((uint32_t *)args->dst)[i] = x0;
+                if (i + 1 < args->n) {
+                    ((uint32_t *)args->dst)[i + 1] = x1;
+                }
+                continue;
+            case RANDOM_UNIFORM:
+                v0 = args->a + (x0 >> 8) * RNG_INV_2_24 * args->b;
+                v1 = args->a + (x1 >> 8) * RNG_INV_2_24 * args->b;
+                break;
+            case RANDOM_NORMAL: {
+                float u0 = ((x0 >> 8) + 1) * RNG_INV_2_24; // (0, 1], 避免log(0)
+                float u1 = (x1 >> 8) * RNG_INV_2_24;
+                float radius = sqrtf(-2.f * logf(u0)) * args->b;
+                v0 = args->a + radius * cosf(RNG_TWO_PI * u1);
+                v1 = args->a + radius * sinf(RNG_TWO_PI * u1);
+                break;
+            }
+            case RANDOM_BERNOULLI:
+                ((unsigned char *)args->dst)[i] = ((x0 >> 8) * RNG_INV_2_24 < args->a)? 1: 0;
+                if (i + 1 < args->n) {
+                    ((unsigned char *)args->dst)[i + 1] = ((x1 >> 8) * RNG_INV_2_24 < args->a)? 1: 0;
+                }
+                continue;
+            default:
+                return;
+            }
+            ((float *)args->dst)[i] = v0;
+            if (i + 1 < args->n) {
+                ((float *)args->dst)[i + 1] = v1;
+            }
+        }
+    }
+}
+
+static void fillRange(void *arg, int lo, int hi)
+{
+    const struct FillArgs *args = arg;
+    uint32_t out[4][RNG_LANES];
+    int g;
+    for (g = lo; g < hi; ++g) {
+        philoxGroup(out, args, args->base + (uint64_t)g * RNG_LANES);
+        storeGroup(args, out, (long)g * RNG_GROUP_SIZE);
+    }
+}
+
+static int fillRandom(struct RandomStream *rs, void *dst, long n, enum RandomKind kind, float a, float b)
+{
+    CHK_NIL(dst);
+    CHK_ERR((n >= 0)? 0: 1);
+    if (rs == NULL) {
+        rs = &g_default_stream;
+    }
+    if (n == 0) {
+        return SUCCESS;
+    }
+
+    long n_groups = (n + RNG_GROUP_SIZE - 1) / RNG_GROUP_SIZE;
+    if (n_groups > 0x7fffffffL) {
+        ERR_MSG("too many random numbers: %ld, error.\n", n);
+        return ERR_COD;
+    }
+
+    struct FillArgs args;
+    args.key[0] = (uint32_t)rs->seed;
+    args.key[1] = (uint32_t)(rs->seed >> 32);
+    args.stream[0] = (uint32_t)rs->stream_id;
+    args.stream[1] = (uint32_t)(rs->stream_id >> 32);
+    // 用掉的计数器按4个随机数一个向上取整, 组内多算的部分不写出, 也不占用流的位置
+    args.base = __atomic_fetch_add(&(rs->offset), (uint64_t)((n + 3) / 4), __ATOMIC_RELAXED);
+    args.n = n;
+    args.dst = dst;
+    args.kind = kind;
+    args.a = a;
+    args.b = b;
+    CHK_ERR(parallelFor(NULL, 0, (int)n_groups, RNG_COST_GROUP, fillRange, &args));
+    return SUCCESS;
+}
+
+int createRandomStream(struct RandomStream **rs, uint64_t seed, uint64_t stream_id)
+{
+    CHK_NIL(rs);
+
+    struct RandomStream *stream = calloc(1, sizeof(struct RandomStream));
+    CHK_NIL(stream);
+    stream->seed = seed;
+    stream->stream_id = stream_id;
+    stream->offset = 0;
+    *rs = stream;
+    return SUCCESS;
+}
+
+void destroyRandomStream(struct RandomStream *rs)
+{
+    free(rs);
+}
+
+int setRandomSeed(uint64_t seed)
+{
+    __atomic_store_n(&(g_default_stream.seed), seed, __ATOMIC_RELAXED);
+    __atomic_store_n(&(g_default_stream.offset), 0, __ATOMIC_RELAXED);
+    return SUCCESS;
+}
+
+int fillRandomUint32(struct RandomStream *rs, uint32_t *dst, long n)
+{
+    return fillRandom(rs, dst, n, RANDOM_UINT32, 0.f, 0.f);
+}
+
+int fillRandomUniform(struct RandomStream *rs, float *dst, long n, float min, float max)
+{
+    if (max < min) {
+        float swap = min;
+        min = max;
+        max = swap;
+    }
+    return fillRandom(rs, dst, n, RANDOM_UNIFORM, min, max - min);
+}
+
+int fillRandomNormal(struct RandomStream *rs, float *dst, long n, float mean, float std)
+{
+    CHK_ERR((std >= 0)? 0: 1);
+    return fillRandom(rs, dst, n, RANDOM_NORMAL, mean, std);
+}
+
+int fillRandomBernoulli(struct RandomStream *rs, unsigned char *dst, long n, float p)
+{
+    CHK_ERR((p >= 0 && p <= 1)? 0: 1);
+    return fillRandom(rs, dst, n, RANDOM_BERNOULLI, p, 0.f);
+}
+
+int fillRandomPermutation(struct RandomStream *rs, int *perm, int n)
+{
+    CHK_NIL(perm);
+    CHK_ERR((n > 0)? 0: 1);
+
+    uint32_t *r = malloc((size_t)n * sizeof(uint32_t));
+    CHK_NIL(r);
+    if (fillRandomUint32(rs, r, n) != SUCCESS) {
+        free(r);
+        return ERR_COD;
+    }
+    int i;
+    for (i = 0; i < n; ++i) {
+        perm[i] = i;
+    }
+    // j = r * (i + 1) / 2^32, 取值在[0, i]内, 偏差不超过(i + 1) / 2^32
+    for (i = n - 1; i > 0; --i) {
+        int j = (int)(((uint64_t)r[i] * (uint64_t)(i + 1)) >> 32);
+        int tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+    free(r);
+    return SUCCESS;
+}
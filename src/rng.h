@@ -0,0 +1,39 @@
+/**
+ * @brief 基于计数器的随机数发生器(Philox4x32-10).
+ *        每个随机数流由(seed, stream_id)确定, 第i个32位随机数只取决于(seed, stream_id, i),
+ *        因此按任意方式切分给线程池并行生成, 结果与线程数无关.
+ *        每次fill从流的当前位置开始, 用掉的随机数按4个一组向上取整, 流的位置随之前进.
+ *
+ *        stream参数为NULL时使用进程内的默认流, 默认流由setRandomSeed重置, 未设置时seed为0.
+ *        可以在多个线程中同时对同一个流调用fill, 每次调用取得不重叠的区间, 但区间的先后顺序不确定.
+ */
+#pragma once
+
+#include <stdint.h>
+
+struct RandomStream;
+
+int createRandomStream(struct RandomStream **rs, uint64_t seed, uint64_t stream_id);
+void destroyRandomStream(struct RandomStream *rs);
+
+/**
+ * @brief 重置默认流: 使用新的seed, 从位置0开始
+ */
+int setRandomSeed(uint64_t seed);
+
+int fillRandomUint32(struct RandomStream *rs, uint32_t *dst, long n);
+
+// [min, max)上的均匀分布
+int fillRandomUniform(struct RandomStream *rs, float *dst, long n, float min, float max);
+
+// 正态分布, Box-Muller变换
+int fillRandomNormal(struct RandomStream *rs, float *dst, long n, float mean, float std);
+
+// 以概率p取1, 否则取0
+int fillRandomBernoulli(struct RandomStream *rs, unsigned char *dst, long n, float p);
+
+/**
+ * @brief 生成[0, n)的随机排列(Fisher-Yates), 用掉流中n个32位随机数, 同一个流的同一位置得到同一个排列.
+ *        按epoch打乱数据集时, 以(seed, epoch)为(seed, stream_id)创建流即可复现每个epoch的顺序.
+ */
+int fillRandomPermutation(struct RandomStream *rs, int *perm, int n);
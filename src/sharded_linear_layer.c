@@ -0,0 +1,677 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "debug_macros.h"
+#include "tensor.h"
+#include "gemm.h"
+#include "layer.h"
+#include "sharded_linear_layer.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "affinity.h"
+#include "thread_pool.h"
+#include "const.h"
+
+enum ShardOp
+{
+    SHARD_OP_INIT,
+    SHARD_OP_FORWARD,
+    SHARD_OP_BACKWARD,
+    SHARD_OP_UPDATE,
+    SHARD_OP_STOP
+};
+
+enum ShardCopy
+{
+    SHARD_COPY_PACK, // 分片 -> 完整布局
+    SHARD_COPY_UNPACK, // 完整布局 -> 分片
+    SHARD_COPY_MERGE // 完整布局累加到分片
+};
+
+struct LinearShard
+{
+    int idx;
+    int lo; // 负责的输出神经元(SHARD_BY_OUTPUT)或输入(SHARD_BY_INPUT)区间[lo, hi)
+    int hi;
+    pthread_t tid;
+    struct ShardedLinearLayer *layer;
+
+    // 以下内存由分片线程创建并首次写入
+    struct Tensor *w; // SHARD_BY_OUTPUT: (hi - lo) * n_in, SHARD_BY_INPUT: n_out * (hi - lo)
+    struct Tensor *b; // SHARD_BY_INPUT时只有分片0持有
+    struct Tensor *w_grad;
+    struct Tensor *b_grad;
+    float *partial; // 待归约的部分输出或部分灵敏度
+    int partial_cap; // partial可容纳的样本数
+    int status;
+};
+
+struct ShardedLinearLayer
+{
+    // 基类，接口类
+    struct Layer base;
+
+    int n_in;
+    int n_out;
+    int n_shards;
+    enum ShardMode mode;
+    int pin;
+    int acc_grad; // b_grad累加而不是覆盖, 用于micro-batch梯度累积(w_grad总是累加)
+
+    struct LinearShard *shards;
+    int n_started;
+    // 所有分片线程都已创建之前, 分片线程在start_mtx/start_cond上等待, 不进入屏障; 创建失败时置abort
+    pthread_mutex_t start_mtx;
+    pthread_cond_t start_cond;
+    int launched;
+    int abort;
+    int n_barriers; // 已初始化的屏障个数, 按shard_barrier, barrier的顺序
+    pthread_barrier_t barrier; // 所有分片线程和调用线程, 标记一次操作的开始和结束
+    pthread_barrier_t shard_barrier; // 只有分片线程, 分隔计算和归约
+
+    // 当前操作的参数, 由调用线程在开始屏障前写入
+    enum ShardOp op;
+    int n_samples;
+    const struct UpdateArgs *args;
+    const float *init_w; // 初始化时的完整参数
+    const float *init_b;
+};
+
+static void getChunk(int *lo, int *hi, int n, int k, int n_chunks)
+{
+    int size = (n + n_chunks - 1) / n_chunks;
+    *lo = size * k;
+    *hi = *lo + size;
+    if (*lo > n) *lo = n;
+    if (*hi > n) *hi = n;
+}
+
+static float *getBlob(struct Tensor *t)
+{
+    void *blob = NULL;
+    if (t == NULL || getTensorBlob(&blob, t) != SUCCESS) {
+        return NULL;
+    }
+    return blob;
+}
+
+// 分片线程创建自己的参数和梯度, 并从完整参数中拷贝初值(首次写入, 内存分配在本线程所在节点)
+static int initShard(struct ShardedLinearLayer *layer, struct LinearShard *shard)
+{
+    int n_in = layer->n_in;
+    int n_out = layer->n_out;
+    int nk = shard->hi - shard->lo;
+    int r;
+
+    if (layer->mode == SHARD_BY_OUTPUT) {
+        CHK_ERR(createTensorParam(&(shard->w), FLOAT32, nk, n_in));
+        CHK_ERR(createTensorParam(&(shard->w_grad), FLOAT32, nk, n_in));
+        CHK_ERR(createTensorParam(&(shard->b), FLOAT32, 1, nk));
+        CHK_ERR(createTensorParam(&(shard->b_grad), FLOAT32, 1, nk));
+        memcpy(getBlob(shard->w), layer->init_w + (size_t)shard->lo * n_in, (size_t)nk * n_in * sizeof(float));
+        memcpy(getBlob(shard->b), layer->init_b + shard->lo, nk * sizeof(float));
+        memset(getBlob(shard->w_grad), 0, (size_t)nk * n_in * sizeof(float));
+        memset(getBlob(shard->b_grad), 0, nk * sizeof(float));
+    }
+    else {
+        CHK_ERR(createTensorParam(&(shard->w), FLOAT32, n_out, nk));
+        CHK_ERR(createTensorParam(&(shard->w_grad), FLOAT32, n_out, nk));
+        float *w = getBlob(shard->w);
+        for (r = 0; r < n_out; ++r) {
+            memcpy(w + (size_t)r * nk, layer->init_w + (size_t)r * n_in + shard->lo, nk * sizeof(float));
+        }
+        memset(getBlob(shard->w_grad), 0, (size_t)n_out * nk * sizeof(float));
+        if (shard->idx == 0) {
+            CHK_ERR(createTensorParam(&(shard->b), FLOAT32, 1, n_out));
+            CHK_ERR(createTensorParam(&(shard->b_grad), FLOAT32, 1, n_out));
+            memcpy(getBlob(shard->b), layer->init_b, n_out * sizeof(float));
+            memset(getBlob(shard->b_grad), 0, n_out * sizeof(float));
+        }
+    }
+    return SUCCESS;
+}
+
+static int reservePartial(struct LinearShard *shard, int n_samples, int n_features)
+{
+    if (shard->partial_cap < n_samples) {
+        free(shard->partial);
+        shard->partial_cap = 0;
+        CHK_NIL((shard->partial = calloc((size_t)n_samples * n_features, sizeof(float))));
+        shard->partial_cap = n_samples;
+    }
+    return SUCCESS;
+}
+
+// 所有分片的partial按列区间[lo, hi)求和, 写入dst, bias不为NULL时加上偏置
+static void reducePartials(struct ShardedLinearLayer *layer, float *dst, const float *bias, int n, int lo, int hi)
+{
+    int i, j, k;
+    for (i = 0; i < layer->n_samples; ++i) {
+        float *d = dst + (size_t)i * n;
+        for (j = lo; j < hi; ++j) {
+            d[j] = (bias)? bias[j]: 0.;
+        }
+        for (k = 0; k < layer->n_shards; ++k) {
+            const float *p = layer->shards[k].partial + (size_t)i * n;
+            for (j = lo; j < hi; ++j) {
+                d[j] += p[j];
+            }
+        }
+    }
+}
+
+// 其他分片第一阶段失败时partial不可用, 跳过归约
+static int checkShards(struct ShardedLinearLayer *layer)
+{
+    int k;
+    for (k = 0; k < layer->n_shards; ++k) {
+        if (layer->shards[k].status != SUCCESS) {
+            return ERR_COD;
+        }
+    }
+    return SUCCESS;
+}
+
+static int forwardShard(struct ShardedLinearLayer *layer, struct LinearShard *shard)
+{
+    int n_in = layer->n_in;
+    int n_out = layer->n_out;
+    int n = layer->n_samples;
+    int nk = shard->hi - shard->lo;
+    float *x = getBlob(((struct Layer *)layer)->input);
+    float *y = getBlob(((struct Layer *)layer)->output);
+    float *w = getBlob(shard->w);
+    int i, lo, hi;
+
+    if (layer->mode == SHARD_BY_OUTPUT) { // 直接写输出的[lo, hi)列
+        const float *b = getBlob(shard->b);
+        for (i = 0; i < n; ++i) {
+            memcpy(y + (size_t)i * n_out + shard->lo, b, nk * sizeof(float));
+        }
+        gemm(0, 1, n, nk, n_in, 1.,
+            x, n_in,
+            w, n_in,
+            1.,
+            y + shard->lo, n_out);
+        return SUCCESS;
+    }
+
+    shard->status = reservePartial(shard, n, n_out);
+    if (shard->status == SUCCESS) {
+        gemm(0, 1, n, n_out, nk, 1.,
+            x + shard->lo, n_in,
+            w, nk,
+            0.,
+            shard->partial, n_out);
+    }
+    pthread_barrier_wait(&(layer->shard_barrier));
+    CHK_ERR(checkShards(layer));
+    getChunk(&lo, &hi, n_out, shard->idx, layer->n_shards);
+    reducePartials(layer, y, getBlob(layer->shards[0].b), n_out, lo, hi);
+    return SUCCESS;
+}
+
+static void biasGradient(float *b_grad, const float *delta, int n, int ld, int lo, int hi, int acc)
+{
+    int i, j;
+    if (!acc) {
+        memset(b_grad, 0, (hi - lo) * sizeof(float));
+    }
+    for (i = 0; i < n; ++i) {
+        for (j = lo; j < hi; ++j) {
+            b_grad[j - lo] += delta[(size_t)i * ld + j];
+        }
+    }
+}
+
+static int backwardShard(struct ShardedLinearLayer *layer, struct LinearShard *shard)
+{
+    int n_in = layer->n_in;
+    int n_out = layer->n_out;
+    int n = layer->n_samples;
+    int nk = shard->hi - shard->lo;
+    float *x = getBlob(((struct Layer *)layer)->input);
+    float *d_in = getBlob(((struct Layer *)layer)->delta_in);
+    float *d_out = getBlob(((struct Layer *)layer)->delta_out); // 反向传播到达layer[0]时为NULL
+    float *w = getBlob(shard->w);
+    float *w_grad = getBlob(shard->w_grad);
+    int lo, hi;
+
+    if (layer->mode == SHARD_BY_INPUT) { // 直接写灵敏度的[lo, hi)列
+        if (d_out) {
+            gemm(0, 0, n, nk, n_out, 1.,
+                d_in, n_out,
+                w, nk,
+                0.,
+                d_out + shard->lo, n_in);
+        }
+        gemm(1, 0, n_out, nk, n, 1.,
+            d_in, n_out,
+            x + shard->lo, n_in,
+            1.,
+            w_grad, nk);
+        if (shard->idx == 0) {
+            biasGradient(getBlob(shard->b_grad), d_in, n, n_out, 0, n_out, layer->acc_grad);
+        }
+        return SUCCESS;
+    }
+
+    if (d_out) {
+        shard->status = reservePartial(shard, n, n_in);
+        if (shard->status == SUCCESS) {
+            gemm(0, 0, n, n_in, nk, 1.,
+                d_in + shard->lo, n_out,
+                w, n_in,
+                0.,
+                shard->partial, n_in);
+        }
+    }
+    gemm(1, 0, nk, n_in, n, 1.,
+        d_in + shard->lo, n_out,
+        x, n_in,
+        1.,
+        w_grad, n_in);
+    biasGradient(getBlob(shard->b_grad), d_in, n, n_out, shard->lo, shard->hi, layer->acc_grad);
+
+    if (d_out) { // 所有分片的d_out是否为NULL一致, 屏障次数一致
+        pthread_barrier_wait(&(layer->shard_barrier));
+        CHK_ERR(checkShards(layer));
+        getChunk(&lo, &hi, n_in, shard->idx, layer->n_shards);
+        reducePartials(layer, d_out, NULL, n_in, lo, hi);
+    }
+    return SUCCESS;
+}
+
+static int updateShard(struct ShardedLinearLayer *layer, struct LinearShard *shard)
+{
+    // 注意：这里的lr应该是已经除以了batch_size后的lr
+    CHK_ERR(addTensor(shard->w, shard->w_grad, 1. * (layer->args->lr), layer->args->momentum));
+    if (shard->b) {
+        CHK_ERR(addTensor(shard->b, shard->b_grad, 1. * (layer->args->lr), layer->args->momentum));
+    }
+    return SUCCESS;
+}
+
+static void *runShardThread(void *arg)
+{
+    struct LinearShard *shard = arg;
+    struct ShardedLinearLayer *layer = shard->layer;
+
+    if (layer->pin) { // 在分配分片内存之前绑定
+        bindThreadToCpus(pthread_self(), shard->idx, layer->n_shards);
+    }
+    setParallelForInline(1); // 分片的计算和首次写入都留在本线程
+
+    pthread_mutex_lock(&(layer->start_mtx));
+    while (!layer->launched && !layer->abort) {
+        pthread_cond_wait(&(layer->start_cond), &(layer->start_mtx));
+    }
+    int quit = layer->abort;
+    pthread_mutex_unlock(&(layer->start_mtx));
+    if (quit) {
+        return NULL;
+    }
+
+    while (1) {
+        pthread_barrier_wait(&(layer->barrier));
+        if (layer->op == SHARD_OP_STOP) {
+            break;
+        }
+        int ret = SUCCESS;
+        shard->status = SUCCESS;
+        switch (layer->op) {
+            case SHARD_OP_INIT: ret = initShard(layer, shard); break;
+            case SHARD_OP_FORWARD: ret = forwardShard(layer, shard); break;
+            case SHARD_OP_BACKWARD: ret = backwardShard(layer, shard); break;
+            case SHARD_OP_UPDATE: ret = updateShard(layer, shard); break;
+            default: ret = ERR_COD; break;
+        }
+        if (shard->status == SUCCESS) {
+            shard->status = ret;
+        }
+        pthread_barrier_wait(&(layer->barrier));
+    }
+    return NULL;
+}
+
+static int runShardOp(struct ShardedLinearLayer *layer, enum ShardOp op)
+{
+    layer->op = op;
+    pthread_barrier_wait(&(layer->barrier)); // 开始
+    pthread_barrier_wait(&(layer->barrier)); // 所有分片完成
+    CHK_ERR(checkShards(layer));
+    return SUCCESS;
+}
+
+int createShardedLinearLayer(struct ShardedLinearLayer **l, const char *name, int n_in, int n_out,
+    int n_shards, enum ShardMode mode, int pin)
+{
+    CHK_NIL(l);
+    CHK_ERR((n_in > 0)? 0: 1);
+    CHK_ERR((n_out > 0)? 0: 1);
+    CHK_ERR((mode == SHARD_BY_OUTPUT || mode == SHARD_BY_INPUT)? 0: 1);
+    CHK_ERR((n_shards > 0 && n_shards <= ((mode == SHARD_BY_OUTPUT)? n_out: n_in))? 0: 1);
+
+    struct Tensor *w = NULL;
+    struct Tensor *b = NULL;
+    struct ShardedLinearLayer *layer = calloc(1, sizeof(struct ShardedLinearLayer));
+    if (layer == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    ((struct Layer *)layer)->type = SHARDED_LINEAR_LAYER_TYPE;
+    if (name) {
+        snprintf(((struct Layer *)layer)->name, NN_LAYER_NAME_LEN, "%s", name);
+    }
+    layer->n_in = n_in;
+    layer->n_out = n_out;
+    layer->n_shards = n_shards;
+    layer->mode = mode;
+    layer->pin = pin;
+    pthread_mutex_init(&(layer->start_mtx), NULL);
+    pthread_cond_init(&(layer->start_cond), NULL);
+
+    // 与createLinearLayer相同的初始化, 相同随机数种子下得到相同的初始参数
+    CHK_ERR_GOTO(createTensorParam(&w, FLOAT32, n_out, n_in));
+    CHK_ERR_GOTO(initTensorParameterAsWeight(w));
+    CHK_ERR_GOTO(createTensorParam(&b, FLOAT32, 1, n_out));
+    CHK_ERR_GOTO(initTensorParameterAsBias(b));
+    layer->init_w = getBlob(w);
+    layer->init_b = getBlob(b);
+
+    CHK_NIL_GOTO((layer->shards = calloc(n_shards, sizeof(struct LinearShard))));
+    CHK_ERR_GOTO(pthread_barrier_init(&(layer->shard_barrier), NULL, n_shards));
+    layer->n_barriers = 1;
+    CHK_ERR_GOTO(pthread_barrier_init(&(layer->barrier), NULL, n_shards + 1));
+    layer->n_barriers = 2;
+    int k;
+    for (k = 0; k < n_shards; ++k) {
+        struct LinearShard *shard = &(layer->shards[k]);
+        shard->idx = k;
+        shard->layer = layer;
+        getChunk(&(shard->lo), &(shard->hi), (mode == SHARD_BY_OUTPUT)? n_out: n_in, k, n_shards);
+        CHK_ERR_GOTO(pthread_create(&(shard->tid), NULL, runShardThread, shard));
+        ++(layer->n_started);
+    }
+    pthread_mutex_lock(&(layer->start_mtx));
+    layer->launched = 1;
+    pthread_cond_broadcast(&(layer->start_cond));
+    pthread_mutex_unlock(&(layer->start_mtx));
+    CHK_ERR_GOTO(runShardOp(layer, SHARD_OP_INIT));
+    layer->init_w = NULL;
+    layer->init_b = NULL;
+    destroyTensor(w);
+    destroyTensor(b);
+
+    *l = layer;
+    return SUCCESS;
+
+err_end:
+    if (!layer->launched && layer->n_started > 0) { // 屏障无法凑齐, 通知已启动的线程退出并等待
+        pthread_mutex_lock(&(layer->start_mtx));
+        layer->abort = 1;
+        pthread_cond_broadcast(&(layer->start_cond));
+        pthread_mutex_unlock(&(layer->start_mtx));
+        for (k = 0; k < layer->n_started; ++k) {
+            pthread_join(layer->shards[k].tid, NULL);
+        }
+        layer->n_started = 0;
+    }
+    destroyShardedLinearLayer(layer);
+    destroyTensor(w);
+    destroyTensor(b);
+    return ERR_COD;
+}
+
+void destroyShardedLinearLayer(struct ShardedLinearLayer *layer)
+{
+    if (layer == NULL) {
+        return;
+    }
+
+    int k;
+    if (layer->n_started > 0) {
+        layer->op = SHARD_OP_STOP;
+        pthread_barrier_wait(&(layer->barrier));
+        for (k = 0; k < layer->n_started; ++k) {
+            pthread_join(layer->shards[k].tid, NULL);
+        }
+    }
+    if (layer->n_barriers > 1) {
+        pthread_barrier_destroy(&(layer->barrier));
+    }
+    if (layer->n_barriers > 0) {
+        pthread_barrier_destroy(&(layer->shard_barrier));
+    }
+    pthread_mutex_destroy(&(layer->start_mtx));
+    pthread_cond_destroy(&(layer->start_cond));
+    if (layer->shards) {
+        for (k = 0; k < layer->n_shards; ++k) {
+            destroyTensor(layer->shards[k].w);
+            destroyTensor(layer->shards[k].b);
+            destroyTensor(layer->shards[k].w_grad);
+            destroyTensor(layer->shards[k].b_grad);
+            free(layer->shards[k].partial);
+        }
+    }
+    free(layer->shards);
+    free(layer);
+}
+
+int getShardedLinearLayerShape(int *n_in, int *n_out, const struct ShardedLinearLayer *layer)
+{
+    CHK_NIL(n_in);
+    CHK_NIL(n_out);
+    CHK_NIL(layer);
+
+    *n_in = layer->n_in;
+    *n_out = layer->n_out;
+    return SUCCESS;
+}
+
+int getShardedLinearLayerInputNumber(int *n_in, const struct ShardedLinearLayer *layer)
+{
+    CHK_NIL(n_in);
+    CHK_NIL(layer);
+    *n_in = layer->n_in;
+    return SUCCESS;
+}
+
+int getShardedLinearLayerOutputNumber(int *n_out, const struct ShardedLinearLayer *layer)
+{
+    CHK_NIL(n_out);
+    CHK_NIL(layer);
+    *n_out = layer->n_out;
+    return SUCCESS;
+}
+
+int setShardedLinearLayerGradientAccumulation(struct ShardedLinearLayer *layer, int on)
+{
+    CHK_NIL(layer);
+    layer->acc_grad = on;
+    return SUCCESS;
+}
+
+int getShardedLinearLayerParamNumber(int *n, const struct ShardedLinearLayer *layer)
+{
+    CHK_NIL(n);
+    CHK_NIL(layer);
+    *n = layer->n_out * layer->n_in + layer->n_out;
+    return SUCCESS;
+}
+
+static void copyFloats(float *shard, float *full, int n, enum ShardCopy dir)
+{
+    int i;
+    switch (dir) {
+        case SHARD_COPY_PACK:
+        memcpy(full, shard, n * sizeof(float));
+        break;
+
+        case SHARD_COPY_UNPACK:
+        memcpy(shard, full, n * sizeof(float));
+        break;
+
+        case SHARD_COPY_MERGE:
+        for (i = 0; i < n; ++i) {
+            shard[i] += full[i];
+        }
+        break;
+    }
+}
+
+// 在分片和完整布局(按w, b的顺序连续存放, 与LinearLayer相同)之间拷贝参数或梯度, 在调用线程上执行
+static void copyShards(struct ShardedLinearLayer *layer, float *full, int grad, enum ShardCopy dir)
+{
+    int n_in = layer->n_in;
+    int n_out = layer->n_out;
+    float *full_b = full + (size_t)n_out * n_in;
+    enum ShardCopy dir_b = (dir == SHARD_COPY_MERGE)? SHARD_COPY_UNPACK: dir; // 与反向传播一致, b_grad覆盖
+    int k, r;
+    for (k = 0; k < layer->n_shards; ++k) {
+        struct LinearShard *shard = &(layer->shards[k]);
+        int nk = shard->hi - shard->lo;
+        float *w = getBlob((grad)? shard->w_grad: shard->w);
+        float *b = getBlob((grad)? shard->b_grad: shard->b);
+        if (layer->mode == SHARD_BY_OUTPUT) {
+            copyFloats(w, full + (size_t)shard->lo * n_in, nk * n_in, dir);
+            copyFloats(b, full_b + shard->lo, nk, dir_b);
+        }
+        else {
+            for (r = 0; r < n_out; ++r) {
+                copyFloats(w + (size_t)r * nk, full + (size_t)r * n_in + shard->lo, nk, dir);
+            }
+            if (b) {
+                copyFloats(b, full_b, n_out, dir_b);
+            }
+        }
+    }
+}
+
+int packShardedLinearLayerParam(float *dst, const struct ShardedLinearLayer *layer)
+{
+    CHK_NIL(dst);
+    CHK_NIL(layer);
+    copyShards((struct ShardedLinearLayer *)layer, dst, 0, SHARD_COPY_PACK);
+    return SUCCESS;
+}
+
+int unpackShardedLinearLayerParam(struct ShardedLinearLayer *layer, const float *src)
+{
+    CHK_NIL(layer);
+    CHK_NIL(src);
+    copyShards(layer, (float *)src, 0, SHARD_COPY_UNPACK);
+    return SUCCESS;
+}
+
+int packShardedLinearLayerGradient(float *dst, const struct ShardedLinearLayer *layer)
+{
+    CHK_NIL(dst);
+    CHK_NIL(layer);
+    copyShards((struct ShardedLinearLayer *)layer, dst, 1, SHARD_COPY_PACK);
+    return SUCCESS;
+}
+
+int clearShardedLinearLayerGradient(struct ShardedLinearLayer *layer)
+{
+    CHK_NIL(layer);
+
+    int k, row, col;
+    for (k = 0; k < layer->n_shards; ++k) {
+        struct LinearShard *shard = &(layer->shards[k]);
+        CHK_ERR(getTensorRowAndCol(&row, &col, shard->w_grad));
+        memset(getBlob(shard->w_grad), 0, (size_t)row * col * sizeof(float));
+        if (shard->b_grad) {
+            CHK_ERR(getTensorRowAndCol(&row, &col, shard->b_grad));
+            memset(getBlob(shard->b_grad), 0, (size_t)row * col * sizeof(float));
+        }
+    }
+    return SUCCESS;
+}
+
+// 合并外部计算的梯度, 语义与反向传播一致: w_grad累加(保留动量项), b_grad覆盖
+int mergeShardedLinearLayerGradient(struct ShardedLinearLayer *layer, const float *src)
+{
+    CHK_NIL(layer);
+    CHK_NIL(src);
+    copyShards(layer, (float *)src, 1, SHARD_COPY_MERGE);
+    return SUCCESS;
+}
+
+// 检查关联的数据Tensor, 返回样本数
+static int checkShardedLinearLayerData(int *n_samples, const struct Tensor *x, int n_x, const struct Tensor *y, int n_y)
+{
+    int b, n;
+    enum DType dtype;
+    CHK_NIL(x);
+    CHK_NIL(y);
+    CHK_ERR(getTensorDType(&dtype, x));
+    CHK_ERR((dtype == FLOAT32)? 0: 1);
+    CHK_ERR(getTensorBatchAndFeatures(&b, &n, x));
+    CHK_ERR((n == n_x)? 0: 1);
+    CHK_ERR(getTensorSamples(n_samples, x));
+    CHK_ERR((*n_samples > 0)? 0: 1);
+    CHK_ERR(getTensorBatchAndFeatures(&b, &n, y));
+    CHK_ERR((n == n_y && b >= *n_samples)? 0: 1);
+    return SUCCESS;
+}
+
+/**
+ * @brief 正向传播, 由各分片线程并行计算, 输出与LinearLayer相同
+ */
+int forwardShardedLinearLayer(struct ShardedLinearLayer *layer, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(layer);
+
+    struct Layer *base = (struct Layer *)layer;
+    CHK_ERR(checkShardedLinearLayerData(&(layer->n_samples), base->input, layer->n_in, base->output, layer->n_out));
+    layer->args = args;
+    CHK_ERR(runShardOp(layer, SHARD_OP_FORWARD));
+    CHK_ERR(setTensorSamples(base->output, layer->n_samples));
+
+    if (probe->dump_output) {
+        CHK_ERR(savetxtTensorData(base->output, probe->dst_dir, "out", base->name, args->cur_epoch, args->cur_iter));
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief 反向传播, 各分片计算自己的梯度; 灵敏度在SHARD_BY_OUTPUT时归约, 在SHARD_BY_INPUT时按列直接写入
+ */
+int backwardShardedLinearLayer(struct ShardedLinearLayer *layer, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(layer);
+
+    struct Layer *base = (struct Layer *)layer;
+    CHK_ERR(checkShardedLinearLayerData(&(layer->n_samples), base->delta_in, layer->n_out, base->input, layer->n_in));
+    if (base->delta_out) {
+        int b, n;
+        CHK_ERR(getTensorBatchAndFeatures(&b, &n, base->delta_out));
+        CHK_ERR((n == layer->n_in && b >= layer->n_samples)? 0: 1);
+    }
+    layer->args = args;
+    CHK_ERR(runShardOp(layer, SHARD_OP_BACKWARD));
+    if (base->delta_out) {
+        CHK_ERR(setTensorSamples(base->delta_out, layer->n_samples));
+        if (probe->dump_delta) {
+            CHK_ERR(savetxtTensorData(base->delta_out, probe->dst_dir, "delta", base->name, args->cur_epoch, args->cur_iter));
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief: 更新当前层参数, 各分片线程更新自己持有的部分
+ */
+int updateShardedLinearLayer(struct ShardedLinearLayer *layer, const struct UpdateArgs *args, struct Probe *probe)
+{
+    CHK_NIL(layer);
+    CHK_NIL(args);
+
+    layer->args = args;
+    CHK_ERR(runShardOp(layer, SHARD_OP_UPDATE));
+    return SUCCESS;
+}
@@ -0,0 +1,44 @@
+/**
+ * @brief 张量并行的线性层: w和w_grad按行或按列切分给n_shards个常驻线程, 每个分片由所属线程创建并首次写入,
+ *        pin非0时分片线程按affinity.h的配置绑定到各自的CPU组(未配置时为compact), 分片内存落在该线程所在的NUMA节点上.
+ *
+ *        SHARD_BY_OUTPUT(列并行): 分片k持有输出神经元[lo, hi)对应的w行和b, 正向传播直接写输出的对应列,
+ *                                 反向传播各分片算出部分灵敏度后按列归约.
+ *        SHARD_BY_INPUT(行并行): 分片k持有输入[lo, hi)对应的w列, b由分片0持有, 正向传播各分片算出部分输出后按列归约,
+ *                                反向传播直接写灵敏度的对应列.
+ *
+ *        参数和梯度的pack/unpack布局与LinearLayer相同, 初始化与LinearLayer消耗相同的随机数序列.
+ */
+#pragma once
+
+#include "tensor.h"
+#include "layer.h"
+#include "opt_alg.h"
+#include "probe.h"
+
+enum ShardMode
+{
+    SHARD_BY_OUTPUT,
+    SHARD_BY_INPUT
+};
+
+struct ShardedLinearLayer;
+
+int createShardedLinearLayer(struct ShardedLinearLayer **l, const char *name, int n_in, int n_out,
+    int n_shards, enum ShardMode mode, int pin);
+void destroyShardedLinearLayer(struct ShardedLinearLayer *layer);
+
+int getShardedLinearLayerShape(int *n_in, int *n_out, const struct ShardedLinearLayer *layer);
+int getShardedLinearLayerInputNumber(int *n_in, const struct ShardedLinearLayer *layer);
+int getShardedLinearLayerOutputNumber(int *n_out, const struct ShardedLinearLayer *layer);
+int setShardedLinearLayerGradientAccumulation(struct ShardedLinearLayer *layer, int on);
+int getShardedLinearLayerParamNumber(int *n, const struct ShardedLinearLayer *layer);
+int packShardedLinearLayerParam(float *dst, const struct ShardedLinearLayer *layer);
+int unpackShardedLinearLayerParam(struct ShardedLinearLayer *layer, const float *src);
+int packShardedLinearLayerGradient(float *dst, const struct ShardedLinearLayer *layer);
+int clearShardedLinearLayerGradient(struct ShardedLinearLayer *layer);
+int mergeShardedLinearLayerGradient(struct ShardedLinearLayer *layer, const float *src);
+
+int forwardShardedLinearLayer(struct ShardedLinearLayer *layer, const struct UpdateArgs *args, struct Probe *probe);
+int backwardShardedLinearLayer(struct ShardedLinearLayer *layer, const struct UpdateArgs *args, struct Probe *probe);
+int updateShardedLinearLayer(struct ShardedLinearLayer *layer, const struct UpdateArgs *args, struct Probe *probe);
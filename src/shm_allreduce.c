@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "debug_macros.h"
+#include "shm_allreduce.h"
+
+#define SHM_ALLREDUCE_ALIGN (64)
+#define SHM_BARRIER_SPIN (1 << 12) // 进入futex等待前的自旋次数
+
+// 共享内存头部, ftruncate得到的全0内容即为合法初值
+struct ShmHeader
+{
+    int count; // 已到达屏障的rank数
+    int generation; // 屏障代数, futex等待在该字段上
+    char pad[SHM_ALLREDUCE_ALIGN - 2 * sizeof(int)];
+};
+
+struct ShmAllreduce
+{
+    char name[NN_SHM_NAME_LEN];
+    int rank;
+    int world_size;
+    long n_floats;
+    long slot_floats; // 每个槽按缓存行对齐后的float个数
+    size_t map_bytes;
+    void *base;
+    struct ShmHeader *header;
+    float *slots; // world_size个输入槽
+    float *result;
+};
+
+// 跨进程的futex不能使用FUTEX_PRIVATE_FLAG
+static long futexWait(int *addr, int val)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static long futexWake(int *addr)
+{
+    return syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+int createShmAllreduce(struct ShmAllreduce **ar, const char *name, int rank, int world_size, long n_floats)
+{
+    CHK_NIL(ar);
+    CHK_NIL(name);
+    CHK_ERR((strlen(name) < NN_SHM_NAME_LEN)? 0: 1);
+    CHK_ERR((world_size > 0)? 0: 1);
+    CHK_ERR((rank >= 0 && rank < world_size)? 0: 1);
+    CHK_ERR((n_floats > 0)? 0: 1);
+
+    struct ShmAllreduce *res = calloc(1, sizeof(struct ShmAllreduce));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    snprintf(res->name, NN_SHM_NAME_LEN, "%s", name);
+    res->rank = rank;
+    res->world_size = world_size;
+    res->n_floats = n_floats;
+    int n_align = SHM_ALLREDUCE_ALIGN / sizeof(float);
+    res->slot_floats = (n_floats + n_align - 1) / n_align * n_align;
+    res->map_bytes = sizeof(struct ShmHeader) + (world_size + 1) * res->slot_floats * sizeof(float);
+
+    // 各rank都可能先到, 因此都带O_CREAT打开; ftruncate到相同大小是幂等的
+    int fd = shm_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        ERR_MSG("shm_open() failed, name: %s, detail: %s, error.\n", name, ERRNO_DETAIL(errno));
+        free(res);
+        return ERR_COD;
+    }
+    if (ftruncate(fd, res->map_bytes) == -1) {
+        ERR_MSG("ftruncate() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        close(fd);
+        free(res);
+        return ERR_COD;
+    }
+    res->base = mmap(NULL, res->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (res->base == MAP_FAILED) {
+        ERR_MSG("mmap() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        free(res);
+        return ERR_COD;
+    }
+    res->header = res->base;
+    res->slots = (float *)((char *)res->base + sizeof(struct ShmHeader));
+    res->result = res->slots + (size_t)world_size * res->slot_floats;
+
+    CHK_ERR_GOTO(barrierShmAllreduce(res));
+    if (rank == 0) { // 全部rank已映射, 名字不再需要
+        shm_unlink(name);
+    }
+
+    *ar = res;
+    return SUCCESS;
+
+err_end:
+    destroyShmAllreduce(res);
+    return ERR_COD;
+}
+
+void destroyShmAllreduce(struct ShmAllreduce *ar)
+{
+    if (ar == NULL) {
+        return;
+    }
+    if (ar->base && ar->base != MAP_FAILED) {
+        munmap(ar->base, ar->map_bytes);
+    }
+    free(ar);
+}
+
+int getShmAllreduceRank(int *rank, int *world_size, const struct ShmAllreduce *ar)
+{
+    CHK_NIL(rank);
+    CHK_NIL(world_size);
+    CHK_NIL(ar);
+
+    *rank = ar->rank;
+    *world_size = ar->world_size;
+    return SUCCESS;
+}
+
+int getShmAllreduceSendBuffer(float **buf, struct ShmAllreduce *ar)
+{
+    CHK_NIL(buf);
+    CHK_NIL(ar);
+
+    *buf = ar->slots + (size_t)ar->rank * ar->slot_floats;
+    return SUCCESS;
+}
+
+/**
+ * @brief 计数屏障: 最后到达的rank清零计数并推进代数, 其余rank在代数上自旋后futex等待.
+ *        count的清零发生在代数推进之前, 被唤醒的rank进入下一次屏障时count已是0.
+ */
+int barrierShmAllreduce(struct ShmAllreduce *ar)
+{
+    CHK_NIL(ar);
+
+    struct ShmHeader *h = ar->header;
+    int gen = __atomic_load_n(&(h->generation), __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&(h->count), 1, __ATOMIC_ACQ_REL) == ar->world_size) {
+        __atomic_store_n(&(h->count), 0, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&(h->generation), 1, __ATOMIC_RELEASE);
+        futexWake(&(h->generation));
+        return SUCCESS;
+    }
+
+    int i;
+    for (i = 0; i < SHM_BARRIER_SPIN; ++i) {
+        if (__atomic_load_n(&(h->generation), __ATOMIC_ACQUIRE) != gen) {
+            return SUCCESS;
+        }
+    }
+    while (__atomic_load_n(&(h->generation), __ATOMIC_ACQUIRE) == gen) {
+        if (futexWait(&(h->generation), gen) == -1 && errno != EAGAIN && errno != EINTR) {
+            ERR_MSG("futex() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+    }
+    return SUCCESS;
+}
+
+int runShmAllreduce(float *dst, long n, struct ShmAllreduce *ar)
+{
+    CHK_NIL(dst);
+    CHK_NIL(ar);
+    CHK_ERR((n > 0 && n <= ar->n_floats)? 0: 1);
+
+    // 各rank的发送缓冲区已写好
+    CHK_ERR(barrierShmAllreduce(ar));
+
+    // reduce-scatter: rank r负责第r段, 段边界按缓存行对齐, 避免不同rank写同一缓存行
+    int n_align = SHM_ALLREDUCE_ALIGN / sizeof(float);
+    long chunk = (n + ar->world_size - 1) / ar->world_size;
+    chunk = (chunk + n_align - 1) / n_align * n_align;
+    long lo = chunk * ar->rank;
+    long hi = (lo + chunk < n)? lo + chunk: n;
+    if (lo < hi) {
+        float *res = ar->result;
+        memcpy(res + lo, ar->slots + lo, (hi - lo) * sizeof(float));
+        int k;
+        for (k = 1; k < ar->world_size; ++k) {
+            const float *src = ar->slots + (size_t)k * ar->slot_floats;
+            long i;
+            for (i = lo; i < hi; ++i) {
+                res[i] += src[i];
+            }
+        }
+    }
+    CHK_ERR(barrierShmAllreduce(ar));
+
+    // allgather: 结果区在下一次调用的第一个屏障之前不会被改写
+    memcpy(dst, ar->result, n * sizeof(float));
+    return SUCCESS;
+}
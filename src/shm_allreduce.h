@@ -0,0 +1,28 @@
+/**
+ * @brief 同一主机上多个进程之间基于POSIX共享内存的all-reduce(求和), 不依赖网络和MPI.
+ *        共享内存布局: 头部(屏障计数器) | 每个rank一个输入槽 | 结果区.
+ *        一次all-reduce: 各rank写入自己的槽 -> 屏障 -> reduce-scatter(rank r把所有槽的第r段求和写入结果区第r段)
+ *        -> 屏障 -> allgather(各rank从结果区读出完整结果). 屏障基于共享内存上的futex实现.
+ */
+#pragma once
+
+#define NN_SHM_NAME_LEN (64)
+
+struct ShmAllreduce;
+
+/**
+ * @brief 所有rank用相同的name, world_size, n_floats调用, 函数返回时全部rank已完成映射.
+ *        共享内存对象在全部rank映射后由rank 0删除名字, 进程异常退出也不会残留.
+ */
+int createShmAllreduce(struct ShmAllreduce **ar, const char *name, int rank, int world_size, long n_floats);
+void destroyShmAllreduce(struct ShmAllreduce *ar);
+
+int getShmAllreduceRank(int *rank, int *world_size, const struct ShmAllreduce *ar);
+int getShmAllreduceSendBuffer(float **buf, struct ShmAllreduce *ar);
+
+int barrierShmAllreduce(struct ShmAllreduce *ar);
+
+/**
+ * @brief 对各rank发送缓冲区(getShmAllreduceSendBuffer)中的前n个元素求和, 结果写入dst(长度n, 可以就是发送缓冲区)
+ */
+int runShmAllreduce(float *dst, long n, struct ShmAllreduce *ar);
@@ -98,7 +98,7 @@ int backwardSigmoidLayer(struct SigmoidLayer *layer, const struct UpdateArgs *ar
     CHK_NIL(layer);
 
     // backward propagation
-    CHK_ERR(deactivateTensor(((struct Layer *)layer)->delta_out, ((struct Layer *)layer)->delta_in, ((struct Layer *)layer)->input, LOGISTIC)); // 更新delta
+    CHK_ERR(deactivateTensor(((struct Layer *)layer)->delta_out, ((struct Layer *)layer)->delta_in, ((struct Layer *)layer)->output, LOGISTIC)); // 更新delta, logistic_gradient的参数是sigmoid的输出
 
     return SUCCESS;
 }
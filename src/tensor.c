@@ -12,8 +12,11 @@
 #include "math_utils.h"
 #include "activations.h"
 #include "gemm.h"
+#include "thread_pool.h"
 #include "tensor.h"
 #include "io_utils.h"
+#include "memory.h"
+#include "rng.h"
 #include "const.h"
 
 /*
@@ -49,6 +52,12 @@ struct Tensor {
     int b; // batch_size
     int n; // n_features
     int b_used; // 当前实际装填的样本数 b_used <= b
+    enum TensorLayout layout;
+
+    // CSR_TENSOR_LAYOUT only, 引用外部数组, 数值为FLOAT32
+    const int *csr_row_ptr;
+    const int *csr_col_idx;
+    const float *csr_val;
 
     // PARAM_TENSOR_TYPE only
     int row;
@@ -60,6 +69,7 @@ struct Tensor {
     int *blob_i32;
     long long *blob_i64;
     unsigned char *blob_u8;
+    size_t n_bytes; // blob或blob_u8由allocBlob分配的字节数, 引用外部数据时为0
 };
 
 const char *getTensorDtypeStrFromEnum(enum DType dtype)
@@ -103,6 +113,38 @@ enum DType getTensorDtypeEnumFromStr(const char *dtype_str)
     return UNKNOW_DTYPE;
 }
 
+int getTensorDtypeSize(int *size, enum DType dtype)
+{
+    CHK_NIL(size);
+
+    switch (dtype) {
+        case FLOAT32:
+        *size = sizeof(float);
+        break;
+
+        case FLOAT64:
+        *size = sizeof(double);
+        break;
+
+        case INT32:
+        *size = sizeof(int);
+        break;
+
+        case INT64:
+        *size = sizeof(long long);
+        break;
+
+        case UINT8:
+        *size = sizeof(unsigned char);
+        break;
+
+        default:
+        ERR_MSG("Unknow DType: %d, error.\n", dtype);
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
 const char *getTensorTtypeStrFromEnum(enum TensorType ttype)
 {
     switch (ttype) {
@@ -124,10 +166,7 @@ int initTensorParameterAsWeight(struct Tensor *tensor)
     CHK_ERR((tensor->ttype == PARAM_TENSOR_TYPE)? 0: 1);
     int inputs = tensor->row;
     float scale = sqrt(2. / inputs);
-    int i = 0;
-    for(i = 0; i < tensor->row * tensor->col; ++i){
-        tensor->blob[i] = scale * rand_uniform(-1, 1);
-    }
+    CHK_ERR(fillRandomUniform(NULL, tensor->blob, (long)tensor->row * tensor->col, -scale, scale)); // 默认随机数流, 由setRandomSeed重置
     return SUCCESS;
 }
 
@@ -155,17 +194,19 @@ int createTensorData(struct Tensor **t, enum DType dtype, int batch_size, int n_
  
     switch (dtype) {
         case FLOAT32:
-        tensor->blob = calloc(batch_size * n_features, sizeof(float));
+        tensor->n_bytes = (size_t)batch_size * n_features * sizeof(float);
+        tensor->blob = allocBlob(tensor->n_bytes);
         if (tensor->blob == NULL) {
-            ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+            ERR_MSG("allocBlob failed, error.\n");
             goto err_end;
         }
         break;
 
         case UINT8:
-        tensor->blob = calloc(batch_size * n_features, sizeof(unsigned char));
+        tensor->n_bytes = (size_t)batch_size * n_features * sizeof(unsigned char);
+        tensor->blob_u8 = allocBlob(tensor->n_bytes);
         if (tensor->blob_u8 == NULL) {
-            ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+            ERR_MSG("allocBlob failed, error.\n");
             goto err_end;
         }
         break;
@@ -185,8 +226,8 @@ int createTensorData(struct Tensor **t, enum DType dtype, int batch_size, int n_
 
 err_end:
     if (tensor) {
-        free(tensor->blob);
-        free(tensor->blob_u8);
+        freeBlob(tensor->blob, tensor->n_bytes);
+        freeBlob(tensor->blob_u8, tensor->n_bytes);
         free(tensor->blob_f64);
         free(tensor->blob_i32);
         free(tensor->blob_i64);
@@ -209,9 +250,10 @@ int createTensorParam(struct Tensor **t, enum DType dtype, int row, int col)
  
     switch (dtype) {
         case FLOAT32: // 目前参数的数据类型只支持32位浮点数float，这也是现阶段GPU计算的需要
-        tensor->blob = calloc(row * col, sizeof(float));
+        tensor->n_bytes = (size_t)row * col * sizeof(float);
+        tensor->blob = allocBlob(tensor->n_bytes);
         if (tensor->blob == NULL) {
-            ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+            ERR_MSG("allocBlob failed, error.\n");
             goto err_end;
         }
         break;
@@ -230,8 +272,8 @@ int createTensorParam(struct Tensor **t, enum DType dtype, int row, int col)
 
 err_end:
     if (tensor) {
-        free(tensor->blob);
-        free(tensor->blob_u8);
+        freeBlob(tensor->blob, tensor->n_bytes);
+        freeBlob(tensor->blob_u8, tensor->n_bytes);
         free(tensor->blob_f64);
         free(tensor->blob_i32);
         free(tensor->blob_i64);
@@ -277,14 +319,64 @@ int createTensorDataWithBlobRef(struct Tensor **t, void *blob, enum DType dtype,
     return SUCCESS;
 }
 
+// CSR数组的合法性: row_ptr非递减, 特征下标在[0, n_features)中. 代价为O(n_nonzeros), 远小于使用它的矩阵乘法
+static int checkCsr(const int *row_ptr, const int *col_idx, int n_samples, int n_features)
+{
+    CHK_ERR((row_ptr[0] >= 0)? 0: 1);
+    int i, k;
+    for (i = 0; i < n_samples; ++i) {
+        if (row_ptr[i + 1] < row_ptr[i]) {
+            ERR_MSG("row_ptr of CSR is decreasing at sample %d, error.\n", i);
+            return ERR_COD;
+        }
+    }
+    for (k = row_ptr[0]; k < row_ptr[n_samples]; ++k) {
+        if (col_idx[k] < 0 || col_idx[k] >= n_features) {
+            ERR_MSG("col_idx[%d] = %d of CSR out of range [0, %d), error.\n", k, col_idx[k], n_features);
+            return ERR_COD;
+        }
+    }
+    return SUCCESS;
+}
+
+int createTensorDataCsrWithRef(struct Tensor **t, const int *row_ptr, const int *col_idx, const float *val,
+    int batch_size, int n_features, int n_samples)
+{
+    CHK_NIL(t);
+    CHK_NIL(row_ptr);
+    CHK_ERR((batch_size > 0)? 0: 1);
+    CHK_ERR((n_features > 0)? 0: 1);
+    CHK_ERR((n_samples > 0 && n_samples <= batch_size)? 0: 1);
+    CHK_ERR(((col_idx != NULL && val != NULL) || row_ptr[n_samples] == row_ptr[0])? 0: 1);
+    CHK_ERR(checkCsr(row_ptr, col_idx, n_samples, n_features));
+
+    struct Tensor *tensor = calloc(1, sizeof(struct Tensor));
+    if (!tensor) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    tensor->ttype = DATA_TENSOR_TYPE;
+    tensor->dtype = FLOAT32;
+    tensor->layout = CSR_TENSOR_LAYOUT;
+    tensor->b = batch_size;
+    tensor->b_used = n_samples;
+    tensor->n = n_features;
+    tensor->csr_row_ptr = row_ptr;
+    tensor->csr_col_idx = col_idx;
+    tensor->csr_val = val;
+
+    *t = tensor;
+    return SUCCESS;
+}
+
 void destroyTensor(struct Tensor *tensor)
 {
     if (tensor) {
-        free(tensor->blob);
+        freeBlob(tensor->blob, tensor->n_bytes);
         free(tensor->blob_f64);
         free(tensor->blob_i32);
         free(tensor->blob_i64);
-        free(tensor->blob_u8);
+        freeBlob(tensor->blob_u8, tensor->n_bytes);
     }
     free(tensor);
 }
@@ -339,6 +431,7 @@ int getTensorBlobByCopy(void *dst, enum DType dtype, const struct Tensor *tensor
     CHK_NIL(dst);
     CHK_NIL(tensor);
     CHK_ERR((tensor->dtype == dtype)? 0: 1);
+    CHK_ERR((tensor->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
 
     if (tensor->ttype == DATA_TENSOR_TYPE) {
         int n_elem = tensor->b * tensor->n;
@@ -448,6 +541,16 @@ int getTensorSamples(int *n_samples, const struct Tensor *tensor)
     return SUCCESS;
 }
 
+// 设置数据Tensor已装填的样本数, 用于在tensor.c之外直接写blob的计算(例如分片的线性层)
+int setTensorSamples(struct Tensor *tensor, int n_samples)
+{
+    CHK_NIL(tensor);
+    CHK_ERR((tensor->ttype == DATA_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((n_samples >= 0 && n_samples <= tensor->b)? 0: 1);
+    tensor->b_used = n_samples;
+    return SUCCESS;
+}
+
 int getTensorDType(enum DType *dtype, const struct Tensor *tensor)
 {
     CHK_NIL(dtype);
@@ -464,10 +567,33 @@ int getTensorType(enum TensorType *ttype, const struct Tensor *tensor)
     return SUCCESS;
 }
 
+int getTensorLayout(enum TensorLayout *layout, const struct Tensor *tensor)
+{
+    CHK_NIL(layout);
+    CHK_NIL(tensor);
+    *layout = tensor->layout;
+    return SUCCESS;
+}
+
+int getTensorCsrConstRef(const int *(*row_ptr), const int *(*col_idx), const float *(*val), const struct Tensor *tensor)
+{
+    CHK_NIL(row_ptr);
+    CHK_NIL(col_idx);
+    CHK_NIL(val);
+    CHK_NIL(tensor);
+    CHK_ERR((tensor->layout == CSR_TENSOR_LAYOUT)? 0: 1);
+
+    *row_ptr = tensor->csr_row_ptr;
+    *col_idx = tensor->csr_col_idx;
+    *val = tensor->csr_val;
+    return SUCCESS;
+}
+
 int getTensorBlob(void **blob, struct Tensor *tensor)
 {
     CHK_NIL(blob);
     CHK_NIL(tensor);
+    CHK_ERR((tensor->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
 
     switch (tensor->dtype) {
         case FLOAT32:
@@ -489,6 +615,7 @@ int getTensorBlobConstRef(const void *(*blob), const struct Tensor *tensor)
 {
     CHK_NIL(blob);
     CHK_NIL(tensor);
+    CHK_ERR((tensor->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
 
     switch (tensor->dtype) {
         case FLOAT32:
@@ -515,6 +642,7 @@ int setTensorSamplesByReplace(void **blob_old, struct Tensor *tensor, void *blob
     CHK_ERR((n_features > 0)? 0: 1);
     CHK_ERR((tensor->dtype == dtype)? 0: 1);
     CHK_ERR((tensor->ttype == DATA_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((tensor->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
     //fprintf(stdout, "n_samples = %d, tensor->b = %d\n", n_samples, tensor->b);
     //CHK_ERR((n_samples <= tensor->b)? 0: 1); 此项无需检查，因为是直接替换blob而不是向blob拷贝，加入该检查后回到值epoch切换时报错（因为上一个epoch最后一个batch缩小了blob）
     CHK_ERR((n_features == tensor->n)? 0: 1);
@@ -535,12 +663,233 @@ int setTensorSamplesByReplace(void **blob_old, struct Tensor *tensor, void *blob
         ERR_MSG("DType: %s is not supported yet, error.\n", getTensorDtypeStrFromEnum(dtype));
         return ERR_COD;
     }
+    if (tensor->n_bytes) { // 原blob由allocBlob分配(可能是mmap), 调用者无法正确释放, 在这里释放
+        freeBlob(tmp, tensor->n_bytes);
+        tmp = NULL;
+    }
     *blob_old = tmp;
+    tensor->n_bytes = 0; // 替换后的blob属于调用者
     tensor->b_used = n_samples;
     tensor->b = n_samples;
     return SUCCESS;
 }
 
+// 与setTensorSamplesByReplace相同, 用于CSR张量, 数组仍由调用者保管
+int setTensorCsrSamplesByReplace(struct Tensor *tensor, const int *row_ptr, const int *col_idx, const float *val, int n_samples, int n_features)
+{
+    CHK_NIL(tensor);
+    CHK_NIL(row_ptr);
+    CHK_ERR((n_samples > 0)? 0: 1);
+    CHK_ERR((tensor->ttype == DATA_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((tensor->layout == CSR_TENSOR_LAYOUT)? 0: 1);
+    CHK_ERR((n_features == tensor->n)? 0: 1);
+    CHK_ERR(((col_idx != NULL && val != NULL) || row_ptr[n_samples] == row_ptr[0])? 0: 1);
+    CHK_ERR(checkCsr(row_ptr, col_idx, n_samples, n_features));
+
+    tensor->csr_row_ptr = row_ptr;
+    tensor->csr_col_idx = col_idx;
+    tensor->csr_val = val;
+    tensor->b_used = n_samples;
+    tensor->b = n_samples;
+    return SUCCESS;
+}
+
+// 以下是各算子按区间执行的部分, 由parallelFor切分; 代价单位约为一次浮点运算
+#define TENSOR_COST_ELEMWISE (1)
+#define TENSOR_COST_EXP (20)
+
+struct TensorRangeArgs
+{
+    float *x;
+    float *y;
+    const float *u;
+    const float *v;
+    const unsigned char *u8;
+    float alpha;
+    float beta;
+    int m; // 行数
+    int n; // 列数
+};
+
+struct CsrRangeArgs
+{
+    float *z;
+    const float *w;
+    const float *bias;
+    const float *delta;
+    const int *row_ptr;
+    const int *col_idx;
+    const float *val;
+    int m; // 样本数
+    int n_in;
+    int n_out;
+};
+
+static void logisticActivateRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        a->y[i] = logistic_activate(a->u[i]); // activations.h, inline
+    }
+}
+
+static void reluActivateRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        a->y[i] = relu_activate(a->u[i]); // activations.h, inline
+    }
+}
+
+static void logisticGradientRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        a->y[i] = logistic_gradient(a->u[i]) * a->v[i];
+    }
+}
+
+static void reluGradientRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        a->y[i] = relu_gradient(a->u[i]) * a->v[i];
+    }
+}
+
+// y[i] = sum_j u[j * n + i], 按列切分, 每列的累加顺序不变
+static void sumColumnsRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int i, j;
+    for (i = lo; i < hi; ++i) {
+        a->y[i] = 0.;
+        for (j = 0; j < a->m; ++j) {
+            a->y[i] += a->u[j * a->n + i];
+        }
+    }
+}
+
+static void scaleRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        a->x[i] *= a->alpha;
+    }
+}
+
+// x = x + lr * y, y = momentum * (lr * y)
+static void addParamRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        a->y[i] *= a->alpha;
+        a->x[i] += a->y[i];
+        a->y[i] *= a->beta;
+    }
+}
+
+static void softmaxRowsRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int k = a->n;
+    int i, j;
+    for (i = lo; i < hi; ++i) {
+        float largest = -FLT_MAX;
+        for(j = 0; j < k; ++j){
+            if(a->u[i * k + j] > largest) {
+                largest = a->u[i * k + j];
+            }
+        }
+        float sum = 0;
+        for(j = 0; j < k; ++j){
+            float e = exp(a->u[i * k + j] - largest);
+            sum += e;
+            a->y[i * k + j] = e;
+        }
+        for(j = 0; j < k; ++j){
+            (a->y[i * k + j]) /= sum;
+        }
+    }
+}
+
+#define CSR_OUT_BLOCK (4)
+
+// z[i][j] = bias[j] + sum_k val[k] * w[j][col_idx[k]], 按样本切分; 每次处理CSR_OUT_BLOCK个输出, 复用读入的非零元
+static void csrForwardRange(void *arg, int lo, int hi)
+{
+    struct CsrRangeArgs *a = arg;
+    int n_in = a->n_in;
+    int n_out = a->n_out;
+    int i, j, k;
+    for (i = lo; i < hi; ++i) {
+        float *z = a->z + (long)i * n_out;
+        int k0 = a->row_ptr[i];
+        int k1 = a->row_ptr[i + 1];
+        for (j = 0; j + CSR_OUT_BLOCK <= n_out; j += CSR_OUT_BLOCK) {
+            const float *w0 = a->w + (long)j * n_in;
+            const float *w1 = w0 + n_in;
+            const float *w2 = w1 + n_in;
+            const float *w3 = w2 + n_in;
+            float s0 = 0.f, s1 = 0.f, s2 = 0.f, s3 = 0.f;
+            for (k = k0; k < k1; ++k) {
+                int c = a->col_idx[k];
+                float v = a->val[k];
+                s0 += v * w0[c];
+                s1 += v * w1[c];
+                s2 += v * w2[c];
+                s3 += v * w3[c];
+            }
+            z[j] = (a->bias)? a->bias[j] + s0: s0;
+            z[j + 1] = (a->bias)? a->bias[j + 1] + s1: s1;
+            z[j + 2] = (a->bias)? a->bias[j + 2] + s2: s2;
+            z[j + 3] = (a->bias)? a->bias[j + 3] + s3: s3;
+        }
+        for (; j < n_out; ++j) {
+            const float *w0 = a->w + (long)j * n_in;
+            float s0 = 0.f;
+            for (k = k0; k < k1; ++k) {
+                s0 += a->val[k] * w0[a->col_idx[k]];
+            }
+            z[j] = (a->bias)? a->bias[j] + s0: s0;
+        }
+    }
+}
+
+// z[j][col_idx[k]] += delta[i][j] * val[k], 按输出切分, 每个线程只写自己的行, 累加顺序与线程数无关
+static void csrWeightGradientRange(void *arg, int lo, int hi)
+{
+    struct CsrRangeArgs *a = arg;
+    int i, j, k;
+    for (j = lo; j < hi; ++j) {
+        float *z = a->z + (long)j * a->n_in;
+        for (i = 0; i < a->m; ++i) {
+            float d = a->delta[(long)i * a->n_out + j];
+            if (d == 0.f) { // 例如relu之后的灵敏度
+                continue;
+            }
+            for (k = a->row_ptr[i]; k < a->row_ptr[i + 1]; ++k) {
+                z[a->col_idx[k]] += d * a->val[k];
+            }
+        }
+    }
+}
+
+static void ceDeltaRange(void *arg, int lo, int hi)
+{
+    struct TensorRangeArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        a->y[i] = (a->u8[i] - a->u[i]) / a->alpha;
+    }
+}
+
 // 前向传播过程的非线性运算部分
 int activateTensor(struct Tensor *y, const struct Tensor *x, enum ActivationType act_type)
 {
@@ -548,22 +897,17 @@ int activateTensor(struct Tensor *y, const struct Tensor *x, enum ActivationType
     CHK_ERR((x->n > 0)? 0: 1);
     CHK_ERR((x->ttype == DATA_TENSOR_TYPE)? 0: 1);
     CHK_ERR((x->ttype == y->ttype)? 0: 1);
+    CHK_ERR((x->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
 
     if (x->ttype == DATA_TENSOR_TYPE) {
-        int i = 0;
+        struct TensorRangeArgs a = {.y = y->blob, .u = x->blob};
         switch (act_type) {
             case LOGISTIC:
-            //fprintf(stdout, "x->b_used = %d,  x->n = %d\n", x->b_used, x->n);
-            for (i = 0; i < x->b_used * x->n; ++i) {
-                y->blob[i] = logistic_activate(x->blob[i]); // activations.h, inline
-            }
+            CHK_ERR(parallelFor(NULL, 0, x->b_used * x->n, TENSOR_COST_EXP, logisticActivateRange, &a));
             break;
 
             case RELU:
-            //fprintf(stdout, "x->b_used = %d,  x->n = %d\n", x->b_used, x->n);
-            for (i = 0; i < x->b_used * x->n; ++i) {
-                y->blob[i] = relu_activate(x->blob[i]); // activations.h, inline
-            }
+            CHK_ERR(parallelFor(NULL, 0, x->b_used * x->n, TENSOR_COST_ELEMWISE, reluActivateRange, &a));
             break;
 
             default:
@@ -594,18 +938,15 @@ int deactivateTensor(struct Tensor *delta_out, const struct Tensor *delta_in, co
     CHK_ERR((delta_in->b_used > 0)? 0: 1);
     CHK_ERR((delta_in->b_used == input->b_used)? 0: 1);
 
-    int i = 0;
+    // 注意这里的input应该是outputs[i]，而不是hiddens[i]
+    struct TensorRangeArgs a = {.y = delta_out->blob, .u = input->blob, .v = delta_in->blob};
     switch (act_type) {
         case LOGISTIC:
-        for (i = 0; i < input->b_used * input->n; ++i) {
-            delta_out->blob[i] = logistic_gradient(input->blob[i]) * delta_in->blob[i]; // 注意这里的x应该是outputs[i]，而不是hiddens[i]
-        }
+        CHK_ERR(parallelFor(NULL, 0, input->b_used * input->n, TENSOR_COST_ELEMWISE, logisticGradientRange, &a));
         break;
 
         case RELU:
-        for (i = 0; i < input->b_used * input->n; ++i) {
-            delta_out->blob[i] = relu_gradient(input->blob[i]) * delta_in->blob[i]; // 注意这里的x应该是outputs[i]，而不是hiddens[i]
-        }
+        CHK_ERR(parallelFor(NULL, 0, input->b_used * input->n, TENSOR_COST_ELEMWISE, reluGradientRange, &a));
         break;
 
         default:
@@ -628,7 +969,7 @@ int linearTensorForward(struct Tensor *z, const struct Tensor *x, const struct T
     CHK_NIL(x);
     CHK_NIL(y);
     CHK_ERR((x->b_used > 0)? 0: 1);
-    CHK_ERR((x->ttype == DATA_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((x->ttype == DATA_TENSOR_TYPE && x->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
     CHK_ERR((z->ttype == DATA_TENSOR_TYPE)? 0: 1);
     CHK_ERR((y->ttype == PARAM_TENSOR_TYPE)? 0: 1);
     CHK_ERR((b->ttype == PARAM_TENSOR_TYPE)? 0: 1);
@@ -661,6 +1002,88 @@ int linearTensorForward(struct Tensor *z, const struct Tensor *x, const struct T
     return SUCCESS;
 }
 
+int linearTensorForwardU8(struct Tensor *z, struct Tensor *x_f, const struct Tensor *x, const struct Tensor *y, const struct Tensor *b,
+    const float *scale, const float *shift)
+{
+    CHK_NIL(z);
+    CHK_NIL(x_f);
+    CHK_NIL(x);
+    CHK_NIL(y);
+    CHK_ERR((x->b_used > 0)? 0: 1);
+    CHK_ERR((x->ttype == DATA_TENSOR_TYPE && x->dtype == UINT8 && x->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
+    CHK_ERR((x_f->ttype == DATA_TENSOR_TYPE && x_f->dtype == FLOAT32)? 0: 1);
+    CHK_ERR((z->ttype == DATA_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((y->ttype == PARAM_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((x->n == y->col)? 0: 1);
+    CHK_ERR((x_f->n == x->n && x_f->b >= x->b_used)? 0: 1);
+    CHK_ERR((z->n == y->row)? 0: 1);
+    CHK_ERR(((scale == NULL) == (shift == NULL))? 0: 1);
+
+    if (b) {
+        CHK_ERR((b->ttype == PARAM_TENSOR_TYPE)? 0: 1);
+        int i = 0;
+        for (i = 0; i < x->b_used; ++i) {
+            memcpy(z->blob + i * z->n, b->blob, sizeof(float) * b->col);
+        }
+    }
+
+    gemm_u8(1, x->b_used, y->row, y->col, 1.,
+        x->blob_u8, x->n,
+        scale, shift,
+        x_f->blob,
+        y->blob, y->col,
+        (b)? 1.: 0.,
+        z->blob, z->n);
+    x_f->b_used = x->b_used;
+    z->b_used = x->b_used;
+    return SUCCESS;
+}
+
+struct NormalizeU8Args
+{
+    const unsigned char *x;
+    const float *scale, *shift;
+    float *x_f;
+    int n;
+};
+
+// 与gemm_u8的packing使用相同的计算, 结果逐位一致
+static void normalizeU8Range(void *arg, int lo, int hi)
+{
+    struct NormalizeU8Args *a = arg;
+    int i, k;
+    for (i = lo; i < hi; ++i) {
+        const unsigned char *x = a->x + (size_t)i * a->n;
+        float *x_f = a->x_f + (size_t)i * a->n;
+        if (a->scale) {
+            for (k = 0; k < a->n; ++k) {
+                x_f[k] = x[k] * a->scale[k] + a->shift[k];
+            }
+        }
+        else {
+            for (k = 0; k < a->n; ++k) {
+                x_f[k] = x[k];
+            }
+        }
+    }
+}
+
+int normalizeTensorU8(struct Tensor *x_f, const struct Tensor *x, const float *scale, const float *shift)
+{
+    CHK_NIL(x_f);
+    CHK_NIL(x);
+    CHK_ERR((x->b_used > 0)? 0: 1);
+    CHK_ERR((x->ttype == DATA_TENSOR_TYPE && x->dtype == UINT8 && x->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
+    CHK_ERR((x_f->ttype == DATA_TENSOR_TYPE && x_f->dtype == FLOAT32)? 0: 1);
+    CHK_ERR((x_f->n == x->n && x_f->b >= x->b_used)? 0: 1);
+    CHK_ERR(((scale == NULL) == (shift == NULL))? 0: 1);
+
+    struct NormalizeU8Args a = {x->blob_u8, scale, shift, x_f->blob, x->n};
+    CHK_ERR(parallelFor(NULL, 0, x->b_used, (long)x->n * TENSOR_COST_ELEMWISE, normalizeU8Range, &a));
+    x_f->b_used = x->b_used;
+    return SUCCESS;
+}
+
 int linearTensorBackward(struct Tensor *z, const struct Tensor *x, const struct Tensor *y)
 {
     CHK_NIL(z);
@@ -683,10 +1106,11 @@ int linearTensorBackward(struct Tensor *z, const struct Tensor *x, const struct
     //     float *B, int ldb,
     //     float BETA,
     //     float *C, int ldc)
+    // 灵敏度每次重新计算, beta = 0, 不能累加上一个iter的结果
     gemm(0, 0, x->b_used, y->col, y->row, 1., 
         x->blob, x->n, 
         y->blob, y->col, 
-        1., 
+        0., 
         z->blob, z->n);
     z->b_used = x->b_used;
     return SUCCESS;
@@ -699,7 +1123,7 @@ int linearTensorWeightGradient(struct Tensor *z, const struct Tensor *x, const s
     CHK_NIL(y);
     CHK_ERR((x->b_used > 0)? 0: 1);
     CHK_ERR((x->ttype == DATA_TENSOR_TYPE)? 0: 1);
-    CHK_ERR((y->ttype == DATA_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((y->ttype == DATA_TENSOR_TYPE && y->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
     CHK_ERR((z->ttype == PARAM_TENSOR_TYPE)? 0: 1);
     CHK_ERR((z->col == y->n)? 0: 1);
     CHK_ERR((z->row == x->n)? 0: 1);
@@ -726,6 +1150,52 @@ int linearTensorWeightGradient(struct Tensor *z, const struct Tensor *x, const s
 }
 
 
+int linearTensorForwardCsr(struct Tensor *z, const struct Tensor *x, const struct Tensor *y, const struct Tensor *b)
+{
+    CHK_NIL(z);
+    CHK_NIL(x);
+    CHK_NIL(y);
+    CHK_ERR((x->b_used > 0)? 0: 1);
+    CHK_ERR((x->ttype == DATA_TENSOR_TYPE && x->layout == CSR_TENSOR_LAYOUT)? 0: 1);
+    CHK_ERR((z->ttype == DATA_TENSOR_TYPE && z->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
+    CHK_ERR((y->ttype == PARAM_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((x->n == y->col)? 0: 1);
+    CHK_ERR((z->n == y->row)? 0: 1);
+    CHK_ERR((z->b >= x->b_used)? 0: 1);
+    if (b) {
+        CHK_ERR((b->ttype == PARAM_TENSOR_TYPE && b->col == y->row)? 0: 1);
+    }
+
+    struct CsrRangeArgs a = {.z = z->blob, .w = y->blob, .bias = (b)? b->blob: NULL,
+        .row_ptr = x->csr_row_ptr, .col_idx = x->csr_col_idx, .val = x->csr_val, .m = x->b_used, .n_in = x->n, .n_out = y->row};
+    long nnz = x->csr_row_ptr[x->b_used] - x->csr_row_ptr[0];
+    long cost = (nnz / x->b_used + 1) * y->row * 2; // 每个样本的平均代价
+    CHK_ERR(parallelFor(NULL, 0, x->b_used, cost, csrForwardRange, &a));
+    z->b_used = x->b_used;
+    return SUCCESS;
+}
+
+int linearTensorWeightGradientCsr(struct Tensor *z, const struct Tensor *x, const struct Tensor *y)
+{
+    CHK_NIL(z);
+    CHK_NIL(x);
+    CHK_NIL(y);
+    CHK_ERR((x->b_used > 0)? 0: 1);
+    CHK_ERR((x->ttype == DATA_TENSOR_TYPE && x->layout == DENSE_TENSOR_LAYOUT)? 0: 1);
+    CHK_ERR((y->ttype == DATA_TENSOR_TYPE && y->layout == CSR_TENSOR_LAYOUT)? 0: 1);
+    CHK_ERR((z->ttype == PARAM_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((z->col == y->n)? 0: 1);
+    CHK_ERR((z->row == x->n)? 0: 1);
+    CHK_ERR((x->b_used == y->b_used)? 0: 1);
+
+    // 与linearTensorWeightGradient相同, 结果累加到z上
+    struct CsrRangeArgs a = {.z = z->blob, .delta = x->blob,
+        .row_ptr = y->csr_row_ptr, .col_idx = y->csr_col_idx, .val = y->csr_val, .m = y->b_used, .n_in = y->n, .n_out = x->n};
+    long nnz = y->csr_row_ptr[y->b_used] - y->csr_row_ptr[0];
+    CHK_ERR(parallelFor(NULL, 0, x->n, (nnz + y->b_used) * 2, csrWeightGradientRange, &a));
+    return SUCCESS;
+}
+
 // 2个形状完全相同的矩阵x和y的元素做Pointwise乘法, 之后每行求和, 压缩成一个向量, 结果保存在z中
 // 该函数用来在反向传播时计算偏置bias的梯度
 //int sumTensorAxisCol(struct Tensor *z, const struct Tensor *x)
@@ -741,18 +1211,53 @@ int linearTensorBiasGradient(struct Tensor *z, const struct Tensor *x)
     fprintf(stdout, "(z.b, z.row, z.col, z.c. z.n) = (%d, %d, %d, %d, %d)\n", z->b, z->row, z->col, z->c, z->n);
 #endif
 
-    int b_used = x->b_used; // batch_size
-    int n = x->n; // n_output
+    struct TensorRangeArgs a = {.y = z->blob, .u = x->blob, .m = x->b_used, .n = x->n}; // m: batch_size, n: n_output
+    CHK_ERR(parallelFor(NULL, 0, x->n, x->b_used, sumColumnsRange, &a));
+    return SUCCESS;
+}
+
+// 与linearTensorBiasGradient相同, 但结果累加到z上, 用于多个micro-batch的梯度累积
+int linearTensorBiasGradientAcc(struct Tensor *z, const struct Tensor *x)
+{
+    CHK_NIL(z);
+    CHK_NIL(x);
+    CHK_ERR((x->ttype == DATA_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((z->ttype == PARAM_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((z->col == x->n)? 0: 1);
+
+    int b_used = x->b_used;
+    int n = x->n;
     int i, j;
-    for (i = 0; i < n; ++i) {
-        z->blob[i] = 0.;
-        for (j = 0; j < b_used; ++j) {
+    for (j = 0; j < b_used; ++j) {
+        for (i = 0; i < n; ++i) {
             z->blob[i] += x->blob[j * n + i];
         }
     }
     return SUCCESS;
 }
 
+// x = alpha * x, 数据Tensor只处理已装填的b_used个样本
+int scaleTensor(struct Tensor *x, float alpha)
+{
+    CHK_NIL(x);
+    CHK_ERR((x->dtype == FLOAT32)? 0: 1);
+
+    int n = 0;
+    if (x->ttype == PARAM_TENSOR_TYPE) {
+        n = x->row * x->col;
+    }
+    else if (x->ttype == DATA_TENSOR_TYPE) {
+        n = x->b_used * x->n;
+    }
+    else {
+        ERR_MSG("TensorType: %s not supported yet, error.\n", getTensorTtypeStrFromEnum(x->ttype));
+        return ERR_COD;
+    }
+    struct TensorRangeArgs a = {.x = x->blob, .alpha = alpha};
+    CHK_ERR(parallelFor(NULL, 0, n, TENSOR_COST_ELEMWISE, scaleRange, &a));
+    return SUCCESS;
+}
+
 // x = x + lr * y
 // y = momentum * (lr * y), 动量法，保存用作下一轮使用
 // 该方法专门为参数更新准备，因此不涉及tensor->b和tensor->n
@@ -771,24 +1276,34 @@ int addTensor(struct Tensor *x, struct Tensor *y, float lr, float momentum)
 #ifdef _DEBUG
     fprintf(stdout, "(y.b, y.row, y.col, y.c, y.n) = (%d, %d, %d, %d, %d)\n", y->b, y->row, y->col, y->c, y->n);
 #endif
-    //fprintf(stdout, "(y.row, y.col) = (%d, %d)\n", y->row, y->col);
-    // STEP 1: y = lr * y
-    int i = 0;
-    for (i = 0; i < n; ++i) {
-        //(y->blob[i]) /= n_samples;
-        (y->blob[i]) *= lr;
-    }
+    // y = lr * y; x = x + y; y = momentum * y, 三步合并为一次遍历
+    struct TensorRangeArgs a = {.x = x->blob, .y = y->blob, .alpha = lr, .beta = momentum};
+    CHK_ERR(parallelFor(NULL, 0, n, TENSOR_COST_ELEMWISE, addParamRange, &a));
 
-    // STEP 2: x = x + lr
-    for (i = 0; i < n; ++i) {
-        x->blob[i] += y->blob[i];
-    }
+    return SUCCESS;
+}
 
-    // STEP 3: y = momentum * y
+// 与addTensor相同, 但x被多个线程无锁并发更新(Hogwild):
+// x的每个元素用relaxed原子读写, 保证单个float不会撕裂, 但读-改-写整体不是原子的, 并发时允许丢失其他线程的更新.
+// y是调用线程私有的梯度, 按普通内存访问.
+int addTensorHogwild(struct Tensor *x, struct Tensor *y, float lr, float momentum)
+{
+    CHK_NIL(x);
+    CHK_NIL(y);
+    CHK_ERR((x->ttype == PARAM_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((y->ttype == PARAM_TENSOR_TYPE)? 0: 1);
+    CHK_ERR((x->row * x->col == y->row * y->col)? 0: 1);
+
+    int n = y->row * y->col;
+    int i;
     for (i = 0; i < n; ++i) {
-        y->blob[i] *= momentum;
+        float step = lr * y->blob[i];
+        float val;
+        __atomic_load(x->blob + i, &val, __ATOMIC_RELAXED);
+        val += step;
+        __atomic_store(x->blob + i, &val, __ATOMIC_RELAXED);
+        y->blob[i] = momentum * step;
     }
-
     return SUCCESS;
 }
 
@@ -800,28 +1315,8 @@ int softmaxTensor(struct Tensor *output, const struct Tensor *input)
     CHK_ERR((output->ttype == DATA_TENSOR_TYPE)? 0: 1);
     CHK_ERR((output->n == input->n)? 0: 1);
 
-    int b_used = input->b_used;
-    int k = output->n;
-
-    int i;
-    for (i = 0; i < b_used; ++i) {
-        float largest = -FLT_MAX;
-        int j;
-        for(j = 0; j < k; ++j){
-            if(input->blob[i * k + j] > largest) {
-                largest = input->blob[i * k + j];
-            }
-        }
-        float sum = 0;
-        for(j = 0; j < k; ++j){
-            float e = exp(input->blob[i * k + j] - largest);
-            sum += e;
-            output->blob[i * k + j] = e;
-        }
-        for(j = 0; j < k; ++j){
-            (output->blob[i * k + j]) /= sum;
-        }
-    }
+    struct TensorRangeArgs a = {.y = output->blob, .u = input->blob, .n = output->n};
+    CHK_ERR(parallelFor(NULL, 0, input->b_used, (long)output->n * TENSOR_COST_EXP, softmaxRowsRange, &a));
     output->b_used = input->b_used;
     return SUCCESS;
 }
@@ -841,12 +1336,10 @@ int addTensor2(struct Tensor *delta, const struct Tensor *y, const struct Tensor
     fprintf(stdout, "(gt->b, gt->row, gt->col, gt->c, gt->n) = (%d, %d, %d, %d, %d)\n", gt->b, gt->row, gt->col, gt->c, gt->n);
     fprintf(stdout, "(delta->b, delta->row, delta->col, delta->c, delta->n) = (%d, %d, %d, %d, %d)\n", delta->b, delta->row, delta->col, delta->c, delta->n);
 #endif
-    int i;
+    struct TensorRangeArgs a = {.y = delta->blob, .u = y->blob, .u8 = gt->blob_u8, .alpha = (float)(gt->b_used)};
     switch (gt->dtype) {
-        case UINT8:
-        for (i = 0; i < n_elems; ++i) {
-            delta->blob[i] = (gt->blob_u8[i] - y->blob[i]) / (float)(gt->b_used); // 学习速率关于每个batch的样本数降低的计算，统一放在代价函数里，不需要放在每一层的update里
-        }
+        case UINT8: // 学习速率关于每个batch的样本数降低的计算，统一放在代价函数里，不需要放在每一层的update里
+        CHK_ERR(parallelFor(NULL, 0, n_elems, TENSOR_COST_ELEMWISE, ceDeltaRange, &a));
         break;
 
         default:
@@ -881,7 +1374,9 @@ int probTensor(float *val, const struct Tensor *p, const struct Tensor *gt)
             }
         }
     }
+#ifdef _DEBUG
     fprintf(stdout, "sum_log_p = %f, n = %d\n", sum_log_p, b_used);
+#endif
     *val = sum_log_p / b_used; // 计算平均值, 用于观察评估寻俩效果的代价值建议与样本数无关
     return SUCCESS;
 }
@@ -19,8 +19,15 @@ enum TensorType
     PARAM_TENSOR_TYPE
 };
 
+enum TensorLayout
+{
+    DENSE_TENSOR_LAYOUT,
+    CSR_TENSOR_LAYOUT // 稀疏数据张量, 只支持FLOAT32, 只能作为LinearLayer的输入
+};
+
 const char *getTensorDtypeStrFromEnum(enum DType dtype);
 enum DType getTensorDtypeEnumFromStr(const char *dtype_str);
+int getTensorDtypeSize(int *size, enum DType dtype);
 const char *getTensorTtypeStrFromEnum(enum TensorType ttype);
 
 struct Tensor;
@@ -31,6 +38,12 @@ int initTensorParameterAsBias(struct Tensor *tensor);
 int createTensorData(struct Tensor **t, enum DType dtype, int batch_size, int n_features);
 int createTensorParam(struct Tensor **t, enum DType dtype, int row, int col);
 int createTensorDataWithBlobRef(struct Tensor **t, void *blob, enum DType dtype, int batch_size, int n_features, int n_samples);
+/**
+ * @brief 引用调用者CSR数组的稀疏数据张量: 第i个样本的非零元为val[row_ptr[i]..row_ptr[i + 1]), 特征下标为col_idx中的对应位置.
+ *        row_ptr[0]不必为0, 整个数据集的CSR数组按batch切分时只需偏移row_ptr. 同一样本内的下标可以无序, 重复的下标按相加处理.
+ */
+int createTensorDataCsrWithRef(struct Tensor **t, const int *row_ptr, const int *col_idx, const float *val,
+    int batch_size, int n_features, int n_samples);
 void destroyTensor(struct Tensor *tensor);
 int loadtxtTensor(struct Tensor *tensor, const char *pth);
 int getTensorBlobByCopy(void *dst, enum DType dtype, const struct Tensor *tensor);
@@ -41,19 +54,44 @@ int getTensorCol(int *col, const struct Tensor *tensor);
 int getTensorBatch(int *b, const struct Tensor *tensor);
 int getTensorFeatures(int *n_features, const struct Tensor *tensor);
 int getTensorSamples(int *n_samples, const struct Tensor *tensor);
+int setTensorSamples(struct Tensor *tensor, int n_samples);
 int getTensorDType(enum DType *dtype, const struct Tensor *tensor);
 int getTensorType(enum TensorType *ttype, const struct Tensor *tensor);
 int getTensorBlob(void **blob, struct Tensor *tensor);
 int getTensorBlobConstRef(const void *(*blob), const struct Tensor *tensor);
+int getTensorLayout(enum TensorLayout *layout, const struct Tensor *tensor);
+int getTensorCsrConstRef(const int *(*row_ptr), const int *(*col_idx), const float *(*val), const struct Tensor *tensor);
+int setTensorCsrSamplesByReplace(struct Tensor *tensor, const int *row_ptr, const int *col_idx, const float *val, int n_samples, int n_features);
+/**
+ * @brief 张量改为引用调用者的blob(之后由调用者保管). 原blob是张量自己分配的(createTensorData)则在这里释放, *blob_old为NULL;
+ *        原blob引用外部数据时*blob_old返回它, 由其所有者处理. 之后与createTensorDataWithBlobRef的张量一样只用free()释放张量.
+ */
 int setTensorSamplesByReplace(void **blob_old, struct Tensor *tensor, void *blob, int n_samples, int n_features, enum DType dtype);
 
 int activateTensor(struct Tensor *y, const struct Tensor *x, enum ActivationType act_type);
 int deactivateTensor(struct Tensor *delta_out, const struct Tensor *delta_in, const struct Tensor *input, enum ActivationType act_type);
 int linearTensorForward(struct Tensor *z, const struct Tensor *x, const struct Tensor *y, const struct Tensor *b);
+/**
+ * @brief x为UINT8数据张量时的正向传播: 按特征做x * scale + shift转换(在gemm分块内完成), 转换结果写入FLOAT32张量x_f,
+ *        之后可用x_f代替x计算权重梯度. scale/shift为NULL时只做类型转换.
+ */
+int linearTensorForwardU8(struct Tensor *z, struct Tensor *x_f, const struct Tensor *x, const struct Tensor *y, const struct Tensor *b,
+    const float *scale, const float *shift);
+// 只做linearTensorForwardU8中x到x_f的转换, 用于反向传播时x_f已不对应x的情况(如流水线中多个micro-batch交错)
+int normalizeTensorU8(struct Tensor *x_f, const struct Tensor *x, const float *scale, const float *shift);
+/**
+ * @brief x为CSR张量时的正向传播和权重梯度, 只访问非零元, 计算量与n_nonzeros * n_output成正比而与输入维数无关.
+ *        参数含义与linearTensorForward/linearTensorWeightGradient相同.
+ */
+int linearTensorForwardCsr(struct Tensor *z, const struct Tensor *x, const struct Tensor *y, const struct Tensor *b);
+int linearTensorWeightGradientCsr(struct Tensor *z, const struct Tensor *x, const struct Tensor *y);
 int linearTensorBackward(struct Tensor *z, const struct Tensor *x, const struct Tensor *y);
 int linearTensorWeightGradient(struct Tensor *z, const struct Tensor *x, const struct Tensor *y);
 int linearTensorBiasGradient(struct Tensor *z, const struct Tensor *x);
+int linearTensorBiasGradientAcc(struct Tensor *z, const struct Tensor *x);
+int scaleTensor(struct Tensor *x, float alpha);
 int addTensor(struct Tensor *x, struct Tensor *y, float lr, float momentum);
+int addTensorHogwild(struct Tensor *x, struct Tensor *y, float lr, float momentum);
 //int addTensor(struct Tensor *x, struct Tensor *y, float lr, int n_samples, float momentum);
 int softmaxTensor(struct Tensor *output, const struct Tensor *input);
 int addTensor2(struct Tensor *delta, const struct Tensor *y, const struct Tensor *gt);
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "debug_macros.h"
+#include "affinity.h"
+#include "thread_pool.h"
+
+// 单个任务的最小代价, 约为10us的计算量, 低于它时调度开销不可忽略
+#define POOL_MIN_TASK_COST (32 * 1024)
+// 每个线程分到的区间数, 多于1以便负载不均时有任务可窃取
+#define POOL_CHUNKS_PER_THREAD (4)
+#define POOL_MAX_CHUNKS (256)
+#define POOL_INIT_DEQUE_CAP (64)
+
+struct PoolTask
+{
+    PoolTaskFunc fn;
+    void *arg;
+    int *n_pending;
+};
+
+// [head, tail)为有效任务, 下标对cap取模, cap是2的幂
+struct TaskDeque
+{
+    pthread_mutex_t mtx;
+    struct PoolTask *tasks;
+    int cap;
+    int head;
+    int tail;
+};
+
+struct ThreadPool
+{
+    int n_threads;
+    int n_started;
+    pthread_t *tids;
+    struct TaskDeque *deques; // 0号由池外线程共用, i号(i > 0)属于第i个后台线程
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    int n_queued; // 所有队列中的任务数
+    int n_sleeping;
+    int quit;
+};
+
+struct PoolWorker
+{
+    struct ThreadPool *pool;
+    int idx;
+};
+
+static __thread struct ThreadPool *tls_pool = NULL;
+static __thread int tls_idx = 0;
+static __thread int tls_inline = 0;
+
+static struct ThreadPool *default_pool = NULL;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+// ---------------- 任务队列 ----------------
+
+static int pushTaskDeque(struct TaskDeque *dq, const struct PoolTask *task)
+{
+    pthread_mutex_lock(&(dq->mtx));
+    if (dq->tail - dq->head == dq->cap) {
+        int cap = dq->cap * 2;
+        struct PoolTask *tasks = calloc(cap, sizeof(struct PoolTask));
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&(dq->mtx));
+            ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        int i;
+        for (i = dq->head; i < dq->tail; ++i) {
+            tasks[i - dq->head] = dq->tasks[i & (dq->cap - 1)];
+        }
+        free(dq->tasks);
+        dq->tasks = tasks;
+        dq->tail -= dq->head;
+        dq->head = 0;
+        dq->cap = cap;
+    }
+    dq->tasks[dq->tail & (dq->cap - 1)] = *task;
+    ++(dq->tail);
+    pthread_mutex_unlock(&(dq->mtx));
+    return SUCCESS;
+}
+
+// from_tail非0时按LIFO取出(队列所有者), 否则按FIFO窃取
+static int popTaskDeque(struct TaskDeque *dq, struct PoolTask *task, int from_tail)
+{
+    int found = 0;
+    pthread_mutex_lock(&(dq->mtx));
+    if (dq->tail > dq->head) {
+        if (from_tail) {
+            --(dq->tail);
+            *task = dq->tasks[dq->tail & (dq->cap - 1)];
+        }
+        else {
+            *task = dq->tasks[dq->head & (dq->cap - 1)];
+            ++(dq->head);
+        }
+        found = 1;
+    }
+    pthread_mutex_unlock(&(dq->mtx));
+    return found;
+}
+
+static int getSelfIndex(const struct ThreadPool *pool)
+{
+    return (tls_pool == pool)? tls_idx: 0;
+}
+
+static int findTask(struct ThreadPool *pool, struct PoolTask *task)
+{
+    if (__atomic_load_n(&(pool->n_queued), __ATOMIC_SEQ_CST) == 0) {
+        return 0;
+    }
+    int self = getSelfIndex(pool);
+    int found = popTaskDeque(&(pool->deques[self]), task, 1);
+    int k;
+    for (k = 1; !found && k < pool->n_threads; ++k) {
+        found = popTaskDeque(&(pool->deques[(self + k) % pool->n_threads]), task, 0);
+    }
+    if (found) {
+        __atomic_sub_fetch(&(pool->n_queued), 1, __ATOMIC_SEQ_CST);
+    }
+    return found;
+}
+
+static void runTask(const struct PoolTask *task)
+{
+    task->fn(task->arg);
+    __atomic_sub_fetch(task->n_pending, 1, __ATOMIC_RELEASE);
+}
+
+// ---------------- 后台线程 ----------------
+
+static void *runPoolWorker(void *arg)
+{
+    struct PoolWorker *worker = arg;
+    struct ThreadPool *pool = worker->pool;
+    tls_pool = pool;
+    tls_idx = worker->idx;
+    free(worker);
+
+    enum AffinityMode mode = AFFINITY_NONE;
+    getAffinityMode(&mode);
+    if (mode != AFFINITY_NONE) {
+        bindThreadToCpus(pthread_self(), tls_idx, pool->n_threads);
+    }
+
+    struct PoolTask task;
+    while (1) {
+        if (findTask(pool, &task)) {
+            runTask(&task);
+            continue;
+        }
+        // n_sleeping与n_queued都用SEQ_CST访问, 提交任务的线程和将要睡眠的线程至少有一方能看到对方的修改
+        pthread_mutex_lock(&(pool->mtx));
+        __atomic_add_fetch(&(pool->n_sleeping), 1, __ATOMIC_SEQ_CST);
+        while (!pool->quit && __atomic_load_n(&(pool->n_queued), __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&(pool->cond), &(pool->mtx));
+        }
+        __atomic_sub_fetch(&(pool->n_sleeping), 1, __ATOMIC_SEQ_CST);
+        int quit = pool->quit;
+        pthread_mutex_unlock(&(pool->mtx));
+        if (quit) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+int createThreadPool(struct ThreadPool **pool, int n_threads)
+{
+    CHK_NIL(pool);
+    CHK_ERR((n_threads > 0)? 0: 1);
+
+    struct ThreadPool *res = calloc(1, sizeof(struct ThreadPool));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    res->n_threads = n_threads;
+    CHK_ERR_GOTO(pthread_mutex_init(&(res->mtx), NULL));
+    CHK_ERR_GOTO(pthread_cond_init(&(res->cond), NULL));
+    CHK_NIL_GOTO((res->tids = calloc(n_threads, sizeof(pthread_t))));
+    CHK_NIL_GOTO((res->deques = calloc(n_threads, sizeof(struct TaskDeque))));
+    int i;
+    for (i = 0; i < n_threads; ++i) {
+        CHK_ERR_GOTO(pthread_mutex_init(&(res->deques[i].mtx), NULL));
+        CHK_NIL_GOTO((res->deques[i].tasks = calloc(POOL_INIT_DEQUE_CAP, sizeof(struct PoolTask))));
+        res->deques[i].cap = POOL_INIT_DEQUE_CAP;
+    }
+    for (i = 1; i < n_threads; ++i) {
+        struct PoolWorker *worker = calloc(1, sizeof(struct PoolWorker));
+        CHK_NIL_GOTO(worker);
+        worker->pool = res;
+        worker->idx = i;
+        if (pthread_create(&(res->tids[i]), NULL, runPoolWorker, worker) != 0) {
+            ERR_MSG("pthread_create() failed, error.\n");
+            free(worker);
+            goto err_end;
+        }
+        ++(res->n_started);
+    }
+
+    *pool = res;
+    return SUCCESS;
+
+err_end:
+    destroyThreadPool(res);
+    return ERR_COD;
+}
+
+void destroyThreadPool(struct ThreadPool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&(pool->mtx));
+    pool->quit = 1;
+    pthread_cond_broadcast(&(pool->cond));
+    pthread_mutex_unlock(&(pool->mtx));
+    int i;
+    for (i = 1; i <= pool->n_started; ++i) {
+        pthread_join(pool->tids[i], NULL);
+    }
+    if (pool->deques) {
+        for (i = 0; i < pool->n_threads; ++i) {
+            if (pool->deques[i].tasks) {
+                pthread_mutex_destroy(&(pool->deques[i].mtx));
+            }
+            free(pool->deques[i].tasks);
+        }
+    }
+    pthread_cond_destroy(&(pool->cond));
+    pthread_mutex_destroy(&(pool->mtx));
+    free(pool->deques);
+    free(pool->tids);
+    free(pool);
+}
+
+// 子进程里没有后台线程, 默认线程池只能串行执行
+static void onForkChild()
+{
+    if (default_pool) {
+        default_pool->n_threads = 1;
+    }
+}
+
+static void createDefaultThreadPool()
+{
+    int n_threads = 0;
+    const char *env = getenv("NN_NUM_THREADS");
+    if (env) {
+        n_threads = atoi(env);
+    }
+    if (n_threads <= 0) {
+        n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (n_threads <= 0) {
+        n_threads = 1;
+    }
+    if (createThreadPool(&default_pool, n_threads) != SUCCESS) {
+        default_pool = NULL;
+        return;
+    }
+    pthread_atfork(NULL, NULL, onForkChild);
+}
+
+int getDefaultThreadPool(struct ThreadPool **pool)
+{
+    CHK_NIL(pool);
+
+    pthread_once(&default_once, createDefaultThreadPool);
+    CHK_NIL(default_pool);
+    *pool = default_pool;
+    return SUCCESS;
+}
+
+int getThreadPoolSize(int *n_threads, const struct ThreadPool *pool)
+{
+    CHK_NIL(n_threads);
+    CHK_NIL(pool);
+
+    *n_threads = pool->n_threads;
+    return SUCCESS;
+}
+
+// ---------------- 任务 ----------------
+
+int spawnThreadPoolTask(struct ThreadPool *pool, struct TaskGroup *group, PoolTaskFunc fn, void *arg)
+{
+    CHK_NIL(pool);
+    CHK_NIL(group);
+    CHK_NIL(fn);
+
+    if (pool->n_threads == 1) {
+        fn(arg);
+        return SUCCESS;
+    }
+    struct PoolTask task = {fn, arg, &(group->n_pending)};
+    __atomic_add_fetch(&(group->n_pending), 1, __ATOMIC_RELAXED);
+    if (pushTaskDeque(&(pool->deques[getSelfIndex(pool)]), &task) != SUCCESS) {
+        __atomic_sub_fetch(&(group->n_pending), 1, __ATOMIC_RELAXED);
+        return ERR_COD;
+    }
+    __atomic_add_fetch(&(pool->n_queued), 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(pool->n_sleeping), __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&(pool->mtx));
+        pthread_cond_signal(&(pool->cond));
+        pthread_mutex_unlock(&(pool->mtx));
+    }
+    return SUCCESS;
+}
+
+// 等待期间执行队列中的任务(不限于本组), 嵌套并行不会因为等待而占住线程
+int waitThreadPoolTasks(struct ThreadPool *pool, struct TaskGroup *group)
+{
+    CHK_NIL(pool);
+    CHK_NIL(group);
+
+    struct PoolTask task;
+    while (__atomic_load_n(&(group->n_pending), __ATOMIC_ACQUIRE) > 0) {
+        if (findTask(pool, &task)) {
+            runTask(&task);
+        }
+        else {
+            sched_yield();
+        }
+    }
+    return SUCCESS;
+}
+
+struct RangeTask
+{
+    PoolRangeFunc fn;
+    void *arg;
+    int lo;
+    int hi;
+};
+
+static void runRangeTask(void *arg)
+{
+    struct RangeTask *task = arg;
+    task->fn(task->arg, task->lo, task->hi);
+}
+
+int parallelFor(struct ThreadPool *pool, int begin, int end, long cost, PoolRangeFunc fn, void *arg)
+{
+    CHK_NIL(fn);
+
+    int n = end - begin;
+    if (n <= 0) {
+        return SUCCESS;
+    }
+    if (pool == NULL) {
+        pthread_once(&default_once, createDefaultThreadPool);
+        pool = default_pool;
+    }
+
+    // 代价模型: 每个区间至少POOL_MIN_TASK_COST
+    int n_chunks = 1;
+    if (pool && pool->n_threads > 1 && !tls_inline) {
+        double total = (double)n * (cost > 0? cost: 1);
+        double max_chunks = total / POOL_MIN_TASK_COST;
+        n_chunks = pool->n_threads * POOL_CHUNKS_PER_THREAD;
+        if (n_chunks > POOL_MAX_CHUNKS) {
+            n_chunks = POOL_MAX_CHUNKS;
+        }
+        if (n_chunks > max_chunks) {
+            n_chunks = (int)max_chunks;
+        }
+        if (n_chunks > n) {
+            n_chunks = n;
+        }
+    }
+    if (n_chunks <= 1) {
+        fn(arg, begin, end);
+        return SUCCESS;
+    }
+
+    struct RangeTask tasks[POOL_MAX_CHUNKS];
+    struct TaskGroup group;
+    memset(&group, 0, sizeof(struct TaskGroup));
+    int k;
+    for (k = 0; k < n_chunks; ++k) {
+        tasks[k].fn = fn;
+        tasks[k].arg = arg;
+        tasks[k].lo = begin + (int)((long)n * k / n_chunks);
+        tasks[k].hi = begin + (int)((long)n * (k + 1) / n_chunks);
+    }
+    for (k = n_chunks - 1; k > 0; --k) { // 提交失败的区间在调用线程上执行
+        if (spawnThreadPoolTask(pool, &group, runRangeTask, &(tasks[k])) != SUCCESS) {
+            runRangeTask(&(tasks[k]));
+        }
+    }
+    runRangeTask(&(tasks[0]));
+    CHK_ERR(waitThreadPoolTasks(pool, &group));
+    return SUCCESS;
+}
+
+void setParallelForInline(int on)
+{
+    tls_inline = on;
+}
@@ -0,0 +1,48 @@
+/**
+ * @brief 常驻的work-stealing线程池, 库内所有并行计算的运行时.
+ *        每个后台线程有自己的任务双端队列, 自己从队尾压入/取出(LIFO), 空闲时从其他队列的队头窃取(FIFO);
+ *        池外线程提交的任务进入共用的0号队列. 等待任务组的线程不阻塞, 而是一边等一边执行队列中的任务,
+ *        因此在任务中再次调用parallelFor(嵌套并行)只会产生更多任务, 不会产生更多线程.
+ *
+ *        parallelFor带一个简单的代价模型: 总代价(迭代数 * 每次迭代的代价, 单位约为一次浮点运算)
+ *        不足POOL_MIN_TASK_COST的两倍时直接在调用线程上执行, 小算子(如10类softmax, bias梯度)没有调度开销.
+ *
+ *        默认线程池在第一次使用时创建, 线程数取环境变量NN_NUM_THREADS, 未设置时取在线CPU数;
+ *        fork出的子进程中默认线程池退化为串行执行.
+ *        affinity.h配置了绑核方式时, 后台线程启动后按配置绑定CPU.
+ */
+#pragma once
+
+struct ThreadPool;
+
+// 任务组计数器, 可以放在栈上, 使用前清零
+struct TaskGroup
+{
+    int n_pending;
+};
+
+typedef void (*PoolTaskFunc)(void *arg);
+typedef void (*PoolRangeFunc)(void *arg, int lo, int hi);
+
+/**
+ * @param n_threads: 并行度, 包括调用线程在内, 后台线程数为n_threads - 1
+ */
+int createThreadPool(struct ThreadPool **pool, int n_threads);
+void destroyThreadPool(struct ThreadPool *pool);
+int getDefaultThreadPool(struct ThreadPool **pool);
+int getThreadPoolSize(int *n_threads, const struct ThreadPool *pool);
+
+int spawnThreadPoolTask(struct ThreadPool *pool, struct TaskGroup *group, PoolTaskFunc fn, void *arg);
+int waitThreadPoolTasks(struct ThreadPool *pool, struct TaskGroup *group);
+
+/**
+ * @brief 把[begin, end)切分为若干连续区间并行执行fn(arg, lo, hi), 返回时全部区间已执行完.
+ *        pool为NULL时使用默认线程池. cost是每次迭代的估计代价.
+ */
+int parallelFor(struct ThreadPool *pool, int begin, int end, long cost, PoolRangeFunc fn, void *arg);
+
+/**
+ * @brief on非0时当前线程之后的parallelFor都直接在本线程上执行.
+ *        用于本身已经是并行单位的线程(分片线程, 流水线段线程, Hogwild线程), 使计算和首次写入留在本线程
+ */
+void setParallelForInline(int on);
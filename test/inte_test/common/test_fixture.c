@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "layer.h"
+#include "linear_layer.h"
+#include "sigmoid_layer.h"
+#include "relu_layer.h"
+#include "ce_cost.h"
+#include "tensor.h"
+#include "rng.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+int labelDataset(unsigned char *gt, const void *x, const char *dtype_str, int n_samples, int n_features, int n_classes)
+{
+    CHK_NIL(gt);
+    CHK_NIL(x);
+    CHK_NIL(dtype_str);
+    CHK_ERR((n_classes > 0 && n_classes <= n_features)? 0: 1);
+
+    enum DType dtype = getTensorDtypeEnumFromStr(dtype_str);
+    CHK_ERR((dtype == FLOAT32 || dtype == UINT8)? 0: 1);
+    int i, j;
+    for (i = 0; i < n_samples; ++i) {
+        int label = 0;
+        for (j = 1; j < n_classes; ++j) {
+            long k = (long)i * n_features;
+            int greater = (dtype == FLOAT32)?
+                ((const float *)x)[k + j] > ((const float *)x)[k + label]:
+                ((const unsigned char *)x)[k + j] > ((const unsigned char *)x)[k + label];
+            if (greater) {
+                label = j;
+            }
+        }
+        memset(gt + (long)i * n_classes, 0, n_classes);
+        gt[(long)i * n_classes + label] = 1;
+    }
+    return SUCCESS;
+}
+
+int makeDataset(float *x, unsigned char *gt, int n_samples, int n_features, int n_classes)
+{
+    CHK_NIL(x);
+    long i;
+    for (i = 0; i < (long)n_samples * n_features; ++i) {
+        x[i] = (float)rand() / RAND_MAX;
+    }
+    CHK_ERR(labelDataset(gt, x, "float32", n_samples, n_features, n_classes));
+    return SUCCESS;
+}
+
+int createLayers(struct Layer **layers, struct CECost **cost, const int *n_units, const enum LayerType *act_types, int n_linear)
+{
+    CHK_NIL(layers);
+    CHK_NIL(cost);
+    CHK_NIL(n_units);
+    CHK_ERR((n_linear > 0)? 0: 1);
+
+    setRandomSeed(1);
+    char name[64];
+    int i;
+    for (i = 0; i < n_linear; ++i) {
+        snprintf(name, sizeof(name), "LIN_L%d", i);
+        CHK_ERR(createLinearLayer((struct LinearLayer **)&(layers[2 * i]), name, n_units[i], n_units[i + 1]));
+        if (i == n_linear - 1) {
+            break;
+        }
+        CHK_NIL(act_types);
+        switch (act_types[i]) {
+            case SIGMOID_LAYER_TYPE:
+            snprintf(name, sizeof(name), "SIG_L%d", i);
+            CHK_ERR(createSigmoidLayer((struct SigmoidLayer **)&(layers[2 * i + 1]), name));
+            break;
+
+            case RELU_LAYER_TYPE:
+            snprintf(name, sizeof(name), "RELU_L%d", i);
+            CHK_ERR(createReluLayer((struct ReluLayer **)&(layers[2 * i + 1]), name));
+            break;
+
+            default:
+            ERR_MSG("Unsupported activation layer type: %d, error.\n", act_types[i]);
+            return ERR_COD;
+        }
+    }
+    snprintf(name, sizeof(name), "CE_L%d", n_linear - 1);
+    CHK_ERR(createCECost(cost, name, n_units[n_linear]));
+    return SUCCESS;
+}
+
+float diffLayers(struct Layer **x, struct Layer **y, int n_layers)
+{
+    float res = 0.;
+    int k, i;
+    for (k = 0; k < n_layers; ++k) {
+        int n = 0;
+        getLayerParamNumber(&n, x[k]);
+        if (n == 0) {
+            continue;
+        }
+        float *p_x = calloc(n, sizeof(float));
+        float *p_y = calloc(n, sizeof(float));
+        packLayerParam(p_x, x[k]);
+        packLayerParam(p_y, y[k]);
+        for (i = 0; i < n; ++i) {
+            res = fmaxf(res, fabsf(p_x[i] - p_y[i]) / fmaxf(1., fabsf(p_x[i])));
+        }
+        free(p_x);
+        free(p_y);
+    }
+    return res;
+}
@@ -0,0 +1,26 @@
+/**
+ * @brief 集成测试共用的数据集, 网络和参数比较, 由各测试的build.sh与test.c一起编译.
+ */
+#pragma once
+
+#include "layer.h"
+#include "ce_cost.h"
+
+/**
+ * @brief 按x中每个样本的前n_classes个特征取最大者作为类别, 写入one-hot的gt(n_samples * n_classes), dtype_str为"float32"或"uint8".
+ *        x的生成不受限制, 构造的数据集总是可分的.
+ */
+int labelDataset(unsigned char *gt, const void *x, const char *dtype_str, int n_samples, int n_features, int n_classes);
+
+// 特征取[0, 1]上rand()的均匀分布, 再用labelDataset标注
+int makeDataset(float *x, unsigned char *gt, int n_samples, int n_features, int n_classes);
+
+/**
+ * @brief 创建n_linear个线性层组成的网络和CECost: 第i个线性层为n_units[i] -> n_units[i + 1],
+ *        相邻线性层之间插入act_types[i]指定的SIGMOID_LAYER_TYPE或RELU_LAYER_TYPE层, 共2 * n_linear - 1层.
+ *        创建前setRandomSeed(1), 多次调用得到相同的初始参数.
+ */
+int createLayers(struct Layer **layers, struct CECost **cost, const int *n_units, const enum LayerType *act_types, int n_linear);
+
+// 返回两组结构相同的层的参数最大相对误差
+float diffLayers(struct Layer **x, struct Layer **y, int n_layers);
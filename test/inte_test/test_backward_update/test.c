@@ -0,0 +1,114 @@
+/**
+ * @brief 两份初始参数相同的网络分别用backwardNetwork + updateNetwork和backwardUpdateNetwork训练, 检查参数完全一致并比较耗时.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "network.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN0 (128)
+#define N_HIDDEN1 (64)
+#define N_CLASSES (10)
+#define N_SAMPLES (2048)
+#define N_LAYERS (5)
+#define BATCH_SIZE (64)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN0, N_HIDDEN1, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE, RELU_LAYER_TYPE};
+
+int main()
+{
+    struct Layer *layers_n[N_LAYERS];
+    struct Layer *layers_p[N_LAYERS];
+    struct CECost *cost_n = NULL;
+    struct CECost *cost_p = NULL;
+    CHK_ERR(createLayers(layers_n, &cost_n, n_units, act_types, 3));
+    CHK_ERR(createLayers(layers_p, &cost_p, n_units, act_types, 3));
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = BATCH_SIZE;
+    args.lr = 0.05;
+    args.momentum = 0.5;
+    args.n_epochs = 1;
+
+    struct Network *net_n = NULL;
+    struct Network *net_p = NULL;
+    CHK_ERR(createNetwork(&net_n, layers_n, N_LAYERS, (struct Cost *)cost_n));
+    CHK_ERR(createNetwork(&net_p, layers_p, N_LAYERS, (struct Cost *)cost_p));
+
+    float *x = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *gt = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    CHK_NIL(x);
+    CHK_NIL(gt);
+    srand(2);
+    CHK_ERR(makeDataset(x, gt, N_SAMPLES, N_FEATURES, N_CLASSES));
+
+    struct Probe probe_n, probe_p;
+    memset(&probe_n, 0, sizeof(struct Probe));
+    memset(&probe_p, 0, sizeof(struct Probe));
+    probe_n.sw_ce_cost = 1;
+    probe_p.sw_ce_cost = 1;
+
+    struct timeval t0, t1, t2;
+    double elapsed_n = 0.;
+    double elapsed_p = 0.;
+    float max_diff = 0.;
+    int i;
+    for (i = 0; i * BATCH_SIZE < N_SAMPLES; ++i) {
+        int n_samples = (i == N_SAMPLES / BATCH_SIZE - 1)? BATCH_SIZE - 3: BATCH_SIZE; // 最后一个batch不满
+        const float *batch = x + i * BATCH_SIZE * N_FEATURES;
+        const unsigned char *label = gt + i * BATCH_SIZE * N_CLASSES;
+        args.cur_iter = i;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetwork(net_n, batch, n_samples, N_FEATURES, "float32", &args, &probe_n));
+        CHK_ERR(backwardNetwork(net_n, label, n_samples, N_CLASSES, "uint8", &args, &probe_n));
+        CHK_ERR(updateNetwork(net_n, &args, &probe_n));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_n += t2.tv_sec + t2.tv_usec / 1e6;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetwork(net_p, batch, n_samples, N_FEATURES, "float32", &args, &probe_p));
+        CHK_ERR(backwardUpdateNetwork(net_p, label, n_samples, N_CLASSES, "uint8", &args, &probe_p));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_p += t2.tv_sec + t2.tv_usec / 1e6;
+
+        float diff = diffLayers(layers_n, layers_p, N_LAYERS);
+        max_diff = fmaxf(max_diff, diff);
+        if (diff != 0. || probe_n.ce_cost != probe_p.ce_cost) { // 每层的计算和更新顺序都没有变, 结果应逐位相同
+            ERR_MSG("iter %d: overlapped update differs from sequential update, ce_cost %f vs %f, max rel diff = %e, error.\n",
+                i, probe_n.ce_cost, probe_p.ce_cost, diff);
+            return ERR_COD;
+        }
+    }
+    fprintf(stdout, "%d iters, batch size %d, max rel diff = %e, last ce_cost = %f\n", i, BATCH_SIZE, max_diff, probe_p.ce_cost);
+    fprintf(stdout, "sequential update: %.3fs, overlapped update: %.3fs\n", elapsed_n, elapsed_p);
+
+    destroyNetwork(net_n);
+    destroyNetwork(net_p);
+    for (i = 0; i < N_LAYERS; ++i) {
+        destroyLayer(layers_n[i]);
+        destroyLayer(layers_p[i]);
+    }
+    destroyCost((struct Cost *)cost_n);
+    destroyCost((struct Cost *)cost_p);
+    free(x);
+    free(gt);
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * @brief 对含有可合并线性层, 瓶颈结构和末尾softmax层的网络做图优化, 检查层数和推理结果不变;
+ *        第一层设置了输入归一化时, 合并后的网络对uint8输入的推理结果也不变.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "network.h"
+#include "graph_opt.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "sigmoid_layer.h"
+#include "relu_layer.h"
+#include "softmax_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "tensor.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "rng.h"
+#include "debug_macros.h"
+
+#define N_FEATURES (784)
+#define N_CLASSES (10)
+#define N_SAMPLES (256)
+#define N_LAYERS (8)
+#define N_LAYERS_OPT (6) // 784->64->32合并, 32->4->32不合并, softmax去掉
+
+int main()
+{
+    struct Layer *layers[N_LAYERS];
+    struct CECost *cost = NULL;
+    setRandomSeed(1);
+    CHK_ERR(createLinearLayer((struct LinearLayer **)&(layers[0]), "LIN_L0", N_FEATURES, 64));
+    CHK_ERR(createLinearLayer((struct LinearLayer **)&(layers[1]), "LIN_L1", 64, 32));
+    CHK_ERR(createSigmoidLayer((struct SigmoidLayer **)&(layers[2]), "SIG_L1"));
+    CHK_ERR(createLinearLayer((struct LinearLayer **)&(layers[3]), "LIN_L2", 32, 4));
+    CHK_ERR(createLinearLayer((struct LinearLayer **)&(layers[4]), "LIN_L3", 4, 32));
+    CHK_ERR(createReluLayer((struct ReluLayer **)&(layers[5]), "RELU_L3"));
+    CHK_ERR(createLinearLayer((struct LinearLayer **)&(layers[6]), "LIN_L4", 32, N_CLASSES));
+    CHK_ERR(createSoftmaxLayer((struct SoftmaxLayer **)&(layers[7]), "SOFTMAX_L4"));
+    CHK_ERR(createCECost(&cost, "CE_L4", N_CLASSES));
+    float mean = 0.1307f;
+    float std = 0.3081f;
+    CHK_ERR(setLinearLayerInputNormalization((struct LinearLayer *)layers[0], &mean, &std, 1));
+
+    struct Layer **layers_opt = NULL;
+    int n_layers_opt = 0;
+    struct CECost *cost_opt = NULL;
+    CHK_ERR(optimizeLayers(&layers_opt, &n_layers_opt, layers, N_LAYERS, (struct Cost *)cost));
+    CHK_ERR(createCECost(&cost_opt, "CE_L4", N_CLASSES));
+    if (n_layers_opt != N_LAYERS_OPT) {
+        ERR_MSG("optimized network has %d layers, expect %d, error.\n", n_layers_opt, N_LAYERS_OPT);
+        return ERR_COD;
+    }
+
+    struct Network *net = NULL;
+    struct Network *net_opt = NULL;
+    CHK_ERR(createNetwork(&net, layers, N_LAYERS, (struct Cost *)cost));
+    CHK_ERR(createNetwork(&net_opt, layers_opt, n_layers_opt, (struct Cost *)cost_opt));
+    int i;
+    for (i = 0; i < n_layers_opt; ++i) {
+        int n_in, n_out;
+        CHK_ERR(getLayerShape(&n_in, &n_out, layers_opt[i]));
+        fprintf(stdout, "layer %d: %s (%d -> %d)\n", i, layers_opt[i]->name, n_in, n_out);
+    }
+
+    float *x = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *x_u = calloc(N_SAMPLES * N_FEATURES, sizeof(unsigned char));
+    CHK_NIL(x);
+    CHK_NIL(x_u);
+    for (i = 0; i < N_SAMPLES * N_FEATURES; ++i) {
+        x[i] = (float)rand() / RAND_MAX;
+        x_u[i] = (unsigned char)(rand() % 256);
+    }
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = N_SAMPLES;
+    args.lr = 0.1;
+    struct Probe probe;
+    memset(&probe, 0, sizeof(struct Probe));
+
+    struct timeval t0, t1, t2, t3;
+    CHK_ERR(gettimeofday(&t0, NULL));
+    CHK_ERR(forwardNetwork(net, x, N_SAMPLES, N_FEATURES, "float32", &args, &probe));
+    CHK_ERR(gettimeofday(&t1, NULL));
+    CHK_ERR(forwardNetwork(net_opt, x, N_SAMPLES, N_FEATURES, "float32", &args, &probe));
+    CHK_ERR(gettimeofday(&t2, NULL));
+
+    // 原网络softmax层的输出与优化后网络代价函数的分类概率一致
+    float *p = NULL;
+    const float *p_opt = NULL;
+    CHK_ERR(getTensorBlob((void **)&p, layers[N_LAYERS - 1]->output));
+    CHK_ERR(getNetworkClassProbabilityConstRef(&p_opt, net_opt));
+    float max_diff = 0.;
+    for (i = 0; i < N_SAMPLES * N_CLASSES; ++i) {
+        max_diff = fmaxf(max_diff, fabsf(p[i] - p_opt[i]));
+    }
+    if (max_diff > 1e-5) {
+        ERR_MSG("optimized network output differs, max diff = %e, error.\n", max_diff);
+        return ERR_COD;
+    }
+
+    // uint8输入经过第一层的归一化, 合并后的层必须保留它; 网络的输入类型固定, 另建两个网络共用同一组层
+    struct Network *net_u = NULL;
+    struct Network *net_opt_u = NULL;
+    CHK_ERR(createNetwork(&net_u, layers, N_LAYERS, (struct Cost *)cost));
+    CHK_ERR(createNetwork(&net_opt_u, layers_opt, n_layers_opt, (struct Cost *)cost_opt));
+    CHK_ERR(forwardNetwork(net_u, x_u, N_SAMPLES, N_FEATURES, "uint8", &args, &probe));
+    CHK_ERR(forwardNetwork(net_opt_u, x_u, N_SAMPLES, N_FEATURES, "uint8", &args, &probe));
+    CHK_ERR(getTensorBlob((void **)&p, layers[N_LAYERS - 1]->output));
+    CHK_ERR(getNetworkClassProbabilityConstRef(&p_opt, net_opt_u));
+    float max_diff_u = 0.;
+    for (i = 0; i < N_SAMPLES * N_CLASSES; ++i) {
+        max_diff_u = fmaxf(max_diff_u, fabsf(p[i] - p_opt[i]));
+    }
+    if (max_diff_u > 1e-5) {
+        ERR_MSG("optimized network output differs for normalized uint8 input, max diff = %e, error.\n", max_diff_u);
+        return ERR_COD;
+    }
+    fprintf(stdout, "uint8 input max diff = %e\n", max_diff_u);
+
+    timersub(&t1, &t0, &t3);
+    fprintf(stdout, "max diff = %e, original: %.3fms", max_diff, (t3.tv_sec * 1e6 + t3.tv_usec) / 1e3);
+    timersub(&t2, &t1, &t3);
+    fprintf(stdout, ", optimized: %.3fms\n", (t3.tv_sec * 1e6 + t3.tv_usec) / 1e3);
+
+    destroyNetwork(net_opt_u);
+    destroyNetwork(net_u);
+    destroyNetwork(net_opt);
+    destroyNetwork(net);
+    destroyOptimizedLayers(layers_opt, n_layers_opt);
+    for (i = 0; i < N_LAYERS; ++i) {
+        destroyLayer(layers[i]);
+    }
+    destroyCost((struct Cost *)cost_opt);
+    destroyCost((struct Cost *)cost);
+    free(x);
+    free(x_u);
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
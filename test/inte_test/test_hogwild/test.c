@@ -0,0 +1,111 @@
+/**
+ * @brief Hogwild基准: 同一份随机数据分别用1个线程和n个线程训练, 输出每秒更新次数
+ *        用法: ./Test [n_threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "hogwild_trainer.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN (128)
+#define N_CLASSES (10)
+#define N_SAMPLES (4096)
+#define BATCH_SIZE (64)
+#define N_EPOCHS (2)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE};
+
+struct Dataset
+{
+    float *x;
+    unsigned char *gt;
+    int n_batches;
+    int n_epochs;
+};
+
+// 与getMnistNthBatch的用法一致: 按全局batch序号取数据, 取完返回NULL
+static int getBatch(const void *(*input_data), const void *(*gt_data), int *n_samples, long n_iter, void *user_data)
+{
+    struct Dataset *ds = user_data;
+    if (n_iter >= (long)ds->n_batches * ds->n_epochs) {
+        *input_data = NULL;
+        *gt_data = NULL;
+        *n_samples = 0;
+        return SUCCESS;
+    }
+    int k = n_iter % ds->n_batches;
+    *input_data = ds->x + (size_t)k * BATCH_SIZE * N_FEATURES;
+    *gt_data = ds->gt + (size_t)k * BATCH_SIZE * N_CLASSES;
+    *n_samples = BATCH_SIZE;
+    return SUCCESS;
+}
+
+static int runBench(struct Dataset *ds, int n_threads, const struct UpdateArgs *args)
+{
+    struct Layer *layers[3];
+    struct CECost *cost = NULL;
+    CHK_ERR(createLayers(layers, &cost, n_units, act_types, 2));
+
+    struct HogwildTrainer *trainer = NULL;
+    CHK_ERR(createHogwildTrainer(&trainer, layers, 3, (struct Cost *)cost, n_threads));
+    CHK_ERR(runHogwildTrainer(trainer, getBatch, ds, N_FEATURES, "float32", N_CLASSES, "uint8", args));
+
+    long n_updates = 0;
+    double elapsed = 0.;
+    float ce_cost = 0.;
+    CHK_ERR(getHogwildTrainerStats(&n_updates, &elapsed, &ce_cost, trainer));
+    fprintf(stdout, "hogwild: threads = %d, updates = %ld, elapsed = %.3fs, %.1f updates/s, ce_cost = %f\n",
+        n_threads, n_updates, elapsed, n_updates / elapsed, ce_cost);
+    if (n_updates != (long)ds->n_batches * ds->n_epochs || isnan(ce_cost)) {
+        ERR_MSG("hogwild training failed, error.\n");
+        return ERR_COD;
+    }
+
+    destroyHogwildTrainer(trainer);
+    int i;
+    for (i = 0; i < 3; ++i) {
+        destroyLayer(layers[i]);
+    }
+    destroyCost((struct Cost *)cost);
+    return SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    int n_threads = (argc > 1)? atoi(argv[1]): 4;
+    CHK_ERR((n_threads > 0)? 0: 1);
+
+    struct Dataset ds;
+    ds.n_batches = N_SAMPLES / BATCH_SIZE;
+    ds.n_epochs = N_EPOCHS;
+    CHK_NIL((ds.x = calloc((size_t)N_SAMPLES * N_FEATURES, sizeof(float))));
+    CHK_NIL((ds.gt = calloc((size_t)N_SAMPLES * N_CLASSES, sizeof(unsigned char))));
+    srand(2);
+    CHK_ERR(makeDataset(ds.x, ds.gt, N_SAMPLES, N_FEATURES, N_CLASSES));
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = BATCH_SIZE;
+    args.lr = 0.01;
+    args.momentum = 0.5;
+    args.n_epochs = N_EPOCHS;
+
+    CHK_ERR(runBench(&ds, 1, &args));
+    CHK_ERR(runBench(&ds, n_threads, &args));
+
+    free(ds.x);
+    free(ds.gt);
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
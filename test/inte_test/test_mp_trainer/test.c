@@ -0,0 +1,111 @@
+/**
+ * @brief 由nn_launch启动多个进程, 每个进程用多进程同步训练和单进程训练分别训练一份初始参数相同的网络,
+ *        检查两者参数一致.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "network.h"
+#include "mp_trainer.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "tensor.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN (128)
+#define N_CLASSES (10)
+#define N_SAMPLES (1024)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE};
+
+int main()
+{
+    struct Layer *layers_s[3];
+    struct Layer *layers_p[3];
+    struct CECost *cost_s = NULL;
+    struct CECost *cost_p = NULL;
+    CHK_ERR(createLayers(layers_s, &cost_s, n_units, act_types, 2));
+    CHK_ERR(createLayers(layers_p, &cost_p, n_units, act_types, 2));
+
+    struct Network *net = NULL;
+    CHK_ERR(createNetwork(&net, layers_s, 3, (struct Cost *)cost_s));
+    struct MultiProcessTrainer *trainer = NULL;
+    CHK_ERR(createMultiProcessTrainerFromEnv(&trainer, layers_p, 3, (struct Cost *)cost_p));
+    int rank, world_size;
+    CHK_ERR(getMultiProcessTrainerRank(&rank, &world_size, trainer));
+
+    // 所有进程生成相同的数据集
+    float *x = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *gt = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    CHK_NIL(x);
+    CHK_NIL(gt);
+    srand(2);
+    CHK_ERR(makeDataset(x, gt, N_SAMPLES, N_FEATURES, N_CLASSES));
+    int i;
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = 128;
+    args.lr = 0.05;
+    args.momentum = 0.9;
+    args.n_epochs = 1;
+
+    struct Probe probe_s, probe_p;
+    memset(&probe_s, 0, sizeof(struct Probe));
+    memset(&probe_p, 0, sizeof(struct Probe));
+    probe_s.sw_ce_cost = 1;
+    probe_p.sw_ce_cost = 1;
+
+    struct timeval t0, t1, t2;
+    double elapsed_p = 0.;
+    for (i = 0; i * args.batch_size < N_SAMPLES; ++i) {
+        // 最后一个batch不满, 检查样本数不能被进程数整除的情况
+        int n_samples = (i == N_SAMPLES / args.batch_size - 1)? args.batch_size - 3: args.batch_size;
+        const float *batch = x + i * args.batch_size * N_FEATURES;
+        const unsigned char *label = gt + i * args.batch_size * N_CLASSES;
+        args.cur_iter = i;
+
+        CHK_ERR(forwardNetwork(net, batch, n_samples, N_FEATURES, "float32", &args, &probe_s));
+        CHK_ERR(backwardNetwork(net, label, n_samples, N_CLASSES, "uint8", &args, &probe_s));
+        CHK_ERR(updateNetwork(net, &args, &probe_s));
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(trainMultiProcessBatch(trainer, batch, N_FEATURES, "float32", label, N_CLASSES, "uint8", n_samples, &args, &probe_p));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_p += t2.tv_sec + t2.tv_usec / 1e6;
+
+        float diff = diffLayers(layers_s, layers_p, 3);
+        if (rank == 0) {
+            fprintf(stderr, "iter %d: n_samples = %d, ce_cost single = %f, multi-process = %f, max rel diff = %e\n",
+                i, n_samples, probe_s.ce_cost, probe_p.ce_cost, diff);
+        }
+        if (diff > 1e-4 || fabsf(probe_s.ce_cost - probe_p.ce_cost) > 1e-4 * fmaxf(1., fabsf(probe_s.ce_cost))) {
+            ERR_MSG("rank %d: multi-process result differs from single process, error.\n", rank);
+            return ERR_COD;
+        }
+    }
+    fprintf(stderr, "rank %d/%d finish, multi-process train time: %.3fs\n", rank, world_size, elapsed_p);
+
+    destroyMultiProcessTrainer(trainer);
+    destroyNetwork(net);
+    for (i = 0; i < 3; ++i) {
+        destroyLayer(layers_s[i]);
+        destroyLayer(layers_p[i]);
+    }
+    destroyCost((struct Cost *)cost_s);
+    destroyCost((struct Cost *)cost_p);
+    free(x);
+    free(gt);
+    return 0;
+}
@@ -0,0 +1,8 @@
+#!/bin/bash
+
+set -ex
+
+# 训练日志输出到stdout, 结果检查输出到stderr
+./nn_launch -n 4 ./Test > train.log
+./nn_launch -n 3 -p ./Test > train.log
+rm -f train.log
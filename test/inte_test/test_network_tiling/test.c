@@ -0,0 +1,107 @@
+/**
+ * @brief 784-625-10网络分别用不分块, 自动分块和指定分块的执行计划训练, 检查参数一致并比较耗时.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "network.h"
+#include "network_plan.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN (625)
+#define N_CLASSES (10)
+#define N_SAMPLES (2048)
+#define N_LAYERS (3)
+#define N_PLANS (3)
+#define BATCH_SIZE (256)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE};
+
+int main()
+{
+    struct Layer *layers[N_PLANS][N_LAYERS];
+    struct CECost *costs[N_PLANS];
+    struct Network *nets[N_PLANS];
+    struct NetworkPlan *plans[N_PLANS];
+    int tile_sizes[N_PLANS] = {BATCH_SIZE, 0, 24}; // 不分块, 自动, 不整除batch的分块
+    double elapsed[N_PLANS];
+    int k, i;
+    for (k = 0; k < N_PLANS; ++k) {
+        CHK_ERR(createLayers(layers[k], &(costs[k]), n_units, act_types, 2));
+        CHK_ERR(createNetwork(&(nets[k]), layers[k], N_LAYERS, (struct Cost *)costs[k]));
+        CHK_ERR(compileNetwork(&(plans[k]), nets[k], BATCH_SIZE, "float32", "uint8"));
+        CHK_ERR(setNetworkPlanTileSize(plans[k], tile_sizes[k]));
+        CHK_ERR(getNetworkPlanTileSize(&(tile_sizes[k]), plans[k]));
+        elapsed[k] = 0.;
+    }
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = BATCH_SIZE;
+    args.lr = 0.01;
+    args.momentum = 0.5;
+    args.n_epochs = 1;
+
+    float *x = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *gt = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    CHK_NIL(x);
+    CHK_NIL(gt);
+    srand(2);
+    CHK_ERR(makeDataset(x, gt, N_SAMPLES, N_FEATURES, N_CLASSES));
+
+    struct Probe probe[N_PLANS];
+    memset(probe, 0, sizeof(probe));
+    struct timeval t0, t1, t2;
+    float max_diff = 0.;
+    for (i = 0; i * BATCH_SIZE < N_SAMPLES; ++i) {
+        args.cur_iter = i;
+        for (k = 0; k < N_PLANS; ++k) {
+            probe[k].sw_ce_cost = 1;
+            CHK_ERR(gettimeofday(&t0, NULL));
+            CHK_ERR(trainNetworkPlan(plans[k], x + i * BATCH_SIZE * N_FEATURES, gt + i * BATCH_SIZE * N_CLASSES,
+                BATCH_SIZE, &args, &(probe[k])));
+            CHK_ERR(gettimeofday(&t1, NULL));
+            timersub(&t1, &t0, &t2);
+            elapsed[k] += t2.tv_sec + t2.tv_usec / 1e6;
+        }
+        for (k = 1; k < N_PLANS; ++k) {
+            // 分块改变了w_grad和b_grad的累加顺序, 只能近似相等
+            float diff = diffLayers(layers[0], layers[k], N_LAYERS);
+            max_diff = fmaxf(max_diff, diff);
+            if (diff > 1e-4 || fabsf(probe[0].ce_cost - probe[k].ce_cost) > 1e-4 * fmaxf(1., fabsf(probe[0].ce_cost))) {
+                ERR_MSG("iter %d: tile size %d differs from untiled plan, ce_cost %f vs %f, max rel diff = %e, error.\n",
+                    i, tile_sizes[k], probe[0].ce_cost, probe[k].ce_cost, diff);
+                return ERR_COD;
+            }
+        }
+    }
+    fprintf(stdout, "%d iters, max rel diff = %e, last ce_cost = %f\n", i, max_diff, probe[0].ce_cost);
+    for (k = 0; k < N_PLANS; ++k) {
+        fprintf(stdout, "tile size %d: %.3fs\n", tile_sizes[k], elapsed[k]);
+    }
+
+    for (k = 0; k < N_PLANS; ++k) {
+        destroyNetworkPlan(plans[k]);
+        destroyNetwork(nets[k]);
+        for (i = 0; i < N_LAYERS; ++i) {
+            destroyLayer(layers[k][i]);
+        }
+        destroyCost((struct Cost *)costs[k]);
+    }
+    free(x);
+    free(gt);
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
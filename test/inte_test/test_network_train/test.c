@@ -13,9 +13,48 @@
 #include "probe.h"
 #include "mnist.h"
 #include "tensor.h"
+#include "data_loader.h"
+#include "rng.h"
 #include "debug_macros.h"
 
 #define DATASET_DIR ("/home/zanghu/data_base/mnist")
+#define SHUFFLE_SEED (2024)
+
+struct MnistBatchArgs
+{
+    const struct MNIST *mnist;
+    int n_train;
+    int batch_size;
+    int n_perms;
+    int **perms; // perms[e]: 第e个epoch的样本顺序
+};
+
+// 数据加载器的回调: 按本epoch的排列从MNIST训练集中复制第batch_idx个batch
+static int fillMnistBatch(void *data, void *label, int *n_samples, int epoch, int batch_idx, void *user_data)
+{
+    struct MnistBatchArgs *a = user_data;
+    CHK_ERR((epoch < a->n_perms)? 0: 1);
+    CHK_ERR(getMnistShuffledBatch(data, label, n_samples, "train", a->mnist, a->perms[epoch], a->n_train, a->batch_size, batch_idx));
+    return SUCCESS;
+}
+
+// 以(SHUFFLE_SEED, epoch)为随机数流生成每个epoch的排列, 重新运行时顺序相同
+static int createEpochPermutations(struct MnistBatchArgs *a, int n_epochs)
+{
+    a->n_perms = n_epochs;
+    a->perms = calloc(n_epochs, sizeof(int *));
+    CHK_NIL(a->perms);
+    int e;
+    for (e = 0; e < n_epochs; ++e) {
+        struct RandomStream *rs = NULL;
+        a->perms[e] = malloc(a->n_train * sizeof(int));
+        CHK_NIL(a->perms[e]);
+        CHK_ERR(createRandomStream(&rs, SHUFFLE_SEED, e));
+        CHK_ERR(fillRandomPermutation(rs, a->perms[e], a->n_train));
+        destroyRandomStream(rs);
+    }
+    return SUCCESS;
+}
 
 int main()
 {
@@ -67,9 +106,16 @@ int main()
     probe.dump_output = 1; // 导出层的输出
     probe.dump_delta = 1; // 导出层的灵敏度
 
+    // 后台预取batch: 2个生产者线程, 4个槽位. 加载器会越过最后一个epoch提前生产, 多准备一个epoch的排列
+    int n_epochs = 1;
+    struct MnistBatchArgs batch_args = {&mnist, n_train, args.batch_size, 0, NULL};
+    CHK_ERR(createEpochPermutations(&batch_args, n_epochs + 1));
+    struct DataLoader *loader = NULL;
+    CHK_ERR(createDataLoader(&loader, fillMnistBatch, &batch_args, (n_train + args.batch_size - 1) / args.batch_size,
+        (size_t)args.batch_size * 28 * 28 * sizeof(float), (size_t)args.batch_size * 10, 4, 2));
+
     struct timeval t_train_0, t_train_1, t_train_2;
     CHK_ERR(gettimeofday(&t_train_0, NULL));
-    int n_epochs = 1;
     for (int k = 0; k < n_epochs; ++k) {
         int n_iters = 0;
         args.cur_epoch = k;
@@ -81,7 +127,7 @@ int main()
         while (1) {
             args.cur_iter = n_iters;
             // 获取batch数据
-            CHK_ERR(getMnistNthBatch((const float *(*))(&data_batch), (const unsigned char *(*))(&label_onehot), &n_samples, "train", &mnist, n_train, args.batch_size, n_iters));
+            CHK_ERR(getDataLoaderNextBatch(&data_batch, &label_onehot, &n_samples, loader));
             if (data_batch == NULL) { // 训练集全部使用了一轮, 当前epoch结束
                 fprintf(stdout, "n_iters = %d, data_batch is NULL\n", n_iters);
                 break;
@@ -105,6 +151,15 @@ int main()
     CHK_ERR(gettimeofday(&t_train_1, NULL));
     timersub(&t_train_1, &t_train_0, &t_train_2);
     fprintf(stdout, "train finish, total epochs = %d, time elapsed: %lu.%06lus\n", n_epochs, t_train_2.tv_sec, t_train_2.tv_usec);
+    long n_batches = 0, n_stalls = 0;
+    double stall_time = 0.;
+    CHK_ERR(getDataLoaderStats(&n_batches, &n_stalls, &stall_time, loader));
+    fprintf(stdout, "data loader: n_batches = %ld, n_stalls = %ld, stall time: %.6fs\n", n_batches, n_stalls, stall_time);
+    destroyDataLoader(loader);
+    for (int e = 0; e < batch_args.n_perms; ++e) {
+        free(batch_args.perms[e]);
+    }
+    free(batch_args.perms);
 
     // 资源释放
     destroyNetwork(net);
@@ -0,0 +1,8 @@
+#!/bin/bash
+
+set -ex
+
+TOOL_DIR="../../../tools/nn_serve"
+
+(cd $TOOL_DIR && ./build.sh)
+cp $TOOL_DIR/nn_serve $TOOL_DIR/nn_loadgen .
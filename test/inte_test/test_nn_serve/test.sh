@@ -0,0 +1,21 @@
+#!/bin/bash
+
+set -ex
+
+SOCK="/tmp/nn_serve_test_$$.sock"
+
+./nn_serve -m model.txt -s $SOCK -t 4 -b 256 > serve.log &
+SERVE_PID=$!
+trap "kill $SERVE_PID 2>/dev/null || true" EXIT
+
+for i in $(seq 1 50); do # 等待服务端完成模型加载
+    [ -S $SOCK ] && break
+    sleep 0.1
+done
+
+./nn_loadgen -s $SOCK -c 4 -n 50 -b 64
+./nn_loadgen -s $SOCK -c 4 -n 20 -b 256 -m -d 4
+
+kill -TERM $SERVE_PID
+wait $SERVE_PID
+tail -1 serve.log
@@ -0,0 +1,168 @@
+/**
+ * @brief 主进程运行参数服务器, fork出的训练进程各自训练数据集的一部分, 其中一个训练进程每个batch额外休眠,
+ *        检查快慢训练进程可以共存, 训练后代价值下降.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "network.h"
+#include "param_server.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN (128)
+#define N_CLASSES (10)
+#define N_SAMPLES (2048)
+#define BATCH_SIZE (64)
+#define N_EPOCHS (3)
+#define N_WORKERS (3)
+#define MAX_STALENESS (4)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE};
+
+// 整个数据集上真实类别的平均对数概率
+static int evalLayers(float *ce, struct Layer **layers, struct CECost *cost, const float *x, const unsigned char *gt, const struct UpdateArgs *args)
+{
+    struct Network *net = NULL;
+    CHK_ERR(createNetwork(&net, layers, 3, (struct Cost *)cost));
+    struct Probe probe;
+    memset(&probe, 0, sizeof(struct Probe));
+    probe.sw_p_class = 1;
+    CHK_NIL((probe.p_class = calloc(BATCH_SIZE * N_CLASSES, sizeof(float))));
+
+    double sum = 0.;
+    int i, j, k;
+    for (i = 0; i < N_SAMPLES / BATCH_SIZE; ++i) {
+        CHK_ERR(forwardNetwork(net, x + i * BATCH_SIZE * N_FEATURES, BATCH_SIZE, N_FEATURES, "float32", args, &probe));
+        for (j = 0; j < BATCH_SIZE; ++j) {
+            for (k = 0; k < N_CLASSES; ++k) {
+                if (gt[(i * BATCH_SIZE + j) * N_CLASSES + k]) {
+                    sum += log(probe.p_class[j * N_CLASSES + k]);
+                }
+            }
+        }
+    }
+    *ce = sum / N_SAMPLES;
+    free(probe.p_class);
+    destroyNetwork(net);
+    return SUCCESS;
+}
+
+static int runWorker(int idx, const char *sock_pth, const float *x, const unsigned char *gt, const struct UpdateArgs *args)
+{
+    struct Layer *layers[3];
+    struct CECost *cost = NULL;
+    CHK_ERR(createLayers(layers, &cost, n_units, act_types, 2));
+    struct ParamServerWorker *worker = NULL;
+    CHK_ERR(createParamServerWorker(&worker, layers, 3, (struct Cost *)cost, sock_pth));
+
+    struct Probe probe;
+    memset(&probe, 0, sizeof(struct Probe));
+    probe.sw_ce_cost = 1;
+    struct UpdateArgs args_w = *args;
+    int n_batches = N_SAMPLES / BATCH_SIZE;
+    int k, i;
+    for (k = 0; k < N_EPOCHS; ++k) {
+        for (i = idx; i < n_batches; i += N_WORKERS) { // 每个训练进程负责一部分batch
+            args_w.cur_epoch = k;
+            args_w.cur_iter = i;
+            CHK_ERR(trainParamServerBatch(worker, x + i * BATCH_SIZE * N_FEATURES, N_FEATURES, "float32",
+                gt + i * BATCH_SIZE * N_CLASSES, N_CLASSES, "uint8", BATCH_SIZE, &args_w, &probe));
+            if (idx == 0) { // 慢训练进程
+                usleep(20000);
+            }
+        }
+    }
+
+    long n_pushes, n_pulls, n_rejected;
+    CHK_ERR(getParamServerWorkerStats(&n_pushes, &n_pulls, &n_rejected, worker));
+    fprintf(stderr, "worker %d%s: pushes = %ld, pulls = %ld, rejected = %ld\n", idx, (idx == 0)? " (slow)": "", n_pushes, n_pulls, n_rejected);
+
+    destroyParamServerWorker(worker);
+    for (i = 0; i < 3; ++i) {
+        destroyLayer(layers[i]);
+    }
+    destroyCost((struct Cost *)cost);
+    return SUCCESS;
+}
+
+int main()
+{
+    float *x = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *gt = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    CHK_NIL(x);
+    CHK_NIL(gt);
+    srand(2);
+    CHK_ERR(makeDataset(x, gt, N_SAMPLES, N_FEATURES, N_CLASSES));
+    int i;
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = BATCH_SIZE;
+    args.lr = 0.05;
+    args.momentum = 0.5;
+    args.n_epochs = N_EPOCHS;
+
+    struct Layer *layers[3];
+    struct CECost *cost = NULL;
+    CHK_ERR(createLayers(layers, &cost, n_units, act_types, 2));
+    float ce_0 = 0.;
+    CHK_ERR(evalLayers(&ce_0, layers, cost, x, gt, &args));
+
+    char sock_pth[64];
+    snprintf(sock_pth, sizeof(sock_pth), "/tmp/nn_ps_test_%d.sock", (int)getpid());
+    struct ParamServer *ps = NULL;
+    CHK_ERR(createParamServer(&ps, layers, 3, sock_pth, MAX_STALENESS));
+
+    pid_t pids[N_WORKERS];
+    for (i = 0; i < N_WORKERS; ++i) {
+        pids[i] = fork();
+        CHK_ERR((pids[i] == -1)? 1: 0);
+        if (pids[i] == 0) {
+            _exit(runWorker(i, sock_pth, x, gt, &args));
+        }
+    }
+
+    CHK_ERR(runParamServer(ps, &args, N_WORKERS));
+    int n_failed = 0;
+    for (i = 0; i < N_WORKERS; ++i) {
+        int status = 0;
+        waitpid(pids[i], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++n_failed;
+        }
+    }
+
+    long version, n_applied, n_rejected;
+    CHK_ERR(getParamServerStats(&version, &n_applied, &n_rejected, ps));
+    float ce_1 = 0.;
+    CHK_ERR(evalLayers(&ce_1, layers, cost, x, gt, &args));
+    fprintf(stderr, "param server: version = %ld, applied = %ld, rejected = %ld, mean log p: %f -> %f\n",
+        version, n_applied, n_rejected, ce_0, ce_1);
+    if (n_failed > 0 || n_applied + n_rejected != (long)N_EPOCHS * (N_SAMPLES / BATCH_SIZE) || !(ce_1 > ce_0)) {
+        ERR_MSG("param server training failed, error.\n");
+        return ERR_COD;
+    }
+
+    destroyParamServer(ps);
+    for (i = 0; i < 3; ++i) {
+        destroyLayer(layers[i]);
+    }
+    destroyCost((struct Cost *)cost);
+    free(x);
+    free(gt);
+    fprintf(stderr, "all finish.\n");
+    return 0;
+}
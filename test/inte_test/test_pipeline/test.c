@@ -0,0 +1,164 @@
+/**
+ * @brief 流水线并行训练与单线程训练分别训练一份初始参数相同的5层网络, 检查两者参数和代价值一致;
+ *        分别输入float32数据和uint8数据(第一层设置归一化, 正反向之间隔着其他micro-batch的正向).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "network.h"
+#include "pipeline_trainer.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "tensor.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN0 (256)
+#define N_HIDDEN1 (128)
+#define N_CLASSES (10)
+#define N_SAMPLES (1024)
+#define N_LAYERS (5)
+#define N_STAGES (3)
+#define N_MICRO_BATCHES (4)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN0, N_HIDDEN1, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE, SIGMOID_LAYER_TYPE};
+
+// mean/std非NULL时两组网络的第一层都设置输入归一化
+static int runCase(const void *x, const char *dtype_str, int elem_size, const unsigned char *gt, const float *mean, const float *std)
+{
+    struct Layer *layers_s[N_LAYERS];
+    struct Layer *layers_p[N_LAYERS];
+    struct CECost *cost_s = NULL;
+    struct CECost *cost_p = NULL;
+    CHK_ERR(createLayers(layers_s, &cost_s, n_units, act_types, 3));
+    CHK_ERR(createLayers(layers_p, &cost_p, n_units, act_types, 3));
+    if (mean) {
+        CHK_ERR(setLinearLayerInputNormalization((struct LinearLayer *)layers_s[0], mean, std, 1));
+        CHK_ERR(setLinearLayerInputNormalization((struct LinearLayer *)layers_p[0], mean, std, 1));
+    }
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = 128;
+    args.lr = 0.01;
+    args.momentum = 0.5;
+    args.n_epochs = 1;
+
+    struct Network *net = NULL;
+    CHK_ERR(createNetwork(&net, layers_s, N_LAYERS, (struct Cost *)cost_s));
+    struct PipelineTrainer *trainer = NULL;
+    CHK_ERR(createPipelineTrainer(&trainer, layers_p, N_LAYERS, (struct Cost *)cost_p, N_STAGES, N_MICRO_BATCHES, 1));
+    int s;
+    for (s = 0; s < N_STAGES; ++s) {
+        int first, last;
+        CHK_ERR(getPipelineTrainerStage(&first, &last, s, trainer));
+        fprintf(stdout, "stage %d: layers [%d, %d]\n", s, first, last);
+    }
+
+    struct Probe probe_s, probe_p;
+    memset(&probe_s, 0, sizeof(struct Probe));
+    memset(&probe_p, 0, sizeof(struct Probe));
+    probe_s.sw_ce_cost = 1;
+    probe_p.sw_ce_cost = 1;
+    probe_p.sw_p_class = 1;
+    CHK_NIL((probe_p.p_class = calloc(args.batch_size * N_CLASSES, sizeof(float))));
+
+    struct timeval t0, t1, t2;
+    double elapsed_s = 0.;
+    double elapsed_p = 0.;
+    int i, j;
+    for (i = 0; i * args.batch_size < N_SAMPLES; ++i) {
+        // 最后一个batch不满, 检查样本数不能被micro-batch数整除的情况
+        int n_samples = (i == N_SAMPLES / args.batch_size - 1)? args.batch_size - 3: args.batch_size;
+        const char *batch = (const char *)x + (size_t)i * args.batch_size * N_FEATURES * elem_size;
+        const unsigned char *label = gt + i * args.batch_size * N_CLASSES;
+        args.cur_iter = i;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetwork(net, batch, n_samples, N_FEATURES, dtype_str, &args, &probe_s));
+        CHK_ERR(backwardNetwork(net, label, n_samples, N_CLASSES, "uint8", &args, &probe_s));
+        CHK_ERR(updateNetwork(net, &args, &probe_s));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_s += t2.tv_sec + t2.tv_usec / 1e6;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(trainPipelineBatch(trainer, batch, N_FEATURES, dtype_str, label, N_CLASSES, "uint8", n_samples, &args, &probe_p));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_p += t2.tv_sec + t2.tv_usec / 1e6;
+
+        for (j = 0; j < n_samples; ++j) {
+            int k;
+            float sum = 0.;
+            for (k = 0; k < N_CLASSES; ++k) {
+                sum += probe_p.p_class[j * N_CLASSES + k];
+            }
+            if (fabsf(sum - 1.) > 1e-3) {
+                ERR_MSG("iter %d sample %d: sum(p) = %f, error.\n", i, j, sum);
+                return ERR_COD;
+            }
+        }
+
+        float diff = diffLayers(layers_s, layers_p, N_LAYERS);
+        fprintf(stdout, "iter %d: n_samples = %d, ce_cost single = %f, pipeline = %f, max rel diff = %e\n",
+            i, n_samples, probe_s.ce_cost, probe_p.ce_cost, diff);
+        if (diff > 1e-4 || fabsf(probe_s.ce_cost - probe_p.ce_cost) > 1e-4 * fmaxf(1., fabsf(probe_s.ce_cost))) {
+            ERR_MSG("pipeline result differs from single thread, error.\n");
+            return ERR_COD;
+        }
+    }
+    fprintf(stdout, "%s input, single thread: %.3fs, pipeline (%d stages, %d micro-batches): %.3fs\n",
+        dtype_str, elapsed_s, N_STAGES, N_MICRO_BATCHES, elapsed_p);
+
+    destroyPipelineTrainer(trainer);
+    destroyNetwork(net);
+    for (i = 0; i < N_LAYERS; ++i) {
+        destroyLayer(layers_s[i]);
+        destroyLayer(layers_p[i]);
+    }
+    destroyCost((struct Cost *)cost_s);
+    destroyCost((struct Cost *)cost_p);
+    free(probe_p.p_class);
+    return SUCCESS;
+}
+
+int main()
+{
+    float *x = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *x_u = calloc(N_SAMPLES * N_FEATURES, sizeof(unsigned char));
+    unsigned char *gt = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    unsigned char *gt_u = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    CHK_NIL(x);
+    CHK_NIL(x_u);
+    CHK_NIL(gt);
+    CHK_NIL(gt_u);
+    srand(2);
+    CHK_ERR(makeDataset(x, gt, N_SAMPLES, N_FEATURES, N_CLASSES));
+    int i;
+    for (i = 0; i < N_SAMPLES * N_FEATURES; ++i) {
+        x_u[i] = (unsigned char)(rand() % 256);
+    }
+    CHK_ERR(labelDataset(gt_u, x_u, "uint8", N_SAMPLES, N_FEATURES, N_CLASSES));
+
+    CHK_ERR(runCase(x, "float32", sizeof(float), gt, NULL, NULL));
+    float mean = 127.5f;
+    float std = 73.9f;
+    CHK_ERR(runCase(x_u, "uint8", sizeof(unsigned char), gt_u, &mean, &std));
+
+    free(x);
+    free(x_u);
+    free(gt);
+    free(gt_u);
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @brief 分片线性层(按输出切分和按输入切分各一层)与普通线性层分别训练一份初始参数相同的网络, 检查两者参数一致.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "network.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "sharded_linear_layer.h"
+#include "sigmoid_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "rng.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN (512)
+#define N_CLASSES (10)
+#define N_SAMPLES (1024)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE};
+
+// 与createLayers结构和初始参数相同, 两个线性层换成分片线性层
+static int createShardedLayers(struct Layer **layers, struct CECost **cost)
+{
+    setRandomSeed(1);
+    CHK_ERR(createShardedLinearLayer((struct ShardedLinearLayer **)&(layers[0]), "LIN_L0", N_FEATURES, N_HIDDEN, 4, SHARD_BY_OUTPUT, 1));
+    CHK_ERR(createSigmoidLayer((struct SigmoidLayer **)&(layers[1]), "SIG_L0"));
+    CHK_ERR(createShardedLinearLayer((struct ShardedLinearLayer **)&(layers[2]), "LIN_L1", N_HIDDEN, N_CLASSES, 3, SHARD_BY_INPUT, 1));
+    CHK_ERR(createCECost(cost, "CE_L1", N_CLASSES));
+    return SUCCESS;
+}
+
+int main()
+{
+    struct Layer *layers_s[3];
+    struct Layer *layers_p[3];
+    struct CECost *cost_s = NULL;
+    struct CECost *cost_p = NULL;
+    CHK_ERR(createLayers(layers_s, &cost_s, n_units, act_types, 2));
+    CHK_ERR(createShardedLayers(layers_p, &cost_p));
+    if (diffLayers(layers_s, layers_p, 3) != 0.) {
+        ERR_MSG("initial parameters differ, error.\n");
+        return ERR_COD;
+    }
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = 128;
+    args.lr = 0.01;
+    args.momentum = 0.5;
+    args.n_epochs = 1;
+
+    struct Network *net_s = NULL;
+    struct Network *net_p = NULL;
+    CHK_ERR(createNetwork(&net_s, layers_s, 3, (struct Cost *)cost_s));
+    CHK_ERR(createNetwork(&net_p, layers_p, 3, (struct Cost *)cost_p));
+
+    float *x = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *gt = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    CHK_NIL(x);
+    CHK_NIL(gt);
+    srand(2);
+    CHK_ERR(makeDataset(x, gt, N_SAMPLES, N_FEATURES, N_CLASSES));
+
+    struct Probe probe_s, probe_p;
+    memset(&probe_s, 0, sizeof(struct Probe));
+    memset(&probe_p, 0, sizeof(struct Probe));
+    probe_s.sw_ce_cost = 1;
+    probe_p.sw_ce_cost = 1;
+
+    struct timeval t0, t1, t2;
+    double elapsed_s = 0.;
+    double elapsed_p = 0.;
+    int i;
+    for (i = 0; i * args.batch_size < N_SAMPLES; ++i) {
+        int n_samples = (i == N_SAMPLES / args.batch_size - 1)? args.batch_size - 3: args.batch_size; // 最后一个batch不满
+        const float *batch = x + i * args.batch_size * N_FEATURES;
+        const unsigned char *label = gt + i * args.batch_size * N_CLASSES;
+        args.cur_iter = i;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetwork(net_s, batch, n_samples, N_FEATURES, "float32", &args, &probe_s));
+        CHK_ERR(backwardNetwork(net_s, label, n_samples, N_CLASSES, "uint8", &args, &probe_s));
+        CHK_ERR(updateNetwork(net_s, &args, &probe_s));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_s += t2.tv_sec + t2.tv_usec / 1e6;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetwork(net_p, batch, n_samples, N_FEATURES, "float32", &args, &probe_p));
+        CHK_ERR(backwardNetwork(net_p, label, n_samples, N_CLASSES, "uint8", &args, &probe_p));
+        CHK_ERR(updateNetwork(net_p, &args, &probe_p));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_p += t2.tv_sec + t2.tv_usec / 1e6;
+
+        float diff = diffLayers(layers_s, layers_p, 3);
+        fprintf(stdout, "iter %d: n_samples = %d, ce_cost linear = %f, sharded = %f, max rel diff = %e\n",
+            i, n_samples, probe_s.ce_cost, probe_p.ce_cost, diff);
+        if (diff > 1e-4 || fabsf(probe_s.ce_cost - probe_p.ce_cost) > 1e-4 * fmaxf(1., fabsf(probe_s.ce_cost))) {
+            ERR_MSG("sharded linear layer result differs from linear layer, error.\n");
+            return ERR_COD;
+        }
+    }
+    fprintf(stdout, "linear: %.3fs, sharded: %.3fs\n", elapsed_s, elapsed_p);
+
+    destroyNetwork(net_s);
+    destroyNetwork(net_p);
+    for (i = 0; i < 3; ++i) {
+        destroyLayer(layers_s[i]);
+        destroyLayer(layers_p[i]);
+    }
+    destroyCost((struct Cost *)cost_s);
+    destroyCost((struct Cost *)cost_p);
+    free(x);
+    free(gt);
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * @brief 两份初始参数相同的网络分别输入稠密float32数据和同一数据的CSR格式(约80%为0, 与MNIST相近), 检查训练后参数一致并比较耗时;
+ *        之后同一网络交替输入稠密和CSR数据时输出一致, 以及非法的CSR下标被拒绝.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "network.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "data_utils.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN0 (128)
+#define N_HIDDEN1 (64)
+#define N_CLASSES (10)
+#define N_SAMPLES (2048)
+#define N_LAYERS (5)
+#define BATCH_SIZE (64)
+#define TOLERANCE (1e-4)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN0, N_HIDDEN1, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE, RELU_LAYER_TYPE};
+
+// 同一网络分别输入稠密和CSR格式的同一batch, 输出的类别概率应在舍入误差内一致
+static int checkSwitchInput(struct Network *net, const float *x_f, const int *row_ptr, const int *col_idx, const float *val,
+    const struct UpdateArgs *args, struct Probe *probe)
+{
+    float p_dense[BATCH_SIZE * N_CLASSES];
+    const float *p = NULL;
+    int round, i;
+    for (round = 0; round < 2; ++round) {
+        CHK_ERR(forwardNetwork(net, x_f, BATCH_SIZE, N_FEATURES, "float32", args, probe));
+        CHK_ERR(getNetworkClassProbabilityConstRef(&p, net));
+        memcpy(p_dense, p, sizeof(p_dense));
+        CHK_ERR(forwardNetworkCsr(net, row_ptr, col_idx, val, BATCH_SIZE, N_FEATURES, args, probe));
+        CHK_ERR(getNetworkClassProbabilityConstRef(&p, net));
+        for (i = 0; i < BATCH_SIZE * N_CLASSES; ++i) {
+            CHK_ERR((fabsf(p[i] - p_dense[i]) <= TOLERANCE)? 0: 1);
+        }
+    }
+    return SUCCESS;
+}
+
+int main()
+{
+    struct Layer *layers_f[N_LAYERS];
+    struct Layer *layers_s[N_LAYERS];
+    struct CECost *cost_f = NULL;
+    struct CECost *cost_s = NULL;
+    CHK_ERR(createLayers(layers_f, &cost_f, n_units, act_types, 3));
+    CHK_ERR(createLayers(layers_s, &cost_s, n_units, act_types, 3));
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = BATCH_SIZE;
+    args.lr = 0.05;
+    args.momentum = 0.5;
+    args.n_epochs = 1;
+
+    struct Network *net_f = NULL;
+    struct Network *net_s = NULL;
+    CHK_ERR(createNetwork(&net_f, layers_f, N_LAYERS, (struct Cost *)cost_f));
+    CHK_ERR(createNetwork(&net_s, layers_s, N_LAYERS, (struct Cost *)cost_s));
+
+    unsigned char *x_u = calloc(N_SAMPLES * N_FEATURES, sizeof(unsigned char));
+    float *x_f = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *gt = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    CHK_NIL(x_u);
+    CHK_NIL(x_f);
+    CHK_NIL(gt);
+    int i;
+    srand(2);
+    for (i = 0; i < N_SAMPLES * N_FEATURES; ++i) { // 每个特征以20%的概率非零
+        x_u[i] = (rand() % 5 == 0)? (unsigned char)(1 + rand() % 255): 0;
+    }
+    CHK_ERR(labelDataset(gt, x_u, "uint8", N_SAMPLES, N_FEATURES, N_CLASSES));
+    for (i = 0; i < N_SAMPLES * N_FEATURES; ++i) {
+        x_f[i] = x_u[i] * (1.f / 255.f);
+    }
+
+    // 整个数据集转换一次, 各batch只偏移row_ptr
+    int *row_ptr = NULL;
+    int *col_idx = NULL;
+    float *val = NULL;
+    CHK_ERR(transformToCsr(&row_ptr, &col_idx, &val, x_u, "uint8", N_SAMPLES, N_FEATURES, 1.f / 255.f));
+    fprintf(stdout, "non-zeros: %d of %d (%.1f%%)\n", row_ptr[N_SAMPLES], N_SAMPLES * N_FEATURES, 100. * row_ptr[N_SAMPLES] / (N_SAMPLES * N_FEATURES));
+
+    struct Probe probe_f, probe_s;
+    memset(&probe_f, 0, sizeof(struct Probe));
+    memset(&probe_s, 0, sizeof(struct Probe));
+    probe_f.sw_ce_cost = 1;
+    probe_s.sw_ce_cost = 1;
+
+    struct timeval t0, t1, t2;
+    double elapsed_f = 0.;
+    double elapsed_s = 0.;
+    float max_diff = 0.;
+    for (i = 0; i * BATCH_SIZE < N_SAMPLES; ++i) {
+        int n_samples = (i == N_SAMPLES / BATCH_SIZE - 1)? BATCH_SIZE - 3: BATCH_SIZE; // 最后一个batch不满
+        const unsigned char *label = gt + i * BATCH_SIZE * N_CLASSES;
+        args.cur_iter = i;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetwork(net_f, x_f + i * BATCH_SIZE * N_FEATURES, n_samples, N_FEATURES, "float32", &args, &probe_f));
+        CHK_ERR(backwardNetwork(net_f, label, n_samples, N_CLASSES, "uint8", &args, &probe_f));
+        CHK_ERR(updateNetwork(net_f, &args, &probe_f));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_f += t2.tv_sec + t2.tv_usec / 1e6;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetworkCsr(net_s, row_ptr + i * BATCH_SIZE, col_idx, val, n_samples, N_FEATURES, &args, &probe_s));
+        CHK_ERR(backwardNetwork(net_s, label, n_samples, N_CLASSES, "uint8", &args, &probe_s));
+        CHK_ERR(updateNetwork(net_s, &args, &probe_s));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_s += t2.tv_sec + t2.tv_usec / 1e6;
+
+        // 第一层的累加顺序不同, 结果只在舍入误差内一致
+        float diff = diffLayers(layers_f, layers_s, N_LAYERS);
+        max_diff = fmaxf(max_diff, diff);
+        if (diff > TOLERANCE || fabsf(probe_f.ce_cost - probe_s.ce_cost) > TOLERANCE * fmaxf(1., fabsf(probe_f.ce_cost))) {
+            ERR_MSG("iter %d: CSR input differs from dense input, ce_cost %f vs %f, max rel diff = %e, error.\n",
+                i, probe_f.ce_cost, probe_s.ce_cost, diff);
+            return ERR_COD;
+        }
+    }
+    fprintf(stdout, "%d iters, batch size %d, max rel diff = %e, last ce_cost = %f\n", i, BATCH_SIZE, max_diff, probe_s.ce_cost);
+    fprintf(stdout, "dense input: %.3fs, CSR input: %.3fs\n", elapsed_f, elapsed_s);
+
+    CHK_ERR(checkSwitchInput(net_s, x_f, row_ptr, col_idx, val, &args, &probe_s));
+
+    // 特征下标越界
+    fprintf(stdout, "the following errors are expected:\n");
+    int bad_row_ptr[2] = {0, 1};
+    int bad_col_idx[1] = {N_FEATURES};
+    float bad_val[1] = {1.f};
+    CHK_ERR((forwardNetworkCsr(net_s, bad_row_ptr, bad_col_idx, bad_val, 1, N_FEATURES, &args, &probe_s) != SUCCESS)? 0: 1);
+
+    destroyNetwork(net_f);
+    destroyNetwork(net_s);
+    for (i = 0; i < N_LAYERS; ++i) {
+        destroyLayer(layers_f[i]);
+        destroyLayer(layers_s[i]);
+    }
+    destroyCost((struct Cost *)cost_f);
+    destroyCost((struct Cost *)cost_s);
+    free(x_u);
+    free(x_f);
+    free(gt);
+    free(row_ptr);
+    free(col_idx);
+    free(val);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+/**
+ * @brief 两份初始参数相同的网络分别输入预先归一化的float32数据和原始uint8数据(第一层设置归一化参数), 检查训练后参数一致并比较耗时.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "network.h"
+#include "layer.h"
+#include "linear_layer.h"
+#include "cost.h"
+#include "ce_cost.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "debug_macros.h"
+#include "test_fixture.h"
+
+#define N_FEATURES (784)
+#define N_HIDDEN0 (128)
+#define N_HIDDEN1 (64)
+#define N_CLASSES (10)
+#define N_SAMPLES (2048)
+#define N_LAYERS (5)
+#define BATCH_SIZE (64)
+#define TOLERANCE (1e-4)
+
+static const int n_units[] = {N_FEATURES, N_HIDDEN0, N_HIDDEN1, N_CLASSES};
+static const enum LayerType act_types[] = {SIGMOID_LAYER_TYPE, RELU_LAYER_TYPE};
+
+// 逐特征的均值和标准差
+static void getFeatureStats(float *mean, float *std, const unsigned char *x, int n_samples)
+{
+    int i, j;
+    for (j = 0; j < N_FEATURES; ++j) {
+        double sum = 0., sum2 = 0.;
+        for (i = 0; i < n_samples; ++i) {
+            double v = x[i * N_FEATURES + j];
+            sum += v;
+            sum2 += v * v;
+        }
+        double m = sum / n_samples;
+        mean[j] = m;
+        std[j] = sqrt(sum2 / n_samples - m * m);
+    }
+}
+
+int main()
+{
+    struct Layer *layers_f[N_LAYERS];
+    struct Layer *layers_u[N_LAYERS];
+    struct CECost *cost_f = NULL;
+    struct CECost *cost_u = NULL;
+    CHK_ERR(createLayers(layers_f, &cost_f, n_units, act_types, 3));
+    CHK_ERR(createLayers(layers_u, &cost_u, n_units, act_types, 3));
+
+    struct UpdateArgs args;
+    memset(&args, 0, sizeof(struct UpdateArgs));
+    args.batch_size = BATCH_SIZE;
+    args.lr = 0.05;
+    args.momentum = 0.5;
+    args.n_epochs = 1;
+
+    struct Network *net_f = NULL;
+    struct Network *net_u = NULL;
+    CHK_ERR(createNetwork(&net_f, layers_f, N_LAYERS, (struct Cost *)cost_f));
+    CHK_ERR(createNetwork(&net_u, layers_u, N_LAYERS, (struct Cost *)cost_u));
+
+    unsigned char *x_u = calloc(N_SAMPLES * N_FEATURES, sizeof(unsigned char));
+    float *x_f = calloc(N_SAMPLES * N_FEATURES, sizeof(float));
+    unsigned char *gt = calloc(N_SAMPLES * N_CLASSES, sizeof(unsigned char));
+    float *mean = calloc(N_FEATURES, sizeof(float));
+    float *std = calloc(N_FEATURES, sizeof(float));
+    CHK_NIL(x_u);
+    CHK_NIL(x_f);
+    CHK_NIL(gt);
+    CHK_NIL(mean);
+    CHK_NIL(std);
+    int i, j;
+    srand(2);
+    for (i = 0; i < N_SAMPLES; ++i) { // 各特征的取值范围不同, 逐特征的统计才有意义
+        for (j = 0; j < N_FEATURES; ++j) {
+            x_u[i * N_FEATURES + j] = (unsigned char)(rand() % (64 + j % 192));
+        }
+    }
+    CHK_ERR(labelDataset(gt, x_u, "uint8", N_SAMPLES, N_FEATURES, N_CLASSES));
+    getFeatureStats(mean, std, x_u, N_SAMPLES);
+    for (i = 0; i < N_SAMPLES; ++i) {
+        for (j = 0; j < N_FEATURES; ++j) {
+            x_f[i * N_FEATURES + j] = (x_u[i * N_FEATURES + j] - mean[j]) / std[j];
+        }
+    }
+    CHK_ERR(setLinearLayerInputNormalization((struct LinearLayer *)layers_u[0], mean, std, N_FEATURES));
+
+    // 参数检查: n既不是1也不是n_in, 或者标准差不为正
+    fprintf(stdout, "the following 2 errors are expected:\n");
+    CHK_ERR((setLinearLayerInputNormalization((struct LinearLayer *)layers_u[0], mean, std, 2) != SUCCESS)? 0: 1);
+    float zero = 0.;
+    CHK_ERR((setLinearLayerInputNormalization((struct LinearLayer *)layers_u[0], mean, &zero, 1) != SUCCESS)? 0: 1);
+    CHK_ERR(setLinearLayerInputNormalization((struct LinearLayer *)layers_u[0], mean, std, N_FEATURES));
+
+    struct Probe probe_f, probe_u;
+    memset(&probe_f, 0, sizeof(struct Probe));
+    memset(&probe_u, 0, sizeof(struct Probe));
+    probe_f.sw_ce_cost = 1;
+    probe_u.sw_ce_cost = 1;
+
+    struct timeval t0, t1, t2;
+    double elapsed_f = 0.;
+    double elapsed_u = 0.;
+    float max_diff = 0.;
+    for (i = 0; i * BATCH_SIZE < N_SAMPLES; ++i) {
+        int n_samples = (i == N_SAMPLES / BATCH_SIZE - 1)? BATCH_SIZE - 3: BATCH_SIZE; // 最后一个batch不满
+        const unsigned char *label = gt + i * BATCH_SIZE * N_CLASSES;
+        args.cur_iter = i;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetwork(net_f, x_f + i * BATCH_SIZE * N_FEATURES, n_samples, N_FEATURES, "float32", &args, &probe_f));
+        CHK_ERR(backwardNetwork(net_f, label, n_samples, N_CLASSES, "uint8", &args, &probe_f));
+        CHK_ERR(updateNetwork(net_f, &args, &probe_f));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_f += t2.tv_sec + t2.tv_usec / 1e6;
+
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(forwardNetwork(net_u, x_u + i * BATCH_SIZE * N_FEATURES, n_samples, N_FEATURES, "uint8", &args, &probe_u));
+        CHK_ERR(backwardNetwork(net_u, label, n_samples, N_CLASSES, "uint8", &args, &probe_u));
+        CHK_ERR(updateNetwork(net_u, &args, &probe_u));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        elapsed_u += t2.tv_sec + t2.tv_usec / 1e6;
+
+        // 归一化的计算顺序不同(x * scale + shift与(x - mean) / std), 结果只在舍入误差内一致
+        float diff = diffLayers(layers_f, layers_u, N_LAYERS);
+        max_diff = fmaxf(max_diff, diff);
+        if (diff > TOLERANCE || fabsf(probe_f.ce_cost - probe_u.ce_cost) > TOLERANCE * fmaxf(1., fabsf(probe_f.ce_cost))) {
+            ERR_MSG("iter %d: uint8 input differs from normalized float32 input, ce_cost %f vs %f, max rel diff = %e, error.\n",
+                i, probe_f.ce_cost, probe_u.ce_cost, diff);
+            return ERR_COD;
+        }
+    }
+    fprintf(stdout, "%d iters, batch size %d, max rel diff = %e, last ce_cost = %f\n", i, BATCH_SIZE, max_diff, probe_u.ce_cost);
+    fprintf(stdout, "float32 input: %.3fs, uint8 input: %.3fs, dataset bytes %d vs %d\n",
+        elapsed_f, elapsed_u, (int)(N_SAMPLES * N_FEATURES * sizeof(float)), N_SAMPLES * N_FEATURES);
+
+    destroyNetwork(net_f);
+    destroyNetwork(net_u);
+    for (i = 0; i < N_LAYERS; ++i) {
+        destroyLayer(layers_f[i]);
+        destroyLayer(layers_u[i]);
+    }
+    destroyCost((struct Cost *)cost_f);
+    destroyCost((struct Cost *)cost_u);
+    free(x_u);
+    free(x_f);
+    free(gt);
+    free(mean);
+    free(std);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
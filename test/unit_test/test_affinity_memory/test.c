@@ -0,0 +1,95 @@
+/**
+ * @brief 绑核配置的解析和绑定结果, NUMA内存策略的解析, 大块/小块内存分配清零, 以及Tensor经allocBlob分配和释放.
+ *        单节点机器上NUMA策略不生效, 只检查不报错.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "affinity.h"
+#include "memory.h"
+#include "tensor.h"
+#include "debug_macros.h"
+
+static int checkZero(const unsigned char *p, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; ++i) {
+        if (p[i] != 0) {
+            return ERR_COD;
+        }
+    }
+    return SUCCESS;
+}
+
+int main()
+{
+    // 1. 配置解析
+    CHK_ERR((setAffinity("abc") != SUCCESS)? 0: 1);
+    CHK_ERR((setAffinity("0-1,x") != SUCCESS)? 0: 1);
+    CHK_ERR((setAffinity("3-1") != SUCCESS)? 0: 1);
+    CHK_ERR(setAffinity("scatter"));
+    CHK_ERR(setAffinity("compact"));
+    enum AffinityMode mode;
+    CHK_ERR(getAffinityMode(&mode));
+    CHK_ERR((mode == AFFINITY_COMPACT)? 0: 1);
+    int n_nodes = 0;
+    CHK_ERR(getNumaNodeNumber(&n_nodes));
+    fprintf(stdout, "numa nodes: %d\n", n_nodes);
+
+    // 2. 绑定: 列表"0"时只能运行在0号CPU上
+    cpu_set_t set;
+    CHK_ERR(bindThreadToCpus(pthread_self(), 0, 1));
+    CHK_ERR(sched_getaffinity(0, sizeof(set), &set));
+    CHK_ERR((CPU_COUNT(&set) > 0)? 0: 1);
+    CHK_ERR(setAffinity("0"));
+    CHK_ERR(bindThreadToCpus(pthread_self(), 0, 2));
+    CHK_ERR(sched_getaffinity(0, sizeof(set), &set));
+    CHK_ERR((CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set))? 0: 1);
+    CHK_ERR(setAffinity("scatter"));
+    CHK_ERR(bindThreadToCpus(pthread_self(), 1, 2));
+    CHK_ERR(setAffinity("none"));
+
+    // 3. 内存策略与分配
+    CHK_ERR((setMemoryPolicy("bind:x") != SUCCESS)? 0: 1);
+    CHK_ERR((setMemoryPolicy("first") != SUCCESS)? 0: 1);
+    CHK_ERR(setMemoryPolicy("bind:0"));
+    enum MemPolicy policy;
+    int node = -1;
+    CHK_ERR(getMemoryPolicy(&policy, &node));
+    CHK_ERR((policy == MEM_POLICY_BIND && node == 0)? 0: 1);
+    CHK_ERR(setMemoryPolicy("interleave"));
+
+    size_t sizes[3] = {100, MEM_LARGE_SIZE, 8 * MEM_LARGE_SIZE + 123};
+    int i;
+    for (i = 0; i < 3; ++i) {
+        unsigned char *p = allocBlob(sizes[i]);
+        CHK_NIL(p);
+        CHK_ERR(checkZero(p, sizes[i]));
+        memset(p, 0xff, sizes[i]);
+        freeBlob(p, sizes[i]);
+    }
+    CHK_ERR(setMemoryPolicy("default"));
+
+    // 4. Tensor分配
+    struct Tensor *w = NULL;
+    struct Tensor *x = NULL;
+    struct Tensor *gt = NULL;
+    CHK_ERR(createTensorParam(&w, FLOAT32, 1024, 784));
+    CHK_ERR(createTensorData(&x, FLOAT32, 512, 784));
+    CHK_ERR(createTensorData(&gt, UINT8, 512, 10));
+    void *blob = NULL;
+    CHK_ERR(getTensorBlob(&blob, w));
+    CHK_ERR(checkZero(blob, 1024 * 784 * sizeof(float)));
+    CHK_ERR(getTensorBlob(&blob, gt));
+    CHK_ERR(checkZero(blob, 512 * 10));
+    destroyTensor(w);
+    destroyTensor(x);
+    destroyTensor(gt);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
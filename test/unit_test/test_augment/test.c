@@ -0,0 +1,293 @@
+/**
+ * @brief 在线数据增强: 不开启任何变换时逐位不变, 整数平移等于某个范围内的平移并填充背景, 结果只取决于(seed, epoch, batch_idx)且与线程数无关,
+ *        常数图像在旋转和弹性形变下不变, 旋转中心不动, 噪声的统计量, 以及作为DataLoader回调时与直接调用一致.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "augment.h"
+#include "data_loader.h"
+#include "thread_pool.h"
+#include "debug_macros.h"
+
+#define HEIGHT (28)
+#define WIDTH (28)
+#define N_PIXELS (HEIGHT * WIDTH)
+#define BATCH_SIZE (64)
+#define N_BATCHES (6)
+#define SEED (20240611ULL)
+
+// 与batch_idx和样本位置有关的图像, 像素在[1, 255]中, 不含背景值0
+static void getSourceBatch(unsigned char *data, int batch_idx)
+{
+    int i;
+    for (i = 0; i < BATCH_SIZE * N_PIXELS; ++i) {
+        unsigned int h = (unsigned int)(batch_idx * BATCH_SIZE * N_PIXELS + i) * 2654435761U;
+        data[i] = (unsigned char)(1 + (h >> 16) % 255);
+    }
+}
+
+static int fillSource(void *data, void *label, int *n_samples, int epoch, int batch_idx, void *user_data)
+{
+    getSourceBatch(data, batch_idx);
+    int *lab = label;
+    int i;
+    for (i = 0; i < BATCH_SIZE; ++i) {
+        lab[i] = batch_idx * BATCH_SIZE + i;
+    }
+    *n_samples = BATCH_SIZE;
+    return SUCCESS;
+}
+
+static void initConfig(struct AugmentConfig *cfg, const char *dtype)
+{
+    memset(cfg, 0, sizeof(struct AugmentConfig));
+    cfg->dtype = dtype;
+    cfg->height = HEIGHT;
+    cfg->width = WIDTH;
+}
+
+static int testIdentity()
+{
+    struct AugmentConfig cfg;
+    initConfig(&cfg, "uint8");
+    struct Augmenter *aug = NULL;
+    unsigned char u8[BATCH_SIZE * N_PIXELS], ref[BATCH_SIZE * N_PIXELS];
+    getSourceBatch(u8, 0);
+    memcpy(ref, u8, sizeof(u8));
+    CHK_ERR(createAugmenter(&aug, &cfg, SEED));
+    CHK_ERR(augmentBatch(aug, u8, BATCH_SIZE, 0, 0));
+    CHK_ERR((memcmp(u8, ref, sizeof(u8)) == 0)? 0: 1);
+    destroyAugmenter(aug);
+
+    // 角度范围极小时走插值路径, 整数坐标上的插值也应逐位不变
+    float f32[BATCH_SIZE * N_PIXELS];
+    int i;
+    for (i = 0; i < BATCH_SIZE * N_PIXELS; ++i) {
+        f32[i] = ref[i] / 255.f - 0.13f;
+    }
+    initConfig(&cfg, "float32");
+    cfg.max_rotation = 1e-30f;
+    CHK_ERR(createAugmenter(&aug, &cfg, SEED));
+    CHK_ERR(augmentBatch(aug, f32, BATCH_SIZE, 0, 0));
+    for (i = 0; i < BATCH_SIZE * N_PIXELS; ++i) {
+        CHK_ERR((f32[i] == ref[i] / 255.f - 0.13f)? 0: 1);
+    }
+    destroyAugmenter(aug);
+
+    fprintf(stdout, "the following errors are expected:\n");
+    initConfig(&cfg, "float64");
+    CHK_ERR((createAugmenter(&aug, &cfg, SEED) != SUCCESS)? 0: 1);
+    initConfig(&cfg, "uint8");
+    cfg.elastic_alpha = 8.f;
+    CHK_ERR((createAugmenter(&aug, &cfg, SEED) != SUCCESS)? 0: 1); // 没有给出sigma
+    initConfig(&cfg, "uint8");
+    cfg.max_shift = -1;
+    CHK_ERR((createAugmenter(&aug, &cfg, SEED) != SUCCESS)? 0: 1);
+    return SUCCESS;
+}
+
+// 输出是否等于原图平移(dx, dy), 移出的位置为0
+static int isShifted(const unsigned char *out, const unsigned char *src, int dx, int dy)
+{
+    int x, y;
+    for (y = 0; y < HEIGHT; ++y) {
+        for (x = 0; x < WIDTH; ++x) {
+            int sx = x - dx;
+            int sy = y - dy;
+            int v = (sx >= 0 && sx < WIDTH && sy >= 0 && sy < HEIGHT)? src[sy * WIDTH + sx]: 0;
+            if (out[y * WIDTH + x] != v) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int testShift()
+{
+    const int max_shift = 3;
+    struct AugmentConfig cfg;
+    initConfig(&cfg, "uint8");
+    cfg.max_shift = max_shift;
+    struct Augmenter *aug = NULL;
+    CHK_ERR(createAugmenter(&aug, &cfg, SEED));
+
+    unsigned char src[BATCH_SIZE * N_PIXELS], out[BATCH_SIZE * N_PIXELS], out2[BATCH_SIZE * N_PIXELS];
+    int hist[2 * max_shift + 1];
+    memset(hist, 0, sizeof(hist));
+    int b, s, dx, dy;
+    for (b = 0; b < N_BATCHES; ++b) {
+        getSourceBatch(src, b);
+        memcpy(out, src, sizeof(src));
+        CHK_ERR(augmentBatch(aug, out, BATCH_SIZE, 1, b));
+        for (s = 0; s < BATCH_SIZE; ++s) {
+            int found = 0;
+            for (dy = -max_shift; dy <= max_shift && !found; ++dy) {
+                for (dx = -max_shift; dx <= max_shift && !found; ++dx) {
+                    if (isShifted(out + s * N_PIXELS, src + s * N_PIXELS, dx, dy)) {
+                        found = 1;
+                        hist[dx + max_shift] += 1;
+                    }
+                }
+            }
+            CHK_ERR(found? 0: 1);
+        }
+
+        // 同一(seed, epoch, batch_idx)结果相同, 与线程数无关
+        memcpy(out2, src, sizeof(src));
+        setParallelForInline(1);
+        CHK_ERR(augmentBatch(aug, out2, BATCH_SIZE, 1, b));
+        setParallelForInline(0);
+        CHK_ERR((memcmp(out, out2, sizeof(out)) == 0)? 0: 1);
+
+        // 不同epoch的结果不同
+        memcpy(out2, src, sizeof(src));
+        CHK_ERR(augmentBatch(aug, out2, BATCH_SIZE, 2, b));
+        CHK_ERR((memcmp(out, out2, sizeof(out)) != 0)? 0: 1);
+    }
+    for (dx = 0; dx < 2 * max_shift + 1; ++dx) { // 每个平移量都出现过
+        CHK_ERR((hist[dx] > 0)? 0: 1);
+    }
+    destroyAugmenter(aug);
+    return SUCCESS;
+}
+
+static int testGeometric()
+{
+    struct AugmentConfig cfg;
+    initConfig(&cfg, "uint8");
+    cfg.max_shift = 2;
+    cfg.max_rotation = 15.f;
+    cfg.elastic_alpha = 34.f;
+    cfg.elastic_sigma = 4.f;
+    cfg.fill = 100.f;
+    struct Augmenter *aug = NULL;
+    CHK_ERR(createAugmenter(&aug, &cfg, SEED));
+
+    // 背景与图像相同的常数图像不变
+    unsigned char u8[BATCH_SIZE * N_PIXELS];
+    memset(u8, 100, sizeof(u8));
+    CHK_ERR(augmentBatch(aug, u8, BATCH_SIZE, 0, 3));
+    int i;
+    for (i = 0; i < BATCH_SIZE * N_PIXELS; ++i) {
+        CHK_ERR((u8[i] == 100)? 0: 1);
+    }
+
+    // 一般图像: 与线程数无关, 且确实被改变
+    unsigned char src[BATCH_SIZE * N_PIXELS], out[BATCH_SIZE * N_PIXELS];
+    getSourceBatch(src, 3);
+    memcpy(u8, src, sizeof(src));
+    memcpy(out, src, sizeof(src));
+    CHK_ERR(augmentBatch(aug, u8, BATCH_SIZE, 0, 3));
+    setParallelForInline(1);
+    CHK_ERR(augmentBatch(aug, out, BATCH_SIZE, 0, 3));
+    setParallelForInline(0);
+    CHK_ERR((memcmp(u8, out, sizeof(out)) == 0)? 0: 1);
+    CHK_ERR((memcmp(u8, src, sizeof(src)) != 0)? 0: 1);
+    destroyAugmenter(aug);
+
+    // 只旋转时, 奇数尺寸图像的中心像素不动
+    const int h = 27, w = 27;
+    float f32[BATCH_SIZE * 27 * 27];
+    for (i = 0; i < BATCH_SIZE * h * w; ++i) {
+        f32[i] = (float)(i % 101) / 7.f;
+    }
+    initConfig(&cfg, "float32");
+    cfg.height = h;
+    cfg.width = w;
+    cfg.max_rotation = 30.f;
+    CHK_ERR(createAugmenter(&aug, &cfg, SEED));
+    CHK_ERR(augmentBatch(aug, f32, BATCH_SIZE, 0, 0));
+    int s, n_changed = 0;
+    for (s = 0; s < BATCH_SIZE; ++s) {
+        int c = s * h * w + (h / 2) * w + w / 2;
+        CHK_ERR((f32[c] == (float)(c % 101) / 7.f)? 0: 1);
+        n_changed += (f32[c + 1] != (float)((c + 1) % 101) / 7.f);
+    }
+    CHK_ERR((n_changed > BATCH_SIZE / 2)? 0: 1);
+    destroyAugmenter(aug);
+    return SUCCESS;
+}
+
+static int testNoise()
+{
+    struct AugmentConfig cfg;
+    initConfig(&cfg, "float32");
+    cfg.noise_std = 2.f;
+    struct Augmenter *aug = NULL;
+    CHK_ERR(createAugmenter(&aug, &cfg, SEED));
+    float *f32 = calloc(BATCH_SIZE * N_PIXELS, sizeof(float));
+    CHK_NIL(f32);
+    CHK_ERR(augmentBatch(aug, f32, BATCH_SIZE, 0, 0));
+    double sum = 0., sum2 = 0.;
+    int i;
+    for (i = 0; i < BATCH_SIZE * N_PIXELS; ++i) {
+        sum += f32[i];
+        sum2 += (double)f32[i] * f32[i];
+    }
+    double mean = sum / (BATCH_SIZE * N_PIXELS);
+    double std = sqrt(sum2 / (BATCH_SIZE * N_PIXELS) - mean * mean);
+    fprintf(stdout, "noise: mean = %f, std = %f\n", mean, std);
+    CHK_ERR((fabs(mean) < 0.05 && fabs(std - 2.) < 0.05)? 0: 1);
+    free(f32);
+    destroyAugmenter(aug);
+    return SUCCESS;
+}
+
+static int testLoader()
+{
+    struct AugmentConfig cfg;
+    initConfig(&cfg, "uint8");
+    cfg.max_shift = 2;
+    cfg.max_rotation = 10.f;
+    cfg.noise_std = 8.f;
+    struct Augmenter *aug = NULL;
+    CHK_ERR(createAugmenter(&aug, &cfg, SEED));
+    fprintf(stdout, "the following error is expected:\n");
+    int n = 0;
+    unsigned char ref[BATCH_SIZE * N_PIXELS];
+    int lab[BATCH_SIZE];
+    CHK_ERR((fillAugmentedBatch(ref, lab, &n, 0, 0, aug) != SUCCESS)? 0: 1);
+    CHK_ERR(setAugmenterSource(aug, fillSource, NULL));
+
+    struct DataLoader *loader = NULL;
+    CHK_ERR(createDataLoader(&loader, fillAugmentedBatch, aug, N_BATCHES, BATCH_SIZE * N_PIXELS, BATCH_SIZE * sizeof(int), 4, 3));
+    int epoch, b, i;
+    for (epoch = 0; epoch < 2; ++epoch) {
+        for (b = 0; b < N_BATCHES; ++b) {
+            const void *data = NULL;
+            const void *label = NULL;
+            CHK_ERR(getDataLoaderNextBatch(&data, &label, &n, loader));
+            CHK_NIL(data);
+            CHK_ERR((n == BATCH_SIZE)? 0: 1);
+            getSourceBatch(ref, b);
+            CHK_ERR(augmentBatch(aug, ref, BATCH_SIZE, epoch, b));
+            CHK_ERR((memcmp(data, ref, sizeof(ref)) == 0)? 0: 1);
+            for (i = 0; i < BATCH_SIZE; ++i) {
+                CHK_ERR((((const int *)label)[i] == b * BATCH_SIZE + i)? 0: 1);
+            }
+        }
+        const void *data = NULL;
+        const void *label = NULL;
+        CHK_ERR(getDataLoaderNextBatch(&data, &label, &n, loader)); // 一轮结束
+        CHK_ERR((data == NULL)? 0: 1);
+    }
+    destroyDataLoader(loader);
+    destroyAugmenter(aug);
+    return SUCCESS;
+}
+
+int main()
+{
+    CHK_ERR(testIdentity());
+    CHK_ERR(testShift());
+    CHK_ERR(testGeometric());
+    CHK_ERR(testNoise());
+    CHK_ERR(testLoader());
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
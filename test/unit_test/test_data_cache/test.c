@@ -0,0 +1,141 @@
+/**
+ * @brief 预处理缓存文件: 写入后映射读出的各项内容和对齐, 文件不存在/key不符/截断时不命中, 写入出错时不留下文件,
+ *        以及数据哈希与线程数无关且对单个字节的改动敏感.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "data_cache.h"
+#include "thread_pool.h"
+#include "debug_macros.h"
+
+#define N_FLOATS (300000)
+#define N_BYTES (1000)
+#define HASH_BYTES (5000003) // 跨多个哈希块, 且不是8的倍数
+
+static char g_dir[256];
+
+static int testHash()
+{
+    unsigned char *buf = malloc(HASH_BYTES);
+    CHK_NIL(buf);
+    long i;
+    for (i = 0; i < HASH_BYTES; ++i) {
+        buf[i] = (unsigned char)(i * 2654435761U >> 13);
+    }
+
+    uint64_t h0, h1, h2;
+    CHK_ERR(getDataHash(&h0, buf, HASH_BYTES, 0));
+    setParallelForInline(1);
+    CHK_ERR(getDataHash(&h1, buf, HASH_BYTES, 0));
+    setParallelForInline(0);
+    CHK_ERR((h0 == h1)? 0: 1);
+
+    // 任一字节, 长度或seed改变时结果都不同
+    buf[HASH_BYTES - 1] ^= 1;
+    CHK_ERR(getDataHash(&h2, buf, HASH_BYTES, 0));
+    CHK_ERR((h2 != h0)? 0: 1);
+    buf[HASH_BYTES - 1] ^= 1;
+    buf[12345] ^= 0x80;
+    CHK_ERR(getDataHash(&h2, buf, HASH_BYTES, 0));
+    CHK_ERR((h2 != h0)? 0: 1);
+    buf[12345] ^= 0x80;
+    CHK_ERR(getDataHash(&h2, buf, HASH_BYTES - 1, 0));
+    CHK_ERR((h2 != h0)? 0: 1);
+    CHK_ERR(getDataHash(&h2, buf, HASH_BYTES, 1));
+    CHK_ERR((h2 != h0)? 0: 1);
+    CHK_ERR(getDataHash(&h2, NULL, 0, 0));
+
+    free(buf);
+    return SUCCESS;
+}
+
+static int testCache()
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/data.cache", g_dir);
+    float *f = malloc(N_FLOATS * sizeof(float));
+    unsigned char b[N_BYTES];
+    double stats[2] = {33.318421, 78.567490};
+    CHK_NIL(f);
+    int i;
+    for (i = 0; i < N_FLOATS; ++i) {
+        f[i] = (float)i / 7.f - 100.f;
+    }
+    for (i = 0; i < N_BYTES; ++i) {
+        b[i] = (unsigned char)(i % 10);
+    }
+    const uint64_t key = 0x1234567890abcdefULL;
+
+    // 文件不存在
+    struct DataCache *c = NULL;
+    CHK_ERR(openDataCache(&c, path, key));
+    CHK_ERR((c == NULL)? 0: 1);
+
+    struct DataCacheWriter *w = NULL;
+    CHK_ERR(createDataCacheWriter(&w, path, key));
+    CHK_ERR(addDataCacheEntry(w, "stats", stats, sizeof(stats)));
+    CHK_ERR(addDataCacheEntry(w, "floats", f, N_FLOATS * sizeof(float)));
+    CHK_ERR(addDataCacheEntry(w, "empty", NULL, 0));
+    CHK_ERR(addDataCacheEntry(w, "bytes", b, N_BYTES));
+    CHK_ERR(closeDataCacheWriter(w));
+
+    CHK_ERR(openDataCache(&c, path, key));
+    CHK_NIL(c);
+    const void *p = NULL;
+    size_t n = 0;
+    CHK_ERR(getDataCacheEntry(&p, &n, c, "floats"));
+    CHK_ERR((p != NULL && n == N_FLOATS * sizeof(float) && (uintptr_t)p % DATA_CACHE_ALIGN == 0)? 0: 1);
+    CHK_ERR((memcmp(p, f, n) == 0)? 0: 1);
+    CHK_ERR(getDataCacheEntry(&p, &n, c, "bytes"));
+    CHK_ERR((p != NULL && n == N_BYTES && memcmp(p, b, n) == 0)? 0: 1);
+    CHK_ERR(getDataCacheEntry(&p, &n, c, "stats"));
+    CHK_ERR((p != NULL && n == sizeof(stats) && memcmp(p, stats, n) == 0)? 0: 1);
+    CHK_ERR(getDataCacheEntry(&p, &n, c, "empty"));
+    CHK_ERR((p != NULL && n == 0)? 0: 1);
+    CHK_ERR(getDataCacheEntry(&p, &n, c, "missing"));
+    CHK_ERR((p == NULL && n == 0)? 0: 1);
+    closeDataCache(c);
+
+    // key不符
+    CHK_ERR(openDataCache(&c, path, key + 1));
+    CHK_ERR((c == NULL)? 0: 1);
+
+    // 截断
+    CHK_ERR(truncate(path, DATA_CACHE_ALIGN + 100));
+    CHK_ERR(openDataCache(&c, path, key));
+    CHK_ERR((c == NULL)? 0: 1);
+
+    // 写入出错(名字重复)时不替换已有文件, 也不留下临时文件
+    fprintf(stdout, "the following errors are expected:\n");
+    CHK_ERR(createDataCacheWriter(&w, path, key));
+    CHK_ERR(addDataCacheEntry(w, "bytes", b, N_BYTES));
+    CHK_ERR((addDataCacheEntry(w, "bytes", b, N_BYTES) != SUCCESS)? 0: 1);
+    CHK_ERR((addDataCacheEntry(w, "more", b, N_BYTES) != SUCCESS)? 0: 1);
+    CHK_ERR((closeDataCacheWriter(w) != SUCCESS)? 0: 1);
+    char tmp_path[600];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+    CHK_ERR((access(tmp_path, F_OK) != 0)? 0: 1);
+    CHK_ERR(openDataCache(&c, path, key));
+    CHK_ERR((c == NULL)? 0: 1);
+
+    unlink(path);
+    free(f);
+    return SUCCESS;
+}
+
+int main()
+{
+    snprintf(g_dir, sizeof(g_dir), "/tmp/test_data_cache_XXXXXX");
+    CHK_NIL(mkdtemp(g_dir));
+
+    CHK_ERR(testHash());
+    CHK_ERR(testCache());
+    rmdir(g_dir);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
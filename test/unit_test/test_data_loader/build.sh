@@ -0,0 +1,9 @@
+#!/bin/bash
+
+set -ex
+
+SRC_DIR=../../../src
+
+INC_CMD="-I$SRC_DIR"
+
+gcc -g -Wall -O2 $INC_CMD test.c $SRC_DIR/data_loader.c $SRC_DIR/memory.c $SRC_DIR/thread_pool.c $SRC_DIR/affinity.c $SRC_DIR/debug_macros.c -lpthread -o Test
\ No newline at end of file
@@ -0,0 +1,114 @@
+/**
+ * @brief 多个生产者乱序完成时batch仍按序号顺序取出, epoch边界返回NULL, 槽位对齐,
+ *        生产慢于消费时统计到等待, 以及回调出错时的报错.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "data_loader.h"
+#include "debug_macros.h"
+
+#define N_FEATURES (1000)
+#define BATCH_SIZE (16)
+#define N_SAMPLES (100) // 最后一个batch只有4个样本
+#define N_BATCHES ((N_SAMPLES + BATCH_SIZE - 1) / BATCH_SIZE)
+
+struct FillArgs
+{
+    int delay_us;
+    int fail_batch; // 第0轮的该batch返回错误, -1表示不出错
+};
+
+// data[i * N_FEATURES + j] = epoch * N_SAMPLES + 样本序号 + j, label[i] = 样本序号 % 10
+static int fillBatch(void *data, void *label, int *n_samples, int epoch, int batch_idx, void *user_data)
+{
+    struct FillArgs *a = user_data;
+    if (epoch == 0 && batch_idx == a->fail_batch) {
+        return ERR_COD;
+    }
+    // 序号为奇数的batch更慢, 使多个生产者乱序完成
+    usleep(a->delay_us * ((batch_idx % 2)? 3: 1));
+
+    int start = batch_idx * BATCH_SIZE;
+    int n = (start + BATCH_SIZE <= N_SAMPLES)? BATCH_SIZE: N_SAMPLES - start;
+    int i, j;
+    for (i = 0; i < n; ++i) {
+        for (j = 0; j < N_FEATURES; ++j) {
+            ((float *)data)[i * N_FEATURES + j] = (float)(epoch * N_SAMPLES + start + i + j);
+        }
+        ((unsigned char *)label)[i] = (unsigned char)((start + i) % 10);
+    }
+    *n_samples = n;
+    return SUCCESS;
+}
+
+static int runEpochs(struct DataLoader *loader, int n_epochs, int consume_us)
+{
+    int e, b, i;
+    for (e = 0; e < n_epochs; ++e) {
+        for (b = 0; ; ++b) {
+            const void *data = NULL;
+            const void *label = NULL;
+            int n_samples = -1;
+            CHK_ERR(getDataLoaderNextBatch(&data, &label, &n_samples, loader));
+            if (data == NULL) {
+                CHK_ERR((b == N_BATCHES)? 0: 1);
+                break;
+            }
+            CHK_ERR(((uintptr_t)data % DATA_LOADER_ALIGN == 0 && (uintptr_t)label % DATA_LOADER_ALIGN == 0)? 0: 1);
+            int start = b * BATCH_SIZE;
+            CHK_ERR((n_samples == ((b < N_BATCHES - 1)? BATCH_SIZE: N_SAMPLES - start))? 0: 1);
+            for (i = 0; i < n_samples; ++i) {
+                CHK_ERR((((const float *)data)[i * N_FEATURES + 7] == (float)(e * N_SAMPLES + start + i + 7))? 0: 1);
+                CHK_ERR((((const unsigned char *)label)[i] == (start + i) % 10)? 0: 1);
+            }
+            usleep(consume_us);
+        }
+    }
+    return SUCCESS;
+}
+
+int main()
+{
+    size_t data_bytes = BATCH_SIZE * N_FEATURES * sizeof(float);
+    struct FillArgs args = {1000, -1};
+    struct DataLoader *loader = NULL;
+    long n_batches, n_stalls;
+    double stall_time;
+
+    // 1. 3个生产者, 4个槽位, 生产慢于消费
+    CHK_ERR(createDataLoader(&loader, fillBatch, &args, N_BATCHES, data_bytes, BATCH_SIZE, 4, 3));
+    CHK_ERR(runEpochs(loader, 3, 0));
+    CHK_ERR(getDataLoaderStats(&n_batches, &n_stalls, &stall_time, loader));
+    fprintf(stdout, "slow producer: n_batches = %ld, n_stalls = %ld, stall time: %.6fs\n", n_batches, n_stalls, stall_time);
+    CHK_ERR((n_batches == 3 * N_BATCHES && n_stalls > 0 && stall_time > 0.)? 0: 1);
+    destroyDataLoader(loader);
+
+    // 2. 双缓冲, 1个生产者, 消费慢于生产: 除第一个batch外几乎不需要等待
+    args.delay_us = 0;
+    CHK_ERR(createDataLoader(&loader, fillBatch, &args, N_BATCHES, data_bytes, BATCH_SIZE, 2, 1));
+    CHK_ERR(runEpochs(loader, 2, 2000));
+    CHK_ERR(getDataLoaderStats(&n_batches, &n_stalls, &stall_time, loader));
+    fprintf(stdout, "slow consumer: n_batches = %ld, n_stalls = %ld, stall time: %.6fs\n", n_batches, n_stalls, stall_time);
+    CHK_ERR((n_batches == 2 * N_BATCHES)? 0: 1);
+    destroyDataLoader(loader);
+
+    // 3. 回调出错
+    args.fail_batch = 3;
+    CHK_ERR(createDataLoader(&loader, fillBatch, &args, N_BATCHES, data_bytes, BATCH_SIZE, 4, 2));
+    CHK_ERR((runEpochs(loader, 1, 0) != SUCCESS)? 0: 1);
+    destroyDataLoader(loader);
+
+    // 4. 参数检查, 析构时生产者阻塞在满的环上也能退出
+    CHK_ERR((createDataLoader(&loader, fillBatch, &args, N_BATCHES, data_bytes, BATCH_SIZE, 1, 1) != SUCCESS)? 0: 1);
+    args.fail_batch = -1;
+    CHK_ERR(createDataLoader(&loader, fillBatch, &args, N_BATCHES, data_bytes, BATCH_SIZE, 3, 2));
+    usleep(10000);
+    destroyDataLoader(loader);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,252 @@
+/**
+ * @brief 单遍并行统计和归一化: 各dtype的均值/标准差与long double两遍计算的参考值一致, 大偏移下不损失精度,
+ *        结果与线程数无关, 分块输入和合并与一次输入一致, 按特征统计和归一化(含常数特征), 以及归一化与标量公式逐位相同.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "data_utils.h"
+#include "thread_pool.h"
+#include "debug_macros.h"
+
+#define N_ELEMS (1000003)
+#define N_SAMPLES (5001)
+#define N_FEATURES (37)
+
+static unsigned int g_state = 12345;
+
+static unsigned int nextRand()
+{
+    g_state = g_state * 1103515245U + 12345U;
+    return g_state >> 8;
+}
+
+static void getRefMeanStd(double *mean, double *std, const double *x, long n, long stride)
+{
+    long double sum = 0.;
+    long i;
+    for (i = 0; i < n; ++i) {
+        sum += x[i * stride];
+    }
+    long double m = sum / n;
+    long double sum2 = 0.;
+    for (i = 0; i < n; ++i) {
+        long double d = x[i * stride] - m;
+        sum2 += d * d;
+    }
+    *mean = (double)m;
+    *std = (double)sqrtl(sum2 / (n - 1));
+}
+
+static int checkClose(double x, double ref, double tol)
+{
+    CHK_ERR((fabs(x - ref) <= tol * fabs(ref) + 1e-300)? 0: 1);
+    return SUCCESS;
+}
+
+// 每种dtype: 与参考值比较, 与线程数无关, 分块输入/合并与一次输入一致
+static int testDType(const char *dtype, const void *data, const double *ref_x, long n)
+{
+    unsigned int elem_size;
+    CHK_ERR(getDataElemSize(&elem_size, dtype));
+    double ref_mean, ref_std;
+    getRefMeanStd(&ref_mean, &ref_std, ref_x, n, 1);
+
+    double mean, std;
+    CHK_ERR(getDataMeanStd(&mean, &std, data, dtype, n));
+    CHK_ERR(checkClose(mean, ref_mean, 1e-12));
+    CHK_ERR(checkClose(std, ref_std, 1e-12));
+    double m1, s1;
+    CHK_ERR(getDataMean(&m1, data, dtype, n));
+    CHK_ERR(getDataStd(&s1, data, dtype, n));
+    CHK_ERR((m1 == mean && s1 == std)? 0: 1);
+
+    setParallelForInline(1);
+    CHK_ERR(getDataMeanStd(&m1, &s1, data, dtype, n));
+    setParallelForInline(0);
+    CHK_ERR((m1 == mean && s1 == std)? 0: 1);
+
+    // 不等长的分块输入, 以及两个累加器合并
+    struct DataStats *a = NULL;
+    struct DataStats *b = NULL;
+    CHK_ERR(createDataStats(&a, 1));
+    CHK_ERR(createDataStats(&b, 1));
+    long start = 0;
+    long len = 1;
+    while (start < n) {
+        long k = (len < n - start)? len: n - start;
+        CHK_ERR(updateDataStats((start < n / 2)? a: b, (const char *)data + start * elem_size, dtype, k));
+        start += k;
+        len = len * 3 + 7;
+    }
+    CHK_ERR(mergeDataStats(a, b));
+    long n_samples = 0;
+    CHK_ERR(getDataStatsMeanStd(&m1, &s1, &n_samples, a));
+    CHK_ERR((n_samples == n)? 0: 1);
+    CHK_ERR(checkClose(m1, ref_mean, 1e-12));
+    CHK_ERR(checkClose(s1, ref_std, 1e-12));
+    destroyDataStats(a);
+    destroyDataStats(b);
+    fprintf(stdout, "%s: mean = %.15g (ref %.15g), std = %.15g (ref %.15g)\n", dtype, mean, ref_mean, std, ref_std);
+    return SUCCESS;
+}
+
+static int testAllDTypes()
+{
+    double *ref = malloc(N_ELEMS * sizeof(double));
+    float *f32 = malloc(N_ELEMS * sizeof(float));
+    double *f64 = malloc(N_ELEMS * sizeof(double));
+    int *i32 = malloc(N_ELEMS * sizeof(int));
+    long long *i64 = malloc(N_ELEMS * sizeof(long long));
+    unsigned char *u8 = malloc(N_ELEMS);
+    CHK_NIL(ref);
+    CHK_NIL(f32);
+    CHK_NIL(f64);
+    CHK_NIL(i32);
+    CHK_NIL(i64);
+    CHK_NIL(u8);
+    long i;
+
+    // 均值远大于标准差: 直接累加平方和的方法在这里会丢失大部分有效数字
+    for (i = 0; i < N_ELEMS; ++i) {
+        f32[i] = 1e4f + (float)(nextRand() % 1000) / 100.f;
+        ref[i] = f32[i];
+    }
+    CHK_ERR(testDType("float32", f32, ref, N_ELEMS));
+    for (i = 0; i < N_ELEMS; ++i) {
+        f64[i] = 1e9 + (double)(nextRand() % 100000) / 1000.;
+        ref[i] = f64[i];
+    }
+    CHK_ERR(testDType("float64", f64, ref, N_ELEMS));
+    for (i = 0; i < N_ELEMS; ++i) {
+        i32[i] = (int)(nextRand() % 200001) - 100000;
+        ref[i] = i32[i];
+    }
+    CHK_ERR(testDType("int32", i32, ref, N_ELEMS));
+    for (i = 0; i < N_ELEMS; ++i) {
+        i64[i] = 1000000000000LL + nextRand() % 1000;
+        ref[i] = (double)i64[i];
+    }
+    CHK_ERR(testDType("int64", i64, ref, N_ELEMS));
+    long long sum = 0;
+    for (i = 0; i < N_ELEMS; ++i) {
+        u8[i] = (unsigned char)nextRand();
+        ref[i] = u8[i];
+        sum += u8[i];
+    }
+    CHK_ERR(testDType("uint8", u8, ref, N_ELEMS));
+    double mean, std;
+    CHK_ERR(getDataMeanStd(&mean, &std, u8, "uint8", N_ELEMS));
+    CHK_ERR((mean == (double)sum / N_ELEMS)? 0: 1); // 直方图统计是精确的
+
+    fprintf(stdout, "the following errors are expected:\n");
+    CHK_ERR((getDataMean(&mean, u8, "int16", N_ELEMS) != SUCCESS)? 0: 1);
+
+    free(ref);
+    free(f32);
+    free(f64);
+    free(i32);
+    free(i64);
+    free(u8);
+    return SUCCESS;
+}
+
+static int testPerFeature()
+{
+    unsigned char *u8 = malloc(N_SAMPLES * N_FEATURES);
+    float *f32 = malloc(N_SAMPLES * N_FEATURES * sizeof(float));
+    double *f64 = malloc(N_SAMPLES * N_FEATURES * sizeof(double));
+    double *ref = malloc(N_SAMPLES * N_FEATURES * sizeof(double));
+    CHK_NIL(u8);
+    CHK_NIL(f32);
+    CHK_NIL(f64);
+    CHK_NIL(ref);
+    long i;
+    int f;
+    for (i = 0; i < N_SAMPLES; ++i) {
+        for (f = 0; f < N_FEATURES; ++f) {
+            long k = i * N_FEATURES + f;
+            u8[k] = (f == 0)? 0: (unsigned char)(nextRand() % (f * 7)); // 第0个特征是常数
+            ref[k] = u8[k];
+        }
+    }
+
+    double mean[N_FEATURES], std[N_FEATURES];
+    double ref_mean, ref_std;
+    struct DataStats *stats = NULL;
+    CHK_ERR(createDataStats(&stats, N_FEATURES));
+    CHK_ERR(updateDataStats(stats, u8, "uint8", 1000));
+    CHK_ERR(updateDataStats(stats, u8 + 1000 * N_FEATURES, "uint8", N_SAMPLES - 1000));
+    CHK_ERR(getDataStatsMeanStd(mean, std, NULL, stats));
+    destroyDataStats(stats);
+    for (f = 0; f < N_FEATURES; ++f) {
+        getRefMeanStd(&ref_mean, &ref_std, ref + f, N_SAMPLES, N_FEATURES);
+        CHK_ERR(checkClose(mean[f], ref_mean, 1e-12));
+        CHK_ERR(checkClose(std[f], ref_std, 1e-12));
+    }
+    CHK_ERR((mean[0] == 0. && std[0] == 0.)? 0: 1);
+
+    // 按特征归一化: 与标量公式逐位相同, 常数特征只减均值
+    for (i = 0; i < N_SAMPLES * N_FEATURES; ++i) {
+        f32[i] = u8[i];
+        f64[i] = u8[i];
+    }
+    CHK_ERR(getDataNormalizationPerFeature(f32, "float32", N_SAMPLES, N_FEATURES, mean, std));
+    CHK_ERR(getDataNormalizationPerFeature(f64, "float64", N_SAMPLES, N_FEATURES, mean, std));
+    for (i = 0; i < N_SAMPLES; ++i) {
+        for (f = 0; f < N_FEATURES; ++f) {
+            long k = i * N_FEATURES + f;
+            double s = (std[f] > 0.)? std[f]: 1.;
+            CHK_ERR((f32[k] == (float)(((float)u8[k] - mean[f]) / s))? 0: 1);
+            CHK_ERR((f64[k] == ((double)u8[k] - mean[f]) / s)? 0: 1);
+        }
+    }
+
+    free(u8);
+    free(f32);
+    free(f64);
+    free(ref);
+    return SUCCESS;
+}
+
+static int testNormalization()
+{
+    float *f32 = malloc(N_ELEMS * sizeof(float));
+    double *f64 = malloc(N_ELEMS * sizeof(double));
+    float *src = malloc(N_ELEMS * sizeof(float));
+    CHK_NIL(f32);
+    CHK_NIL(f64);
+    CHK_NIL(src);
+    long i;
+    for (i = 0; i < N_ELEMS; ++i) {
+        src[i] = (float)(nextRand() % 100000) / 37.f;
+        f32[i] = src[i];
+        f64[i] = src[i];
+    }
+    double mean = 1234.5678, std = 789.0123;
+    CHK_ERR(getDataNormalization(f32, "float32", N_ELEMS, mean, std));
+    CHK_ERR(getDataNormalization(f64, "float64", N_ELEMS, mean, std));
+    for (i = 0; i < N_ELEMS; ++i) {
+        CHK_ERR((f32[i] == (float)((src[i] - mean) / std))? 0: 1);
+        CHK_ERR((f64[i] == ((double)src[i] - mean) / std)? 0: 1);
+    }
+    fprintf(stdout, "the following errors are expected:\n");
+    CHK_ERR((getDataNormalization(src, "int32", N_ELEMS, mean, std) != SUCCESS)? 0: 1);
+
+    free(f32);
+    free(f64);
+    free(src);
+    return SUCCESS;
+}
+
+int main()
+{
+    CHK_ERR(testAllDTypes());
+    CHK_ERR(testPerFeature());
+    CHK_ERR(testNormalization());
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,9 @@
+#!/bin/bash
+
+set -ex
+
+SRC_DIR=../../../src
+
+INC_CMD="-I$SRC_DIR -I$SRC_DIR/datasets"
+
+gcc -g -Wall -O2 $INC_CMD test.c $SRC_DIR/datasets/dataset.c $SRC_DIR/datasets/idx_file.c $SRC_DIR/datasets/data_utils.c $SRC_DIR/memory.c $SRC_DIR/thread_pool.c $SRC_DIR/affinity.c $SRC_DIR/debug_macros.c -lm -lpthread -o Test
\ No newline at end of file
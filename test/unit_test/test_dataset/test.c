@@ -0,0 +1,255 @@
+/**
+ * @brief 通用数据集的IDX和原始二进制两种后端: 形状和类型, 顺序/按排列取batch(含不满的最后一个batch和epoch结束),
+ *        onehot展开和原样复制两种类标, 以及各种格式错误.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dataset.h"
+#include "idx_file.h"
+#include "debug_macros.h"
+
+#define N_SAMPLES (100)
+#define HEIGHT (6)
+#define WIDTH (5)
+#define N_CLASSES (10)
+#define BATCH_SIZE (16)
+
+#define N_RAW (50)
+#define RAW_OFFSET (16)
+#define RAW_LABEL_SIZE (2)
+
+static char g_dir[256];
+
+static void getPath(char *path, const char *name)
+{
+    snprintf(path, 512, "%s/%s", g_dir, name);
+}
+
+static int writeFile(const char *name, const void *head, size_t head_bytes, const void *data, size_t n_bytes)
+{
+    char path[512];
+    getPath(path, name);
+    FILE *fp = fopen(path, "wb");
+    CHK_NIL(fp);
+    fwrite(head, 1, head_bytes, fp);
+    fwrite(data, 1, n_bytes, fp);
+    fclose(fp);
+    return SUCCESS;
+}
+
+static int writeIdxUint8(const char *name, int n_dims, const int *dims, const unsigned char *data, size_t n_bytes)
+{
+    unsigned char head[4 + 4 * IDX_MAX_DIMS] = {0, 0, IDX_UINT8, (unsigned char)n_dims};
+    int i;
+    for (i = 0; i < n_dims; ++i) {
+        head[4 + 4 * i] = dims[i] >> 24;
+        head[5 + 4 * i] = dims[i] >> 16;
+        head[6 + 4 * i] = dims[i] >> 8;
+        head[7 + 4 * i] = dims[i];
+    }
+    return writeFile(name, head, 4 + 4 * n_dims, data, n_bytes);
+}
+
+static int testIdxDataset(void)
+{
+    unsigned char images[N_SAMPLES * HEIGHT * WIDTH];
+    unsigned char labels[N_SAMPLES];
+    int i, j;
+    for (i = 0; i < N_SAMPLES * HEIGHT * WIDTH; ++i) {
+        images[i] = (unsigned char)(i * 13);
+    }
+    for (i = 0; i < N_SAMPLES; ++i) {
+        labels[i] = (i * 7) % N_CLASSES;
+    }
+    const int dims[3] = {N_SAMPLES, HEIGHT, WIDTH};
+    CHK_ERR(writeIdxUint8("images-idx3-ubyte", 3, dims, images, sizeof(images)));
+    CHK_ERR(writeIdxUint8("labels-idx1-ubyte", 1, dims, labels, sizeof(labels)));
+
+    char images_path[512], labels_path[512];
+    getPath(images_path, "images-idx3-ubyte");
+    getPath(labels_path, "labels-idx1-ubyte");
+    struct Dataset *ds = NULL;
+    CHK_ERR(createIdxDataset(&ds, images_path, labels_path, N_CLASSES));
+
+    enum DatasetType type;
+    int n_samples, n_dims, n_features, n_label_features, n_classes;
+    int shape[DATASET_MAX_DIMS];
+    const char *dtype = NULL;
+    const char *label_dtype = NULL;
+    CHK_ERR(getDatasetType(&type, ds));
+    CHK_ERR(getDatasetSampleNumber(&n_samples, ds));
+    CHK_ERR(getDatasetShape(&n_dims, shape, ds));
+    CHK_ERR(getDatasetFeatureNumber(&n_features, ds));
+    CHK_ERR(getDatasetDType(&dtype, ds));
+    CHK_ERR(getDatasetLabelShape(&n_label_features, &label_dtype, &n_classes, ds));
+    CHK_ERR((type == IDX_DATASET_TYPE && n_samples == N_SAMPLES && n_dims == 2 && shape[0] == HEIGHT && shape[1] == WIDTH)? 0: 1);
+    CHK_ERR((n_features == HEIGHT * WIDTH && strcmp(dtype, "uint8") == 0)? 0: 1);
+    CHK_ERR((n_label_features == N_CLASSES && strcmp(label_dtype, "uint8") == 0 && n_classes == N_CLASSES)? 0: 1);
+
+    // 顺序取前80个样本, 最后一个batch不满, 之后返回epoch结束
+    unsigned char data[BATCH_SIZE * HEIGHT * WIDTH];
+    unsigned char onehot[BATCH_SIZE * N_CLASSES];
+    int n_use = 80;
+    int b, n, total = 0;
+    for (b = 0; ; ++b) {
+        CHK_ERR(getDatasetBatch(data, onehot, &n, ds, NULL, 0, n_use, BATCH_SIZE, b));
+        if (n == 0) {
+            break;
+        }
+        CHK_ERR((memcmp(data, images + (size_t)b * BATCH_SIZE * HEIGHT * WIDTH, (size_t)n * HEIGHT * WIDTH) == 0)? 0: 1);
+        for (i = 0; i < n; ++i) {
+            for (j = 0; j < N_CLASSES; ++j) {
+                CHK_ERR((onehot[i * N_CLASSES + j] == ((j == labels[b * BATCH_SIZE + i])? 1: 0))? 0: 1);
+            }
+        }
+        total += n;
+    }
+    CHK_ERR((total == n_use && b == (n_use + BATCH_SIZE - 1) / BATCH_SIZE)? 0: 1);
+
+    // 按排列取后20个样本(验证集)
+    int perm[20];
+    for (i = 0; i < 20; ++i) {
+        perm[i] = (i * 7) % 20;
+    }
+    CHK_ERR(getDatasetBatch(data, onehot, &n, ds, perm, 80, 20, BATCH_SIZE, 1));
+    CHK_ERR((n == 4)? 0: 1);
+    for (i = 0; i < n; ++i) {
+        int k = 80 + perm[BATCH_SIZE + i];
+        CHK_ERR((memcmp(data + i * HEIGHT * WIDTH, images + k * HEIGHT * WIDTH, HEIGHT * WIDTH) == 0)? 0: 1);
+        CHK_ERR((onehot[i * N_CLASSES + labels[k]] == 1)? 0: 1);
+    }
+    fprintf(stdout, "the following error is expected:\n");
+    CHK_ERR((getDatasetBatch(data, onehot, &n, ds, NULL, 90, 20, BATCH_SIZE, 0) != SUCCESS)? 0: 1);
+    destroyDataset(ds);
+
+    // 没有类标
+    ds = NULL;
+    CHK_ERR(createIdxDataset(&ds, images_path, NULL, 0));
+    CHK_ERR(getDatasetLabelShape(&n_label_features, &label_dtype, &n_classes, ds));
+    CHK_ERR((n_label_features == 0)? 0: 1);
+    CHK_ERR(getDatasetBatch(data, NULL, &n, ds, NULL, 0, N_SAMPLES, BATCH_SIZE, 0));
+    destroyDataset(ds);
+
+    // 类标越界, 类标样本数不一致
+    fprintf(stdout, "the following errors are expected:\n");
+    ds = NULL;
+    CHK_ERR((createIdxDataset(&ds, images_path, labels_path, N_CLASSES - 1) != SUCCESS && ds == NULL)? 0: 1);
+    const int dims_short[1] = {N_SAMPLES - 1};
+    CHK_ERR(writeIdxUint8("labels-idx1-ubyte", 1, dims_short, labels, N_SAMPLES - 1));
+    CHK_ERR((createIdxDataset(&ds, images_path, labels_path, N_CLASSES) != SUCCESS && ds == NULL)? 0: 1);
+    unlink(images_path);
+    unlink(labels_path);
+    return SUCCESS;
+}
+
+static int testRawDataset(void)
+{
+    float samples[N_RAW * 3 * 4];
+    float dense[N_RAW * RAW_LABEL_SIZE];
+    int classes[N_RAW];
+    char head[RAW_OFFSET];
+    int i;
+    for (i = 0; i < N_RAW * 3 * 4; ++i) {
+        samples[i] = i * 0.5f;
+    }
+    for (i = 0; i < N_RAW * RAW_LABEL_SIZE; ++i) {
+        dense[i] = -i;
+    }
+    for (i = 0; i < N_RAW; ++i) {
+        classes[i] = i % 3;
+    }
+    memset(head, 0x5a, RAW_OFFSET);
+    CHK_ERR(writeFile("samples.bin", head, RAW_OFFSET, samples, sizeof(samples)));
+    CHK_ERR(writeFile("dense.bin", head, 0, dense, sizeof(dense)));
+    CHK_ERR(writeFile("classes.bin", head, 0, classes, sizeof(classes)));
+
+    char samples_path[512], dense_path[512], classes_path[512];
+    getPath(samples_path, "samples.bin");
+    getPath(dense_path, "dense.bin");
+    getPath(classes_path, "classes.bin");
+    struct RawDatasetDesc desc;
+    memset(&desc, 0, sizeof(struct RawDatasetDesc));
+    desc.data_path = samples_path;
+    desc.data_offset = RAW_OFFSET;
+    desc.dtype = "FLOAT32";
+    desc.n_dims = 2;
+    desc.dims[0] = 3;
+    desc.dims[1] = 4;
+    desc.label_path = dense_path;
+    desc.label_dtype = "float32";
+    desc.label_size = RAW_LABEL_SIZE;
+
+    // 原样复制的类标
+    struct Dataset *ds = NULL;
+    CHK_ERR(createRawDataset(&ds, &desc));
+    int n_samples, n_label_features, n_classes, n;
+    const char *dtype = NULL;
+    const char *label_dtype = NULL;
+    CHK_ERR(getDatasetSampleNumber(&n_samples, ds));
+    CHK_ERR(getDatasetDType(&dtype, ds));
+    CHK_ERR(getDatasetLabelShape(&n_label_features, &label_dtype, &n_classes, ds));
+    CHK_ERR((n_samples == N_RAW && strcmp(dtype, "float32") == 0)? 0: 1);
+    CHK_ERR((n_label_features == RAW_LABEL_SIZE && strcmp(label_dtype, "float32") == 0 && n_classes == 0)? 0: 1);
+    float data[BATCH_SIZE * 12];
+    float label[BATCH_SIZE * RAW_LABEL_SIZE];
+    int perm[N_RAW];
+    for (i = 0; i < N_RAW; ++i) {
+        perm[i] = N_RAW - 1 - i;
+    }
+    CHK_ERR(getDatasetBatch(data, label, &n, ds, perm, 0, N_RAW, BATCH_SIZE, 3));
+    CHK_ERR((n == N_RAW - 3 * BATCH_SIZE)? 0: 1);
+    for (i = 0; i < n; ++i) {
+        int k = perm[3 * BATCH_SIZE + i];
+        CHK_ERR((memcmp(data + i * 12, samples + k * 12, 12 * sizeof(float)) == 0)? 0: 1);
+        CHK_ERR((memcmp(label + i * RAW_LABEL_SIZE, dense + k * RAW_LABEL_SIZE, RAW_LABEL_SIZE * sizeof(float)) == 0)? 0: 1);
+    }
+    destroyDataset(ds);
+
+    // int32类别序号展开为onehot
+    desc.label_path = classes_path;
+    desc.label_dtype = "int32";
+    desc.label_size = 1;
+    desc.n_classes = 3;
+    ds = NULL;
+    CHK_ERR(createRawDataset(&ds, &desc));
+    unsigned char onehot[BATCH_SIZE * 3];
+    CHK_ERR(getDatasetBatch(data, onehot, &n, ds, NULL, 10, 40, BATCH_SIZE, 0));
+    CHK_ERR((n == BATCH_SIZE)? 0: 1);
+    for (i = 0; i < n; ++i) {
+        CHK_ERR((onehot[i * 3 + classes[10 + i]] == 1 && onehot[i * 3 + (classes[10 + i] + 1) % 3] == 0)? 0: 1);
+    }
+    destroyDataset(ds);
+
+    // 文件大小不是样本的整数倍, 类标数不一致, 未知类型
+    fprintf(stdout, "the following errors are expected:\n");
+    ds = NULL;
+    desc.data_offset = RAW_OFFSET - 4;
+    CHK_ERR((createRawDataset(&ds, &desc) != SUCCESS && ds == NULL)? 0: 1);
+    desc.data_offset = RAW_OFFSET;
+    desc.label_path = dense_path;
+    CHK_ERR((createRawDataset(&ds, &desc) != SUCCESS && ds == NULL)? 0: 1);
+    desc.label_path = NULL;
+    desc.dtype = "float16";
+    CHK_ERR((createRawDataset(&ds, &desc) != SUCCESS && ds == NULL)? 0: 1);
+
+    unlink(samples_path);
+    unlink(dense_path);
+    unlink(classes_path);
+    return SUCCESS;
+}
+
+int main()
+{
+    snprintf(g_dir, sizeof(g_dir), "/tmp/test_dataset_XXXXXX");
+    CHK_NIL(mkdtemp(g_dir));
+
+    CHK_ERR(testIdxDataset());
+    CHK_ERR(testRawDataset());
+    rmdir(g_dir);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @brief 大块分配按大页对齐, 三种大页模式的分配清零和释放, 以及大页字节数的统计;
+ *        数据张量改为引用外部blob时, 自己分配的大块blob被释放.
+ *        内核关闭THP或没有预留hugetlb大页时统计值可以为0, 只检查不报错.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "memory.h"
+#include "tensor.h"
+#include "debug_macros.h"
+
+static int checkZero(const unsigned char *p, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; ++i) {
+        if (p[i] != 0) {
+            return ERR_COD;
+        }
+    }
+    return SUCCESS;
+}
+
+static int testMode(const char *spec, size_t size)
+{
+    CHK_ERR(setHugePageMode(spec));
+    unsigned char *p = allocBlob(size);
+    CHK_NIL(p);
+    if (strcmp(spec, "none") != 0) {
+        CHK_ERR(((uintptr_t)p % MEM_HUGE_PAGE_SIZE == 0)? 0: 1);
+    }
+    CHK_ERR(checkZero(p, size));
+    memset(p, 0xff, size);
+
+    size_t huge = 0;
+    size_t total = 0;
+    CHK_ERR(getHugePageBytes(&huge, &total));
+    CHK_ERR((total >= size && huge <= total)? 0: 1);
+    fprintf(stdout, "%s: huge page bytes = %zu / %zu\n", spec, huge, total);
+
+    freeBlob(p, size);
+    CHK_ERR(getHugePageBytes(&huge, &total));
+    CHK_ERR((total == 0 && huge == 0)? 0: 1);
+    return SUCCESS;
+}
+
+int main()
+{
+    CHK_ERR((setHugePageMode("2m") != SUCCESS)? 0: 1);
+    enum HugePageMode mode;
+    CHK_ERR(getHugePageMode(&mode));
+
+    CHK_ERR(testMode("thp", 64 * MEM_LARGE_SIZE + 123));
+    CHK_ERR(testMode("hugetlb", 16 * MEM_LARGE_SIZE)); // 没有预留大页时退回THP
+    CHK_ERR(testMode("none", 8 * MEM_LARGE_SIZE + 1));
+    CHK_ERR(testMode("thp", MEM_LARGE_SIZE)); // 不足一个大页时也按大页对齐
+
+    // Tensor的大块参数经allocBlob登记
+    CHK_ERR(setHugePageMode("thp"));
+    struct Tensor *w = NULL;
+    CHK_ERR(createTensorParam(&w, FLOAT32, 625, 784));
+    size_t huge = 0;
+    size_t total = 0;
+    CHK_ERR(getHugePageBytes(&huge, &total));
+    CHK_ERR((total == MEM_HUGE_PAGE_SIZE)? 0: 1);
+    destroyTensor(w);
+
+    // 替换张量自己分配的blob: 原blob就地释放, 不交给调用者
+    struct Tensor *x = NULL;
+    CHK_ERR(createTensorData(&x, FLOAT32, 512, 784));
+    CHK_ERR(getHugePageBytes(&huge, &total));
+    CHK_ERR((total > 0)? 0: 1);
+    float *ext = calloc(512 * 784, sizeof(float));
+    CHK_NIL(ext);
+    void *blob_old = ext;
+    CHK_ERR(setTensorSamplesByReplace(&blob_old, x, ext, 512, 784, FLOAT32));
+    CHK_ERR((blob_old == NULL)? 0: 1);
+    CHK_ERR(getHugePageBytes(&huge, &total));
+    CHK_ERR((total == 0)? 0: 1);
+    free(x); // 引用外部blob的张量只释放结构体, 与网络的输入张量相同
+    free(ext);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,288 @@
+/**
+ * @brief IDX文件的映射和文件头校验(魔数, 类型, 维数, 文件大小), 以及基于映射的MNIST加载:
+ *        在临时目录中生成MNIST格式的随机数据, 检查均值/标准差和归一化结果与串行计算一致, 类标越界时加载失败.
+ *        带缓存的加载: 命中时与重新计算的结果逐字节相同, 源文件改变后缓存失效.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "idx_file.h"
+#include "mnist.h"
+#include "debug_macros.h"
+
+#define TMP_DIR_SIZE (256)
+
+// 写一个IDX文件, n_extra为正时在末尾多写若干字节, 为负时截掉若干字节
+static int writeIdx(const char *path, int type, int n_dims, const int *dims, const void *data, size_t n_bytes, int n_extra)
+{
+    FILE *fp = fopen(path, "wb");
+    CHK_NIL(fp);
+    unsigned char head[4] = {0, 0, (unsigned char)type, (unsigned char)n_dims};
+    fwrite(head, 1, 4, fp);
+    int i;
+    for (i = 0; i < n_dims; ++i) {
+        unsigned char d[4] = {(unsigned char)(dims[i] >> 24), (unsigned char)(dims[i] >> 16), (unsigned char)(dims[i] >> 8), (unsigned char)dims[i]};
+        fwrite(d, 1, 4, fp);
+    }
+    fwrite(data, 1, (n_extra < 0)? n_bytes + n_extra: n_bytes, fp);
+    for (i = 0; i < n_extra; ++i) {
+        fputc(0, fp);
+    }
+    fclose(fp);
+    return SUCCESS;
+}
+
+static int testIdxFile(const char *dir)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/small-idx3-ubyte", dir);
+    const int dims[3] = {3, 4, 5};
+    unsigned char raw[60];
+    int i;
+    for (i = 0; i < 60; ++i) {
+        raw[i] = (unsigned char)(i * 7);
+    }
+
+    // 合法文件: 数据区与写入的内容一致
+    struct IdxFile *f = NULL;
+    CHK_ERR(writeIdx(path, IDX_UINT8, 3, dims, raw, 60, 0));
+    CHK_ERR(openIdxFile(&f, path));
+    enum IdxDType dtype;
+    int n_dims;
+    int shape[IDX_MAX_DIMS];
+    const void *data = NULL;
+    size_t n_bytes = 0;
+    CHK_ERR(getIdxFileDType(&dtype, f));
+    CHK_ERR(getIdxFileShape(&n_dims, shape, f));
+    CHK_ERR(getIdxFileData(&data, &n_bytes, f));
+    CHK_ERR((dtype == IDX_UINT8 && n_dims == 3 && shape[0] == 3 && shape[1] == 4 && shape[2] == 5)? 0: 1);
+    CHK_ERR((n_bytes == 60 && memcmp(data, raw, 60) == 0)? 0: 1);
+    CHK_ERR(checkIdxFileShape(f, IDX_UINT8, 3, dims));
+    const int dims_bad[3] = {3, 5, 4};
+    fprintf(stdout, "the following errors are expected:\n");
+    CHK_ERR((checkIdxFileShape(f, IDX_UINT8, 3, dims_bad) != SUCCESS)? 0: 1);
+    CHK_ERR((checkIdxFileShape(f, IDX_INT32, 3, dims) != SUCCESS)? 0: 1);
+    closeIdxFile(f);
+
+    // 非法文件: 截断, 多余字节, 未知类型, 魔数错误, 文件不存在
+    f = NULL;
+    CHK_ERR(writeIdx(path, IDX_UINT8, 3, dims, raw, 60, -1));
+    CHK_ERR((openIdxFile(&f, path) != SUCCESS && f == NULL)? 0: 1);
+    CHK_ERR(writeIdx(path, IDX_UINT8, 3, dims, raw, 60, 1));
+    CHK_ERR((openIdxFile(&f, path) != SUCCESS && f == NULL)? 0: 1);
+    CHK_ERR(writeIdx(path, 0x07, 3, dims, raw, 60, 0));
+    CHK_ERR((openIdxFile(&f, path) != SUCCESS && f == NULL)? 0: 1);
+    CHK_ERR(writeIdx(path, IDX_UINT8, 3, dims, raw, 60, 0));
+    FILE *fp = fopen(path, "r+b");
+    CHK_NIL(fp);
+    fputc(1, fp);
+    fclose(fp);
+    CHK_ERR((openIdxFile(&f, path) != SUCCESS && f == NULL)? 0: 1);
+    unlink(path);
+    CHK_ERR((openIdxFile(&f, path) != SUCCESS && f == NULL)? 0: 1);
+    return SUCCESS;
+}
+
+static int writeMnistFiles(const char *dir, const unsigned char *train, const unsigned char *train_label, const unsigned char *test, const unsigned char *test_label)
+{
+    char path[512];
+    const int dims_train[3] = {MNIST_N_TRAIN, MNIST_HEIGHT, MNIST_WIDTH};
+    const int dims_test[3] = {MNIST_N_TEST, MNIST_HEIGHT, MNIST_WIDTH};
+    snprintf(path, sizeof(path), "%s/train-images-idx3-ubyte", dir);
+    CHK_ERR(writeIdx(path, IDX_UINT8, 3, dims_train, train, (size_t)MNIST_N_TRAIN * MNIST_SAMPLE_SIZE, 0));
+    snprintf(path, sizeof(path), "%s/train-labels-idx1-ubyte", dir);
+    CHK_ERR(writeIdx(path, IDX_UINT8, 1, dims_train, train_label, MNIST_N_TRAIN, 0));
+    snprintf(path, sizeof(path), "%s/t10k-images-idx3-ubyte", dir);
+    CHK_ERR(writeIdx(path, IDX_UINT8, 3, dims_test, test, (size_t)MNIST_N_TEST * MNIST_SAMPLE_SIZE, 0));
+    snprintf(path, sizeof(path), "%s/t10k-labels-idx1-ubyte", dir);
+    CHK_ERR(writeIdx(path, IDX_UINT8, 1, dims_test, test_label, MNIST_N_TEST, 0));
+    return SUCCESS;
+}
+
+// 比较预处理结果, to_float为0时不比较float数组
+static int checkSameMnist(const struct MNIST *a, const struct MNIST *b, int to_float)
+{
+    CHK_ERR((a->mean == b->mean && a->std == b->std)? 0: 1);
+    if (to_float) {
+        CHK_ERR((memcmp(a->train_images_norm, b->train_images_norm, 50000L * MNIST_SAMPLE_SIZE * sizeof(float)) == 0)? 0: 1);
+        CHK_ERR((memcmp(a->valid_images_norm, b->valid_images_norm, 10000L * MNIST_SAMPLE_SIZE * sizeof(float)) == 0)? 0: 1);
+        CHK_ERR((memcmp(a->test_images_norm, b->test_images_norm, (long)MNIST_N_TEST * MNIST_SAMPLE_SIZE * sizeof(float)) == 0)? 0: 1);
+    }
+    CHK_ERR((memcmp(a->train_labels_onehot, b->train_labels_onehot, 50000 * MNIST_N_CLASSES) == 0)? 0: 1);
+    CHK_ERR((memcmp(a->valid_labels_onehot, b->valid_labels_onehot, 10000 * MNIST_N_CLASSES) == 0)? 0: 1);
+    CHK_ERR((memcmp(a->test_labels_onehot, b->test_labels_onehot, MNIST_N_TEST * MNIST_N_CLASSES) == 0)? 0: 1);
+    return SUCCESS;
+}
+
+static int testMnistCache(const char *dir, const struct MNIST *ref)
+{
+    char cache_path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s/mnist.cache", dir);
+    struct timeval t0, t1, t2;
+    struct MNIST mnist;
+    int k;
+    for (k = 0; k < 2; ++k) { // 第一次计算并写缓存, 第二次映射缓存
+        CHK_ERR(gettimeofday(&t0, NULL));
+        CHK_ERR(loadMnistAllCached(&mnist, dir, cache_path));
+        CHK_ERR(gettimeofday(&t1, NULL));
+        timersub(&t1, &t0, &t2);
+        fprintf(stdout, "loadMnistAllCached (%s): %.3fs\n", k? "hit": "miss", t2.tv_sec + t2.tv_usec / 1e6);
+        CHK_ERR(((mnist.cache != NULL) == (k == 1))? 0: 1);
+        CHK_ERR(checkSameMnist(&mnist, ref, 1));
+        CHK_ERR((memcmp(mnist.train_images, ref->train_images, (long)MNIST_N_TRAIN * MNIST_SAMPLE_SIZE) == 0)? 0: 1);
+        freeMnist(&mnist);
+    }
+
+    // 完整的缓存也可以用于loadMnistUint8Cached
+    CHK_ERR(loadMnistUint8Cached(&mnist, dir, cache_path));
+    CHK_ERR((mnist.cache != NULL && mnist.train_images_norm == NULL)? 0: 1);
+    CHK_ERR(checkSameMnist(&mnist, ref, 0));
+    freeMnist(&mnist);
+
+    // 只有uint8结果的缓存不能用于loadMnistAllCached, 重新计算后写入完整的缓存
+    unlink(cache_path);
+    CHK_ERR(loadMnistUint8Cached(&mnist, dir, cache_path));
+    CHK_ERR((mnist.cache == NULL)? 0: 1);
+    freeMnist(&mnist);
+    CHK_ERR(loadMnistUint8Cached(&mnist, dir, cache_path));
+    CHK_ERR((mnist.cache != NULL)? 0: 1);
+    CHK_ERR(checkSameMnist(&mnist, ref, 0));
+    freeMnist(&mnist);
+    CHK_ERR(loadMnistAllCached(&mnist, dir, cache_path));
+    CHK_ERR((mnist.cache == NULL)? 0: 1);
+    freeMnist(&mnist);
+    CHK_ERR(loadMnistAllCached(&mnist, dir, cache_path));
+    CHK_ERR((mnist.cache != NULL)? 0: 1);
+    CHK_ERR(checkSameMnist(&mnist, ref, 1));
+    freeMnist(&mnist);
+    return SUCCESS;
+}
+
+static int testMnist(const char *dir)
+{
+    long n_train = (long)MNIST_N_TRAIN * MNIST_SAMPLE_SIZE;
+    long n_test = (long)MNIST_N_TEST * MNIST_SAMPLE_SIZE;
+    unsigned char *train = malloc(n_train);
+    unsigned char *test = malloc(n_test);
+    unsigned char *train_label = malloc(MNIST_N_TRAIN);
+    unsigned char *test_label = malloc(MNIST_N_TEST);
+    CHK_NIL(train);
+    CHK_NIL(test);
+    CHK_NIL(train_label);
+    CHK_NIL(test_label);
+    long i;
+    srand(3);
+    for (i = 0; i < n_train; ++i) {
+        train[i] = (rand() % 4 == 0)? rand() % 256: 0; // 与MNIST类似, 大部分像素为0
+    }
+    for (i = 0; i < n_test; ++i) {
+        test[i] = rand() % 256;
+    }
+    for (i = 0; i < MNIST_N_TRAIN; ++i) {
+        train_label[i] = rand() % MNIST_N_CLASSES;
+    }
+    for (i = 0; i < MNIST_N_TEST; ++i) {
+        test_label[i] = rand() % MNIST_N_CLASSES;
+    }
+    CHK_ERR(writeMnistFiles(dir, train, train_label, test, test_label));
+
+    // 串行计算的参考值, 与原先先转float再统计的方法相同
+    long n_stat = 50000L * MNIST_SAMPLE_SIZE;
+    double sum = 0.;
+    for (i = 0; i < n_stat; ++i) {
+        sum += (float)train[i];
+    }
+    double mean = sum / n_stat;
+    double sum2 = 0.;
+    for (i = 0; i < n_stat; ++i) {
+        sum2 += pow((double)((float)train[i] - mean), 2.);
+    }
+    double std = sqrt(sum2 / (n_stat - 1));
+
+    struct timeval t0, t1, t2;
+    struct MNIST mnist;
+    CHK_ERR(gettimeofday(&t0, NULL));
+    CHK_ERR(loadMnistAll(&mnist, dir));
+    CHK_ERR(gettimeofday(&t1, NULL));
+    timersub(&t1, &t0, &t2);
+    fprintf(stdout, "loadMnistAll: %.3fs, mean = %f (ref %f), std = %f (ref %f)\n",
+        t2.tv_sec + t2.tv_usec / 1e6, mnist.mean, mean, mnist.std, std);
+    CHK_ERR((mnist.mean == mean)? 0: 1); // 整数求和在double中是精确的
+    CHK_ERR((fabs(mnist.std - std) < 1e-9 * std)? 0: 1);
+    CHK_ERR((memcmp(mnist.train_images, train, n_train) == 0)? 0: 1);
+    CHK_ERR((memcmp(mnist.test_labels, test_label, MNIST_N_TEST) == 0)? 0: 1);
+    for (i = 0; i < 50000L * MNIST_SAMPLE_SIZE; ++i) {
+        float x = (float)train[i];
+        x = (x - mnist.mean) / mnist.std;
+        CHK_ERR((mnist.train_images_norm[i] == x)? 0: 1);
+    }
+    for (i = 0; i < n_test; ++i) {
+        float x = (float)test[i];
+        x = (x - mnist.mean) / mnist.std;
+        CHK_ERR((mnist.test_images_norm[i] == x)? 0: 1);
+    }
+    for (i = 0; i < MNIST_N_TRAIN - 50000; ++i) {
+        CHK_ERR((mnist.valid_labels_onehot[i * MNIST_N_CLASSES + train_label[50000 + i]] == 1)? 0: 1);
+    }
+    CHK_ERR(testMnistCache(dir, &mnist));
+    freeMnist(&mnist);
+
+    CHK_ERR(gettimeofday(&t0, NULL));
+    CHK_ERR(loadMnistUint8(&mnist, dir));
+    CHK_ERR(gettimeofday(&t1, NULL));
+    timersub(&t1, &t0, &t2);
+    fprintf(stdout, "loadMnistUint8: %.3fs\n", t2.tv_sec + t2.tv_usec / 1e6);
+    CHK_ERR((mnist.train_images_norm == NULL && mnist.test_images_norm == NULL && mnist.mean == mean)? 0: 1);
+    freeMnist(&mnist);
+
+    CHK_ERR(loadMnist(&mnist, dir));
+    CHK_ERR((mnist.train_images == NULL && mnist.train_images_norm != NULL)? 0: 1);
+    freeMnist(&mnist);
+
+    // 源文件改变后缓存不再命中
+    char cache_path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s/mnist.cache", dir);
+    train[77] ^= 0x40;
+    CHK_ERR(writeMnistFiles(dir, train, train_label, test, test_label));
+    CHK_ERR(loadMnistAllCached(&mnist, dir, cache_path));
+    CHK_ERR((mnist.cache == NULL && mnist.mean != mean)? 0: 1);
+    CHK_ERR((mnist.train_images_norm[77] == (float)(((float)train[77] - mnist.mean) / mnist.std))? 0: 1);
+    freeMnist(&mnist);
+    unlink(cache_path);
+
+    // 类标越界
+    train_label[123] = MNIST_N_CLASSES;
+    CHK_ERR(writeMnistFiles(dir, train, train_label, test, test_label));
+    fprintf(stdout, "the following errors are expected:\n");
+    CHK_ERR((loadMnistAll(&mnist, dir) != SUCCESS)? 0: 1);
+
+    const char *names[4] = {"train-images-idx3-ubyte", "train-labels-idx1-ubyte", "t10k-images-idx3-ubyte", "t10k-labels-idx1-ubyte"};
+    char path[512];
+    for (i = 0; i < 4; ++i) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        unlink(path);
+    }
+    free(train);
+    free(test);
+    free(train_label);
+    free(test_label);
+    return SUCCESS;
+}
+
+int main()
+{
+    char dir[TMP_DIR_SIZE];
+    snprintf(dir, TMP_DIR_SIZE, "/tmp/test_idx_file_XXXXXX");
+    CHK_NIL(mkdtemp(dir));
+
+    CHK_ERR(testIdxFile(dir));
+    CHK_ERR(testMnist(dir));
+    rmdir(dir);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -6,4 +6,4 @@ SRC_DIR=../../../src
 
 INC_CMD="-I$SRC_DIR -I$SRC_DIR/datasets"
 
-gcc -g -Wall $INC_CMD test.c $SRC_DIR/datasets/mnist.c $SRC_DIR/debug_macros.c -o Test
\ No newline at end of file
+gcc -g -Wall $INC_CMD test.c $SRC_DIR/datasets/mnist.c $SRC_DIR/datasets/idx_file.c $SRC_DIR/datasets/dataset.c $SRC_DIR/datasets/data_cache.c $SRC_DIR/memory.c $SRC_DIR/thread_pool.c $SRC_DIR/affinity.c $SRC_DIR/debug_macros.c -lpthread -o Test
\ No newline at end of file
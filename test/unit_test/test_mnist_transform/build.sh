@@ -24,7 +24,7 @@ TEST_DIR="$PROJECT_DIR/test"
 #    -o libnn.so
 
 INC_CMD="-I. -I$SRC_DIR -I$SRC_DIR/datasets"
-LIB_CMD="-lm"
+LIB_CMD="-lm -lpthread"
 #CFLAGS="-g -Wall -O2 -fopenmp"
 CFLAGS="-g -Wall -O2"
 
@@ -32,7 +32,12 @@ gcc $CFLAGS \
     $INC_CMD \
     test.c \
     $SRC_DIR/datasets/mnist.c \
+    $SRC_DIR/datasets/idx_file.c \
+    $SRC_DIR/datasets/dataset.c $SRC_DIR/datasets/data_cache.c \
     $SRC_DIR/datasets/data_utils.c \
+    $SRC_DIR/memory.c \
+    $SRC_DIR/thread_pool.c \
+    $SRC_DIR/affinity.c \
     $SRC_DIR/debug_macros.c \
     $LIB_CMD \
     -o Test
\ No newline at end of file
@@ -0,0 +1,124 @@
+/**
+ * @brief Philox4x32-10的已知答案, 并行与串行生成结果一致, 分段生成与一次生成一致, 不同流互不相同,
+ *        以及均匀/正态/伯努利分布的均值和方差.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "rng.h"
+#include "thread_pool.h"
+#include "debug_macros.h"
+
+#define N (1 << 20)
+
+// 分别在默认线程池上和当前线程上生成, 结果应逐位一致
+static int checkSerial(int kind)
+{
+    static float x[N], y[N];
+    int i;
+    for (i = 0; i < 2; ++i) {
+        float *dst = (i == 0)? x: y;
+        setParallelForInline(i);
+        CHK_ERR(setRandomSeed(42));
+        switch (kind) {
+        case 0:
+            CHK_ERR(fillRandomUint32(NULL, (uint32_t *)dst, N - 3));
+            break;
+        case 1:
+            CHK_ERR(fillRandomUniform(NULL, dst, N - 3, -1.f, 1.f));
+            break;
+        case 2:
+            CHK_ERR(fillRandomNormal(NULL, dst, N - 3, 0.f, 1.f));
+            break;
+        default:
+            CHK_ERR(fillRandomBernoulli(NULL, (unsigned char *)dst, N - 3, 0.3f));
+            break;
+        }
+    }
+    setParallelForInline(0);
+    CHK_ERR((memcmp(x, y, (N - 3) * sizeof(float)) == 0)? 0: 1);
+    return SUCCESS;
+}
+
+static void getMeanStd(double *mean, double *std, const float *x, int n)
+{
+    double s = 0., s2 = 0.;
+    int i;
+    for (i = 0; i < n; ++i) {
+        s += x[i];
+        s2 += (double)x[i] * x[i];
+    }
+    *mean = s / n;
+    *std = sqrt(s2 / n - *mean * *mean);
+}
+
+int main()
+{
+    int n_threads = 0;
+    struct ThreadPool *pool = NULL;
+    CHK_ERR(getDefaultThreadPool(&pool));
+    CHK_ERR(getThreadPoolSize(&n_threads, pool));
+    fprintf(stdout, "threads: %d\n", n_threads);
+
+    // 1. 已知答案: counter = 0, key = 0
+    uint32_t u[16];
+    const uint32_t kat[4] = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+    CHK_ERR(setRandomSeed(0));
+    CHK_ERR(fillRandomUint32(NULL, u, 4));
+    CHK_ERR((memcmp(u, kat, sizeof(kat)) == 0)? 0: 1);
+
+    // 2. 与线程数无关
+    int k;
+    for (k = 0; k < 4; ++k) {
+        CHK_ERR(checkSerial(k));
+    }
+
+    // 3. 分段生成与一次生成一致; 不同流互不相同
+    struct RandomStream *rs0 = NULL;
+    struct RandomStream *rs1 = NULL;
+    struct RandomStream *rs2 = NULL;
+    uint32_t v[16];
+    CHK_ERR(createRandomStream(&rs0, 7, 0));
+    CHK_ERR(createRandomStream(&rs1, 7, 0));
+    CHK_ERR(createRandomStream(&rs2, 7, 1));
+    CHK_ERR(fillRandomUint32(rs0, u, 16));
+    CHK_ERR(fillRandomUint32(rs1, v, 8));
+    CHK_ERR(fillRandomUint32(rs1, v + 8, 8));
+    CHK_ERR((memcmp(u, v, sizeof(u)) == 0)? 0: 1);
+    CHK_ERR(fillRandomUint32(rs2, v, 16));
+    CHK_ERR((memcmp(u, v, sizeof(u)) != 0)? 0: 1);
+    destroyRandomStream(rs0);
+    destroyRandomStream(rs1);
+    destroyRandomStream(rs2);
+
+    // 4. 分布
+    static float x[N];
+    static unsigned char b[N];
+    double mean, std;
+    CHK_ERR(fillRandomUniform(NULL, x, N, 2.f, -1.f));
+    getMeanStd(&mean, &std, x, N);
+    fprintf(stdout, "uniform(-1, 2): mean = %f, std = %f\n", mean, std);
+    CHK_ERR((fabs(mean - 0.5) < 0.01 && fabs(std - 3. / sqrt(12.)) < 0.01)? 0: 1);
+    for (k = 0; k < N; ++k) {
+        CHK_ERR((x[k] >= -1.f && x[k] <= 2.f)? 0: 1);
+    }
+    CHK_ERR(fillRandomNormal(NULL, x, N, 1.f, 2.f));
+    getMeanStd(&mean, &std, x, N);
+    fprintf(stdout, "normal(1, 2): mean = %f, std = %f\n", mean, std);
+    CHK_ERR((fabs(mean - 1.) < 0.01 && fabs(std - 2.) < 0.01)? 0: 1);
+    CHK_ERR(fillRandomBernoulli(NULL, b, N, 0.3f));
+    int n_ones = 0;
+    for (k = 0; k < N; ++k) {
+        n_ones += b[k];
+    }
+    fprintf(stdout, "bernoulli(0.3): rate = %f\n", (double)n_ones / N);
+    CHK_ERR((fabs((double)n_ones / N - 0.3) < 0.005)? 0: 1);
+
+    CHK_ERR((fillRandomBernoulli(NULL, b, N, 1.5f) != SUCCESS)? 0: 1);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,320 @@
+/**
+ * @brief 分片数据集的写入和流式读取: io_uring和pread两种读取方式下每个epoch每条记录恰好出现一次且样本/类标配对正确,
+ *        不打乱时按顺序读出, 打乱结果由(seed, epoch)决定, 多个块组成的分片, 校验和检出损坏的字节, 以及作为DataLoader回调.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "shard_dataset.h"
+#include "data_loader.h"
+#include "debug_macros.h"
+
+#define N_RECORDS (1003)
+#define RECORDS_PER_SHARD (97)
+#define DATA_BYTES (20)
+#define BATCH_SIZE (32)
+#define N_EPOCHS (3)
+
+#define N_BIG (40)
+#define BIG_PER_SHARD (7)
+#define BIG_DATA_BYTES (300000) // 每块3条记录, 每个分片3个块
+
+static char g_dir[256];
+
+static void getPrefix(char *prefix, const char *name)
+{
+    snprintf(prefix, 512, "%s/%s", g_dir, name);
+}
+
+static void removeShards(const char *prefix, int n_shards)
+{
+    char path[600];
+    int i;
+    for (i = 0; i < n_shards; ++i) {
+        snprintf(path, sizeof(path), "%s-%05d.shard", prefix, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s.index", prefix);
+    unlink(path);
+}
+
+// 第i条记录: 前4字节为i, 其余字节由i和位置决定; 类标为i * 7 + 1
+static void fillRecord(unsigned char *data, int32_t *label, int i, size_t data_bytes)
+{
+    size_t j;
+    for (j = 0; j < data_bytes; ++j) {
+        data[j] = (unsigned char)(i * 31 + j);
+    }
+    memcpy(data, &i, sizeof(int));
+    *label = i * 7 + 1;
+}
+
+static int checkRecord(int *id, const unsigned char *data, const int32_t *label, int n_records, size_t data_bytes)
+{
+    int i;
+    memcpy(&i, data, sizeof(int));
+    CHK_ERR((i >= 0 && i < n_records)? 0: 1);
+    size_t j;
+    for (j = sizeof(int); j < data_bytes; ++j) {
+        CHK_ERR((data[j] == (unsigned char)(i * 31 + j))? 0: 1);
+    }
+    CHK_ERR((*label == i * 7 + 1)? 0: 1);
+    *id = i;
+    return SUCCESS;
+}
+
+static int writeShards(const char *prefix, int n_records, size_t data_bytes, long per_shard, int checksum)
+{
+    struct ShardWriter *w = NULL;
+    unsigned char *data = malloc(data_bytes * 8);
+    int32_t label[8];
+    CHK_NIL(data);
+    CHK_ERR(createShardWriter(&w, prefix, data_bytes, sizeof(int32_t), per_shard, checksum));
+    // 每次写入的条数不同, 覆盖跨分片的写入
+    int i = 0;
+    int n = 1;
+    while (i < n_records) {
+        int k;
+        if (n > n_records - i) {
+            n = n_records - i;
+        }
+        for (k = 0; k < n; ++k) {
+            fillRecord(data + k * data_bytes, label + k, i + k, data_bytes);
+        }
+        CHK_ERR(writeShardRecords(w, data, label, n));
+        i += n;
+        n = n % 8 + 1;
+    }
+    CHK_ERR(closeShardWriter(w));
+    free(data);
+    return SUCCESS;
+}
+
+/**
+ * @brief 读N_EPOCHS轮, 检查每轮每条记录恰好出现一次, orders记录各轮的读出顺序
+ */
+static int readEpochs(int *orders, const char *prefix, int n_records, size_t data_bytes, int window, uint64_t seed, enum ShardIoMode mode)
+{
+    struct ShardReader *r = NULL;
+    unsigned char *data = malloc(BATCH_SIZE * data_bytes);
+    int32_t label[BATCH_SIZE];
+    int *seen = malloc(n_records * sizeof(int));
+    CHK_NIL(data);
+    CHK_NIL(seen);
+    CHK_ERR(createShardReader(&r, prefix, BATCH_SIZE, window, 4, seed, mode));
+
+    long n_total = 0;
+    size_t db = 0, lb = 0;
+    int n_shards = 0;
+    CHK_ERR(getShardReaderInfo(&n_total, &db, &lb, &n_shards, r));
+    CHK_ERR((n_total == n_records && db == data_bytes && lb == sizeof(int32_t))? 0: 1);
+    enum ShardIoMode actual = SHARD_IO_AUTO;
+    CHK_ERR(getShardReaderIoMode(&actual, r));
+    CHK_ERR((actual == SHARD_IO_URING || actual == SHARD_IO_PREAD)? 0: 1);
+    if (mode != SHARD_IO_AUTO) {
+        CHK_ERR((actual == mode)? 0: 1);
+    }
+
+    int e;
+    for (e = 0; e < N_EPOCHS; ++e) {
+        int *order = orders + e * n_records;
+        int n_read = 0;
+        int n_batches = 0;
+        memset(seen, 0, n_records * sizeof(int));
+        while (1) {
+            int n = -1;
+            CHK_ERR(readShardBatch(data, label, &n, r));
+            if (n == 0) {
+                break;
+            }
+            CHK_ERR((n == BATCH_SIZE || n_read + n == n_records)? 0: 1);
+            int k;
+            for (k = 0; k < n; ++k) {
+                int id = -1;
+                CHK_ERR(checkRecord(&id, data + k * data_bytes, label + k, n_records, data_bytes));
+                CHK_ERR((seen[id] == 0)? 0: 1);
+                seen[id] = 1;
+                order[n_read++] = id;
+            }
+            ++n_batches;
+        }
+        CHK_ERR((n_read == n_records)? 0: 1);
+        CHK_ERR((n_batches == (n_records + BATCH_SIZE - 1) / BATCH_SIZE)? 0: 1);
+    }
+
+    long n_bytes = 0, n_stalls = 0;
+    double stall_time = 0.;
+    CHK_ERR(getShardReaderStats(&n_bytes, &n_stalls, &stall_time, r));
+    CHK_ERR((n_bytes >= (long)N_EPOCHS * n_records * (long)(data_bytes + sizeof(int32_t)))? 0: 1);
+    fprintf(stdout, "io mode %s, window %d: %ld bytes, %ld stalls, %.6f s\n",
+        (actual == SHARD_IO_URING)? "uring": "pread", window, n_bytes, n_stalls, stall_time);
+
+    destroyShardReader(r);
+    free(seen);
+    free(data);
+    return SUCCESS;
+}
+
+static int testReadModes(const char *prefix, int n_records, size_t data_bytes)
+{
+    int *a = malloc(N_EPOCHS * n_records * sizeof(int));
+    int *b = malloc(N_EPOCHS * n_records * sizeof(int));
+    int *c = malloc(N_EPOCHS * n_records * sizeof(int));
+    CHK_NIL(a);
+    CHK_NIL(b);
+    CHK_NIL(c);
+    size_t n_bytes = N_EPOCHS * n_records * sizeof(int);
+
+    // 不打乱: 每轮都按写入顺序
+    CHK_ERR(readEpochs(a, prefix, n_records, data_bytes, 0, 1, SHARD_IO_PREAD));
+    int i;
+    for (i = 0; i < N_EPOCHS * n_records; ++i) {
+        CHK_ERR((a[i] == i % n_records)? 0: 1);
+    }
+    CHK_ERR(readEpochs(b, prefix, n_records, data_bytes, 0, 1, SHARD_IO_AUTO));
+    CHK_ERR((memcmp(a, b, n_bytes) == 0)? 0: 1);
+
+    // 打乱: 同一seed两种读取方式结果相同, 各轮不同, 不同seed不同
+    CHK_ERR(readEpochs(a, prefix, n_records, data_bytes, 64, 2024, SHARD_IO_PREAD));
+    CHK_ERR(readEpochs(b, prefix, n_records, data_bytes, 64, 2024, SHARD_IO_AUTO));
+    CHK_ERR((memcmp(a, b, n_bytes) == 0)? 0: 1);
+    CHK_ERR((memcmp(a, a + n_records, n_records * sizeof(int)) != 0)? 0: 1);
+    CHK_ERR(readEpochs(c, prefix, n_records, data_bytes, 64, 2025, SHARD_IO_AUTO));
+    CHK_ERR((memcmp(a, c, n_bytes) != 0)? 0: 1);
+
+    free(a);
+    free(b);
+    free(c);
+    return SUCCESS;
+}
+
+static int testChecksum(const char *prefix)
+{
+    CHK_ERR(writeShards(prefix, N_RECORDS, DATA_BYTES, RECORDS_PER_SHARD, 1));
+
+    // 改动第3个分片中的一个字节
+    char path[600];
+    snprintf(path, sizeof(path), "%s-%05d.shard", prefix, 2);
+    int fd = open(path, O_RDWR);
+    CHK_ERR((fd >= 0)? 0: 1);
+    unsigned char byte = 0;
+    off_t offset = SHARD_HEADER_SIZE + 5 * (DATA_BYTES + sizeof(int32_t)) + 9;
+    CHK_ERR((pread(fd, &byte, 1, offset) == 1)? 0: 1);
+    byte ^= 0x10;
+    CHK_ERR((pwrite(fd, &byte, 1, offset) == 1)? 0: 1);
+    close(fd);
+
+    struct ShardReader *r = NULL;
+    unsigned char data[BATCH_SIZE * DATA_BYTES];
+    int32_t label[BATCH_SIZE];
+    CHK_ERR(createShardReader(&r, prefix, BATCH_SIZE, 0, 2, 1, SHARD_IO_AUTO));
+    int n_read = 0;
+    int res = SUCCESS;
+    while (1) {
+        int n = 0;
+        res = readShardBatch(data, label, &n, r);
+        if (res != SUCCESS || n == 0) {
+            break;
+        }
+        n_read += n;
+    }
+    // 读到第3个分片的最后一块时报错(这里整个分片只有一块), 之后的调用也都失败
+    CHK_ERR((res != SUCCESS)? 0: 1);
+    CHK_ERR((n_read > 2 * RECORDS_PER_SHARD - BATCH_SIZE && n_read <= 2 * RECORDS_PER_SHARD)? 0: 1);
+    int n = 0;
+    CHK_ERR((readShardBatch(data, label, &n, r) != SUCCESS)? 0: 1);
+    destroyShardReader(r);
+
+    // 不带校验和时读不出错误
+    int n_shards = (N_RECORDS + RECORDS_PER_SHARD - 1) / RECORDS_PER_SHARD;
+    removeShards(prefix, n_shards);
+    CHK_ERR(writeShards(prefix, N_RECORDS, DATA_BYTES, RECORDS_PER_SHARD, 0));
+    CHK_ERR(createShardReader(&r, prefix, BATCH_SIZE, 0, 2, 1, SHARD_IO_AUTO));
+    n_read = 0;
+    while (1) {
+        CHK_ERR(readShardBatch(data, label, &n, r));
+        if (n == 0) {
+            break;
+        }
+        n_read += n;
+    }
+    CHK_ERR((n_read == N_RECORDS)? 0: 1);
+    destroyShardReader(r);
+
+    removeShards(prefix, n_shards);
+    return SUCCESS;
+}
+
+static int testDataLoader(const char *prefix)
+{
+    struct ShardReader *r = NULL;
+    struct DataLoader *loader = NULL;
+    int n_batches = (N_RECORDS + BATCH_SIZE - 1) / BATCH_SIZE;
+    int seen[N_RECORDS];
+    CHK_ERR(createShardReader(&r, prefix, BATCH_SIZE, 128, 4, 7, SHARD_IO_AUTO));
+    CHK_ERR(createDataLoader(&loader, fillShardBatch, r, n_batches,
+        BATCH_SIZE * DATA_BYTES, BATCH_SIZE * sizeof(int32_t), 3, 1));
+
+    int e;
+    for (e = 0; e < N_EPOCHS; ++e) {
+        int i;
+        int n_read = 0;
+        memset(seen, 0, sizeof(seen));
+        for (i = 0; i < n_batches; ++i) {
+            const void *data = NULL;
+            const void *label = NULL;
+            int n = 0;
+            CHK_ERR(getDataLoaderNextBatch(&data, &label, &n, loader));
+            int k;
+            for (k = 0; k < n; ++k) {
+                int id = -1;
+                CHK_ERR(checkRecord(&id, (const unsigned char *)data + k * DATA_BYTES, (const int32_t *)label + k, N_RECORDS, DATA_BYTES));
+                CHK_ERR((seen[id] == 0)? 0: 1);
+                seen[id] = 1;
+            }
+            n_read += n;
+        }
+        CHK_ERR((n_read == N_RECORDS)? 0: 1);
+        // epoch结束标记
+        const void *data = NULL;
+        const void *label = NULL;
+        int n = 0;
+        CHK_ERR(getDataLoaderNextBatch(&data, &label, &n, loader));
+        CHK_ERR((data == NULL)? 0: 1);
+    }
+
+    destroyDataLoader(loader);
+    destroyShardReader(r);
+    return SUCCESS;
+}
+
+int main()
+{
+    snprintf(g_dir, sizeof(g_dir), "/tmp/test_shard_dataset_XXXXXX");
+    CHK_NIL(mkdtemp(g_dir));
+
+    char prefix[512];
+    getPrefix(prefix, "small");
+    CHK_ERR(writeShards(prefix, N_RECORDS, DATA_BYTES, RECORDS_PER_SHARD, 1));
+    CHK_ERR(testReadModes(prefix, N_RECORDS, DATA_BYTES));
+    CHK_ERR(testDataLoader(prefix));
+    removeShards(prefix, (N_RECORDS + RECORDS_PER_SHARD - 1) / RECORDS_PER_SHARD);
+
+    // 记录比块大得多, 每个分片分多个块读入
+    getPrefix(prefix, "big");
+    CHK_ERR(writeShards(prefix, N_BIG, BIG_DATA_BYTES, BIG_PER_SHARD, 1));
+    CHK_ERR(testReadModes(prefix, N_BIG, BIG_DATA_BYTES));
+    removeShards(prefix, (N_BIG + BIG_PER_SHARD - 1) / BIG_PER_SHARD);
+
+    getPrefix(prefix, "corrupt");
+    CHK_ERR(testChecksum(prefix));
+
+    rmdir(g_dir);
+
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * @brief 按epoch生成的排列合法且可复现, gatherRows在普通复制和非临时写两条路径上与逐行memcpy一致,
+ *        并对比按排列gather与顺序切片的耗时.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "rng.h"
+#include "memory.h"
+#include "data_utils.h"
+#include "debug_macros.h"
+
+#define N_ROWS (50000)
+#define ROW_FLOATS (784)
+#define BATCH_SIZE (128)
+
+static int getEpochPermutation(int *perm, int n, int epoch)
+{
+    struct RandomStream *rs = NULL;
+    CHK_ERR(createRandomStream(&rs, 2024, epoch));
+    CHK_ERR(fillRandomPermutation(rs, perm, n));
+    destroyRandomStream(rs);
+    return SUCCESS;
+}
+
+static int checkGather(const float *src, const int *perm, int n_rows, size_t row_bytes)
+{
+    size_t bytes = (size_t)n_rows * row_bytes;
+    char *dst = allocBlob(bytes);
+    char *ref = malloc(bytes);
+    CHK_NIL(dst);
+    CHK_NIL(ref);
+    int i;
+    for (i = 0; i < n_rows; ++i) {
+        memcpy(ref + (size_t)i * row_bytes, (const char *)src + (size_t)perm[i] * row_bytes, row_bytes);
+    }
+    CHK_ERR(gatherRows(dst, src, perm, n_rows, row_bytes));
+    CHK_ERR((memcmp(dst, ref, bytes) == 0)? 0: 1);
+    freeBlob(dst, bytes);
+    free(ref);
+    return SUCCESS;
+}
+
+int main()
+{
+    // 1. 排列: 每个下标恰好出现一次, 同一epoch相同, 不同epoch不同
+    int *perm0 = malloc(N_ROWS * sizeof(int));
+    int *perm1 = malloc(N_ROWS * sizeof(int));
+    int *count = calloc(N_ROWS, sizeof(int));
+    CHK_ERR(getEpochPermutation(perm0, N_ROWS, 0));
+    int i;
+    for (i = 0; i < N_ROWS; ++i) {
+        CHK_ERR((perm0[i] >= 0 && perm0[i] < N_ROWS)? 0: 1);
+        ++count[perm0[i]];
+    }
+    for (i = 0; i < N_ROWS; ++i) {
+        CHK_ERR((count[i] == 1)? 0: 1);
+    }
+    CHK_ERR(getEpochPermutation(perm1, N_ROWS, 0));
+    CHK_ERR((memcmp(perm0, perm1, N_ROWS * sizeof(int)) == 0)? 0: 1);
+    CHK_ERR(getEpochPermutation(perm1, N_ROWS, 1));
+    CHK_ERR((memcmp(perm0, perm1, N_ROWS * sizeof(int)) != 0)? 0: 1);
+
+    // 2. gather: 类标行(10字节), 样本行, 以及超过非临时写阈值的大batch
+    size_t src_bytes = (size_t)N_ROWS * ROW_FLOATS * sizeof(float);
+    float *src = allocBlob(src_bytes);
+    CHK_NIL(src);
+    for (i = 0; i < N_ROWS * ROW_FLOATS; ++i) {
+        src[i] = (float)i;
+    }
+    CHK_ERR(checkGather(src, perm0, BATCH_SIZE, 10));
+    CHK_ERR(checkGather(src, perm0, BATCH_SIZE, ROW_FLOATS * sizeof(float)));
+    CHK_ERR(checkGather(src, perm0 + 1000, 4096, ROW_FLOATS * sizeof(float)));
+    CHK_ERR(checkGather(src, perm0, 4096, ROW_FLOATS * sizeof(float) - 4)); // 行长不是16的倍数
+
+    // 3. 一个epoch的耗时: 按排列gather与顺序切片复制
+    float *batch = allocBlob(BATCH_SIZE * ROW_FLOATS * sizeof(float));
+    CHK_NIL(batch);
+    struct timeval t0, t1, t2;
+    double t_seq, t_shuffle;
+    gettimeofday(&t0, NULL);
+    for (i = 0; i + BATCH_SIZE <= N_ROWS; i += BATCH_SIZE) {
+        memcpy(batch, src + (size_t)i * ROW_FLOATS, BATCH_SIZE * ROW_FLOATS * sizeof(float));
+    }
+    gettimeofday(&t1, NULL);
+    timersub(&t1, &t0, &t2);
+    t_seq = t2.tv_sec + t2.tv_usec / 1e6;
+    gettimeofday(&t0, NULL);
+    for (i = 0; i + BATCH_SIZE <= N_ROWS; i += BATCH_SIZE) {
+        CHK_ERR(gatherRows(batch, src, perm0 + i, BATCH_SIZE, ROW_FLOATS * sizeof(float)));
+    }
+    gettimeofday(&t1, NULL);
+    timersub(&t1, &t0, &t2);
+    t_shuffle = t2.tv_sec + t2.tv_usec / 1e6;
+    fprintf(stdout, "one epoch: sequential copy %.6fs, shuffled gather %.6fs\n", t_seq, t_shuffle);
+
+    freeBlob(batch, BATCH_SIZE * ROW_FLOATS * sizeof(float));
+    freeBlob(src, src_bytes);
+    free(perm0);
+    free(perm1);
+    free(count);
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
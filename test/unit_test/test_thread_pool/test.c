@@ -0,0 +1,111 @@
+/**
+ * @brief 线程池: parallelFor覆盖全部区间且不重叠, 小计算量时在调用线程上执行, 嵌套parallelFor和任务组正确完成.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread_pool.h"
+#include "debug_macros.h"
+
+#define N_ELEMS (1 << 20)
+#define N_OUTER (64)
+#define N_INNER (4096)
+#define N_TASKS (100)
+
+struct CountArgs
+{
+    int *hits;
+    int n_calls;
+};
+
+static void countRange(void *arg, int lo, int hi)
+{
+    struct CountArgs *a = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        ++(a->hits[i]);
+    }
+    __atomic_add_fetch(&(a->n_calls), 1, __ATOMIC_RELAXED);
+}
+
+static struct ThreadPool *g_pool = NULL;
+static int *g_matrix = NULL;
+
+static void innerRange(void *arg, int lo, int hi)
+{
+    int *row = arg;
+    int i;
+    for (i = lo; i < hi; ++i) {
+        row[i] += 1;
+    }
+}
+
+// 每行再次parallelFor, 检查嵌套并行
+static void outerRange(void *arg, int lo, int hi)
+{
+    int r;
+    for (r = lo; r < hi; ++r) {
+        parallelFor(g_pool, 0, N_INNER, 64, innerRange, g_matrix + r * N_INNER);
+    }
+}
+
+static void addOne(void *arg)
+{
+    __atomic_add_fetch((int *)arg, 1, __ATOMIC_RELAXED);
+}
+
+int main()
+{
+    CHK_ERR(createThreadPool(&g_pool, 4));
+
+    // 1. 覆盖且不重叠
+    struct CountArgs args;
+    memset(&args, 0, sizeof(struct CountArgs));
+    CHK_NIL((args.hits = calloc(N_ELEMS, sizeof(int))));
+    CHK_ERR(parallelFor(g_pool, 0, N_ELEMS, 8, countRange, &args));
+    int i;
+    for (i = 0; i < N_ELEMS; ++i) {
+        if (args.hits[i] != 1) {
+            ERR_MSG("element %d visited %d times, error.\n", i, args.hits[i]);
+            return ERR_COD;
+        }
+    }
+    fprintf(stdout, "parallelFor over %d elements: %d chunks\n", N_ELEMS, args.n_calls);
+    CHK_ERR((args.n_calls > 1)? 0: 1);
+
+    // 2. 小计算量不切分
+    args.n_calls = 0;
+    CHK_ERR(parallelFor(g_pool, 0, 10, 8, countRange, &args));
+    CHK_ERR((args.n_calls == 1)? 0: 1);
+
+    // 3. 嵌套
+    CHK_NIL((g_matrix = calloc(N_OUTER * N_INNER, sizeof(int))));
+    CHK_ERR(parallelFor(g_pool, 0, N_OUTER, 64L * N_INNER, outerRange, NULL));
+    for (i = 0; i < N_OUTER * N_INNER; ++i) {
+        CHK_ERR((g_matrix[i] == 1)? 0: 1);
+    }
+
+    // 4. 任务组
+    struct TaskGroup group;
+    memset(&group, 0, sizeof(struct TaskGroup));
+    int counter = 0;
+    for (i = 0; i < N_TASKS; ++i) {
+        CHK_ERR(spawnThreadPoolTask(g_pool, &group, addOne, &counter));
+    }
+    CHK_ERR(waitThreadPoolTasks(g_pool, &group));
+    CHK_ERR((counter == N_TASKS)? 0: 1);
+
+    // 5. 默认线程池
+    struct ThreadPool *pool = NULL;
+    int n_threads = 0;
+    CHK_ERR(getDefaultThreadPool(&pool));
+    CHK_ERR(getThreadPoolSize(&n_threads, pool));
+    fprintf(stdout, "default thread pool: %d threads\n", n_threads);
+
+    destroyThreadPool(g_pool);
+    free(g_matrix);
+    free(args.hits);
+    fprintf(stdout, "all finish.\n");
+    return 0;
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+set -ex
+
+PROJECT_DIR="../.."
+
+SRC_DIR="$PROJECT_DIR/src"
+
+INC_CMD="-I. -I$SRC_DIR"
+LIB_CMD="-lrt"
+CFLAGS="-g -Wall -O2"
+
+gcc $CFLAGS \
+    $INC_CMD \
+    nn_launch.c \
+    $SRC_DIR/debug_macros.c \
+    $LIB_CMD \
+    -o nn_launch
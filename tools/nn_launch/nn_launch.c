@@ -0,0 +1,190 @@
+/**
+ * @brief 本机多进程训练启动器: fork出n个训练进程, 通过环境变量传递共享内存all-reduce的参数
+ *        NN_SHM_NAME, NN_RANK, NN_WORLD_SIZE(见src/mp_trainer.h).
+ *
+ *        用法: nn_launch -n n_procs [-p] prog [args...]
+ *        -p 把rank r绑定到NUMA节点r % n_nodes的全部CPU上(每个socket一个进程), 没有NUMA信息时绑定到CPU r % n_cpus.
+ *        任一进程失败时终止其余进程(其余进程会阻塞在屏障上), 启动器的退出码为第一个失败进程的退出码.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "debug_macros.h"
+#include "shm_allreduce.h"
+
+#define NN_NODE_DIR ("/sys/devices/system/node")
+
+// 解析形如"0-3,8-11"的cpulist
+static int parseCpuList(cpu_set_t *set, const char *str)
+{
+    CPU_ZERO(set);
+    const char *p = str;
+    while (*p && *p != '\n') {
+        char *end = NULL;
+        long lo = strtol(p, &end, 10);
+        if (end == p) {
+            ERR_MSG("bad cpulist: %s, error.\n", str);
+            return ERR_COD;
+        }
+        long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        long c;
+        for (c = lo; c <= hi && c < CPU_SETSIZE; ++c) {
+            CPU_SET(c, set);
+        }
+        if (*p == ',') {
+            ++p;
+        }
+    }
+    return SUCCESS;
+}
+
+static int getNodeNumber()
+{
+    int n = 0;
+    char pth[256];
+    while (1) {
+        snprintf(pth, sizeof(pth), "%s/node%d", NN_NODE_DIR, n);
+        if (access(pth, F_OK) != 0) {
+            break;
+        }
+        ++n;
+    }
+    return n;
+}
+
+static int getPinnedCpus(cpu_set_t *set, int rank)
+{
+    int n_nodes = getNodeNumber();
+    if (n_nodes > 0) {
+        char pth[256];
+        char buf[4096];
+        snprintf(pth, sizeof(pth), "%s/node%d/cpulist", NN_NODE_DIR, rank % n_nodes);
+        FILE *fp = fopen(pth, "r");
+        if (fp) {
+            char *ret = fgets(buf, sizeof(buf), fp);
+            fclose(fp);
+            if (ret && parseCpuList(set, buf) == SUCCESS && CPU_COUNT(set) > 0) {
+                return SUCCESS;
+            }
+        }
+    }
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    CPU_ZERO(set);
+    CPU_SET(rank % (n_cpus > 0? n_cpus: 1), set);
+    return SUCCESS;
+}
+
+static void runChild(const char *shm_name, int rank, int world_size, int pin, char **argv)
+{
+    char buf[32];
+    setenv("NN_SHM_NAME", shm_name, 1);
+    snprintf(buf, sizeof(buf), "%d", rank);
+    setenv("NN_RANK", buf, 1);
+    snprintf(buf, sizeof(buf), "%d", world_size);
+    setenv("NN_WORLD_SIZE", buf, 1);
+
+    if (pin) {
+        cpu_set_t set;
+        if (getPinnedCpus(&set, rank) != SUCCESS || sched_setaffinity(0, sizeof(set), &set) == -1) {
+            ERR_MSG("rank %d: pin cpu failed, continue without pinning.\n", rank);
+        }
+    }
+    execvp(argv[0], argv);
+    ERR_MSG("execvp() failed, prog: %s, detail: %s, error.\n", argv[0], ERRNO_DETAIL(errno));
+    _exit(127);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -n n_procs [-p] prog [args...]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    int n_procs = 0;
+    int pin = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "+n:ph")) != -1) { // "+": 遇到prog后停止解析, 其后的参数交给子进程
+        switch (opt) {
+            case 'n': n_procs = atoi(optarg); break;
+            case 'p': pin = 1; break;
+            default: usage(argv[0]); return ERR_COD;
+        }
+    }
+    if (n_procs <= 0 || optind >= argc) {
+        usage(argv[0]);
+        return ERR_COD;
+    }
+
+    char shm_name[NN_SHM_NAME_LEN];
+    snprintf(shm_name, NN_SHM_NAME_LEN, "/nn_launch_%d", (int)getpid());
+
+    pid_t *pids = calloc(n_procs, sizeof(pid_t));
+    CHK_NIL(pids);
+    int n_started = 0;
+    int ret = SUCCESS;
+    int i;
+    for (i = 0; i < n_procs; ++i) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            ERR_MSG("fork() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            ret = ERR_COD;
+            break;
+        }
+        if (pid == 0) {
+            runChild(shm_name, i, n_procs, pin, argv + optind);
+        }
+        pids[i] = pid;
+        ++n_started;
+    }
+    if (ret != SUCCESS) { // 进程没有全部启动, 已启动的进程无法凑齐屏障
+        for (i = 0; i < n_started; ++i) {
+            kill(pids[i], SIGTERM);
+        }
+    }
+
+    int n_alive = n_started;
+    while (n_alive > 0) {
+        int status = 0;
+        pid_t pid = wait(&status);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (i = 0; i < n_started; ++i) {
+            if (pids[i] == pid) {
+                pids[i] = 0;
+                --n_alive;
+                break;
+            }
+        }
+        int failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        if (failed && ret == SUCCESS) {
+            ERR_MSG("rank %d (pid %d) failed, status = %d, terminate others.\n", i, (int)pid, status);
+            ret = WIFEXITED(status)? WEXITSTATUS(status): ERR_COD;
+            for (i = 0; i < n_started; ++i) {
+                if (pids[i] > 0) {
+                    kill(pids[i], SIGTERM);
+                }
+            }
+        }
+    }
+    shm_unlink(shm_name); // 进程在全部rank映射前失败时, 名字可能还未被rank 0删除
+    free(pids);
+    return ret;
+}
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+set -ex
+
+PROJECT_DIR="../.."
+
+SRC_DIR="$PROJECT_DIR/src"
+
+INC_CMD="-I. -I$SRC_DIR -I$SRC_DIR/datasets"
+LIB_CMD="-lm -lpthread -lrt"
+CFLAGS="-g -Wall -O2"
+
+gcc $CFLAGS \
+    $INC_CMD \
+    nn_serve.c \
+    shm_ring.c \
+    $SRC_DIR/model.c \
+    $SRC_DIR/network.c \
+    $SRC_DIR/layer.c \
+    $SRC_DIR/linear_layer.c \
+    $SRC_DIR/sharded_linear_layer.c \
+    $SRC_DIR/sigmoid_layer.c \
+    $SRC_DIR/relu_layer.c \
+    $SRC_DIR/softmax_layer.c \
+    $SRC_DIR/cost.c \
+    $SRC_DIR/ce_cost.c \
+    $SRC_DIR/opt_alg.c \
+    $SRC_DIR/tensor.c \
+    $SRC_DIR/gemm.c \
+    $SRC_DIR/thread_pool.c \
+    $SRC_DIR/affinity.c \
+    $SRC_DIR/memory.c \
+    $SRC_DIR/rng.c \
+    $SRC_DIR/math_utils.c \
+    $SRC_DIR/io_utils.c \
+    $SRC_DIR/debug_macros.c \
+    $LIB_CMD \
+    -o nn_serve
+
+gcc $CFLAGS \
+    $INC_CMD \
+    nn_loadgen.c \
+    shm_ring.c \
+    $SRC_DIR/debug_macros.c \
+    $LIB_CMD \
+    -o nn_loadgen
@@ -0,0 +1,312 @@
+/**
+ * @brief nn_serve的压测客户端, 每个连接一个线程, 发送随机特征并校验返回的概率分布(每行和为1)
+ *
+ *        用法: nn_loadgen -s socket_path [-c n_conns] [-n n_requests] [-b batch] [-m] [-d depth]
+ *        -m 使用共享内存环形缓冲区传输数据, 此时每个连接最多有depth个请求同时在途;
+ *           内联模式下请求和结果都走socket, 为避免双方同时阻塞在send上, 每个连接只有1个在途请求.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "debug_macros.h"
+#include "serve_proto.h"
+#include "shm_ring.h"
+
+struct LoadgenArgs
+{
+    const char *sock_pth;
+    int n_conns;
+    int n_requests;
+    int batch;
+    int use_shm;
+    int depth;
+};
+
+struct LoadgenConn
+{
+    int idx;
+    pthread_t tid;
+    const struct LoadgenArgs *args;
+    double *latency; // 每个请求的耗时, 单位ms
+    int n_done;
+    int n_failed;
+};
+
+static double getNowMs()
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return t.tv_sec * 1000. + t.tv_usec / 1000.;
+}
+
+static int readFull(int fd, void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        ssize_t ret = recv(fd, (char *)buf + done, n - done, 0);
+        if (ret <= 0) {
+            if (ret == -1 && errno == EINTR) {
+                continue;
+            }
+            ERR_MSG("recv() failed or peer closed, error.\n");
+            return ERR_COD;
+        }
+        done += ret;
+    }
+    return SUCCESS;
+}
+
+static int writeFull(int fd, const void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        ssize_t ret = send(fd, (const char *)buf + done, n - done, MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR_MSG("send() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        done += ret;
+    }
+    return SUCCESS;
+}
+
+static int sendHello(struct ServeResponse *resp, int fd, const char *shm_name, int n_slots, size_t slot_bytes)
+{
+    struct ServeRequest req;
+    char name[NN_SERVE_SHM_NAME_LEN];
+    memset(&req, 0, sizeof(req));
+    memset(name, 0, sizeof(name));
+    req.magic = NN_SERVE_MAGIC;
+    req.op = SERVE_OP_HELLO;
+    req.n_slots = n_slots;
+    req.slot_bytes = slot_bytes;
+    if (shm_name) {
+        snprintf(name, NN_SERVE_SHM_NAME_LEN, "%s", shm_name);
+    }
+    CHK_ERR(writeFull(fd, &req, sizeof(req)));
+    CHK_ERR(writeFull(fd, name, sizeof(name)));
+    CHK_ERR(readFull(fd, resp, sizeof(*resp)));
+    CHK_ERR((resp->magic == NN_SERVE_MAGIC && resp->status == SERVE_STATUS_OK)? 0: 1);
+    return SUCCESS;
+}
+
+static void fillFeatures(float *x, int n, unsigned int *seed)
+{
+    int i;
+    for (i = 0; i < n; ++i) {
+        x[i] = (float)rand_r(seed) / RAND_MAX * 2. - 1.;
+    }
+}
+
+static int checkProbability(const float *p, int n_samples, int n_classes)
+{
+    int i, j;
+    for (i = 0; i < n_samples; ++i) {
+        double sum = 0.;
+        for (j = 0; j < n_classes; ++j) {
+            sum += p[i * n_classes + j];
+        }
+        if (fabs(sum - 1.) > 1e-3) {
+            ERR_MSG("sample %d: sum(p) = %f, error.\n", i, sum);
+            return ERR_COD;
+        }
+    }
+    return SUCCESS;
+}
+
+static int runLoadgenConn(struct LoadgenConn *c)
+{
+    const struct LoadgenArgs *args = c->args;
+    struct ShmRing *ring = NULL;
+    float *buf = NULL;
+    double *t_send = NULL;
+    unsigned int seed = 1234 + c->idx;
+    int ret = ERR_COD;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        ERR_MSG("socket() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", args->sock_pth);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        ERR_MSG("connect() failed, path: %s, detail: %s, error.\n", args->sock_pth, ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+
+    struct ServeResponse resp;
+    CHK_ERR_GOTO(sendHello(&resp, fd, NULL, 0, 0)); // 先查询模型维度
+    int n_features = resp.n_features;
+    int n_classes = resp.n_classes;
+    if (args->batch > (int)resp.output_offset) {
+        ERR_MSG("batch = %d > server max_batch = %d, error.\n", args->batch, (int)resp.output_offset);
+        goto err_end;
+    }
+
+    uint64_t out_offset = getServeOutputOffset(args->batch, n_features);
+    size_t slot_bytes = out_offset + (size_t)args->batch * n_classes * sizeof(float);
+    int depth = args->use_shm? args->depth: 1;
+    if (args->use_shm) {
+        char name[NN_SERVE_SHM_NAME_LEN];
+        snprintf(name, NN_SERVE_SHM_NAME_LEN, "/nn_loadgen_%d_%d", (int)getpid(), c->idx);
+        CHK_ERR_GOTO(createShmRing(&ring, name, depth, slot_bytes));
+        CHK_ERR_GOTO(sendHello(&resp, fd, name, depth, slot_bytes));
+    }
+    CHK_NIL_GOTO((buf = calloc(slot_bytes / sizeof(float) + 1, sizeof(float))));
+    CHK_NIL_GOTO((t_send = calloc(depth, sizeof(double))));
+
+    struct ServeRequest req;
+    memset(&req, 0, sizeof(req));
+    req.magic = NN_SERVE_MAGIC;
+    req.op = args->use_shm? SERVE_OP_INFER_SHM: SERVE_OP_INFER;
+    req.n_samples = args->batch;
+    req.n_features = n_features;
+
+    int n_sent = 0;
+    while (c->n_done < args->n_requests) {
+        // 在途请求未满时继续发送
+        while (n_sent < args->n_requests && n_sent - c->n_done < depth) {
+            int slot = n_sent % depth;
+            req.slot = slot;
+            if (args->use_shm) {
+                void *dst = NULL;
+                CHK_ERR_GOTO(getShmRingSlot(&dst, ring, slot));
+                fillFeatures((float *)dst, args->batch * n_features, &seed);
+                t_send[slot] = getNowMs();
+                CHK_ERR_GOTO(writeFull(fd, &req, sizeof(req)));
+            }
+            else {
+                fillFeatures(buf, args->batch * n_features, &seed);
+                t_send[slot] = getNowMs();
+                CHK_ERR_GOTO(writeFull(fd, &req, sizeof(req)));
+                CHK_ERR_GOTO(writeFull(fd, buf, (size_t)args->batch * n_features * sizeof(float)));
+            }
+            ++n_sent;
+        }
+
+        // 服务端按请求顺序回复
+        CHK_ERR_GOTO(readFull(fd, &resp, sizeof(resp)));
+        if (resp.magic != NN_SERVE_MAGIC || resp.status != SERVE_STATUS_OK || resp.n_samples != args->batch) {
+            ERR_MSG("bad response: status = %u, n_samples = %u, error.\n", resp.status, resp.n_samples);
+            goto err_end;
+        }
+        const float *p = buf;
+        if (args->use_shm) {
+            void *src = NULL;
+            CHK_ERR_GOTO(getShmRingSlot(&src, ring, resp.slot));
+            p = (const float *)((char *)src + resp.output_offset);
+        }
+        else {
+            CHK_ERR_GOTO(readFull(fd, buf, (size_t)resp.n_samples * n_classes * sizeof(float)));
+        }
+        if (checkProbability(p, resp.n_samples, n_classes) != SUCCESS) {
+            ++(c->n_failed);
+        }
+        c->latency[c->n_done] = getNowMs() - t_send[resp.slot];
+        ++(c->n_done);
+    }
+    ret = SUCCESS;
+
+err_end:
+    close(fd);
+    destroyShmRing(ring);
+    free(buf);
+    free(t_send);
+    return ret;
+}
+
+static void *runLoadgenThread(void *arg)
+{
+    struct LoadgenConn *c = arg;
+    if (runLoadgenConn(c) != SUCCESS) {
+        c->n_failed += c->args->n_requests - c->n_done;
+    }
+    return NULL;
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -s socket_path [-c n_conns] [-n n_requests] [-b batch] [-m] [-d depth]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct LoadgenArgs args;
+    memset(&args, 0, sizeof(args));
+    args.n_conns = 4;
+    args.n_requests = 1000;
+    args.batch = 64;
+    args.depth = 4;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:c:n:b:md:h")) != -1) {
+        switch (opt) {
+            case 's': args.sock_pth = optarg; break;
+            case 'c': args.n_conns = atoi(optarg); break;
+            case 'n': args.n_requests = atoi(optarg); break;
+            case 'b': args.batch = atoi(optarg); break;
+            case 'm': args.use_shm = 1; break;
+            case 'd': args.depth = atoi(optarg); break;
+            default: usage(argv[0]); return ERR_COD;
+        }
+    }
+    if (args.sock_pth == NULL || args.n_conns <= 0 || args.n_requests <= 0 || args.batch <= 0 || args.depth <= 0) {
+        usage(argv[0]);
+        return ERR_COD;
+    }
+
+    struct LoadgenConn *conns = calloc(args.n_conns, sizeof(struct LoadgenConn));
+    double *latency = calloc((size_t)args.n_conns * args.n_requests, sizeof(double));
+    CHK_NIL(conns);
+    CHK_NIL(latency);
+
+    double t0 = getNowMs();
+    int i;
+    for (i = 0; i < args.n_conns; ++i) {
+        conns[i].idx = i;
+        conns[i].args = &args;
+        conns[i].latency = latency + (size_t)i * args.n_requests;
+        CHK_ERR(pthread_create(&(conns[i].tid), NULL, runLoadgenThread, &(conns[i])));
+    }
+    int n_done = 0;
+    int n_failed = 0;
+    for (i = 0; i < args.n_conns; ++i) {
+        pthread_join(conns[i].tid, NULL);
+        n_failed += conns[i].n_failed;
+        // 各连接完成的请求耗时紧凑排列, 用于计算分位数
+        memmove(latency + n_done, conns[i].latency, conns[i].n_done * sizeof(double));
+        n_done += conns[i].n_done;
+    }
+    double elapsed = (getNowMs() - t0) / 1000.;
+
+    qsort(latency, n_done, sizeof(double), cmpDouble);
+    double p50 = n_done? latency[n_done / 2]: 0.;
+    double p99 = n_done? latency[(int)(n_done * 0.99)]: 0.;
+    fprintf(stdout, "nn_loadgen: mode = %s, conns = %d, requests = %d, failed = %d, samples = %ld, elapsed = %.3fs\n",
+        args.use_shm? "shm": "inline", args.n_conns, n_done, n_failed, (long)n_done * args.batch, elapsed);
+    fprintf(stdout, "nn_loadgen: %.1f req/s, %.1f samples/s, latency p50 = %.3fms, p99 = %.3fms\n",
+        n_done / elapsed, (double)n_done * args.batch / elapsed, p50, p99);
+
+    free(conns);
+    free(latency);
+    return (n_failed == 0 && n_done == args.n_conns * args.n_requests)? SUCCESS: ERR_COD;
+}
@@ -0,0 +1,549 @@
+/**
+ * @brief 本机推理服务: 读取模型描述文件, 在Unix domain socket上用epoll接收batch推理请求,
+ *        连接就绪后交给工作线程池处理, 每个工作线程持有一份独立的Network, 互不加锁.
+ *        大batch可以通过客户端创建的共享内存环形缓冲区传输(见serve_proto.h).
+ *
+ *        用法: nn_serve -m model.txt -s /tmp/nn_serve.sock [-t n_workers] [-b max_batch]
+ *        收到SIGINT/SIGTERM后退出.
+ */
+#define _GNU_SOURCE // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/time.h>
+
+#include "debug_macros.h"
+#include "layer.h"
+#include "cost.h"
+#include "network.h"
+#include "model.h"
+#include "opt_alg.h"
+#include "probe.h"
+#include "serve_proto.h"
+#include "shm_ring.h"
+
+#define SERVE_MAX_EVENTS (64)
+#define SERVE_IO_TIMEOUT_SEC (5) // 请求读到一半或结果写不出去时, 超时后关闭连接, 不让工作线程一直阻塞
+#define SERVE_CONN_CLOSED (2) // 对端在请求边界上正常关闭
+
+struct ServeConn
+{
+    int fd;
+    struct ShmRing *ring; // 客户端未使用共享内存时为NULL
+    struct ServeConn *prev; // 全部连接链表, 用于退出时释放
+    struct ServeConn *next;
+    struct ServeConn *q_next; // 就绪队列
+};
+
+struct ServeServer;
+
+struct ServeWorker
+{
+    int idx;
+    pthread_t tid;
+    struct ServeServer *srv;
+    struct Model *model;
+    struct Network *net;
+    struct UpdateArgs args;
+    struct Probe probe;
+    float *input; // 内联请求的输入缓冲区, max_batch * n_in
+    long n_requests;
+    long n_samples;
+};
+
+struct ServeServer
+{
+    int listen_fd;
+    int epoll_fd;
+    int signal_fd;
+    int n_in;
+    int n_classes;
+    int max_batch;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    struct ServeConn *q_head;
+    struct ServeConn *q_tail;
+    struct ServeConn *conns;
+    int stop;
+
+    int n_workers;
+    struct ServeWorker *workers;
+};
+
+// 还未读到任何字节时对端关闭返回SERVE_CONN_CLOSED, 读到一半时关闭或超时返回ERR_COD
+static int readFull(int fd, void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        ssize_t ret = recv(fd, (char *)buf + done, n - done, 0);
+        if (ret == 0) {
+            return (done == 0)? SERVE_CONN_CLOSED: ERR_COD;
+        }
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return ERR_COD;
+        }
+        done += ret;
+    }
+    return SUCCESS;
+}
+
+static int writeFull(int fd, const void *buf, size_t n)
+{
+    size_t done = 0;
+    while (done < n) {
+        ssize_t ret = send(fd, (const char *)buf + done, n - done, MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return ERR_COD;
+        }
+        done += ret;
+    }
+    return SUCCESS;
+}
+
+static int armServeConn(struct ServeServer *srv, struct ServeConn *conn, int op)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT; // ONESHOT保证同一连接同时只被一个工作线程处理
+    ev.data.ptr = conn;
+    if (epoll_ctl(srv->epoll_fd, op, conn->fd, &ev) == -1) {
+        ERR_MSG("epoll_ctl() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+static void closeServeConn(struct ServeServer *srv, struct ServeConn *conn)
+{
+    pthread_mutex_lock(&srv->mtx);
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    }
+    else {
+        srv->conns = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    pthread_mutex_unlock(&srv->mtx);
+
+    close(conn->fd); // close会自动把fd从epoll中移除
+    destroyShmRing(conn->ring);
+    free(conn);
+}
+
+static int runServeInference(struct ServeWorker *w, const float *input, int n_samples, float *output)
+{
+    const float *p = NULL;
+    CHK_ERR(forwardNetwork(w->net, input, n_samples, w->srv->n_in, "float32", &w->args, &w->probe));
+    CHK_ERR(getNetworkClassProbabilityConstRef(&p, w->net));
+    memcpy(output, p, (size_t)n_samples * w->srv->n_classes * sizeof(float));
+    ++(w->n_requests);
+    w->n_samples += n_samples;
+    return SUCCESS;
+}
+
+/**
+ * @brief 处理连接上的一条请求
+ * @return SUCCESS表示连接可以继续使用, 其他值表示需要关闭连接
+ */
+static int handleServeRequest(struct ServeWorker *w, struct ServeConn *conn)
+{
+    struct ServeServer *srv = w->srv;
+    struct ServeRequest req;
+    struct ServeResponse resp;
+
+    int ret = readFull(conn->fd, &req, sizeof(req));
+    if (ret == SERVE_CONN_CLOSED) { // 客户端正常断开, 不是错误
+        return ret;
+    }
+    CHK_ERR(ret);
+    memset(&resp, 0, sizeof(resp));
+    resp.magic = NN_SERVE_MAGIC;
+    resp.status = SERVE_STATUS_OK;
+    resp.n_samples = req.n_samples;
+    resp.n_classes = srv->n_classes;
+    resp.slot = req.slot;
+    if (req.magic != NN_SERVE_MAGIC) {
+        ERR_MSG("bad magic: 0x%x, error.\n", req.magic);
+        return ERR_COD;
+    }
+
+    switch (req.op) {
+        case SERVE_OP_HELLO: {
+            char name[NN_SERVE_SHM_NAME_LEN];
+            CHK_ERR(readFull(conn->fd, name, NN_SERVE_SHM_NAME_LEN));
+            name[NN_SERVE_SHM_NAME_LEN - 1] = '\0';
+            destroyShmRing(conn->ring);
+            conn->ring = NULL;
+            if (name[0] != '\0' && attachShmRing(&(conn->ring), name, req.n_slots, req.slot_bytes) != SUCCESS) {
+                resp.status = SERVE_STATUS_BAD_REQUEST;
+            }
+            resp.n_features = srv->n_in;
+            resp.output_offset = srv->max_batch;
+            CHK_ERR(writeFull(conn->fd, &resp, sizeof(resp)));
+            return SUCCESS;
+        }
+
+        case SERVE_OP_INFER: {
+            if (req.n_samples == 0 || req.n_samples > srv->max_batch || req.n_features != srv->n_in) {
+                resp.status = SERVE_STATUS_BAD_REQUEST;
+                writeFull(conn->fd, &resp, sizeof(resp));
+                return ERR_COD; // payload长度不可信, 无法继续解析该连接
+            }
+            CHK_ERR(readFull(conn->fd, w->input, (size_t)req.n_samples * req.n_features * sizeof(float)));
+            float *output = w->input; // 前向传播结束后输入已不再需要, 结果直接写回输入缓冲区
+
+            if (runServeInference(w, w->input, req.n_samples, output) != SUCCESS) {
+                resp.status = SERVE_STATUS_INTERNAL_ERROR;
+                CHK_ERR(writeFull(conn->fd, &resp, sizeof(resp)));
+                return SUCCESS;
+            }
+            CHK_ERR(writeFull(conn->fd, &resp, sizeof(resp)));
+            CHK_ERR(writeFull(conn->fd, output, (size_t)req.n_samples * srv->n_classes * sizeof(float)));
+            return SUCCESS;
+        }
+
+        case SERVE_OP_INFER_SHM: {
+            void *slot = NULL;
+            int n_slots = 0;
+            size_t slot_bytes = 0;
+            uint64_t offset = getServeOutputOffset(req.n_samples, req.n_features);
+            if (conn->ring == NULL || req.n_samples == 0 || req.n_samples > srv->max_batch || req.n_features != srv->n_in
+                || getShmRingShape(&n_slots, &slot_bytes, conn->ring) != SUCCESS
+                || offset + (uint64_t)req.n_samples * srv->n_classes * sizeof(float) > slot_bytes
+                || getShmRingSlot(&slot, conn->ring, req.slot) != SUCCESS) {
+                resp.status = SERVE_STATUS_BAD_REQUEST;
+                CHK_ERR(writeFull(conn->fd, &resp, sizeof(resp)));
+                return SUCCESS;
+            }
+            resp.output_offset = offset;
+            if (runServeInference(w, (const float *)slot, req.n_samples, (float *)((char *)slot + offset)) != SUCCESS) {
+                resp.status = SERVE_STATUS_INTERNAL_ERROR;
+            }
+            CHK_ERR(writeFull(conn->fd, &resp, sizeof(resp)));
+            return SUCCESS;
+        }
+
+        default:
+        ERR_MSG("Unknow serve op: %u, error.\n", req.op);
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+static void *runServeWorker(void *arg)
+{
+    struct ServeWorker *w = arg;
+    struct ServeServer *srv = w->srv;
+
+    while (1) {
+        pthread_mutex_lock(&srv->mtx);
+        while (srv->q_head == NULL && !srv->stop) {
+            pthread_cond_wait(&srv->cond, &srv->mtx);
+        }
+        if (srv->stop) {
+            pthread_mutex_unlock(&srv->mtx);
+            break;
+        }
+        struct ServeConn *conn = srv->q_head;
+        srv->q_head = conn->q_next;
+        if (srv->q_head == NULL) {
+            srv->q_tail = NULL;
+        }
+        conn->q_next = NULL;
+        pthread_mutex_unlock(&srv->mtx);
+
+        if (handleServeRequest(w, conn) != SUCCESS || armServeConn(srv, conn, EPOLL_CTL_MOD) != SUCCESS) {
+            closeServeConn(srv, conn);
+        }
+    }
+    return NULL;
+}
+
+static void pushServeConn(struct ServeServer *srv, struct ServeConn *conn)
+{
+    pthread_mutex_lock(&srv->mtx);
+    if (srv->q_tail) {
+        srv->q_tail->q_next = conn;
+    }
+    else {
+        srv->q_head = conn;
+    }
+    srv->q_tail = conn;
+    pthread_cond_signal(&srv->cond);
+    pthread_mutex_unlock(&srv->mtx);
+}
+
+static int acceptServeConns(struct ServeServer *srv)
+{
+    while (1) {
+        int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return SUCCESS;
+            }
+            ERR_MSG("accept4() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        struct ServeConn *conn = calloc(1, sizeof(struct ServeConn));
+        if (conn == NULL) {
+            ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+            close(fd);
+            return ERR_COD;
+        }
+        conn->fd = fd;
+        struct timeval tv = {.tv_sec = SERVE_IO_TIMEOUT_SEC, .tv_usec = 0};
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1
+            || setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) == -1) {
+            ERR_MSG("setsockopt() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            close(fd);
+            free(conn);
+            continue;
+        }
+        pthread_mutex_lock(&srv->mtx);
+        conn->next = srv->conns;
+        if (srv->conns) {
+            srv->conns->prev = conn;
+        }
+        srv->conns = conn;
+        pthread_mutex_unlock(&srv->mtx);
+        if (armServeConn(srv, conn, EPOLL_CTL_ADD) != SUCCESS) {
+            closeServeConn(srv, conn);
+        }
+    }
+    return SUCCESS;
+}
+
+static int runServeLoop(struct ServeServer *srv)
+{
+    struct epoll_event events[SERVE_MAX_EVENTS];
+    while (1) {
+        int n = epoll_wait(srv->epoll_fd, events, SERVE_MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR_MSG("epoll_wait() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            return ERR_COD;
+        }
+        int i;
+        for (i = 0; i < n; ++i) {
+            if (events[i].data.ptr == &(srv->listen_fd)) {
+                CHK_ERR(acceptServeConns(srv));
+            }
+            else if (events[i].data.ptr == &(srv->signal_fd)) {
+                fprintf(stdout, "nn_serve: signal received, shutting down.\n");
+                return SUCCESS;
+            }
+            else {
+                pushServeConn(srv, events[i].data.ptr);
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+static int addServeEpollFd(struct ServeServer *srv, int *fd)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = fd;
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, *fd, &ev) == -1) {
+        ERR_MSG("epoll_ctl() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+static int openServeSocket(struct ServeServer *srv, const char *sock_pth)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    CHK_ERR((strlen(sock_pth) < sizeof(addr.sun_path))? 0: 1);
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock_pth);
+
+    srv->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (srv->listen_fd == -1) {
+        ERR_MSG("socket() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    unlink(sock_pth); // 清理上次异常退出遗留的socket文件
+    if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        ERR_MSG("bind() failed, path: %s, detail: %s, error.\n", sock_pth, ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    if (listen(srv->listen_fd, 128) == -1) {
+        ERR_MSG("listen() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    return SUCCESS;
+}
+
+static int createServeWorker(struct ServeWorker *w, struct ServeServer *srv, const char *model_pth)
+{
+    struct Layer **layers = NULL;
+    struct Cost *cost = NULL;
+    int n_layers = 0;
+    int n_in = 0;
+    int n_out = 0;
+
+    w->srv = srv;
+    CHK_ERR(loadModel(&(w->model), model_pth));
+    CHK_ERR(getModelLayers(&layers, &n_layers, w->model));
+    CHK_ERR(getModelCost(&cost, w->model));
+    CHK_ERR(getModelShape(&n_in, &n_out, w->model));
+    CHK_ERR(createNetwork(&(w->net), layers, n_layers, cost));
+    if (srv->n_in == 0) {
+        srv->n_in = n_in;
+        srv->n_classes = n_out;
+    }
+    CHK_ERR((srv->n_in == n_in && srv->n_classes == n_out)? 0: 1);
+
+    memset(&(w->args), 0, sizeof(struct UpdateArgs));
+    w->args.batch_size = srv->max_batch;
+    w->args.lr = 1.; // 推理不更新参数, 仅为通过checkUpdateArgs
+    memset(&(w->probe), 0, sizeof(struct Probe));
+
+    size_t n_floats = (size_t)srv->max_batch * (n_in > n_out? n_in: n_out);
+    w->input = calloc(n_floats, sizeof(float));
+    CHK_NIL(w->input);
+    return SUCCESS;
+}
+
+static void destroyServeWorker(struct ServeWorker *w)
+{
+    destroyNetwork(w->net);
+    destroyModel(w->model);
+    free(w->input);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s -m model.txt -s socket_path [-t n_workers] [-b max_batch]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    const char *model_pth = NULL;
+    const char *sock_pth = NULL;
+    int n_workers = 4;
+    int max_batch = 256;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s:t:b:h")) != -1) {
+        switch (opt) {
+            case 'm': model_pth = optarg; break;
+            case 's': sock_pth = optarg; break;
+            case 't': n_workers = atoi(optarg); break;
+            case 'b': max_batch = atoi(optarg); break;
+            default: usage(argv[0]); return ERR_COD;
+        }
+    }
+    if (model_pth == NULL || sock_pth == NULL || n_workers <= 0 || max_batch <= 0) {
+        usage(argv[0]);
+        return ERR_COD;
+    }
+
+    struct ServeServer srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.listen_fd = -1;
+    srv.epoll_fd = -1;
+    srv.signal_fd = -1;
+    srv.max_batch = max_batch;
+    pthread_mutex_init(&srv.mtx, NULL);
+    pthread_cond_init(&srv.cond, NULL);
+
+    // 信号在所有线程中屏蔽, 统一由epoll通过signalfd处理
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    CHK_ERR(pthread_sigmask(SIG_BLOCK, &mask, NULL));
+    signal(SIGPIPE, SIG_IGN);
+
+    int ret = ERR_COD;
+    int i;
+    int n_started = 0;
+    CHK_NIL_GOTO((srv.workers = calloc(n_workers, sizeof(struct ServeWorker))));
+    srv.n_workers = n_workers;
+    for (i = 0; i < n_workers; ++i) { // 模型在主线程中依次加载, spec中的seed保证随机初始化的各副本权重一致
+        srv.workers[i].idx = i;
+        CHK_ERR_GOTO(createServeWorker(&(srv.workers[i]), &srv, model_pth));
+    }
+
+    CHK_ERR_GOTO(openServeSocket(&srv, sock_pth));
+    if ((srv.epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        ERR_MSG("epoll_create1() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    if ((srv.signal_fd = signalfd(-1, &mask, SFD_CLOEXEC)) == -1) {
+        ERR_MSG("signalfd() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    CHK_ERR_GOTO(addServeEpollFd(&srv, &srv.listen_fd));
+    CHK_ERR_GOTO(addServeEpollFd(&srv, &srv.signal_fd));
+
+    for (i = 0; i < n_workers; ++i) {
+        CHK_ERR_GOTO(pthread_create(&(srv.workers[i].tid), NULL, runServeWorker, &(srv.workers[i])));
+        ++n_started;
+    }
+    fprintf(stdout, "nn_serve: listening on %s, n_in = %d, n_classes = %d, workers = %d, max_batch = %d\n",
+        sock_pth, srv.n_in, srv.n_classes, n_workers, max_batch);
+    fflush(stdout);
+
+    CHK_ERR_GOTO(runServeLoop(&srv));
+    ret = SUCCESS;
+
+err_end:
+    pthread_mutex_lock(&srv.mtx);
+    srv.stop = 1;
+    pthread_cond_broadcast(&srv.cond);
+    pthread_mutex_unlock(&srv.mtx);
+    long n_requests = 0;
+    long n_samples = 0;
+    for (i = 0; i < n_started; ++i) {
+        pthread_join(srv.workers[i].tid, NULL);
+    }
+    while (srv.conns) {
+        closeServeConn(&srv, srv.conns);
+    }
+    if (srv.workers) {
+        for (i = 0; i < n_workers; ++i) {
+            n_requests += srv.workers[i].n_requests;
+            n_samples += srv.workers[i].n_samples;
+            destroyServeWorker(&(srv.workers[i]));
+        }
+    }
+    fprintf(stdout, "nn_serve: served %ld requests, %ld samples.\n", n_requests, n_samples);
+    free(srv.workers);
+    if (srv.signal_fd != -1) {
+        close(srv.signal_fd);
+    }
+    if (srv.epoll_fd != -1) {
+        close(srv.epoll_fd);
+    }
+    if (srv.listen_fd != -1) {
+        close(srv.listen_fd);
+        unlink(sock_pth);
+    }
+    pthread_cond_destroy(&srv.cond);
+    pthread_mutex_destroy(&srv.mtx);
+    return ret;
+}
@@ -0,0 +1,59 @@
+/**
+ * @brief nn_serve与客户端之间的消息格式, 所有字段均为本机字节序(仅用于同一台主机上的进程间通信)
+ *
+ *        每条请求由定长头部ServeRequest开始:
+ *        (1) HELLO: 头部之后紧跟NN_SERVE_SHM_NAME_LEN字节的共享内存名, n_slots/slot_bytes描述环形缓冲区,
+ *            shm名为空串表示客户端只使用内联传输; 服务端回复的ServeResponse中携带模型的输入/输出维度;
+ *        (2) INFER: 头部之后紧跟n_samples * n_features个float, 回复头部之后紧跟n_samples * n_classes个float;
+ *        (3) INFER_SHM: 输入数据位于共享内存slot的起始位置, 结果写回同一slot中偏移output_offset处,
+ *            回复只有头部, socket上不传输任何payload.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define NN_SERVE_MAGIC (0x4e4e5356) // "NNSV"
+#define NN_SERVE_SHM_NAME_LEN (64)
+
+enum ServeOp
+{
+    SERVE_OP_HELLO = 1,
+    SERVE_OP_INFER = 2,
+    SERVE_OP_INFER_SHM = 3
+};
+
+enum ServeStatus
+{
+    SERVE_STATUS_OK = 0,
+    SERVE_STATUS_BAD_REQUEST = 1,
+    SERVE_STATUS_INTERNAL_ERROR = 2
+};
+
+struct ServeRequest
+{
+    uint32_t magic;
+    uint32_t op;
+    uint32_t n_samples;
+    uint32_t n_features;
+    uint32_t slot; // INFER_SHM only
+    uint32_t n_slots; // HELLO only
+    uint64_t slot_bytes; // HELLO only
+};
+
+struct ServeResponse
+{
+    uint32_t magic;
+    uint32_t status;
+    uint32_t n_samples;
+    uint32_t n_classes;
+    uint32_t slot;
+    uint32_t n_features; // HELLO only, 模型输入维度
+    uint64_t output_offset; // INFER_SHM时结果在slot内的字节偏移, HELLO时为服务端支持的最大batch
+};
+
+// slot内输出区起始偏移, 按cache line对齐
+static inline uint64_t getServeOutputOffset(uint32_t n_samples, uint32_t n_features)
+{
+    uint64_t bytes = (uint64_t)n_samples * n_features * sizeof(float);
+    return (bytes + 63) & ~((uint64_t)63);
+}
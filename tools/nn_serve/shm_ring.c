@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "debug_macros.h"
+#include "serve_proto.h"
+#include "shm_ring.h"
+
+struct ShmRing
+{
+    char name[NN_SERVE_SHM_NAME_LEN];
+    int n_slots;
+    size_t slot_bytes;
+    size_t map_bytes;
+    void *base;
+    int owner; // 创建者负责shm_unlink
+};
+
+static int mapShmRing(struct ShmRing **ring, const char *name, int n_slots, size_t slot_bytes, int owner)
+{
+    CHK_NIL(ring);
+    CHK_NIL(name);
+    CHK_ERR((n_slots > 0 && n_slots <= SHM_RING_MAX_SLOTS)? 0: 1);
+    CHK_ERR((slot_bytes > 0 && slot_bytes <= SHM_RING_MAX_SLOT_BYTES)? 0: 1);
+    CHK_ERR((strlen(name) < NN_SERVE_SHM_NAME_LEN)? 0: 1);
+    size_t aligned_bytes = (slot_bytes + 4095) & ~((size_t)4095); // 每个slot按页对齐
+    size_t map_bytes = 0;
+    if (__builtin_mul_overflow(aligned_bytes, (size_t)n_slots, &map_bytes)) {
+        ERR_MSG("shm ring size overflow, n_slots = %d, slot_bytes = %zu, error.\n", n_slots, slot_bytes);
+        return ERR_COD;
+    }
+
+    struct ShmRing *res = calloc(1, sizeof(struct ShmRing));
+    if (res == NULL) {
+        ERR_MSG("calloc failed, detail: %s\n", ERRNO_DETAIL(errno));
+        return ERR_COD;
+    }
+    snprintf(res->name, NN_SERVE_SHM_NAME_LEN, "%s", name);
+    res->n_slots = n_slots;
+    res->slot_bytes = aligned_bytes;
+    res->map_bytes = map_bytes;
+    res->owner = owner;
+
+    int flags = owner? (O_RDWR | O_CREAT | O_EXCL): O_RDWR;
+    int fd = shm_open(name, flags, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        ERR_MSG("shm_open() failed, name: %s, detail: %s, error.\n", name, ERRNO_DETAIL(errno));
+        free(res);
+        return ERR_COD;
+    }
+    if (owner) {
+        if (ftruncate(fd, res->map_bytes) == -1) {
+            ERR_MSG("ftruncate() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            goto err_end;
+        }
+    }
+    else {
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            ERR_MSG("fstat() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+            goto err_end;
+        }
+        if (st.st_size < 0 || (uint64_t)st.st_size < (uint64_t)res->map_bytes) { // 客户端声明的尺寸与实际不符
+            ERR_MSG("shm %s size %ld < expected %zu, error.\n", name, (long)st.st_size, res->map_bytes);
+            goto err_end;
+        }
+    }
+    res->base = mmap(NULL, res->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (res->base == MAP_FAILED) {
+        ERR_MSG("mmap() failed, detail: %s, error.\n", ERRNO_DETAIL(errno));
+        goto err_end;
+    }
+    close(fd);
+
+    *ring = res;
+    return SUCCESS;
+
+err_end:
+    close(fd);
+    if (owner) {
+        shm_unlink(name);
+    }
+    free(res);
+    return ERR_COD;
+}
+
+int createShmRing(struct ShmRing **ring, const char *name, int n_slots, size_t slot_bytes)
+{
+    CHK_ERR(mapShmRing(ring, name, n_slots, slot_bytes, 1));
+    return SUCCESS;
+}
+
+int attachShmRing(struct ShmRing **ring, const char *name, int n_slots, size_t slot_bytes)
+{
+    CHK_ERR(mapShmRing(ring, name, n_slots, slot_bytes, 0));
+    return SUCCESS;
+}
+
+void destroyShmRing(struct ShmRing *ring)
+{
+    if (ring) {
+        if (ring->base && ring->base != MAP_FAILED) {
+            munmap(ring->base, ring->map_bytes);
+        }
+        if (ring->owner) {
+            shm_unlink(ring->name);
+        }
+    }
+    free(ring);
+}
+
+int getShmRingSlot(void **slot, const struct ShmRing *ring, int idx)
+{
+    CHK_NIL(slot);
+    CHK_NIL(ring);
+    CHK_ERR((idx >= 0 && idx < ring->n_slots)? 0: 1);
+
+    *slot = (char *)(ring->base) + ring->slot_bytes * idx;
+    return SUCCESS;
+}
+
+int getShmRingShape(int *n_slots, size_t *slot_bytes, const struct ShmRing *ring)
+{
+    CHK_NIL(n_slots);
+    CHK_NIL(slot_bytes);
+    CHK_NIL(ring);
+
+    *n_slots = ring->n_slots;
+    *slot_bytes = ring->slot_bytes;
+    return SUCCESS;
+}
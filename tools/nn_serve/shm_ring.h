@@ -0,0 +1,20 @@
+/**
+ * @brief 客户端创建、服务端映射的POSIX共享内存环形缓冲区, 由n_slots个定长slot组成,
+ *        大batch的输入和输出都放在slot中, socket上只传递slot序号, 避免数据在内核中拷贝
+ */
+#pragma once
+
+#include <stddef.h>
+
+// 服务端映射客户端声明的缓冲区, 尺寸必须有上限
+#define SHM_RING_MAX_SLOTS (1024)
+#define SHM_RING_MAX_SLOT_BYTES ((size_t)1 << 30)
+
+struct ShmRing;
+
+int createShmRing(struct ShmRing **ring, const char *name, int n_slots, size_t slot_bytes);
+int attachShmRing(struct ShmRing **ring, const char *name, int n_slots, size_t slot_bytes);
+void destroyShmRing(struct ShmRing *ring);
+
+int getShmRingSlot(void **slot, const struct ShmRing *ring, int idx);
+int getShmRingShape(int *n_slots, size_t *slot_bytes, const struct ShmRing *ring);